@@ -0,0 +1,1118 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <numeric>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <kvs/Affinity.hpp>
+#include <kvs/Value.hpp>
+#include <kvs/Log.hpp>
+#include <kvs/Store.hpp>
+#include <kvs/Command.hpp>
+#include <kvs/CommandTable.hpp>
+#include <kvs/Connection.hpp>
+#include <kvs/ConnectionPool.hpp>
+#include <kvs/Reactor.hpp>
+#include <kvs/ListenHandler.hpp>
+#include <kvs/Shm.hpp>
+#include <kvs/ShmListener.hpp>
+#include <kvs/Error.hpp>
+#include <kvs/Fd.hpp>
+#include <kvs/UnixSocket.hpp>
+
+#include <boost/program_options.hpp>
+
+using namespace kvs;
+
+namespace po = boost::program_options;
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+struct Options
+{
+  std::size_t iterations;
+  std::size_t listSize;
+  uint16_t port;
+  std::vector<std::size_t> depths;
+  bool large;
+  std::vector<std::size_t> connections;
+  bool edge;
+  std::string backend;
+  std::string unixPath;
+  std::string shmPath;
+  std::size_t spin;
+  unsigned busyPoll;
+  int cpu;
+  int clientCpu;
+  std::vector<std::size_t> threads;
+};
+
+/** Serialized command, as received by the CommandHandler */
+template <typename Command>
+std::vector<char> serialize(const Command& command)
+{
+  iovec serialized[Command::serializedVectorSize];
+  command::Size size;
+  command.serialize(serialized, size);
+
+  std::vector<char> result;
+  for (auto&& vec : serialized)
+  {
+    const char* begin = static_cast<const char*>(vec.iov_base);
+    result.insert(result.end(), begin, begin + vec.iov_len);
+  }
+  return result;
+}
+
+/** Deserializes the command from `buffer`, like the CommandHandler */
+template <typename Command>
+Command deserialize(const std::vector<char>& buffer)
+{
+  return Command(
+    command::deserialize{},
+    buffer.data() + sizeof(command::Size),
+    buffer.size() - sizeof(command::Size)
+  );
+}
+
+/** Keeps the results of the measured commands alive */
+volatile std::size_t g_sink;
+
+template <typename Command>
+void respond(const Command& response)
+{
+  iovec serialized[Command::serializedVectorSize];
+  command::Size size;
+  response.serialize(serialized, size);
+  g_sink = g_sink + size;
+}
+
+void report(const char* name, Clock::duration elapsed, std::size_t count)
+{
+  const double ns = std::chrono::duration<double, std::nano>(elapsed).count();
+  std::printf("%-12s %12.1f ns/op\n", name, ns / count);
+}
+
+template <typename Command>
+void benchQuery(const char* name, Store& store, const Key& key, const Options& options)
+{
+  const std::vector<char> request = serialize(Command(key));
+
+  const auto start = Clock::now();
+  for (std::size_t i = 0; i < options.iterations; ++i)
+  {
+    command::ResultBuffer buffer;
+    respond(deserialize<Command>(request).execute(store, buffer));
+  }
+  report(name, Clock::now() - start, options.iterations);
+}
+
+/**
+ * Per command CPU cost of the list commands, executed in process,
+ * without the network: deserialize, execute, serialize the response.
+ */
+void commandMode(const Options& options)
+{
+  Store store(nullptr);
+
+  std::vector<int> list(options.listSize);
+  for (std::size_t i = 0; i < list.size(); ++i) { list[i] = int(i * 7 % 1000); }
+
+  std::vector<char> value(value::serializedSize(list));
+  value::serialize(list, value.data());
+  deserialize<SetCommand>(serialize(SetCommand("list", value.size(), value.data()))).execute(store);
+
+  std::printf("list size: %zu, iterations: %zu\n", options.listSize, options.iterations);
+
+  // GET
+  {
+    const std::vector<char> request = serialize(GetCommand("list"));
+
+    const auto start = Clock::now();
+    for (std::size_t i = 0; i < options.iterations; ++i)
+    {
+      respond(deserialize<GetCommand>(request).execute(store));
+    }
+    report("GET", Clock::now() - start, options.iterations);
+  }
+
+  benchQuery<SumCommand>("SUM", store, "list", options);
+  benchQuery<MinCommand>("MIN", store, "list", options);
+  benchQuery<MaxCommand>("MAX", store, "list", options);
+
+  // PUSH and POP, in batches to keep the list size around `listSize`
+  {
+    const int item = 42;
+    std::vector<char> itemValue(value::serializedSize(item));
+    value::serialize(item, itemValue.data());
+
+    const std::vector<char> push = serialize(PushCommand("list", itemValue.size(), itemValue.data()));
+    const std::vector<char> pop = serialize(PopCommand("list"));
+
+    constexpr std::size_t batchSize = 64;
+    Clock::duration pushTime{};
+    Clock::duration popTime{};
+
+    for (std::size_t i = 0; i < options.iterations; i += batchSize)
+    {
+      auto start = Clock::now();
+      for (std::size_t j = 0; j < batchSize; ++j) { deserialize<PushCommand>(push).execute(store); }
+      pushTime += Clock::now() - start;
+
+      start = Clock::now();
+      for (std::size_t j = 0; j < batchSize; ++j) { deserialize<PopCommand>(pop).execute(store); }
+      popTime += Clock::now() - start;
+    }
+
+    const std::size_t count = (options.iterations + batchSize - 1) / batchSize * batchSize;
+    report("PUSH", pushTime, count);
+    report("POP", popTime, count);
+  }
+}
+
+/** Deserializes the dispatched commands, without executing them */
+struct Deserializer
+{
+  template <typename Command>
+  void visit(const std::vector<char>& request)
+  {
+    const Command command = deserialize<Command>(request);
+    g_sink = g_sink + sizeof(command);
+  }
+};
+
+typedef command::Table<void(const std::vector<char>&), Deserializer, command::Builtins> Dispatch;
+
+void dispatch(Deserializer& deserializer, const std::vector<char>& request)
+{
+  command::Tag tag;
+  std::memcpy(&tag, request.data() + sizeof(command::Size), sizeof(tag));
+  Dispatch::find(tag)(deserializer, request);
+}
+
+template <typename Command>
+void benchDispatch(const char* name, const Command& sample, const Options& options, std::vector<std::vector<char>>& requests)
+{
+  const std::vector<char> request = serialize(sample);
+  requests.push_back(request);
+
+  Deserializer deserializer;
+
+  auto start = Clock::now();
+  for (std::size_t i = 0; i < options.iterations; ++i) { deserializer.visit<Command>(request); }
+  const Clock::duration direct = Clock::now() - start;
+
+  start = Clock::now();
+  for (std::size_t i = 0; i < options.iterations; ++i) { dispatch(deserializer, request); }
+  const Clock::duration dispatched = Clock::now() - start;
+
+  const double n = double(options.iterations);
+  std::printf(
+    "%-12s %12.1f ns/op %12.1f ns/op\n", name,
+    std::chrono::duration<double, std::nano>(direct).count() / n,
+    std::chrono::duration<double, std::nano>(dispatched).count() / n
+  );
+}
+
+/**
+ * Cost of dispatching by the tag of the request, as the CommandHandler:
+ * deserializing the command of a known type, and through the command::Table, per command.
+ * The mixed requests alternate between the commands, as a connection of various requests.
+ */
+void dispatchMode(const Options& options)
+{
+  const int item = 42;
+  std::vector<char> value(value::serializedSize(item));
+  value::serialize(item, value.data());
+
+  std::vector<std::vector<char>> requests;
+
+  std::printf("%-12s %18s %18s\n", "command", "deserialize", "dispatch");
+
+  benchDispatch("GET", GetCommand("key"), options, requests);
+  benchDispatch("SET", SetCommand("key", value.size(), value.data()), options, requests);
+  benchDispatch("PUSH", PushCommand("key", value.size(), value.data()), options, requests);
+  benchDispatch("POP", PopCommand("key"), options, requests);
+  benchDispatch("SUM", SumCommand("key"), options, requests);
+  benchDispatch("ARITHMETIC", ArithmeticCommand(command::Arithmetic::ADD, "dst", "lhs", "rhs"), options, requests);
+  benchDispatch("SCALE", ScaleCommand("dst", "src", value.size(), value.data()), options, requests);
+  benchDispatch("DOT", DotCommand("lhs", "rhs"), options, requests);
+  benchDispatch("NORM", NormCommand("key"), options, requests);
+  benchDispatch("HELLO", HelloCommand(2), options, requests);
+
+  Deserializer deserializer;
+
+  const auto start = Clock::now();
+  for (std::size_t i = 0; i < options.iterations; ++i)
+  {
+    dispatch(deserializer, requests[i % requests.size()]);
+  }
+  report("mixed", Clock::now() - start, options.iterations);
+}
+
+/** @returns the reads and writes of the thread `tid` so far, as accounted in /proc/self/task/<tid>/io */
+std::size_t ioSyscalls(pid_t tid)
+{
+  char path[64];
+  std::snprintf(path, sizeof(path), "/proc/self/task/%d/io", int(tid));
+  std::FILE* io = std::fopen(path, "r");
+  if (! io) { failure("fopen"); }
+
+  std::size_t result = 0;
+  char line[256];
+  while (std::fgets(line, sizeof(line), io))
+  {
+    if (std::strncmp(line, "syscr:", 6) == 0 || std::strncmp(line, "syscw:", 6) == 0)
+    {
+      result += std::strtoul(line + 6, nullptr, 10);
+    }
+  }
+
+  std::fclose(io);
+  return result;
+}
+
+/** Runs a server on a background thread, for the network benchmarks */
+class Server
+{
+public:
+  Server(const Options& options)
+    :_reactor(
+       options.edge ? Reactor::Trigger::edge : Reactor::Trigger::level,
+       options.backend == "uring" ? Reactor::Backend::uring : Reactor::Backend::epoll
+     ),
+     _store(nullptr),
+     _listener(_reactor, options.port, _store),
+     _unixListener(_reactor, options.unixPath, _store),
+     _shmListener(_reactor, options.shmPath, _store),
+     _busyPoll(options.busyPoll),
+     _cpu(options.cpu),
+     _threadId(0),
+     _waits(0),
+     _thread([this]()
+     {
+       if (_cpu >= 0 && ! pinThread(unsigned(_cpu))) { failure("pinThread"); }
+       _reactor.setBusyPoll(_busyPoll);
+       _threadId.store(pid_t(syscall(SYS_gettid)));
+       while (! _reactor.isStopped())
+       {
+         _reactor.dispatch();
+         _waits.fetch_add(1, std::memory_order_relaxed);
+       }
+     })
+  {}
+
+  ~Server()
+  {
+    _reactor.stop();
+    _thread.join();
+  }
+
+  Store& store() { return _store; }
+
+  /**
+   * @returns the syscalls of the server thread so far:
+   * reads and writes (as accounted in /proc/self/task/<tid>/io) and waits
+   * (epoll_wait or io_uring_enter). Accepts and epoll_ctl calls are not counted.
+   */
+  std::size_t syscalls() const
+  {
+    while (_threadId.load() == 0) { std::this_thread::yield(); }
+
+    return ioSyscalls(_threadId.load()) + _waits.load(std::memory_order_relaxed);
+  }
+
+private:
+  Reactor _reactor;
+  Store _store;
+  ListenHandler _listener;
+  ListenHandler _unixListener;
+  ShmListener _shmListener;
+  const std::chrono::microseconds _busyPoll;
+  const int _cpu;
+  std::atomic<pid_t> _threadId;
+  std::atomic<std::size_t> _waits; // dispatch rounds, one wait each
+  std::thread _thread;
+};
+
+Fd connectTo(uint16_t port)
+{
+  Fd socket(::socket(PF_INET, SOCK_STREAM, IPPROTO_TCP));
+  if (! socket) { failure("socket"); }
+
+  sockaddr_in address;
+  std::memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_port = htons(port);
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+  if (connect(*socket, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0)
+  {
+    failure("connect");
+  }
+
+  return socket;
+}
+
+Fd connectUnix(const std::string& path)
+{
+  Fd socket(::socket(PF_UNIX, SOCK_STREAM, 0));
+  if (! socket) { failure("socket"); }
+
+  sockaddr_un address;
+  const socklen_t addressSize = unixAddress(path, address);
+
+  if (connect(*socket, reinterpret_cast<sockaddr*>(&address), addressSize) < 0)
+  {
+    failure("connect");
+  }
+
+  return socket;
+}
+
+void sendAll(int socket, const char* data, std::size_t size)
+{
+  while (size)
+  {
+    const ssize_t wsize = ::write(socket, data, size);
+    if (wsize < 0) { failure("write"); }
+    data += wsize;
+    size -= wsize;
+  }
+}
+
+/** Receives `count` responses, @returns the number of recv calls */
+std::size_t recvResponses(int socket, std::size_t count, std::vector<char>& buffer)
+{
+  std::size_t received = 0;
+  std::size_t recvCalls = 0;
+
+  while (count)
+  {
+    const ssize_t rsize = recv(socket, buffer.data() + received, buffer.size() - received, 0);
+    if (rsize <= 0) { failure("recv"); }
+    ++recvCalls;
+    received += rsize;
+
+    // consume the complete responses
+    std::size_t offset = 0;
+    command::Size size;
+    while (
+       count
+    && received - offset >= sizeof(size)
+    && (std::memcpy(&size, buffer.data() + offset, sizeof(size)), received - offset >= size)
+    )
+    {
+      offset += size;
+      --count;
+    }
+
+    std::memmove(buffer.data(), buffer.data() + offset, received - offset);
+    received -= offset;
+
+    if (received == buffer.size()) { buffer.resize(buffer.size() * 2); }
+  }
+
+  return recvCalls;
+}
+
+/**
+ * GET throughput of a single connection, at different pipeline depths:
+ * `depth` requests are sent at once, then every response is awaited.
+ * The value is a scalar, or a list of `listSize` elements if `large`.
+ */
+void pipelineMode(const Options& options)
+{
+  Server server(options);
+
+  std::vector<char> itemValue;
+  if (options.large)
+  {
+    const std::vector<int> list(options.listSize, 42);
+    itemValue.resize(value::serializedSize(list));
+    value::serialize(list, itemValue.data());
+  }
+  else
+  {
+    const int item = 42;
+    itemValue.resize(value::serializedSize(item));
+    value::serialize(item, itemValue.data());
+  }
+
+  deserialize<SetCommand>(serialize(SetCommand("key", itemValue.size(), itemValue.data())))
+    .execute(server.store());
+
+  Fd socket = connectTo(options.port);
+
+  const std::vector<char> request = serialize(GetCommand("key"));
+  std::vector<char> responses(1 << 20);
+
+  std::printf("requests: %zu, value size: %zu\n", options.iterations, itemValue.size());
+
+  for (std::size_t depth : options.depths)
+  {
+    if (depth == 0) { continue; }
+
+    std::vector<char> batch;
+    for (std::size_t i = 0; i < depth; ++i)
+    {
+      batch.insert(batch.end(), request.begin(), request.end());
+    }
+
+    const std::size_t rounds = (options.iterations + depth - 1) / depth;
+    std::size_t recvCalls = 0;
+
+    const std::size_t syscallsBefore = server.syscalls();
+    const auto start = Clock::now();
+    for (std::size_t i = 0; i < rounds; ++i)
+    {
+      sendAll(*socket, batch.data(), batch.size());
+      recvCalls += recvResponses(*socket, depth, responses);
+    }
+    const auto elapsed = Clock::now() - start;
+    const std::size_t syscalls = server.syscalls() - syscallsBefore;
+
+    const double seconds = std::chrono::duration<double>(elapsed).count();
+    std::printf(
+      "depth %-6zu %12.0f GET/s %10.1f ns/op %8.2f recv/round %8.3f server syscalls/op\n",
+      depth,
+      rounds * depth / seconds,
+      seconds * 1e9 / (rounds * depth),
+      double(recvCalls) / rounds,
+      double(syscalls) / (rounds * depth)
+    );
+  }
+}
+
+/**
+ * SET throughput of a single connection, with `listSize` element values:
+ * `depth` SETs and a GET are sent at once, then the GET response is awaited.
+ */
+void ingestMode(const Options& options)
+{
+  Server server(options);
+
+  std::vector<int> list(options.listSize);
+  std::iota(list.begin(), list.end(), 0);
+  std::vector<char> value(value::serializedSize(list));
+  value::serialize(list, value.data());
+
+  Fd socket = connectTo(options.port);
+
+  const std::vector<char> set = serialize(SetCommand("key", value.size(), value.data()));
+  const std::vector<char> get = serialize(GetCommand("sync"));
+  std::vector<char> responses(1 << 20);
+
+  std::printf("SETs: %zu, command size: %zu\n", options.iterations, set.size());
+
+  for (std::size_t depth : options.depths)
+  {
+    if (depth == 0) { continue; }
+
+    std::vector<char> batch;
+    for (std::size_t i = 0; i < depth; ++i)
+    {
+      batch.insert(batch.end(), set.begin(), set.end());
+    }
+    batch.insert(batch.end(), get.begin(), get.end());
+
+    const std::size_t rounds = (options.iterations + depth - 1) / depth;
+
+    const std::size_t syscallsBefore = server.syscalls();
+    const auto start = Clock::now();
+    for (std::size_t i = 0; i < rounds; ++i)
+    {
+      sendAll(*socket, batch.data(), batch.size());
+      recvResponses(*socket, 1, responses);
+    }
+    const auto elapsed = Clock::now() - start;
+    const std::size_t syscalls = server.syscalls() - syscallsBefore;
+
+    const double seconds = std::chrono::duration<double>(elapsed).count();
+    std::printf(
+      "depth %-6zu %12.0f SET/s %10.1f ns/op %8.1f MB/s %8.3f server syscalls/op\n",
+      depth,
+      rounds * depth / seconds,
+      seconds * 1e9 / (rounds * depth),
+      rounds * batch.size() / seconds / 1e6,
+      double(syscalls) / (rounds * depth)
+    );
+  }
+}
+
+/**
+ * GET throughput of a pipelining Connection, from a single client thread:
+ * `depth` asynchronous GETs are queued, flushed by a single write, then awaited by `sync()`.
+ * Over loopback TCP, the unix socket and the shared memory of the server,
+ * responses passed to callbacks, or to futures. Client syscalls are reads and writes.
+ */
+void clientMode(const Options& options)
+{
+  Server server(options);
+
+  const int item = 42;
+  std::vector<char> itemValue(value::serializedSize(item));
+  value::serialize(item, itemValue.data());
+  deserialize<SetCommand>(serialize(SetCommand("key", itemValue.size(), itemValue.data())))
+    .execute(server.store());
+
+  std::printf("requests: %zu\n", options.iterations);
+
+  const pid_t clientThread = pid_t(syscall(SYS_gettid));
+
+  Connection tcp("127.0.0.1", options.port, protocol::Version::v2);
+  Connection local(options.unixPath, protocol::Version::v2);
+  Connection shm{Connection::Shm(options.shmPath, options.spin), protocol::Version::v2};
+
+  const std::pair<const char*, Connection*> connections[] = {
+    {"tcp", &tcp},
+    {"unix", &local},
+    {"shm", &shm},
+  };
+
+  for (auto&& connection : connections)
+  {
+    for (std::size_t depth : options.depths)
+    {
+      if (depth == 0) { continue; }
+
+      const std::size_t rounds = (options.iterations + depth - 1) / depth;
+      std::size_t found = 0;
+
+      const std::size_t syscallsBefore = ioSyscalls(clientThread);
+      const auto startCallbacks = Clock::now();
+      for (std::size_t i = 0; i < rounds; ++i)
+      {
+        for (std::size_t j = 0; j < depth; ++j)
+        {
+          connection.second->getAsync<int>("key", [&found](boost::optional<int> result) { found += bool(result); });
+        }
+        connection.second->sync();
+      }
+      const double callbackSeconds = std::chrono::duration<double>(Clock::now() - startCallbacks).count();
+
+      std::vector<Connection::Future<int>> futures;
+      futures.reserve(depth);
+
+      const auto startFutures = Clock::now();
+      for (std::size_t i = 0; i < rounds; ++i)
+      {
+        futures.clear();
+        for (std::size_t j = 0; j < depth; ++j) { futures.push_back(connection.second->getAsync<int>("key")); }
+        for (auto&& future : futures) { found += bool(future.get()); }
+      }
+      const double futureSeconds = std::chrono::duration<double>(Clock::now() - startFutures).count();
+      const std::size_t syscalls = ioSyscalls(clientThread) - syscallsBefore;
+
+      if (found != 2 * rounds * depth) { failure("clientMode: GET not found"); }
+
+      std::printf(
+        "%-5s depth %-6zu %12.0f GET/s (callbacks) %12.0f GET/s (futures) %8.3f client syscalls/op\n",
+        connection.first, depth, rounds * depth / callbackSeconds, rounds * depth / futureSeconds,
+        double(syscalls) / (2 * rounds * depth)
+      );
+    }
+  }
+}
+
+/**
+ * GET throughput of client threads sharing a ConnectionPool over loopback TCP,
+ * each thread waits for its response before the next request.
+ * The pool has a single connection, multiplexing every thread, or one per thread.
+ */
+void poolMode(const Options& options)
+{
+  Server server(options);
+
+  const int item = 42;
+  std::vector<char> itemValue(value::serializedSize(item));
+  value::serialize(item, itemValue.data());
+  deserialize<SetCommand>(serialize(SetCommand("key", itemValue.size(), itemValue.data())))
+    .execute(server.store());
+
+  std::printf("requests: %zu\n", options.iterations);
+
+  auto connect = [&options]() {
+    return std::unique_ptr<Connection>(new Connection("127.0.0.1", options.port, protocol::Version::v2));
+  };
+
+  for (std::size_t threadCount : options.threads)
+  {
+    if (threadCount == 0) { continue; }
+
+    const std::size_t perThread = (options.iterations + threadCount - 1) / threadCount;
+
+    for (std::size_t poolSize : {std::size_t(1), threadCount})
+    {
+      ConnectionPool pool(connect, poolSize);
+      std::atomic<std::size_t> found(0);
+
+      const auto start = Clock::now();
+
+      std::vector<std::thread> clients;
+      for (std::size_t t = 0; t < threadCount; ++t)
+      {
+        clients.emplace_back([&pool, &found, perThread]() {
+          std::size_t local = 0;
+          int val = 0;
+          for (std::size_t i = 0; i < perThread; ++i) { local += pool.get("key", val); }
+          found += local;
+        });
+      }
+      for (std::thread& client : clients) { client.join(); }
+
+      const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+      if (found != perThread * threadCount) { failure("poolMode: GET not found"); }
+
+      std::printf(
+        "threads %-4zu connections %-4zu %12.0f GET/s\n",
+        threadCount, poolSize, perThread * threadCount / seconds
+      );
+
+      if (threadCount == 1) { break; }
+    }
+  }
+}
+
+/** @returns the `percent` percentile of the sorted `values` */
+double percentile(const std::vector<double>& values, double percent)
+{
+  if (values.empty()) { return 0; }
+  const std::size_t index = std::size_t(percent / 100 * (values.size() - 1));
+  return values[index];
+}
+
+/**
+ * Round trip latency of a single connection, a single GET in flight,
+ * over loopback TCP, the unix socket and the shared memory of the server.
+ * Shared memory clients sleep, or poll the response ring `spin` times first.
+ * Compare with a busy polling server (--busy-poll), pinned (--cpu, --client-cpu).
+ */
+void rttMode(const Options& options)
+{
+  Server server(options);
+
+  // after the server thread started, it is not pinned to the cpu of the client
+  if (options.clientCpu >= 0 && ! pinThread(unsigned(options.clientCpu))) { failure("pinThread"); }
+
+  const int item = 42;
+  std::vector<char> itemValue(value::serializedSize(item));
+  value::serialize(item, itemValue.data());
+  deserialize<SetCommand>(serialize(SetCommand("key", itemValue.size(), itemValue.data())))
+    .execute(server.store());
+
+  const std::vector<char> request = serialize(GetCommand("key"));
+  std::vector<char> responses(1 << 16);
+
+  std::printf(
+    "requests: %zu, unix socket: %s, shared memory: %s, spin: %zu, busy poll: %u us, cpu: %d, client cpu: %d\n",
+    options.iterations, options.unixPath.c_str(), options.shmPath.c_str(), options.spin,
+    options.busyPoll, options.cpu, options.clientCpu
+  );
+
+  auto measure = [&options](const char* name, const std::function<void()>& roundTrip)
+  {
+    std::vector<double> latencies;
+    latencies.reserve(options.iterations);
+
+    // warm up the caches and the scheduler
+    for (std::size_t i = 0; i < options.iterations / 10; ++i) { roundTrip(); }
+
+    const auto start = Clock::now();
+    for (std::size_t i = 0; i < options.iterations; ++i)
+    {
+      const auto sent = Clock::now();
+      roundTrip();
+      latencies.push_back(std::chrono::duration<double, std::micro>(Clock::now() - sent).count());
+    }
+    const auto elapsed = Clock::now() - start;
+
+    std::sort(latencies.begin(), latencies.end());
+
+    std::printf(
+      "%-9s mean %8.2f us p50 %8.2f us p99 %8.2f us\n",
+      name,
+      std::chrono::duration<double, std::micro>(elapsed).count() / options.iterations,
+      percentile(latencies, 50), percentile(latencies, 99)
+    );
+  };
+
+  const std::pair<const char*, Fd> sockets[] = {
+    {"tcp", connectTo(options.port)},
+    {"unix", connectUnix(options.unixPath)},
+  };
+
+  for (auto&& socket : sockets)
+  {
+    measure(socket.first, [&]() {
+      sendAll(*socket.second, request.data(), request.size());
+      recvResponses(*socket.second, 1, responses);
+    });
+  }
+
+  const std::pair<const char*, std::size_t> shmClients[] = {
+    {"shm", 0},
+    {"shm-spin", options.spin},
+  };
+
+  for (auto&& client : shmClients)
+  {
+    ShmChannel channel(options.shmPath, client.second);
+
+    measure(client.first, [&]() {
+      iovec vec{const_cast<char*>(request.data()), request.size()};
+      channel.write(&vec, 1);
+
+      command::Size size;
+      channel.read(reinterpret_cast<char*>(&size), sizeof(size));
+      channel.read(responses.data(), size - sizeof(size));
+    });
+  }
+}
+
+/**
+ * GET throughput of many active connections: in every round each client
+ * sends `depth` requests, then the responses of every client are awaited.
+ * Latency is measured from sending the requests of a client
+ * to receiving its last response, responses are received in order.
+ */
+void activeMode(const Options& options)
+{
+  rlimit limit;
+  if (getrlimit(RLIMIT_NOFILE, &limit) == 0)
+  {
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+  }
+
+  Server server(options);
+
+  const int item = 42;
+  std::vector<char> itemValue(value::serializedSize(item));
+  value::serialize(item, itemValue.data());
+  deserialize<SetCommand>(serialize(SetCommand("key", itemValue.size(), itemValue.data())))
+    .execute(server.store());
+
+  const std::vector<char> request = serialize(GetCommand("key"));
+  std::vector<char> responses(1 << 20);
+
+  for (std::size_t count : options.connections)
+  {
+    if (2 * count + 64 > limit.rlim_cur)
+    {
+      std::printf("%-8zu connections: skipped, open file limit is %zu\n", count, std::size_t(limit.rlim_cur));
+      continue;
+    }
+
+    std::vector<Fd> clients;
+    clients.reserve(count);
+    for (std::size_t i = 0; i < count; ++i) { clients.push_back(connectTo(options.port)); }
+
+    for (std::size_t depth : options.depths)
+    {
+      if (depth == 0) { continue; }
+
+      std::vector<char> batch;
+      for (std::size_t i = 0; i < depth; ++i)
+      {
+        batch.insert(batch.end(), request.begin(), request.end());
+      }
+
+      const std::size_t rounds = std::max<std::size_t>(options.iterations / (depth * count), 1);
+      std::vector<Clock::time_point> sendTimes(count);
+      std::vector<double> latencies;
+      latencies.reserve(rounds * count);
+
+      const std::size_t syscallsBefore = server.syscalls();
+      const auto start = Clock::now();
+      for (std::size_t i = 0; i < rounds; ++i)
+      {
+        for (std::size_t c = 0; c < count; ++c)
+        {
+          sendTimes[c] = Clock::now();
+          sendAll(*clients[c], batch.data(), batch.size());
+        }
+        for (std::size_t c = 0; c < count; ++c)
+        {
+          recvResponses(*clients[c], depth, responses);
+          latencies.push_back(std::chrono::duration<double, std::micro>(Clock::now() - sendTimes[c]).count());
+        }
+      }
+      const auto elapsed = Clock::now() - start;
+      const std::size_t syscalls = server.syscalls() - syscallsBefore;
+
+      std::sort(latencies.begin(), latencies.end());
+
+      const std::size_t requests = rounds * depth * count;
+      const double seconds = std::chrono::duration<double>(elapsed).count();
+      std::printf(
+        "%-8zu connections, depth %-6zu %12.0f GET/s %8.3f server syscalls/op"
+        " latency p50 %8.1f us p99 %8.1f us\n",
+        count, depth,
+        requests / seconds,
+        double(syscalls) / requests,
+        percentile(latencies, 50), percentile(latencies, 99)
+      );
+    }
+  }
+}
+
+/** @returns the `field` of /proc/self/status in bytes, e.g: VmRSS */
+std::size_t procStatus(const char* field)
+{
+  std::FILE* status = std::fopen("/proc/self/status", "r");
+  if (! status) { failure("fopen"); }
+
+  const std::size_t fieldLength = std::strlen(field);
+  std::size_t result = 0;
+  char line[256];
+  while (std::fgets(line, sizeof(line), status))
+  {
+    if (std::strncmp(line, field, fieldLength) == 0 && line[fieldLength] == ':')
+    {
+      result = std::strtoul(line + fieldLength + 1, nullptr, 10) * 1024; // kB
+      break;
+    }
+  }
+
+  std::fclose(status);
+  return result;
+}
+
+/**
+ * Memory of idle connections: each client sends a GET,
+ * receives the response, then stays connected.
+ * Server and clients share the process, client sockets hold no user memory.
+ */
+void connectionsMode(const Options& options)
+{
+  // two descriptors per connection
+  rlimit limit;
+  if (getrlimit(RLIMIT_NOFILE, &limit) == 0)
+  {
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+  }
+
+  Server server(options);
+
+  const int item = 42;
+  std::vector<char> itemValue(value::serializedSize(item));
+  value::serialize(item, itemValue.data());
+  deserialize<SetCommand>(serialize(SetCommand("key", itemValue.size(), itemValue.data())))
+    .execute(server.store());
+
+  const std::vector<char> request = serialize(GetCommand("key"));
+  std::vector<char> response(1024);
+
+  for (std::size_t count : options.connections)
+  {
+    if (2 * count + 64 > limit.rlim_cur)
+    {
+      std::printf("%-8zu connections: skipped, open file limit is %zu\n", count, std::size_t(limit.rlim_cur));
+      continue;
+    }
+
+    const std::size_t rssBefore = procStatus("VmRSS");
+    const std::size_t vmBefore = procStatus("VmSize");
+
+    std::vector<Fd> clients;
+    clients.reserve(count);
+    for (std::size_t i = 0; i < count; ++i)
+    {
+      clients.push_back(connectTo(options.port));
+      sendAll(*clients.back(), request.data(), request.size());
+      recvResponses(*clients.back(), 1, response);
+    }
+
+    const std::size_t rss = procStatus("VmRSS") - rssBefore;
+    const std::size_t vm = procStatus("VmSize") - vmBefore;
+
+    std::printf(
+      "%-8zu connections: RSS %8.1f MB %8.0f B/conn, virtual %9.1f MB %8.0f B/conn\n",
+      count,
+      rss / 1e6, double(rss) / count,
+      vm / 1e6, double(vm) / count
+    );
+  }
+}
+
+/**
+ * Accept rate under reconnect storms: while `count` idle connections
+ * are held open, bursts of clients connect, send a GET, receive the response
+ * and reset the connection, until `iterations` connections are served.
+ * The growth of the RSS shows whether the handlers of closed connections are freed.
+ */
+void reconnectMode(const Options& options)
+{
+  rlimit limit;
+  if (getrlimit(RLIMIT_NOFILE, &limit) == 0)
+  {
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+  }
+
+  Server server(options);
+
+  const int item = 42;
+  std::vector<char> itemValue(value::serializedSize(item));
+  value::serialize(item, itemValue.data());
+  deserialize<SetCommand>(serialize(SetCommand("key", itemValue.size(), itemValue.data())))
+    .execute(server.store());
+
+  const std::vector<char> request = serialize(GetCommand("key"));
+  std::vector<char> response(1024);
+
+  // reset instead of close: no TIME_WAIT, the ephemeral ports are reused
+  const linger reset{1, 0};
+  constexpr std::size_t burstSize = 64;
+
+  for (std::size_t count : options.connections)
+  {
+    if (2 * (count + burstSize) + 64 > limit.rlim_cur)
+    {
+      std::printf("%-8zu connections: skipped, open file limit is %zu\n", count, std::size_t(limit.rlim_cur));
+      continue;
+    }
+
+    std::vector<Fd> idle;
+    idle.reserve(count);
+    for (std::size_t i = 0; i < count; ++i) { idle.push_back(connectTo(options.port)); }
+
+    const std::size_t rssBefore = procStatus("VmRSS");
+    std::vector<double> latencies;
+    latencies.reserve(options.iterations);
+    std::vector<Fd> burst;
+    std::vector<Clock::time_point> connectTimes(burstSize);
+
+    const auto start = Clock::now();
+    for (std::size_t served = 0; served < options.iterations; served += burstSize)
+    {
+      for (std::size_t i = 0; i < burstSize; ++i)
+      {
+        connectTimes[i] = Clock::now();
+        burst.push_back(connectTo(options.port));
+        setsockopt(*burst.back(), SOL_SOCKET, SO_LINGER, &reset, sizeof(reset));
+        sendAll(*burst.back(), request.data(), request.size());
+      }
+      for (std::size_t i = 0; i < burstSize; ++i)
+      {
+        recvResponses(*burst[i], 1, response);
+        latencies.push_back(std::chrono::duration<double, std::micro>(Clock::now() - connectTimes[i]).count());
+      }
+      burst.clear();
+    }
+    const auto elapsed = Clock::now() - start;
+    const std::size_t rssAfter = procStatus("VmRSS");
+    const std::size_t rss = rssAfter > rssBefore ? rssAfter - rssBefore : 0;
+
+    std::sort(latencies.begin(), latencies.end());
+
+    std::printf(
+      "%-8zu idle connections %10.0f accepts/s latency p50 %8.1f us p99 %8.1f us RSS +%6.1f MB\n",
+      count,
+      latencies.size() / std::chrono::duration<double>(elapsed).count(),
+      percentile(latencies, 50), percentile(latencies, 99),
+      rss / 1e6
+    );
+  }
+}
+
+} // namespace
+
+int main(int argc, const char* argv[])
+{
+  const std::map<std::string, std::function<void(const Options&)>> modes{
+    {"command", commandMode},
+    {"dispatch", dispatchMode},
+    {"pipeline", pipelineMode},
+    {"rtt", rttMode},
+    {"ingest", ingestMode},
+    {"client", clientMode},
+    {"pool", poolMode},
+    {"connections", connectionsMode},
+    {"active", activeMode},
+    {"reconnect", reconnectMode},
+  };
+
+  Options options;
+  std::string mode;
+
+  po::options_description description("kvsBench options");
+  description.add_options()
+    ("help,h", "print this help")
+    ("mode,m", po::value(&mode)->default_value("command"), "benchmark to run: command, dispatch, pipeline, rtt, ingest, client, pool, connections, active, reconnect")
+    ("iterations,n", po::value(&options.iterations)->default_value(100000), "commands per measurement")
+    ("list-size,l", po::value(&options.listSize)->default_value(1000), "elements of the benchmarked list")
+    ("port,p", po::value(&options.port)->default_value(1400), "port of the benchmark server")
+    ("depth,d",
+      po::value(&options.depths)->multitoken()->default_value({1, 16, 256}, "1 16 256"),
+      "pipeline depths"
+    )
+    ("large", po::bool_switch(&options.large), "pipeline: GET a list of list-size elements")
+    ("connections,c",
+      po::value(&options.connections)->multitoken()->default_value({1000, 10000}, "1000 10000"),
+      "connection counts of the connections, active and reconnect modes"
+    )
+    ("edge", po::bool_switch(&options.edge), "edge triggered server reactor")
+    ("backend,b", po::value(&options.backend)->default_value("epoll"), "server reactor backend: epoll, uring")
+    ("unix,u", po::value(&options.unixPath)->default_value("@kvsBench"), "unix socket of the benchmark server, '@': abstract")
+    ("shm", po::value(&options.shmPath)->default_value("@kvsBenchShm"), "unix socket of the shared memory clients of the benchmark server")
+    ("spin", po::value(&options.spin)->default_value(10000), "rtt, client: response polls of shared memory clients, before sleeping")
+    ("busy-poll", po::value(&options.busyPoll)->default_value(0), "microseconds of polling without events before the server reactor blocks")
+    ("cpu", po::value(&options.cpu)->default_value(-1), "pin the server reactor to this cpu, -1: not pinned")
+    ("client-cpu", po::value(&options.clientCpu)->default_value(-1), "rtt: pin the client to this cpu, -1: not pinned")
+    ("threads,t",
+      po::value(&options.threads)->multitoken()->default_value({1, 2, 4, 8, 16, 32, 64}, "1 2 4 8 16 32 64"),
+      "pool: client thread counts"
+    )
+  ;
+
+  po::variables_map vm;
+  try
+  {
+    po::store(po::parse_command_line(argc, argv, description), vm);
+    po::notify(vm);
+  }
+  catch (const po::error& ex)
+  {
+    std::cerr << ex.what() << "\n" << description;
+    return 1;
+  }
+
+  if (vm.count("help"))
+  {
+    std::cout << description;
+    return 0;
+  }
+
+  auto modeIt = modes.find(mode);
+  if (modeIt == modes.end())
+  {
+    std::cerr << "Unknown mode: " << mode << "\n" << description;
+    return 1;
+  }
+
+  openLogfile("/tmp/kvs_bench.log");
+
+  modeIt->second(options);
+
+  return 0;
+}
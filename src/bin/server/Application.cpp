@@ -1,23 +1,96 @@
 #include <cstdio>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
 
+#include <kvs/Affinity.hpp>
+#include <kvs/Command.hpp>
 #include <kvs/Log.hpp>
 #include <kvs/Reactor.hpp>
 #include <kvs/ConsoleCommandHandler.hpp>
 #include <kvs/ListenHandler.hpp>
+#include <kvs/ShmListener.hpp>
 #include <kvs/Store.hpp>
+#include <kvs/WorkerPool.hpp>
+
+#include <boost/program_options.hpp>
 
 using namespace kvs;
 
+namespace po = boost::program_options;
+
 int main(int argc, const char* argv[])
 {
-  (void)argc;
-  (void)argv;
+  std::string backend;
+  unsigned idleTimeout = 0;
+  unsigned receiveTimeout = 0;
+  unsigned workerCount = 0;
+  std::vector<std::string> libraries;
+  std::string unixPath;
+  std::string shmPath;
+  uint32_t shmRing = 0;
+  unsigned busyPoll = 0;
+  int cpu = -1;
+
+  po::options_description description("kvsServer options");
+  description.add_options()
+    ("help,h", "print this help")
+    ("backend,b", po::value(&backend)->default_value("epoll"), "reactor backend: epoll, uring")
+    ("idle-timeout", po::value(&idleTimeout)->default_value(0), "close connections idle for seconds, 0: never")
+    ("receive-timeout", po::value(&receiveTimeout)->default_value(0), "close connections sending a command for seconds, 0: never")
+    ("workers", po::value(&workerCount)->default_value(0), "threads of slow commands of v2 clients, 0: run by the reactor")
+    ("busy-poll", po::value(&busyPoll)->default_value(0), "microseconds of polling without events before the reactor blocks, 0: never polls")
+    ("cpu", po::value(&cpu)->default_value(-1), "pin the reactor thread to this cpu, -1: not pinned")
+    ("library,l", po::value(&libraries), "load the procedures and commands of a library, before the store replays its commands")
+    ("unix,u", po::value(&unixPath), "also listen at this unix socket, in the abstract namespace if it starts with '@'")
+    ("shm", po::value(&shmPath), "also accept shared memory clients at this unix socket")
+    ("shm-ring", po::value(&shmRing)->default_value(shm::defaultCapacity), "bytes of the shared memory rings of a client, a power of two")
+  ;
+
+  po::variables_map vm;
+  try
+  {
+    po::store(po::parse_command_line(argc, argv, description), vm);
+    po::notify(vm);
+  }
+  catch (const po::error& ex)
+  {
+    std::cerr << ex.what() << "\n" << description;
+    return 1;
+  }
+
+  if (vm.count("help"))
+  {
+    std::cout << description;
+    return 0;
+  }
+
+  if (shmRing < 64 || shmRing > (uint32_t(1) << 30) || (shmRing & (shmRing - 1)))
+  {
+    std::cerr << "Invalid shm-ring: " << shmRing << "\n" << description;
+    return 1;
+  }
+
+  if (backend != "epoll" && backend != "uring")
+  {
+    std::cerr << "Unknown backend: " << backend << "\n" << description;
+    return 1;
+  }
 
   openLogfile("/tmp/kvs_server.log");
 
+  for (const std::string& library : libraries) { SourceCommand(library).execute(); }
+
   Store store("/var/tmp/kvs_store.db");
 
-  Reactor reactor;
+  // the console is level triggered, connections drain their sockets
+  Reactor reactor(
+    Reactor::Trigger::edge,
+    (backend == "uring") ? Reactor::Backend::uring : Reactor::Backend::epoll
+  );
+
+  reactor.setBusyPoll(std::chrono::microseconds(busyPoll));
 
   // Add console
   reactor.addHandler<ConsoleCommandHandler>(
@@ -26,7 +99,26 @@ int main(int argc, const char* argv[])
   );
 
   // Add server
-  ListenHandler server(reactor, 1337, store);
+  CommandHandler::Timeouts timeouts;
+  timeouts.idle = std::chrono::seconds(idleTimeout);
+  timeouts.receive = std::chrono::seconds(receiveTimeout);
+  // destroyed before the reactor, which gets their responses
+  std::unique_ptr<WorkerPool> workers(workerCount ? new WorkerPool(workerCount) : nullptr);
+  ListenHandler server(reactor, 1337, store, timeouts, workers.get());
+  std::unique_ptr<ListenHandler> unixServer(
+    unixPath.empty() ? nullptr : new ListenHandler(reactor, unixPath, store, timeouts, workers.get())
+  );
+  // shared memory connections have no timeouts, they are closed when the client is gone
+  std::unique_ptr<ShmListener> shmServer(
+    shmPath.empty() ? nullptr : new ShmListener(reactor, shmPath, store, shmRing, workers.get())
+  );
+
+  // after the workers are started, they are not pinned
+  if (cpu >= 0 && ! pinThread(unsigned(cpu)))
+  {
+    std::cerr << "Failed to pin the reactor to cpu " << cpu << "\n";
+    return 1;
+  }
 
   while (! reactor.isStopped())
   {
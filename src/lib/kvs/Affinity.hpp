@@ -0,0 +1,22 @@
+#ifndef KVS_AFFINITY_HPP_
+#define KVS_AFFINITY_HPP_
+
+#include <pthread.h>
+#include <sched.h>
+
+namespace kvs {
+
+/** Pins the calling thread to `cpu`, e.g: a busy polling reactor. @returns false on error */
+inline bool pinThread(unsigned cpu)
+{
+  if (cpu >= CPU_SETSIZE) { return false; }
+
+  cpu_set_t cpus;
+  CPU_ZERO(&cpus);
+  CPU_SET(cpu, &cpus);
+  return pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) == 0;
+}
+
+} // namespace kvs
+
+#endif // KVS_AFFINITY_HPP_
@@ -33,7 +33,7 @@ bool ReadBuffer::read(boost::string_ref& string)
 
 void WriteBuffer::write(const void* buffer, std::size_t size)
 {
-  if (_pWrite + size < _buffer.size())
+  if (_pWrite + size <= _buffer.size())
   {
     memcpy(_buffer.data() + _pWrite, buffer, size);
     _pWrite += size;
@@ -43,8 +43,9 @@ void WriteBuffer::write(const void* buffer, std::size_t size)
     auto newReadSize = readAvailable() + size;
     std::vector<char> newBuffer(newReadSize * 2);
 
-    memcpy(newBuffer.data(), _buffer.data(), readAvailable());
+    memcpy(newBuffer.data(), read(), readAvailable());
     memcpy(newBuffer.data() + readAvailable(), buffer, size);
+    _buffer.swap(newBuffer);
     _pRead = 0;
     _pWrite= newReadSize;
   }
@@ -0,0 +1,192 @@
+#include <algorithm>
+#include <cstring> // memcpy
+#include <limits>
+#include <new> // bad_alloc
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <kvs/BufferPool.hpp>
+#include <kvs/Error.hpp>
+#include <kvs/Fd.hpp>
+
+namespace kvs {
+
+constexpr std::size_t BufferPool::minSize;
+constexpr std::size_t BufferPool::maxSize;
+
+BufferPool::BufferPool(std::size_t maxFreeBytes)
+  :_maxFreeBytes(maxFreeBytes)
+{}
+
+BufferPool::~BufferPool()
+{
+  for (auto&& buffers : _free)
+  {
+    for (char* buffer : buffers) { deallocate(buffer, minSize << (&buffers - _free)); }
+  }
+}
+
+std::size_t BufferPool::capacity(std::size_t size)
+{
+  static const std::size_t pageSize = sysconf(_SC_PAGESIZE);
+
+  if (size > maxSize) { return (size + pageSize - 1) / pageSize * pageSize; }
+
+  std::size_t result = (minSize < pageSize) ? pageSize : minSize;
+  while (result < size) { result *= 2; }
+  return result;
+}
+
+std::size_t BufferPool::sizeClass(std::size_t capacity)
+{
+  std::size_t result = 0;
+  while ((minSize << result) < capacity) { ++result; }
+  return result;
+}
+
+char* BufferPool::acquire(std::size_t size)
+{
+  const std::size_t bufferSize = capacity(size);
+
+  if (bufferSize <= maxSize)
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    std::vector<char*>& buffers = _free[sizeClass(bufferSize)];
+    if (! buffers.empty())
+    {
+      char* buffer = buffers.back();
+      buffers.pop_back();
+      return buffer;
+    }
+  }
+
+  return allocate(bufferSize);
+}
+
+void BufferPool::release(char* buffer, std::size_t capacity)
+{
+  if (capacity <= maxSize)
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    std::vector<char*>& buffers = _free[sizeClass(capacity)];
+    if ((buffers.size() + 1) * capacity <= _maxFreeBytes)
+    {
+      buffers.push_back(buffer);
+      return;
+    }
+  }
+
+  deallocate(buffer, capacity);
+}
+
+std::size_t BufferPool::freeBytes() const
+{
+  std::lock_guard<std::mutex> lock(_mutex);
+
+  std::size_t result = 0;
+  for (std::size_t i = 0; i < classCount; ++i)
+  {
+    result += _free[i].size() * (minSize << i);
+  }
+  return result;
+}
+
+char* BufferPool::allocate(std::size_t capacity)
+{
+  // a client declaring a huge command must not take the process down
+  Fd memory(memfd_create("kvs-buffer", MFD_CLOEXEC));
+  if (! memory || ftruncate(*memory, capacity) < 0) { throw std::bad_alloc(); }
+
+  // reserve the address range of both mappings
+  void* reserved = mmap(nullptr, 2 * capacity, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (reserved == MAP_FAILED) { throw std::bad_alloc(); }
+
+  char* buffer = static_cast<char*>(reserved);
+
+  for (char* half : {buffer, buffer + capacity})
+  {
+    void* mapped = mmap(half, capacity, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, *memory, 0);
+    if (mapped == MAP_FAILED)
+    {
+      munmap(reserved, 2 * capacity);
+      throw std::bad_alloc();
+    }
+  }
+
+  return buffer; // the mappings keep the memory alive
+}
+
+void BufferPool::deallocate(char* buffer, std::size_t capacity)
+{
+  munmap(buffer, 2 * capacity);
+}
+
+PooledBuffer::PooledBuffer(BufferPool& pool)
+  :_pool(pool),
+   _buffer(nullptr),
+   _capacity(0),
+   _pWrite(0),
+   _pRead(0)
+{}
+
+PooledBuffer::~PooledBuffer()
+{
+  release();
+}
+
+void PooledBuffer::reserve(std::size_t size)
+{
+  if (_buffer && writeAvailable() >= size) { return; }
+
+  // grows at least twice as large: appending stays linear above the pooled sizes
+  const std::size_t used = readAvailable();
+
+  // the size and both mappings are computed without overflow
+  if (size > std::numeric_limits<std::size_t>::max() / 4 - used) { throw std::bad_alloc(); }
+  const std::size_t capacity = BufferPool::capacity(std::max(used + size, 2 * _capacity));
+  char* buffer = _pool.acquire(capacity);
+
+  if (_buffer)
+  {
+    memcpy(buffer, read(), used);
+    _pool.release(_buffer, _capacity);
+  }
+
+  _buffer = buffer;
+  _capacity = capacity;
+  _pWrite = used;
+  _pRead = 0;
+}
+
+void PooledBuffer::doneRead(std::size_t size)
+{
+  _pRead += size;
+
+  // continue in the first mapping
+  if (_pRead >= _capacity)
+  {
+    _pRead -= _capacity;
+    _pWrite -= _capacity;
+  }
+}
+
+void PooledBuffer::releaseIfEmpty()
+{
+  if (readAvailable() == 0) { release(); }
+}
+
+void PooledBuffer::release()
+{
+  if (_buffer)
+  {
+    _pool.release(_buffer, _capacity);
+  }
+
+  _buffer = nullptr;
+  _capacity = 0;
+  _pWrite = 0;
+  _pRead = 0;
+}
+
+} // namespace kvs
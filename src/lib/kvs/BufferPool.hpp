@@ -0,0 +1,106 @@
+#ifndef KVS_BUFFERPOOL_HPP_
+#define KVS_BUFFERPOOL_HPP_
+
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+namespace kvs {
+
+/**
+ * Pool of mirrored buffers in power of two size classes,
+ * from minSize to maxSize. Larger buffers are not pooled.
+ *
+ * The pages of a buffer of `capacity` bytes are mapped twice, back to back:
+ * `buffer[i]` and `buffer[capacity + i]` are the same byte.
+ * Data wrapping around the end can be accessed contiguously.
+ */
+class BufferPool
+{
+public:
+  static constexpr std::size_t minSize = 4096;
+  static constexpr std::size_t maxSize = 1 << 20;
+
+  /** @param maxFreeBytes is the limit of idle bytes kept per size class */
+  explicit BufferPool(std::size_t maxFreeBytes = 8 << 20);
+  ~BufferPool();
+
+  BufferPool(const BufferPool&) = delete;
+  BufferPool& operator=(const BufferPool&) = delete;
+
+  /** @returns the size of the buffer acquired for `size` bytes, a multiple of the page size */
+  static std::size_t capacity(std::size_t size);
+
+  /** @returns a buffer of `capacity(size)` bytes, mapped twice. Throws std::bad_alloc if not available */
+  char* acquire(std::size_t size);
+
+  /** Returns `buffer` of `capacity` bytes to the pool */
+  void release(char* buffer, std::size_t capacity);
+
+  /** @returns the number of bytes in idle buffers */
+  std::size_t freeBytes() const;
+
+private:
+  static constexpr std::size_t classCount = 9; // 4K .. 1M
+  static_assert(minSize << (classCount - 1) == maxSize, "Invalid size class count");
+
+  static std::size_t sizeClass(std::size_t capacity);
+
+  static char* allocate(std::size_t capacity);
+  static void deallocate(char* buffer, std::size_t capacity);
+
+  const std::size_t _maxFreeBytes;
+
+  mutable std::mutex _mutex;
+  std::vector<char*> _free[classCount];
+};
+
+/**
+ * Input ring buffer, which holds a pooled buffer only while
+ * it has unread bytes. Grows on demand.
+ *
+ * The buffer is mirrored, the unread bytes and the free space
+ * are always contiguous: consumed bytes are never moved,
+ * unread bytes are copied only when the buffer grows.
+ */
+class PooledBuffer
+{
+public:
+  explicit PooledBuffer(BufferPool& pool);
+  ~PooledBuffer();
+
+  PooledBuffer(const PooledBuffer&) = delete;
+  PooledBuffer& operator=(const PooledBuffer&) = delete;
+
+  /** Makes at least `size` bytes available for write. Throws std::bad_alloc, keeps the buffer then */
+  void reserve(std::size_t size);
+
+  std::size_t writeAvailable() const { return _capacity - readAvailable(); }
+  std::size_t readAvailable() const { return _pWrite - _pRead; }
+
+  char* write() { return _buffer + _pWrite; }
+  const char* read() const { return _buffer + _pRead; }
+
+  void doneWrite(std::size_t size) { _pWrite += size; }
+  void doneRead(std::size_t size);
+
+  /** Returns the buffer to the pool, if there are no unread bytes */
+  void releaseIfEmpty();
+
+  /** Returns the buffer to the pool, discards the unread bytes */
+  void release();
+
+  /** @returns the size of the held buffer, 0 if none */
+  std::size_t capacity() const { return _capacity; }
+
+private:
+  BufferPool& _pool;
+  char* _buffer;
+  std::size_t _capacity;
+  std::size_t _pWrite; // _pRead <= _pWrite <= _pRead + _capacity
+  std::size_t _pRead;  // < _capacity
+};
+
+} // namespace kvs
+
+#endif // KVS_BUFFERPOOL_HPP_
@@ -1,25 +1,91 @@
 #include <cstring> // memcpy
+#include <cmath> // sqrt
 #include <map>
 
 #include <kvs/Command.hpp>
+#include <kvs/CommandRegistry.hpp>
 #include <kvs/Store.hpp>
 #include <kvs/Value.hpp>
 #include <kvs/Buffer.hpp>
 #include <kvs/Error.hpp>
+#include <kvs/Kernel.hpp>
+#include <kvs/Query.hpp>
 
 #include <dlfcn.h>
 
 namespace kvs {
 
-const command::Tag GetCommand::_tag = command::Tag::GET;
-const command::Tag SetCommand::_tag = command::Tag::SET;
-const command::Tag PushCommand::_tag = command::Tag::PUSH;
-const command::Tag PopCommand::_tag = command::Tag::POP;
-const command::Tag SumCommand::_tag = command::Tag::SUM;
-const command::Tag MaxCommand::_tag = command::Tag::MAX;
-const command::Tag MinCommand::_tag = command::Tag::MIN;
-const command::Tag SourceCommand::_tag = command::Tag::SOURCE;
-const command::Tag ExecuteCommand::_tag = command::Tag::EXECUTE;
+constexpr command::Tag GetCommand::tag;
+constexpr command::Tag SetCommand::tag;
+constexpr command::Tag PushCommand::tag;
+constexpr command::Tag PopCommand::tag;
+constexpr command::Tag SumCommand::tag;
+constexpr command::Tag MaxCommand::tag;
+constexpr command::Tag MinCommand::tag;
+constexpr command::Tag SourceCommand::tag;
+constexpr command::Tag ExecuteCommand::tag;
+constexpr command::Tag ArithmeticCommand::tag;
+constexpr command::Tag ScaleCommand::tag;
+constexpr command::Tag DotCommand::tag;
+constexpr command::Tag NormCommand::tag;
+constexpr command::Tag QueryCommand::tag;
+constexpr command::Tag MultiGetCommand::tag;
+constexpr command::Tag HelloCommand::tag;
+
+namespace {
+
+/** Reads the tag of a serialized command, throws std::runtime_error if it is not `tag` */
+void readTag(ReadBuffer& reader, command::Tag tag)
+{
+  command::Tag actualTag;
+
+  check(reader.read(actualTag));
+  check(actualTag == tag);
+}
+
+/** Refers `size` and `tag` as the first two vectors, `size` is grown by the further fields */
+void serializeHeader(iovec* output, command::Size& size, const command::Tag& tag)
+{
+  size = sizeof(size) + sizeof(tag);
+
+  output[0].iov_base = &size;
+  output[0].iov_len = sizeof(size);
+
+  output[1].iov_base = const_cast<command::Tag*>(&tag);
+  output[1].iov_len = sizeof(tag);
+}
+
+/** Refers `fieldSize` bytes at `field` as `output` */
+void serializeField(iovec& output, command::Size& size, const void* field, std::size_t fieldSize)
+{
+  output.iov_base = const_cast<void*>(field);
+  output.iov_len = fieldSize;
+  size += fieldSize;
+}
+
+/** Refers `key` and its terminator as `output` */
+void serializeKey(iovec& output, command::Size& size, const Key& key)
+{
+  serializeField(output, size, key.data(), key.size() + 1);
+}
+
+/** Commands starting with a key: the header and the key */
+void serializeKeyCommand(iovec* output, command::Size& size, const command::Tag& tag, const Key& key)
+{
+  serializeHeader(output, size, tag);
+  serializeKey(output[2], size, key);
+}
+
+/** Commands of a single key */
+void deserializeKeyCommand(const char* buffer, command::Size size, command::Tag tag, Key& key)
+{
+  ReadBuffer reader(buffer, size);
+
+  readTag(reader, tag);
+  check(reader.read(key));
+}
+
+} // namespace
 
 //
 // SET
@@ -29,10 +95,7 @@ SetCommand::SetCommand(command::deserialize, const char* buffer, command::Size s
 {
   ReadBuffer reader(buffer, size);
 
-  command::Tag actualTag;
-
-  check(reader.read(actualTag));
-  check(actualTag == _tag);
+  readTag(reader, tag);
   check(reader.read(_key));
   check(reader.read(_serializedValueSize));
   _serializedValue = reader.get();
@@ -48,14 +111,24 @@ void SetCommand::execute(Store& store) const
     store.writePersStore(serialized, serializedVectorSize, fullSize);
   }
 
-  auto&& entry = store[_key];
-  if (entry.first < _serializedValueSize)
+  apply(store);
+}
+
+void SetCommand::apply(Store& store) const
+{
+  // commands trust compressed payloads, e.g: packed MIN/MAX read the block headers only
+  if (! value::validate(_serializedValue, _serializedValueSize))
   {
-    entry.second.reset(new char[_serializedValueSize]);
+    KVS_LOG_WARNING << "Set command: invalid compressed list";
+    return;
   }
 
-  memcpy(entry.second.get(), _serializedValue, _serializedValueSize);
-  entry.first = _serializedValueSize;
+  // legacy lists (e.g: from old log records) are stored in the aligned layout
+  const std::size_t storedSize = value::normalizedSize(_serializedValue, _serializedValueSize);
+
+  auto&& entry = store[_key];
+  value::normalize(_serializedValue, _serializedValueSize, resetValue(entry, storedSize));
+  entry.first = storedSize;
 }
 
 std::pair<const char*, std::size_t> SetCommand::value() const
@@ -65,22 +138,9 @@ std::pair<const char*, std::size_t> SetCommand::value() const
 
 void SetCommand::serialize(iovec* output, command::Size& size) const
 {
-  size = sizeof(size) + sizeof(_tag) + _key.size() + 1 + sizeof(_serializedValueSize) + _serializedValueSize;
-
-  output[0].iov_base = &size;
-  output[0].iov_len = sizeof(size);
-
-  output[1].iov_base = const_cast<command::Tag*>(&_tag);
-  output[1].iov_len = sizeof(_tag);
-
-  output[2].iov_base = const_cast<char*>(_key.data());
-  output[2].iov_len = _key.size() + 1;
-
-  output[3].iov_base = const_cast<std::size_t*>(&_serializedValueSize);
-  output[3].iov_len = sizeof(_serializedValueSize);
-
-  output[4].iov_base = const_cast<char*>(_serializedValue);
-  output[4].iov_len = _serializedValueSize;
+  serializeKeyCommand(output, size, tag, _key);
+  serializeField(output[3], size, &_serializedValueSize, sizeof(_serializedValueSize));
+  serializeField(output[4], size, _serializedValue, _serializedValueSize);
 }
 
 //
@@ -89,20 +149,22 @@ void SetCommand::serialize(iovec* output, command::Size& size) const
 
 GetCommand::GetCommand(command::deserialize, const char* buffer, command::Size size)
 {
-  ReadBuffer reader(buffer, size);
-  command::Tag actualTag;
-
-  check(reader.read(actualTag));
-  check(actualTag == _tag);
-  check(reader.read(_key));
+  deserializeKeyCommand(buffer, size, tag, _key);
 }
 
 SetCommand GetCommand::execute(const Store& store) const
+{
+  ValueBuffer value;
+  return execute(store, value);
+}
+
+SetCommand GetCommand::execute(const Store& store, ValueBuffer& value) const
 {
   auto finder = store.find(_key);
   if (finder != store.end())
   {
     // *finder is the requested value
+    value = finder->second.second;
     SetCommand result(_key, finder->second.first, finder->second.second.get());
     return result;
   }
@@ -116,16 +178,7 @@ SetCommand GetCommand::execute(const Store& store) const
 
 void GetCommand::serialize(iovec* output, command::Size& size) const
 {
-  size = sizeof(size) + sizeof(_tag) + _key.size() + 1;
-
-  output[0].iov_base = &size;
-  output[0].iov_len = sizeof(size);
-
-  output[1].iov_base = const_cast<command::Tag*>(&_tag);
-  output[1].iov_len = sizeof(_tag);
-
-  output[2].iov_base = const_cast<char*>(_key.data());
-  output[2].iov_len = _key.size() + 1;
+  serializeKeyCommand(output, size, tag, _key);
 }
 
 //
@@ -136,10 +189,7 @@ PushCommand::PushCommand(command::deserialize, const char* buffer, command::Size
 {
   ReadBuffer reader(buffer, size);
 
-  command::Tag actualTag;
-
-  check(reader.read(actualTag));
-  check(actualTag == _tag);
+  readTag(reader, tag);
   check(reader.read(_key));
   check(reader.read(_serializedValueSize));
   _serializedValue = reader.get();
@@ -188,6 +238,97 @@ struct PushBackIfSame : public boost::static_visitor<>
   void operator()(const T&, const U&) const {}
 };
 
+namespace {
+
+/**
+ * Appends an uncompressed item (scalar or list) to the aligned list
+ * in `entry` (or to the empty entry), copying the elements as bytes.
+ *
+ * @returns false, if the item or the stored list is compressed
+ */
+class AppendFlat : public boost::static_visitor<bool>
+{
+public:
+  AppendFlat(Store::Entry& entry) :_entry(entry) {}
+
+  bool operator()(NullValue) const { return false; }
+
+  template <typename T>
+  bool operator()(const T& item) const
+  {
+    return append<T>(reinterpret_cast<const char*>(&item), 1);
+  }
+
+  template <typename T>
+  bool operator()(const value::ListRef<T>& items) const
+  {
+    return items.isPlain() && append<T>(items.data, items.size);
+  }
+
+private:
+  template <typename T>
+  bool append(const char* items, ListSize count) const
+  {
+    ListSize size = 0;
+
+    if (_entry.first > 0)
+    {
+      value::ValueRef stored;
+      if (! value::ref(_entry.second.get(), _entry.first, stored)) { return false; }
+
+      const value::ListRef<T> list{stored.layout, stored.data, stored.end, stored.size};
+      if (list.layout != ValueTag::aligned || ! list.isPlain()) { return false; }
+      size = list.size;
+    }
+
+    const std::size_t oldSize = size * sizeof(T);
+    const std::size_t newSize = value::listHeaderSize + oldSize + count * sizeof(T);
+
+    // in place, unless shared by a response or a snapshot
+    char* buffer = growValue(_entry, newSize);
+    ValueDescriptor<std::vector<T>>::serializeHeader(size + count, buffer);
+    memcpy(buffer + value::listHeaderSize + oldSize, items, count * sizeof(T));
+
+    _entry.first = newSize;
+    return true;
+  }
+
+  Store::Entry& _entry;
+};
+
+/** Push by deserializing and serializing the whole list, keeps compressed layouts */
+void pushDecoded(Store::Entry& entry, const char* serializedValue, std::size_t serializedValueSize)
+{
+  TypedValue result;
+  ValueTag layout = ValueTag::aligned; // keep the layout chosen for the key
+
+  // if has content
+  if (entry.first > 0)
+  {
+    // deserialize
+    layout = value::deserializeLayout(entry.second.get(), entry.first);
+    result = value::deserialize(entry.second.get(), entry.first);
+    TypedValue item = value::deserialize(serializedValue, serializedValueSize);
+    // add item
+    boost::apply_visitor(PushBackIfSame{}, result, item);
+  }
+  // else no content
+  else
+  {
+    // create serialized singular list
+    layout = value::deserializeLayout(serializedValue, serializedValueSize);
+    TypedValue value = value::deserialize(serializedValue, serializedValueSize);
+    result = boost::apply_visitor(CreateSingularList{}, value);
+  }
+
+  // set content
+  std::size_t newSize = value::serializedSize(result, layout);
+  value::serialize(result, resetValue(entry, newSize), layout);
+  entry.first = newSize;
+}
+
+} // namespace
+
 void PushCommand::execute(Store& store) const
 {
   // write persistent store
@@ -198,29 +339,22 @@ void PushCommand::execute(Store& store) const
     store.writePersStore(serialized, serializedVectorSize, fullSize);
   }
 
+  apply(store);
+}
+
+void PushCommand::apply(Store& store) const
+{
   // get field
   auto&& entry = store[_key];
 
-  TypedValue result;
-
-  // if has content
+  // if has content, type must match
   if (entry.first > 0)
   {
-    // if type match
     ValueTag actualTag = value::deserializeTag(entry.second.get(), entry.first);
     ValueTag expectedTag = static_cast<ValueTag>(
       ValueTag::list | value::deserializeTag(_serializedValue, _serializedValueSize)
     );
-    if (actualTag == expectedTag)
-    {
-      // deserialize
-      result = value::deserialize(entry.second.get(), entry.first);
-      TypedValue item = value::deserialize(_serializedValue, _serializedValueSize);
-      // add item
-      boost::apply_visitor(PushBackIfSame{}, result, item);
-    }
-    // else error
-    else
+    if (actualTag != expectedTag)
     {
       // TODO send back error?
       KVS_LOG_WARNING << "Add command: type mismatch"
@@ -228,22 +362,16 @@ void PushCommand::execute(Store& store) const
       return;
     }
   }
-  // else no content
-  else
-  {
-    // create serialized singular list
-    TypedValue value = value::deserialize(_serializedValue, _serializedValueSize);
-    result = boost::apply_visitor(CreateSingularList{}, value);
-  }
 
-  // set content
-  std::size_t newSize = value::serializedSize(result);
-  if (entry.first < newSize)
+  value::ValueRef item;
+  AppendFlat append(entry);
+  if (value::ref(_serializedValue, _serializedValueSize, item) && value::applyRefVisitor(append, item))
   {
-    entry.second.reset(new char[newSize]);
+    return;
   }
-  value::serialize(result, entry.second.get());
-  entry.first = newSize;
+
+  // compressed lists are decoded and encoded again
+  pushDecoded(entry, _serializedValue, _serializedValueSize);
 }
 
 std::pair<const char*, std::size_t> PushCommand::value() const
@@ -253,22 +381,9 @@ std::pair<const char*, std::size_t> PushCommand::value() const
 
 void PushCommand::serialize(iovec* output, command::Size& size) const
 {
-  size = sizeof(size) + sizeof(_tag) + _key.size() + 1 + sizeof(_serializedValueSize) + _serializedValueSize;
-
-  output[0].iov_base = &size;
-  output[0].iov_len = sizeof(size);
-
-  output[1].iov_base = const_cast<command::Tag*>(&_tag);
-  output[1].iov_len = sizeof(_tag);
-
-  output[2].iov_base = const_cast<char*>(_key.data());
-  output[2].iov_len = _key.size() + 1;
-
-  output[3].iov_base = const_cast<std::size_t*>(&_serializedValueSize);
-  output[3].iov_len = sizeof(_serializedValueSize);
-
-  output[4].iov_base = const_cast<char*>(_serializedValue);
-  output[4].iov_len = _serializedValueSize;
+  serializeKeyCommand(output, size, tag, _key);
+  serializeField(output[3], size, &_serializedValueSize, sizeof(_serializedValueSize));
+  serializeField(output[4], size, _serializedValue, _serializedValueSize);
 }
 
 //
@@ -280,7 +395,7 @@ struct PopBack : public boost::static_visitor<>
   template <typename T>
   void operator()(std::vector<T>& list) const
   {
-    list.pop_back();
+    if (! list.empty()) { list.pop_back(); }
   }
 
   template <typename T>
@@ -289,14 +404,45 @@ struct PopBack : public boost::static_visitor<>
 
 PopCommand::PopCommand(command::deserialize, const char* buffer, command::Size size)
 {
-  ReadBuffer reader(buffer, size);
-  command::Tag actualTag;
-
-  check(reader.read(actualTag));
-  check(actualTag == _tag);
-  check(reader.read(_key));
+  deserializeKeyCommand(buffer, size, tag, _key);
 }
 
+namespace {
+
+/**
+ * Pops from aligned lists by shrinking them in place,
+ * other values than lists are left as they are.
+ *
+ * @returns false, if the list is compressed
+ */
+class PopFlat : public boost::static_visitor<bool>
+{
+public:
+  PopFlat(Store::Entry& entry) :_entry(entry) {}
+
+  template <typename T>
+  bool operator()(const T&) const { return true; }
+
+  template <typename T>
+  bool operator()(const value::ListRef<T>& list) const
+  {
+    if (list.layout != ValueTag::aligned || ! list.isPlain()) { return false; }
+
+    if (list.size > 0)
+    {
+      ValueDescriptor<std::vector<T>>::serializeHeader(list.size - 1, modifyValue(_entry));
+      _entry.first = value::listHeaderSize + (list.size - 1) * sizeof(T);
+    }
+
+    return true;
+  }
+
+private:
+  Store::Entry& _entry;
+};
+
+} // namespace
+
 void PopCommand::execute(Store& store) const
 {
   // write persistent store
@@ -310,21 +456,21 @@ void PopCommand::execute(Store& store) const
   // get field
   auto&& entry = store[_key];
 
+  value::ValueRef list;
+  PopFlat pop(entry);
+
   // if has content
-  if (entry.first > 0)
+  if (entry.first > 0 && ! (value::ref(entry.second.get(), entry.first, list) && value::applyRefVisitor(pop, list)))
   {
-    // deserialize
-    TypedValue list = value::deserialize(entry.second.get(), entry.first);
-    // add item
-    boost::apply_visitor(PopBack{}, list);
+    // compressed list: deserialize
+    const ValueTag layout = value::deserializeLayout(entry.second.get(), entry.first);
+    TypedValue decoded = value::deserialize(entry.second.get(), entry.first);
+    // remove item
+    boost::apply_visitor(PopBack{}, decoded);
 
     // set content
-    std::size_t newSize = value::serializedSize(list);
-    if (entry.first < newSize)
-    {
-      entry.second.reset(new char[newSize]);
-    }
-    value::serialize(list, entry.second.get());
+    std::size_t newSize = value::serializedSize(decoded, layout);
+    value::serialize(decoded, resetValue(entry, newSize), layout);
     entry.first = newSize;
   }
   // else no content, nop
@@ -332,245 +478,211 @@ void PopCommand::execute(Store& store) const
 
 void PopCommand::serialize(iovec* output, command::Size& size) const
 {
-  size = sizeof(size) + sizeof(_tag) + _key.size() + 1;
-
-  output[0].iov_base = &size;
-  output[0].iov_len = sizeof(size);
-
-  output[1].iov_base = const_cast<command::Tag*>(&_tag);
-  output[1].iov_len = sizeof(_tag);
-
-  output[2].iov_base = const_cast<char*>(_key.data());
-  output[2].iov_len = _key.size() + 1;
+  serializeKeyCommand(output, size, tag, _key);
 }
 
 //
-// SUM
+// Aggregates
 //
 
-struct SumList : public boost::static_visitor<TypedValue>
+namespace {
+
+enum class Aggregate { SUM, MIN, MAX };
+
+/** Decoder of uncompressed, but not suitably aligned elements */
+template <typename T>
+class PlainDecoder
 {
-  template <typename T>
-  TypedValue operator()(const T&) const
-  {
-    TypedValue result = NullValue{};
-    return result;
-  }
+public:
+  PlainDecoder(const char* data, ListSize size) :_data(data), _left(size) {}
 
-  template <typename T>
-  TypedValue operator()(const std::vector<T>& items) const
+  std::size_t next(T* block)
   {
-    T sum = 0;
-    for (auto&& item : items)
-    {
-      sum += item;
-    }
-    TypedValue result(sum);
-    return result;
+    const std::size_t count = std::min<ListSize>(_left, encoding::blockSize);
+    memcpy(block, _data, count * sizeof(T));
+    _data += count * sizeof(T);
+    _left -= count;
+    return count;
   }
+
+private:
+  const char* _data;
+  ListSize _left;
 };
 
-SumCommand::SumCommand(command::deserialize, const char* buffer, command::Size size)
+/**
+ * Aggregates lists without materializing them: aligned lists in place,
+ * compressed lists block by block. The serialized result is written to `result`.
+ *
+ * @returns the size of the result, 0 if not a list, or MIN/MAX of an empty list
+ */
+class Reduce : public boost::static_visitor<std::size_t>
 {
-  ReadBuffer reader(buffer, size);
-  command::Tag actualTag;
+public:
+  Reduce(Aggregate op, command::ResultBuffer& result) :_op(op), _result(result) {}
 
-  check(reader.read(actualTag));
-  check(actualTag == _tag);
-  check(reader.read(_key));
-}
+  template <typename T>
+  std::size_t operator()(const T&) const { return 0; }
 
-SetCommand SumCommand::execute(const Store& store) const
-{
-  auto finder = store.find(_key);
-  if (finder != store.end())
+  template <typename T>
+  std::size_t operator()(const value::ListRef<T>& list) const
   {
-    // *finder is the requested value
-    TypedValue maybeList = value::deserialize(finder->second.second.get(), finder->second.first);
-    TypedValue sumVal = boost::apply_visitor(SumList{}, maybeList);
-
-    char buffer[64];
-    std::size_t serSize = value::serializedSize(sumVal);
-
-    if (serSize <= 64)
+    value::ListView<T> view;
+    if (list.view(view))
     {
-      value::serialize(sumVal, buffer);
-      SetCommand result(_key, serSize, buffer);
-      return result;
+      switch (_op)
+      {
+      case Aggregate::SUM: return write(kernel::sum(view.data, view.size));
+      case Aggregate::MIN: return (view.size) ? write(kernel::min(view.data, view.size)) : 0;
+      case Aggregate::MAX: return (view.size) ? write(kernel::max(view.data, view.size)) : 0;
+      }
     }
-    else
+
+    if (list.isPlain())
     {
-      KVS_LOG_ERROR << "Sum result serialized size was too large: " << serSize;
+      return reduce<T>(PlainDecoder<T>(list.data, list.size));
     }
-  }
-
-  // not found (or too large)
-  SetCommand result(_key, NullValue::serializedSize, NullValue::serializedValue());
-  return result;
-}
 
-void SumCommand::serialize(iovec* output, command::Size& size) const
-{
-  size = sizeof(size) + sizeof(_tag) + _key.size() + 1;
+    return reduceCompressed(list, std::is_integral<T>{});
+  }
 
-  output[0].iov_base = &size;
-  output[0].iov_len = sizeof(size);
+private:
+  template <typename T>
+  std::size_t reduceCompressed(const value::ListRef<T>& list, std::true_type) const
+  {
+    switch (list.layout)
+    {
+    case ValueTag::delta:
+      return reduce<T>(encoding::DeltaDecoder<T>(list.data, list.end, list.size));
+    case ValueTag::packed:
+      return reduce<T>(encoding::PackedDecoder<T>(list.data, list.end, list.size));
+    default:
+      return 0;
+    }
+  }
 
-  output[1].iov_base = const_cast<command::Tag*>(&_tag);
-  output[1].iov_len = sizeof(_tag);
+  template <typename T>
+  std::size_t reduceCompressed(const value::ListRef<T>&, std::false_type) const
+  {
+    return 0;
+  }
 
-  output[2].iov_base = const_cast<char*>(_key.data());
-  output[2].iov_len = _key.size() + 1;
-}
+  template <typename T, typename Decoder>
+  std::size_t reduce(Decoder&& decoder) const
+  {
+    T result = 0;
 
-//
-// MAX
-//
+    switch (_op)
+    {
+    case Aggregate::SUM:
+      return write(encoding::sum<T>(decoder));
+    case Aggregate::MIN:
+      return encoding::min(decoder, result) ? write(result) : 0;
+    case Aggregate::MAX:
+      return encoding::max(decoder, result) ? write(result) : 0;
+    }
 
-struct GetMax : public boost::static_visitor<TypedValue>
-{
-  template <typename T>
-  TypedValue operator()(const T&) const
-  {
-    TypedValue result = NullValue{};
-    return result;
+    return 0;
   }
 
   template <typename T>
-  TypedValue operator()(const std::vector<T>& items) const
+  std::size_t write(const T& t) const
   {
-    T max = *std::max_element(items.begin(), items.end());
-    TypedValue result = max;
-    return result;
+    static_assert(sizeof(command::ResultBuffer) >= ValueDescriptor<T>::size(T()), "Result too large");
+    value::serialize(t, _result);
+    return value::serializedSize(t);
   }
-};
-
-MaxCommand::MaxCommand(command::deserialize, const char* buffer, command::Size size)
-{
-  ReadBuffer reader(buffer, size);
-  command::Tag actualTag;
 
-  check(reader.read(actualTag));
-  check(actualTag == _tag);
-  check(reader.read(_key));
-}
+  Aggregate _op;
+  char* _result;
+};
 
-SetCommand MaxCommand::execute(const Store& store) const
+SetCommand aggregate(
+  const Store& store,
+  const Key& key,
+  Aggregate op,
+  command::ResultBuffer& buffer
+)
 {
-  auto finder = store.find(_key);
+  auto finder = store.find(key);
   if (finder != store.end())
   {
     // *finder is the requested value
-    TypedValue maybeList = value::deserialize(finder->second.second.get(), finder->second.first);
-    TypedValue maxVal = boost::apply_visitor(GetMax{}, maybeList);
+    value::ValueRef list;
+    Reduce reduce(op, buffer);
 
-    char buffer[64];
-    std::size_t serSize = value::serializedSize(maxVal);
-
-    if (serSize <= 64)
-    {
-      value::serialize(maxVal, buffer);
-      SetCommand result(_key, serSize, buffer);
-      return result;
-    }
-    else
+    if (value::ref(finder->second.second.get(), finder->second.first, list))
     {
-      KVS_LOG_ERROR << "Max result serialized size was too large: " << serSize;
+      if (std::size_t serSize = value::applyRefVisitor(reduce, list))
+      {
+        SetCommand result(key, serSize, buffer);
+        return result;
+      }
     }
   }
 
-  // not found (or too large)
-  SetCommand result(_key, NullValue::serializedSize, NullValue::serializedValue());
+  // not found (or not a list)
+  SetCommand result(key, NullValue::serializedSize, NullValue::serializedValue());
   return result;
 }
 
-void MaxCommand::serialize(iovec* output, command::Size& size) const
-{
-  size = sizeof(size) + sizeof(_tag) + _key.size() + 1;
-
-  output[0].iov_base = &size;
-  output[0].iov_len = sizeof(size);
-
-  output[1].iov_base = const_cast<command::Tag*>(&_tag);
-  output[1].iov_len = sizeof(_tag);
-
-  output[2].iov_base = const_cast<char*>(_key.data());
-  output[2].iov_len = _key.size() + 1;
-}
+} // namespace
 
 //
-// MIN
+// SUM
 //
 
-struct GetMin : public boost::static_visitor<TypedValue>
+SumCommand::SumCommand(command::deserialize, const char* buffer, command::Size size)
 {
-  template <typename T>
-  TypedValue operator()(const T&) const
-  {
-    TypedValue result = NullValue{};
-    return result;
-  }
-
-  template <typename T>
-  TypedValue operator()(const std::vector<T>& items) const
-  {
-    T min = *std::min_element(items.begin(), items.end());
-    TypedValue result = min;
-    return result;
-  }
-};
+  deserializeKeyCommand(buffer, size, tag, _key);
+}
 
-MinCommand::MinCommand(command::deserialize, const char* buffer, command::Size size)
+SetCommand SumCommand::execute(const Store& store, command::ResultBuffer& buffer) const
 {
-  ReadBuffer reader(buffer, size);
-  command::Tag actualTag;
-
-  check(reader.read(actualTag));
-  check(actualTag == _tag);
-  check(reader.read(_key));
+  return aggregate(store, _key, Aggregate::SUM, buffer);
 }
 
-SetCommand MinCommand::execute(const Store& store) const
+void SumCommand::serialize(iovec* output, command::Size& size) const
 {
-  auto finder = store.find(_key);
-  if (finder != store.end())
-  {
-    // *finder is the requested value
-    TypedValue maybeList = value::deserialize(finder->second.second.get(), finder->second.first);
-    TypedValue maxVal = boost::apply_visitor(GetMin{}, maybeList);
+  serializeKeyCommand(output, size, tag, _key);
+}
 
-    char buffer[64];
-    std::size_t serSize = value::serializedSize(maxVal);
+//
+// MAX
+//
 
-    if (serSize <= 64)
-    {
-      value::serialize(maxVal, buffer);
-      SetCommand result(_key, serSize, buffer);
-      return result;
-    }
-    else
-    {
-      KVS_LOG_ERROR << "Max result serialized size was too large: " << serSize;
-    }
-  }
+MaxCommand::MaxCommand(command::deserialize, const char* buffer, command::Size size)
+{
+  deserializeKeyCommand(buffer, size, tag, _key);
+}
 
-  // not found (or too large)
-  SetCommand result(_key, NullValue::serializedSize, NullValue::serializedValue());
-  return result;
+SetCommand MaxCommand::execute(const Store& store, command::ResultBuffer& buffer) const
+{
+  return aggregate(store, _key, Aggregate::MAX, buffer);
 }
 
-void MinCommand::serialize(iovec* output, command::Size& size) const
+void MaxCommand::serialize(iovec* output, command::Size& size) const
 {
-  size = sizeof(size) + sizeof(_tag) + _key.size() + 1;
+  serializeKeyCommand(output, size, tag, _key);
+}
 
-  output[0].iov_base = &size;
-  output[0].iov_len = sizeof(size);
+//
+// MIN
+//
+
+MinCommand::MinCommand(command::deserialize, const char* buffer, command::Size size)
+{
+  deserializeKeyCommand(buffer, size, tag, _key);
+}
 
-  output[1].iov_base = const_cast<command::Tag*>(&_tag);
-  output[1].iov_len = sizeof(_tag);
+SetCommand MinCommand::execute(const Store& store, command::ResultBuffer& buffer) const
+{
+  return aggregate(store, _key, Aggregate::MIN, buffer);
+}
 
-  output[2].iov_base = const_cast<char*>(_key.data());
-  output[2].iov_len = _key.size() + 1;
+void MinCommand::serialize(iovec* output, command::Size& size) const
+{
+  serializeKeyCommand(output, size, tag, _key);
 }
 
 //
@@ -581,12 +693,7 @@ std::map<std::string, void(*)(Store&)> g_storedProcedures;
 
 SourceCommand::SourceCommand(command::deserialize, const char* buffer, command::Size size)
 {
-  ReadBuffer reader(buffer, size);
-  command::Tag actualTag;
-
-  check(reader.read(actualTag));
-  check(actualTag == _tag);
-  check(reader.read(_key));
+  deserializeKeyCommand(buffer, size, tag, _key);
 }
 
 void SourceCommand::execute()
@@ -601,14 +708,23 @@ void SourceCommand::execute()
   }
 
   void* procedure = dlsym(lib, "kvs_procedure");
+  void* commands = dlsym(lib, "kvs_commands");
 
-  if (!procedure)
+  if (!procedure && !commands)
   {
-    KVS_LOG_WARNING << "No kvs_procedure found in library: '" << _key << "', error: "
+    KVS_LOG_WARNING << "No kvs_procedure or kvs_commands found in library: '" << _key << "', error: "
       << dlerror();
     return;
   }
 
+  if (commands)
+  {
+    reinterpret_cast<void(*)(CommandRegistry&)>(commands)(CommandRegistry::instance());
+    KVS_LOG_INFO << "Commands loaded: " << _key;
+  }
+
+  if (!procedure) { return; }
+
   Key name = _key;
 
   { // beautify name
@@ -625,16 +741,7 @@ void SourceCommand::execute()
 
 void SourceCommand::serialize(iovec* output, command::Size& size) const
 {
-  size = sizeof(size) + sizeof(_tag) + _key.size() + 1;
-
-  output[0].iov_base = &size;
-  output[0].iov_len = sizeof(size);
-
-  output[1].iov_base = const_cast<command::Tag*>(&_tag);
-  output[1].iov_len = sizeof(_tag);
-
-  output[2].iov_base = const_cast<char*>(_key.data());
-  output[2].iov_len = _key.size() + 1;
+  serializeKeyCommand(output, size, tag, _key);
 }
 
 //
@@ -643,12 +750,7 @@ void SourceCommand::serialize(iovec* output, command::Size& size) const
 
 ExecuteCommand::ExecuteCommand(command::deserialize, const char* buffer, command::Size size)
 {
-  ReadBuffer reader(buffer, size);
-  command::Tag actualTag;
-
-  check(reader.read(actualTag));
-  check(actualTag == _tag);
-  check(reader.read(_key));
+  deserializeKeyCommand(buffer, size, tag, _key);
 }
 
 void ExecuteCommand::execute(Store& store)
@@ -669,16 +771,528 @@ void ExecuteCommand::execute(Store& store)
 
 void ExecuteCommand::serialize(iovec* output, command::Size& size) const
 {
-  size = sizeof(size) + sizeof(_tag) + _key.size() + 1;
+  serializeKeyCommand(output, size, tag, _key);
+}
 
-  output[0].iov_base = &size;
-  output[0].iov_len = sizeof(size);
+//
+// ARITHMETIC
+//
+
+namespace {
+
+/** Result of a list operation, to be stored */
+struct ListResult
+{
+  std::size_t size = 0;
+  ValueBuffer value;
+
+  template <typename T>
+  T* allocate(ListSize listSize)
+  {
+    size = value::listHeaderSize + listSize * sizeof(T);
+    value = makeValueBuffer(size);
+    ValueDescriptor<std::vector<T>>::serializeHeader(listSize, value.get());
+    return reinterpret_cast<T*>(value.get() + value::listHeaderSize);
+  }
+
+  void store(Store& store, const Key& key)
+  {
+    auto&& entry = store[key];
+    entry.first = size;
+    entry.second = std::move(value);
+  }
+};
+
+struct ApplyArithmetic : public boost::static_visitor<bool>
+{
+  ApplyArithmetic(command::Arithmetic op, const char* rhs, std::size_t rhsSize, ListResult& result)
+    :_op(op), _rhs(rhs), _rhsSize(rhsSize), _result(result)
+  {}
+
+  template <typename T>
+  bool operator()(const value::ListView<T>& lhs) const
+  {
+    value::ListView<T> rhs;
+    std::vector<T> scratch;
+    if (! value::view(_rhs, _rhsSize, rhs, scratch))
+    {
+      KVS_LOG_WARNING << "Arithmetic command: type mismatch"
+        " (exp: " << int(ValueDescriptor<std::vector<T>>::tag)
+        << ", act: " << int(value::deserializeTag(_rhs, _rhsSize)) << ")";
+      return false;
+    }
+
+    if (lhs.size != rhs.size)
+    {
+      KVS_LOG_WARNING << "Arithmetic command: size mismatch"
+        " (lhs: " << lhs.size << ", rhs: " << rhs.size << ")";
+      return false;
+    }
+
+    T* out = _result.allocate<T>(lhs.size);
+
+    switch (_op)
+    {
+    case command::Arithmetic::ADD:      kernel::add(lhs.data, rhs.data, out, lhs.size); break;
+    case command::Arithmetic::SUBTRACT: kernel::subtract(lhs.data, rhs.data, out, lhs.size); break;
+    case command::Arithmetic::MULTIPLY: kernel::multiply(lhs.data, rhs.data, out, lhs.size); break;
+    }
+
+    return true;
+  }
+
+  bool operator()(const NullValue&) const
+  {
+    KVS_LOG_WARNING << "Arithmetic command: lhs is not a list";
+    return false;
+  }
+
+  command::Arithmetic _op;
+  const char* _rhs;
+  std::size_t _rhsSize;
+  ListResult& _result;
+};
+
+} // namespace
+
+ArithmeticCommand::ArithmeticCommand(command::deserialize, const char* buffer, command::Size size)
+{
+  ReadBuffer reader(buffer, size);
+
+  readTag(reader, tag);
+  check(reader.read(_op));
+  check(_op <= command::Arithmetic::MULTIPLY);
+  check(reader.read(_destination));
+  check(reader.read(_lhs));
+  check(reader.read(_rhs));
+}
+
+void ArithmeticCommand::execute(Store& store) const
+{
+  // write persistent store
+  {
+    iovec serialized[serializedVectorSize];
+    std::size_t fullSize;
+    serialize(serialized, fullSize);
+    store.writePersStore(serialized, serializedVectorSize, fullSize);
+  }
+
+  auto lhs = store.find(_lhs);
+  auto rhs = store.find(_rhs);
+  if (lhs == store.end() || rhs == store.end())
+  {
+    KVS_LOG_WARNING << "Arithmetic command: operand not found";
+    return;
+  }
+
+  ListResult result;
+  ApplyArithmetic visitor(_op, rhs->second.second.get(), rhs->second.first, result);
+
+  if (value::applyViewVisitor(visitor, lhs->second.second.get(), lhs->second.first))
+  {
+    result.store(store, _destination);
+  }
+}
+
+void ArithmeticCommand::serialize(iovec* output, command::Size& size) const
+{
+  serializeHeader(output, size, tag);
+  serializeField(output[2], size, &_op, sizeof(_op));
+  serializeKey(output[3], size, _destination);
+  serializeKey(output[4], size, _lhs);
+  serializeKey(output[5], size, _rhs);
+}
+
+//
+// SCALE
+//
+
+namespace {
+
+struct Scale : public boost::static_visitor<bool>
+{
+  Scale(const char* factor, std::size_t factorSize, ListResult& result)
+    :_factor(factor), _factorSize(factorSize), _result(result)
+  {}
+
+  template <typename T>
+  bool operator()(const value::ListView<T>& source) const
+  {
+    TypedValue factor = value::deserialize(_factor, _factorSize);
+    const T* pFactor = boost::get<T>(&factor);
+    if (! pFactor)
+    {
+      KVS_LOG_WARNING << "Scale command: type mismatch"
+        " (exp: " << int(ValueDescriptor<T>::tag)
+        << ", act: " << int(value::deserializeTag(_factor, _factorSize)) << ")";
+      return false;
+    }
+
+    T* out = _result.allocate<T>(source.size);
+    kernel::scale(source.data, *pFactor, out, source.size);
+    return true;
+  }
+
+  bool operator()(const NullValue&) const
+  {
+    KVS_LOG_WARNING << "Scale command: source is not a list";
+    return false;
+  }
+
+  const char* _factor;
+  std::size_t _factorSize;
+  ListResult& _result;
+};
+
+} // namespace
+
+ScaleCommand::ScaleCommand(command::deserialize, const char* buffer, command::Size size)
+{
+  ReadBuffer reader(buffer, size);
+
+  readTag(reader, tag);
+  check(reader.read(_destination));
+  check(reader.read(_source));
+  check(reader.read(_serializedFactorSize));
+  check(reader.size() >= _serializedFactorSize);
+  _serializedFactor = reader.get();
+}
+
+void ScaleCommand::execute(Store& store) const
+{
+  // write persistent store
+  {
+    iovec serialized[serializedVectorSize];
+    std::size_t fullSize;
+    serialize(serialized, fullSize);
+    store.writePersStore(serialized, serializedVectorSize, fullSize);
+  }
+
+  auto source = store.find(_source);
+  if (source == store.end())
+  {
+    KVS_LOG_WARNING << "Scale command: source not found";
+    return;
+  }
+
+  ListResult result;
+  Scale visitor(_serializedFactor, _serializedFactorSize, result);
+
+  if (value::applyViewVisitor(visitor, source->second.second.get(), source->second.first))
+  {
+    result.store(store, _destination);
+  }
+}
+
+void ScaleCommand::serialize(iovec* output, command::Size& size) const
+{
+  serializeKeyCommand(output, size, tag, _destination);
+  serializeKey(output[3], size, _source);
+  serializeField(output[4], size, &_serializedFactorSize, sizeof(_serializedFactorSize));
+  serializeField(output[5], size, _serializedFactor, _serializedFactorSize);
+}
+
+//
+// DOT
+//
+
+namespace {
+
+/** Serializes the dot product to `_buffer`, @returns its size, 0 on error */
+struct Dot : public boost::static_visitor<std::size_t>
+{
+  Dot(const char* rhs, std::size_t rhsSize, char* buffer)
+    :_rhs(rhs), _rhsSize(rhsSize), _buffer(buffer)
+  {}
+
+  template <typename T>
+  std::size_t operator()(const value::ListView<T>& lhs) const
+  {
+    value::ListView<T> rhs;
+    std::vector<T> scratch;
+    if (! value::view(_rhs, _rhsSize, rhs, scratch) || lhs.size != rhs.size)
+    {
+      KVS_LOG_WARNING << "Dot command: type or size mismatch";
+      return 0;
+    }
+
+    const T result = kernel::dot(lhs.data, rhs.data, lhs.size);
+    value::serialize(result, _buffer);
+    return value::serializedSize(result);
+  }
+
+  std::size_t operator()(const NullValue&) const { return 0; }
+
+  const char* _rhs;
+  std::size_t _rhsSize;
+  char* _buffer;
+};
+
+} // namespace
+
+DotCommand::DotCommand(command::deserialize, const char* buffer, command::Size size)
+{
+  ReadBuffer reader(buffer, size);
+
+  readTag(reader, tag);
+  check(reader.read(_lhs));
+  check(reader.read(_rhs));
+}
+
+SetCommand DotCommand::execute(const Store& store, command::ResultBuffer& buffer) const
+{
+  auto lhs = store.find(_lhs);
+  auto rhs = store.find(_rhs);
+  if (lhs != store.end() && rhs != store.end())
+  {
+    Dot visitor(rhs->second.second.get(), rhs->second.first, buffer);
+
+    if (std::size_t serSize = value::applyViewVisitor(visitor, lhs->second.second.get(), lhs->second.first))
+    {
+      SetCommand result(_lhs, serSize, buffer);
+      return result;
+    }
+  }
+
+  // not found (or mismatch)
+  SetCommand result(_lhs, NullValue::serializedSize, NullValue::serializedValue());
+  return result;
+}
+
+void DotCommand::serialize(iovec* output, command::Size& size) const
+{
+  serializeKeyCommand(output, size, tag, _lhs);
+  serializeKey(output[3], size, _rhs);
+}
+
+//
+// NORM
+//
+
+namespace {
+
+struct Norm : public boost::static_visitor<std::size_t>
+{
+  Norm(char* buffer) :_buffer(buffer) {}
+
+  template <typename T>
+  std::size_t operator()(const value::ListView<T>& items) const
+  {
+    typedef typename std::conditional<std::is_floating_point<T>::value, T, double>::type Result;
+
+    const Result result = std::sqrt(kernel::squaredNorm<Result>(items.data, items.size));
+    value::serialize(result, _buffer);
+    return value::serializedSize(result);
+  }
+
+  std::size_t operator()(const NullValue&) const { return 0; }
+
+  char* _buffer;
+};
+
+} // namespace
+
+NormCommand::NormCommand(command::deserialize, const char* buffer, command::Size size)
+{
+  deserializeKeyCommand(buffer, size, tag, _key);
+}
+
+SetCommand NormCommand::execute(const Store& store, command::ResultBuffer& buffer) const
+{
+  auto finder = store.find(_key);
+  if (finder != store.end())
+  {
+    Norm visitor(buffer);
+
+    if (std::size_t serSize = value::applyViewVisitor(visitor, finder->second.second.get(), finder->second.first))
+    {
+      SetCommand result(_key, serSize, buffer);
+      return result;
+    }
+  }
+
+  // not found (or not a list)
+  SetCommand result(_key, NullValue::serializedSize, NullValue::serializedValue());
+  return result;
+}
+
+void NormCommand::serialize(iovec* output, command::Size& size) const
+{
+  serializeKeyCommand(output, size, tag, _key);
+}
+
+//
+// QUERY
+//
+
+QueryCommand::QueryCommand(command::deserialize, const char* buffer, command::Size size)
+{
+  ReadBuffer reader(buffer, size);
+
+  readTag(reader, tag);
+  check(reader.read(_key));
+  check(reader.read(_serializedQuerySize));
+  check(reader.size() >= _serializedQuerySize);
+  _serializedQuery = reader.get();
+
+  _parsed = query::parse(_serializedQuery, _serializedQuerySize, _pipeline);
+  check(_parsed);
+}
+
+SetCommand QueryCommand::execute(const Store& store, command::ResultBuffer& buffer) const
+{
+  auto finder = store.find(_key);
+
+  if (finder != store.end() && _parsed)
+  {
+    const std::size_t serSize =
+      query::execute(_pipeline, finder->second.second.get(), finder->second.first, buffer);
+
+    if (serSize)
+    {
+      SetCommand result(_key, serSize, buffer);
+      return result;
+    }
+  }
+
+  // not found (or mismatch)
+  SetCommand result(_key, NullValue::serializedSize, NullValue::serializedValue());
+  return result;
+}
+
+void QueryCommand::serialize(iovec* output, command::Size& size) const
+{
+  serializeKeyCommand(output, size, tag, _key);
+  serializeField(output[3], size, &_serializedQuerySize, sizeof(_serializedQuerySize));
+  serializeField(output[4], size, _serializedQuery, _serializedQuerySize);
+}
+
+//
+// MSET, MPUSH
+//
+
+template <typename Command, command::Tag BatchTag>
+MultiCommand<Command, BatchTag>::MultiCommand(command::deserialize, const char* buffer, command::Size size)
+{
+  ReadBuffer reader(buffer, size);
+
+  readTag(reader, tag);
+  check(reader.read(_count));
+  check(_count <= reader.size()); // not to reserve for a corrupt count
+  _items.reserve(_count);
+
+  for (command::BatchSize i = 0; i < _count; ++i)
+  {
+    Key key;
+    std::size_t serializedValueSize;
+    check(reader.read(key));
+    check(reader.read(serializedValueSize));
+    check(reader.size() >= serializedValueSize);
+
+    _items.push_back(Command(key, serializedValueSize, reader.get()));
+    reader.discard(serializedValueSize);
+  }
+}
+
+template <typename Command, command::Tag BatchTag>
+void MultiCommand<Command, BatchTag>::execute(Store& store) const
+{
+  // write persistent store, the items are not logged one by one
+  {
+    std::vector<iovec> serialized(serializedVectorSize());
+    std::size_t fullSize;
+    serialize(serialized.data(), fullSize);
+    store.writePersStore(serialized.data(), serialized.size(), fullSize);
+  }
+
+  for (const Command& item : _items) { item.apply(store); }
+}
+
+template <typename Command, command::Tag BatchTag>
+void MultiCommand<Command, BatchTag>::serialize(iovec* output, command::Size& size) const
+{
+  serializeHeader(output, size, tag);
+  serializeField(output[2], size, &_count, sizeof(_count));
+
+  // key, value size and value of the serialized item, referring to the item
+  iovec item[Command::serializedVectorSize];
+  command::Size itemSize;
+
+  for (std::size_t i = 0; i < _items.size(); ++i)
+  {
+    _items[i].serialize(item, itemSize);
+
+    iovec* itemOutput = output + 3 + 3 * i;
+    for (int j = 0; j < 3; ++j)
+    {
+      serializeField(itemOutput[j], size, item[2 + j].iov_base, item[2 + j].iov_len);
+    }
+  }
+}
+
+template <typename Command, command::Tag BatchTag>
+constexpr command::Tag MultiCommand<Command, BatchTag>::tag;
+
+template class MultiCommand<SetCommand, command::Tag::MSET>;
+template class MultiCommand<PushCommand, command::Tag::MPUSH>;
+
+//
+// MGET
+//
+
+MultiGetCommand::MultiGetCommand(command::deserialize, const char* buffer, command::Size size)
+{
+  ReadBuffer reader(buffer, size);
+
+  readTag(reader, tag);
+  check(reader.read(_count));
+  check(_count <= reader.size());
+  _keys.resize(_count);
+
+  for (Key& key : _keys) { check(reader.read(key)); }
+}
 
-  output[1].iov_base = const_cast<command::Tag*>(&_tag);
-  output[1].iov_len = sizeof(_tag);
+MultiSetCommand MultiGetCommand::execute(const Store& store, std::vector<ValueBuffer>& values) const
+{
+  MultiSetCommand result;
+
+  for (const Key& key : _keys)
+  {
+    ValueBuffer value;
+    result.add(GetCommand(key).execute(store, value));
+    values.push_back(std::move(value));
+  }
+
+  return result;
+}
+
+void MultiGetCommand::serialize(iovec* output, command::Size& size) const
+{
+  serializeHeader(output, size, tag);
+  serializeField(output[2], size, &_count, sizeof(_count));
+
+  for (std::size_t i = 0; i < _keys.size(); ++i)
+  {
+    serializeKey(output[3 + i], size, _keys[i]);
+  }
+}
+
+//
+// HELLO
+//
 
-  output[2].iov_base = const_cast<char*>(_key.data());
-  output[2].iov_len = _key.size() + 1;
+HelloCommand::HelloCommand(command::deserialize, const char* buffer, command::Size size)
+{
+  ReadBuffer reader(buffer, size);
+
+  readTag(reader, tag);
+  check(reader.read(_version));
+}
+
+void HelloCommand::serialize(iovec* output, command::Size& size) const
+{
+  serializeHeader(output, size, tag);
+  serializeField(output[2], size, &_version, sizeof(_version));
 }
 
 } // namespace
@@ -3,11 +3,13 @@
 
 #include <cstdint>
 #include <memory>
+#include <vector>
 #include <sys/uio.h>
 
 #include <boost/utility/string_ref.hpp>
 
 #include <kvs/Buffer.hpp>
+#include <kvs/Pipeline.hpp>
 
 namespace kvs {
 
@@ -17,6 +19,9 @@ namespace command {
 
 typedef uint64_t Size;
 
+/** Frames larger than this, as declared by their size, are rejected by both sides */
+constexpr Size maxSize = Size(1) << 30;
+
 enum class Tag : uint16_t
 {
   GET,
@@ -28,10 +33,32 @@ enum class Tag : uint16_t
   MIN,
   SOURCE,
   EXECUTE,
+  ARITHMETIC,
+  SCALE,
+  DOT,
+  NORM,
+  QUERY,
+  MGET,
+  MSET,
+  MPUSH,
+  HELLO,
+};
+
+enum class Arithmetic : uint8_t
+{
+  ADD,
+  SUBTRACT,
+  MULTIPLY,
 };
 
 struct deserialize {};
 
+/** Number of items of a batch command */
+typedef uint32_t BatchSize;
+
+/** Serialized scalar results of aggregates, referenced by the returned SetCommand */
+typedef char ResultBuffer[64];
+
 } // namespace command
 
 class Store;
@@ -52,15 +79,20 @@ public:
   SetCommand(command::deserialize, const char* buffer, command::Size size);
 
   void execute(Store& store) const;
+
+  /** Executes without writing the persistent store, e.g: an item of a logged batch */
+  void apply(Store& store) const;
+
+  const Key& key() const { return _key; }
   std::pair<const char*, std::size_t> value() const;
 
+  static constexpr command::Tag tag = command::Tag::SET;
+
   static constexpr int serializedVectorSize = 5;
 
   void serialize(iovec* output, command::Size& size) const;
 
 private:
-  static const command::Tag _tag;
-
   Key _key;
   std::size_t _serializedValueSize;
   const char* _serializedValue;
@@ -75,13 +107,16 @@ public:
 
   SetCommand execute(const Store& store) const;
 
+  /** @param value is set to the buffer of the returned value, if found */
+  SetCommand execute(const Store& store, std::shared_ptr<char>& value) const;
+
+  static constexpr command::Tag tag = command::Tag::GET;
+
   static constexpr int serializedVectorSize = 3;
 
   void serialize(iovec* output, command::Size& size) const;
 
 private:
-  static const command::Tag _tag;
-
   Key _key;
 };
 
@@ -101,15 +136,20 @@ public:
   PushCommand(command::deserialize, const char* buffer, command::Size size);
 
   void execute(Store& store) const;
+
+  /** Executes without writing the persistent store, e.g: an item of a logged batch */
+  void apply(Store& store) const;
+
+  const Key& key() const { return _key; }
   std::pair<const char*, std::size_t> value() const;
 
+  static constexpr command::Tag tag = command::Tag::PUSH;
+
   static constexpr int serializedVectorSize = 5;
 
   void serialize(iovec* output, command::Size& size) const;
 
 private:
-  static const command::Tag _tag;
-
   Key _key;
   std::size_t _serializedValueSize;
   const char* _serializedValue;
@@ -124,13 +164,13 @@ public:
 
   void execute(Store& store) const;
 
+  static constexpr command::Tag tag = command::Tag::POP;
+
   static constexpr int serializedVectorSize = 3;
 
   void serialize(iovec* output, command::Size& size) const;
 
 private:
-  static const command::Tag _tag;
-
   Key _key;
 };
 
@@ -141,15 +181,15 @@ public:
 
   SumCommand(command::deserialize, const char* buffer, command::Size size);
 
-  SetCommand execute(const Store& store) const;
+  SetCommand execute(const Store& store, command::ResultBuffer& buffer) const;
+
+  static constexpr command::Tag tag = command::Tag::SUM;
 
   static constexpr int serializedVectorSize = 3;
 
   void serialize(iovec* output, command::Size& size) const;
 
 private:
-  static const command::Tag _tag;
-
   Key _key;
 };
 
@@ -160,15 +200,15 @@ public:
 
   MaxCommand(command::deserialize, const char* buffer, command::Size size);
 
-  SetCommand execute(const Store& store) const;
+  SetCommand execute(const Store& store, command::ResultBuffer& buffer) const;
+
+  static constexpr command::Tag tag = command::Tag::MAX;
 
   static constexpr int serializedVectorSize = 3;
 
   void serialize(iovec* output, command::Size& size) const;
 
 private:
-  static const command::Tag _tag;
-
   Key _key;
 };
 
@@ -179,15 +219,15 @@ public:
 
   MinCommand(command::deserialize, const char* buffer, command::Size size);
 
-  SetCommand execute(const Store& store) const;
+  SetCommand execute(const Store& store, command::ResultBuffer& buffer) const;
+
+  static constexpr command::Tag tag = command::Tag::MIN;
 
   static constexpr int serializedVectorSize = 3;
 
   void serialize(iovec* output, command::Size& size) const;
 
 private:
-  static const command::Tag _tag;
-
   Key _key;
 };
 
@@ -200,13 +240,13 @@ public:
 
   void execute();
 
+  static constexpr command::Tag tag = command::Tag::SOURCE;
+
   static constexpr int serializedVectorSize = 3;
 
   void serialize(iovec* output, command::Size& size) const;
 
 private:
-  static const command::Tag _tag;
-
   Key _key;
 };
 
@@ -219,16 +259,251 @@ public:
 
   void execute(Store& store);
 
+  static constexpr command::Tag tag = command::Tag::EXECUTE;
+
   static constexpr int serializedVectorSize = 3;
 
   void serialize(iovec* output, command::Size& size) const;
 
 private:
-  static const command::Tag _tag;
+  Key _key;
+};
+
+/**
+ * Element-wise arithmetic of two lists of the same type and size,
+ * the result is stored at `destination`
+ */
+class ArithmeticCommand
+{
+public:
+  ArithmeticCommand(
+    command::Arithmetic op,
+    const Key& destination,
+    const Key& lhs,
+    const Key& rhs
+  )
+    :_op(op),
+     _destination(destination),
+     _lhs(lhs),
+     _rhs(rhs)
+  {}
+
+  ArithmeticCommand(command::deserialize, const char* buffer, command::Size size);
+
+  void execute(Store& store) const;
+
+  static constexpr command::Tag tag = command::Tag::ARITHMETIC;
+
+  static constexpr int serializedVectorSize = 6;
+
+  void serialize(iovec* output, command::Size& size) const;
+
+private:
+  command::Arithmetic _op;
+  Key _destination;
+  Key _lhs;
+  Key _rhs;
+};
+
+/**
+ * Multiplies the elements of a list by a scalar of the element type,
+ * the result is stored at `destination`
+ */
+class ScaleCommand
+{
+public:
+  ScaleCommand(
+    const Key& destination,
+    const Key& source,
+    std::size_t serializedFactorSize,
+    const char* serializedFactor
+  )
+    :_destination(destination),
+     _source(source),
+     _serializedFactorSize(serializedFactorSize),
+     _serializedFactor(serializedFactor)
+  {}
+
+  ScaleCommand(command::deserialize, const char* buffer, command::Size size);
+
+  void execute(Store& store) const;
 
+  static constexpr command::Tag tag = command::Tag::SCALE;
+
+  static constexpr int serializedVectorSize = 6;
+
+  void serialize(iovec* output, command::Size& size) const;
+
+private:
+  Key _destination;
+  Key _source;
+  std::size_t _serializedFactorSize;
+  const char* _serializedFactor;
+};
+
+/** Dot product of two lists of the same type and size */
+class DotCommand
+{
+public:
+  DotCommand(const Key& lhs, const Key& rhs) : _lhs(lhs), _rhs(rhs) {}
+
+  DotCommand(command::deserialize, const char* buffer, command::Size size);
+
+  SetCommand execute(const Store& store, command::ResultBuffer& buffer) const;
+
+  static constexpr command::Tag tag = command::Tag::DOT;
+
+  static constexpr int serializedVectorSize = 4;
+
+  void serialize(iovec* output, command::Size& size) const;
+
+private:
+  Key _lhs;
+  Key _rhs;
+};
+
+/** L2 norm of a list: of the element type for floating point lists, double otherwise */
+class NormCommand
+{
+public:
+  NormCommand(const Key& key) : _key(key) {}
+
+  NormCommand(command::deserialize, const char* buffer, command::Size size);
+
+  SetCommand execute(const Store& store, command::ResultBuffer& buffer) const;
+
+  static constexpr command::Tag tag = command::Tag::NORM;
+
+  static constexpr int serializedVectorSize = 3;
+
+  void serialize(iovec* output, command::Size& size) const;
+
+private:
   Key _key;
 };
 
+/**
+ * Filter-and-aggregate query over a list, see Query
+ */
+class QueryCommand
+{
+public:
+  QueryCommand(
+    const Key& key,
+    std::size_t serializedQuerySize,
+    const char* serializedQuery
+  )
+    :_key(key),
+     _serializedQuerySize(serializedQuerySize),
+     _serializedQuery(serializedQuery),
+     _parsed(query::parse(serializedQuery, serializedQuerySize, _pipeline))
+  {}
+
+  QueryCommand(command::deserialize, const char* buffer, command::Size size);
+
+  SetCommand execute(const Store& store, command::ResultBuffer& buffer) const;
+
+  static constexpr command::Tag tag = command::Tag::QUERY;
+
+  static constexpr int serializedVectorSize = 5;
+
+  void serialize(iovec* output, command::Size& size) const;
+
+private:
+  Key _key;
+  std::size_t _serializedQuerySize;
+  const char* _serializedQuery;
+  query::Pipeline _pipeline; // parsed once, by the constructor
+  bool _parsed;              // false, if the query is invalid
+};
+
+/**
+ * Batch of SET (MSET) or PUSH (MPUSH) commands of many keys in a single frame,
+ * written to the persistent store by a single append.
+ * The items are serialized as their commands, without the size and the tag.
+ * MSET is also the response of MGET.
+ */
+template <typename Command, command::Tag BatchTag>
+class MultiCommand
+{
+public:
+  typedef Command Item;
+
+  MultiCommand() = default;
+
+  MultiCommand(command::deserialize, const char* buffer, command::Size size);
+
+  /** The key and the value of `item` must be valid until serialized */
+  void add(const Command& item) { _items.push_back(item); ++_count; }
+
+  const std::vector<Command>& items() const { return _items; }
+
+  void execute(Store& store) const;
+
+  static constexpr command::Tag tag = BatchTag;
+
+  std::size_t serializedVectorSize() const { return 3 + 3 * _items.size(); }
+
+  /** `output` must have `serializedVectorSize()` elements */
+  void serialize(iovec* output, command::Size& size) const;
+
+private:
+  std::vector<Command> _items;
+  command::BatchSize _count = 0; // serialized size of the vector
+};
+
+typedef MultiCommand<SetCommand, command::Tag::MSET> MultiSetCommand;
+typedef MultiCommand<PushCommand, command::Tag::MPUSH> MultiPushCommand;
+
+/** Gets many keys, the response is a MultiSetCommand, in the order of the keys */
+class MultiGetCommand
+{
+public:
+  MultiGetCommand() = default;
+
+  MultiGetCommand(command::deserialize, const char* buffer, command::Size size);
+
+  /** `key` must be valid until serialized */
+  void add(const Key& key) { _keys.push_back(key); ++_count; }
+
+  /** @param values is extended by the buffers of the returned values, not found ones are empty */
+  MultiSetCommand execute(const Store& store, std::vector<std::shared_ptr<char>>& values) const;
+
+  static constexpr command::Tag tag = command::Tag::MGET;
+
+  std::size_t serializedVectorSize() const { return 3 + _keys.size(); }
+
+  /** `output` must have `serializedVectorSize()` elements */
+  void serialize(iovec* output, command::Size& size) const;
+
+private:
+  std::vector<Key> _keys;
+  command::BatchSize _count = 0; // serialized size of the vector
+};
+
+/**
+ * Requests a protocol version (see protocol::Version), always in v1 framing.
+ * The response is a HELLO of the accepted version: the connection switches to it after the response.
+ */
+class HelloCommand
+{
+public:
+  explicit HelloCommand(uint8_t version) : _version(version) {}
+
+  HelloCommand(command::deserialize, const char* buffer, command::Size size);
+
+  uint8_t version() const { return _version; }
+
+  static constexpr command::Tag tag = command::Tag::HELLO;
+
+  static constexpr int serializedVectorSize = 3;
+
+  void serialize(iovec* output, command::Size& size) const;
+
+private:
+  uint8_t _version;
+};
+
 } // namespace kvs
 
 #endif // KVS_COMMAND_HPP_
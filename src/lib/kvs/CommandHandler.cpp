@@ -1,260 +1,726 @@
-#include <cstring>  // strerror
+#include <cstring>  // strerror, memcpy
+#include <cerrno>
+#include <climits>  // IOV_MAX
+#include <new>      // bad_alloc
+#include <algorithm>
+
+#include <sys/socket.h>
 
 #include <kvs/CommandHandler.hpp>
 #include <kvs/Command.hpp>
+#include <kvs/CommandRegistry.hpp>
 #include <kvs/Reactor.hpp>
+#include <kvs/Store.hpp>
+#include <kvs/WorkerPool.hpp>
 
 namespace kvs {
 
-CommandHandler::CommandHandler(int socket, Store& store, Reactor& reactor)
+constexpr std::size_t CommandHandler::readBudget;
+constexpr std::size_t CommandHandler::commandBudget;
+constexpr std::size_t CommandHandler::outputHighWater;
+constexpr std::size_t CommandHandler::outputLowWater;
+constexpr std::size_t CommandHandler::offloadThreshold;
+
+CommandHandler::CommandHandler(
+  int socket, Store& store, Reactor& reactor,
+  const Timeouts& timeouts, WorkerPool* pWorkers
+)
   :_socket(socket),
    _store(store),
-   _buffer(1 << 20),
-   _writer(_socket, reactor)
+   _reactor(reactor),
+   _timeouts(timeouts),
+   _lastActivity(reactor.now()),
+   _partial(false),
+   _buffer(reactor.bufferPool()),
+   _pendingSize(0),
+   _executed(0),
+   _throttled(false),
+   _waitingOutput(false),
+   _paused(false),
+   _version(protocol::Version::v1),
+   _requestId(0),
+   _pWorkers(pWorkers),
+   _sending(false)
 {}
 
 bool CommandHandler::dispatch()
 {
-  if (_buffer.writeAvailable() < 256) { _buffer.enlarge(); }
+  // write the backlog, if any, might resume reading
+  if (! flush()) { return false; }
+
+  _executed = 0;
+  _throttled = false;
 
-  ssize_t rsize = read(*_socket, _buffer.write(), _buffer.writeAvailable());
+  // input left by an earlier dispatch runs first
+  if (! executeBuffered()) { return false; }
 
-  if (rsize < 0)
+  // level triggered: one read per dispatch, epoll reports the rest.
+  // edge triggered: read until drained, yield after `readBudget` reads.
+  // completion based: input is received, this only continues throttled input
+  const std::size_t readCount =
+      completionBased() ? 0
+    : edgeTriggered() ? readBudget
+    : 1;
+  bool drained = true;
+
+  for (std::size_t readIndex = 0; readIndex < readCount && ! _throttled && ! _paused; ++readIndex)
   {
-    _socket.close();
-    return false;
+    // the input buffer is acquired only when there is data to read.
+    // It grows as a partially received command arrives, at most twice as large
+    // per read: the size declared by the client is not allocated up front
+    if (! reserveInput(std::max<std::size_t>(std::min(_pendingSize, _buffer.capacity()), 256))) { return false; }
+
+    const std::size_t wanted = _buffer.writeAvailable();
+    ssize_t rsize = readInput(_buffer.write(), wanted);
+
+    if (rsize < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+    {
+      drained = true; // or woken up for output only
+      break;
+    }
+
+    if (rsize <= 0)
+    {
+      close();
+      return false;
+    }
+
+    _buffer.doneWrite(rsize);
+    _lastActivity = _reactor.now();
+
+    if (! executeBuffered()) { return false; }
+
+    // a short read emptied the socket, new data raises a new edge
+    drained = std::size_t(rsize) < wanted;
+    if (drained) { break; }
   }
 
-  _buffer.doneWrite(rsize);
+  // return the buffer to the pool, if the connection is idle,
+  // responses do not refer to the input buffer
+  _buffer.releaseIfEmpty();
+
+  // one writev for every response of this pass
+  if (! flush()) { return false; }
 
-  while (_buffer.readAvailable() > sizeof(command::Size) + sizeof(command::Tag))
+  // unexecuted input, or the socket might have more input:
+  // continue after the other handlers. If the output is full, after it drains
+  if ((_throttled || (! drained && edgeTriggered())) && ! _paused)
   {
-    ReadBuffer reader(_buffer.read(), _buffer.readAvailable());
+    _reactor.dispatchAgain(this);
+  }
+
+  updateTimeout();
+  return true;
+}
 
-    command::Size comSize;
-    reader.read(comSize);
+bool CommandHandler::received(const char* data, std::size_t size)
+{
+  if (! _socket) { return false; } // a late completion, after close
 
-    if (_buffer.readAvailable() < comSize) { break; }
+  if (size == 0)
+  {
+    close();
+    return false;
+  }
 
-    command::Tag comTag;
-    reader.read(comTag);
+  _executed = 0;
+  _throttled = false;
+  _lastActivity = _reactor.now();
 
-    const char* comBegin = _buffer.read() + sizeof(comSize);
-    auto payloadSize = comSize - sizeof(comSize);
+  // complete the partially received command in the input buffer,
+  // or queue after the input not executed yet
+  if (_buffer.readAvailable() || _paused)
+  {
+    const std::size_t part = (_pendingSize && _pendingSize < size) ? _pendingSize : size;
+    if (! reserveInput(part)) { return false; }
+    memcpy(_buffer.write(), data, part);
+    _buffer.doneWrite(part);
+    data += part;
+    size -= part;
+
+    if (! executeBuffered()) { return false; }
+  }
 
-    try
+  // the rest is executed in place, only what is left is copied
+  if (size)
+  {
+    std::size_t consumed = 0;
+    if (_buffer.readAvailable() == 0)
     {
+      if (! processCommands(data, size, consumed)) { return false; }
+    }
 
-      switch (comTag)
-      {
-      case command::Tag::GET:
-      {
-        GetCommand input(command::deserialize{}, comBegin, payloadSize);
-        SetCommand output = input.execute(_store);
+    const std::size_t left = size - consumed;
+    if (left)
+    {
+      if (! reserveInput(left)) { return false; }
+      memcpy(_buffer.write(), data + consumed, left);
+      _buffer.doneWrite(left);
+    }
+  }
 
-        iovec serialized[SetCommand::serializedVectorSize];
-        std::size_t fullSize;
-        output.serialize(serialized, fullSize);
-        _writer.write(serialized, SetCommand::serializedVectorSize, fullSize);
+  _buffer.releaseIfEmpty();
 
-        break;
-      }
-      case command::Tag::SET:
-      {
-        SetCommand input(command::deserialize{}, comBegin, payloadSize);
-        input.execute(_store);
-        break;
-      }
-      case command::Tag::PUSH:
-      {
-        PushCommand input(command::deserialize{}, comBegin, payloadSize);
-        input.execute(_store);
-        break;
-      }
-      case command::Tag::POP:
-      {
-        PopCommand input(command::deserialize{}, comBegin, payloadSize);
-        input.execute(_store);
-        break;
-      }
-      case command::Tag::SUM:
-      {
-        SumCommand input(command::deserialize{}, comBegin, payloadSize);
-        SetCommand output = input.execute(_store);
+  // sent with the next submission
+  flush();
 
-        iovec serialized[SetCommand::serializedVectorSize];
-        std::size_t fullSize;
-        output.serialize(serialized, fullSize);
-        _writer.write(serialized, SetCommand::serializedVectorSize, fullSize);
+  if (_throttled && ! _paused) { _reactor.dispatchAgain(this); }
 
-        break;
-      }
-      case command::Tag::MAX:
-      {
-        MaxCommand input(command::deserialize{}, comBegin, payloadSize);
-        SetCommand output = input.execute(_store);
+  updateTimeout();
+  return true;
+}
 
-        iovec serialized[SetCommand::serializedVectorSize];
-        std::size_t fullSize;
-        output.serialize(serialized, fullSize);
-        _writer.write(serialized, SetCommand::serializedVectorSize, fullSize);
+void CommandHandler::sent(ssize_t result)
+{
+  _sending = false;
 
-        break;
-      }
-      case command::Tag::MIN:
-      {
-        MinCommand input(command::deserialize{}, comBegin, payloadSize);
-        SetCommand output = input.execute(_store);
+  if (! _socket)
+  {
+    // closed while sending, the segments are released now
+    _output.clear();
+    return;
+  }
 
-        iovec serialized[SetCommand::serializedVectorSize];
-        std::size_t fullSize;
-        output.serialize(serialized, fullSize);
-        _writer.write(serialized, SetCommand::serializedVectorSize, fullSize);
+  if (result < 0)
+  {
+    KVS_LOG_WARNING << "CommandHandler resp send: " << strerror(-result);
+    close();
+    return;
+  }
 
-        break;
-      }
-      case command::Tag::SOURCE:
+  _output.consume(std::size_t(result));
+  if (result > 0) { _lastActivity = _reactor.now(); }
+
+  flush();
+  updateTimeout();
+}
+
+bool CommandHandler::timedOut()
+{
+  KVS_LOG_INFO << "CommandHandler timed out, "
+    << (_partial ? "partial command received" : "idle");
+  close();
+  return false;
+}
+
+void CommandHandler::updateTimeout()
+{
+  if (! _timeouts.idle.count() && ! _timeouts.receive.count()) { return; }
+
+  Reactor::Clock::time_point deadline = Reactor::Clock::time_point::max();
+
+  if (_timeouts.idle.count())
+  {
+    deadline = _lastActivity + _timeouts.idle;
+  }
+
+  // input left unexecuted is a partial command, unless throttled.
+  // Measured from its start, a slow sender does not extend it
+  const bool partial = _buffer.readAvailable() && ! _throttled && ! _paused;
+  if (partial && ! _partial) { _partialSince = _reactor.now(); }
+  _partial = partial;
+
+  if (partial && _timeouts.receive.count())
+  {
+    deadline = std::min(deadline, _partialSince + _timeouts.receive);
+  }
+
+  _reactor.setTimeout(this, deadline);
+}
+
+ssize_t CommandHandler::readInput(char* data, std::size_t size)
+{
+  return read(*_socket, data, size);
+}
+
+bool CommandHandler::writeOutput(OutputQueue& output)
+{
+  return output.writeTo(*_socket);
+}
+
+void CommandHandler::watch(int events)
+{
+  _reactor.readdHandler(this, *_socket, events);
+}
+
+bool CommandHandler::edgeTriggered() const
+{
+  return _reactor.edgeTriggered();
+}
+
+bool CommandHandler::completionBased() const
+{
+  return _reactor.completionBased();
+}
+
+bool CommandHandler::reserveInput(std::size_t size)
+{
+  try
+  {
+    _buffer.reserve(size);
+    return true;
+  }
+  catch (const std::bad_alloc&)
+  {
+    KVS_LOG_ERROR << "CommandHandler: no memory for the input, " << _buffer.readAvailable() + size << " bytes";
+    close();
+    return false;
+  }
+}
+
+bool CommandHandler::executeBuffered()
+{
+  if (_buffer.readAvailable() == 0) { return true; }
+
+  std::size_t consumed = 0;
+  if (! processCommands(_buffer.read(), _buffer.readAvailable(), consumed)) { return false; }
+  _buffer.doneRead(consumed);
+  return true;
+}
+
+struct CommandHandler::V1Frame
+{
+  const char* data; // after the size
+  command::Size size;
+
+  template <typename Command>
+  Command command() const { return Command(command::deserialize{}, data, size); }
+};
+
+bool CommandHandler::processCommands(const char* data, std::size_t size, std::size_t& consumed)
+{
+  while (consumed < size)
+  {
+    // the rest waits for the other connections, or for the output to drain
+    if (_executed == commandBudget || _paused || _output.size() >= outputHighWater)
+    {
+      _throttled = true;
+      break;
+    }
+
+    const char* command = data + consumed;
+    const std::size_t available = size - consumed;
+
+    // the size of the frame, once its size is received
+    std::size_t frameSize;
+    std::size_t headerSize;
+
+    if (_version == protocol::Version::v1)
+    {
+      if (available <= sizeof(command::Size) + sizeof(command::Tag)) { break; }
+
+      command::Size comSize;
+      ReadBuffer reader(command, available);
+      reader.read(comSize);
+
+      if (comSize <= sizeof(command::Size) + sizeof(command::Tag) || comSize > command::maxSize)
       {
-        SourceCommand input(command::deserialize{}, comBegin, payloadSize);
-        input.execute();
-        break;
+        KVS_LOG_ERROR << "Invalid command size received: " << comSize;
+        close();
+        return false;
       }
-      case command::Tag::EXECUTE:
+
+      frameSize = comSize;
+      headerSize = sizeof(command::Size);
+    }
+    else
+    {
+      uint64_t bodySize;
+      headerSize = protocol::readVarint(command, available, bodySize);
+
+      if (headerSize == 0)
       {
-        ExecuteCommand input(command::deserialize{}, comBegin, payloadSize);
-        input.execute(_store);
-        break;
+        if (available < protocol::maxVarintSize) { break; }
+
+        KVS_LOG_ERROR << "Invalid frame size received";
+        close();
+        return false;
       }
-      default:
+
+      // the sum does not overflow
+      if (bodySize > command::maxSize - headerSize)
       {
-        KVS_LOG_ERROR << "Invalid command tag received: " << static_cast<int>(comTag);
-        _socket.close();
+        KVS_LOG_ERROR << "Invalid frame size received: " << bodySize;
+        close();
         return false;
-        break;
       }
+
+      frameSize = headerSize + bodySize;
+    }
+
+    if (available < frameSize)
+    {
+      _pendingSize = frameSize - available;
+      break;
+    }
+
+    try
+    {
+      if (_version == protocol::Version::v1)
+      {
+        command::Tag comTag;
+        memcpy(&comTag, command + headerSize, sizeof(comTag));
+
+        if (! executeCommand(comTag, V1Frame{command + headerSize, frameSize - headerSize})) { return false; }
       }
+      else
+      {
+        check(protocol::decode(command + headerSize, frameSize - headerSize, _frame));
+        _requestId = _frame.requestId;
 
+        if (! offload(command + headerSize, frameSize - headerSize))
+        {
+          if (! executeCommand(_frame.tag, _frame)) { return false; }
+        }
+      }
     }
     catch (const std::runtime_error& ex)
     {
       KVS_LOG_ERROR << "Failed to deserialize command";
-      _socket.close();
+      close();
       return false;
     }
 
-    _buffer.doneRead(comSize);
+    consumed += frameSize;
+    _pendingSize = 0;
+    ++_executed;
+  }
+
+  return true;
+}
+
+template <typename Frame>
+bool CommandHandler::executeCommand(command::Tag tag, const Frame& frame)
+{
+  typedef command::Table<bool(const Frame&), CommandHandler, command::Builtins> Commands;
+
+  if (typename Commands::Entry execute = Commands::find(tag))
+  {
+    return execute(*this, frame);
   }
 
-  _buffer.rewind(); // move the remaining bytes to the beginning
+  return executeUnknown(tag, frame);
+}
+
+template <typename Command, typename Frame>
+bool CommandHandler::visit(const Frame& frame)
+{
+  Command input = frame.template command<Command>();
+  return run(input);
+}
 
+template <typename Command>
+auto CommandHandler::run(Command& input) -> decltype(input.execute(std::declval<Store&>()), bool())
+{
+  input.execute(_store);
   return true;
 }
 
-CommandHandler::ResponseWriter::ResponseWriter(Fd& socket, Reactor& reactor)
-  :_socket(socket),
-   _reactor(reactor),
-   _addedToReactor(false)
-{}
+template <typename Command>
+auto CommandHandler::run(Command& input)
+  -> decltype(input.execute(std::declval<const Store&>(), std::declval<command::ResultBuffer&>()), bool())
+{
+  command::ResultBuffer result;
+  respond(input.execute(_store, result));
+  return true;
+}
+
+bool CommandHandler::run(GetCommand& input)
+{
+  ValueBuffer value;
+  const SetCommand output = input.execute(_store, value);
+  respond(output, std::move(value)); // only after execute set the value
+  return true;
+}
+
+bool CommandHandler::run(MultiGetCommand& input)
+{
+  std::vector<ValueBuffer> values;
+  const MultiSetCommand output = input.execute(_store, values);
+  respond(output, values);
+  return true;
+}
+
+bool CommandHandler::run(SourceCommand& input)
+{
+  input.execute();
+  return true;
+}
+
+bool CommandHandler::run(HelloCommand& input)
+{
+  check(input.version() >= uint8_t(protocol::Version::v1));
+
+  // the latest version up to the requested one, the response is in the current framing
+  const uint8_t version = std::min(input.version(), uint8_t(protocol::latest));
+  respond(HelloCommand(version));
+  _version = protocol::Version(version);
+
+  return true;
+}
 
-bool CommandHandler::ResponseWriter::dispatch()
+bool CommandHandler::executeUnknown(command::Tag tag, const V1Frame& frame)
 {
-  ssize_t wsize = ::write(*_socket, _buffer.read(), _buffer.readAvailable());
-  if (wsize < 0)
+  CommandRegistry::Entry library;
+  if (! CommandRegistry::instance().find(tag, library))
   {
-    _socket.close();
-    return false;
+    return executeUnknown(tag, _frame); // not a command of a library either
   }
 
-  _buffer.doneRead(wsize);
+  _libraryResponse.clear();
+  library.execute(_store, frame.data, frame.size, _libraryResponse);
 
-  if (_buffer.readAvailable())
+  if (! _libraryResponse.empty())
   {
-    addToReactor();
+    respond(SetCommand(Key(""), _libraryResponse.size(), _libraryResponse.data()));
   }
 
   return true;
 }
 
-void CommandHandler::ResponseWriter::write(iovec* output, std::size_t vecSize, std::size_t fullSize)
+bool CommandHandler::executeUnknown(command::Tag tag, const protocol::Frame&)
+{
+  KVS_LOG_ERROR << "Invalid command tag received: " << static_cast<int>(tag);
+  close();
+  return false;
+}
+
+namespace {
+
+/** Calls `f(key)` for the keys of `frame` */
+template <typename F>
+void forEachKey(const protocol::Frame& frame, F&& f)
 {
-  // try drain buffer if any
-  ssize_t wsize;
-  if (_buffer.readAvailable())
+  // fields in the order of the schema, a value size and a value are a single field
+  std::size_t index = 0;
+  for (const char* field = protocol::schema(frame.tag); *field && *field != '*'; ++field)
   {
-    wsize = ::write(*_socket, _buffer.read(), _buffer.readAvailable());
-    if (wsize < 0)
+    if (*field == 'l') { continue; }
+    if (*field == 'k') { f(frame.key(index)); }
+    ++index;
+  }
+}
+
+/** An aggregate on a worker, owns its request and the snapshot of the values it reads */
+struct AsyncCommand
+{
+  AsyncCommand() : snapshot(nullptr) {}
+
+  std::vector<char> request; // the v2 frame, after its size
+  protocol::Frame frame; // refers to `request`
+  Store snapshot; // shares the values: shared values are not modified
+  command::ResultBuffer result;
+
+  template <typename Command>
+  SetCommand visit() { return frame.command<Command>().execute(snapshot, result); }
+};
+
+/** Aggregates only read the store, and might take long on large values */
+typedef command::Table<SetCommand(), AsyncCommand, command::Aggregates> Aggregates;
+
+} // namespace
+
+bool CommandHandler::offload(const char* body, std::size_t size)
+{
+  if (! _pWorkers || ! Aggregates::find(_frame.tag)) { return false; }
+
+  std::size_t valueSize = 0;
+  forEachKey(_frame, [&](const Key& key) {
+    auto finder = _store.find(key);
+    if (finder != _store.end()) { valueSize += finder->second.first; }
+  });
+
+  if (valueSize < offloadThreshold) { return false; }
+
+  auto async = std::make_shared<AsyncCommand>();
+  async->request.assign(body, body + size);
+  check(protocol::decode(async->request.data(), size, async->frame));
+
+  forEachKey(async->frame, [&](const Key& key) {
+    auto finder = _store.find(key);
+    if (finder != _store.end()) { async->snapshot[key] = finder->second; }
+  });
+
+  if (! _self) { _self = std::make_shared<CommandHandler*>(this); }
+  std::weak_ptr<CommandHandler*> self = _self;
+  Reactor& reactor = _reactor;
+
+  _pWorkers->post([async, self, &reactor]() {
+    const SetCommand output = Aggregates::find(async->frame.tag)(*async);
+
+    reactor.post([async, self, output]() {
+      if (auto pSelf = self.lock()) { (*pSelf)->respondAsync(async->frame.requestId, output); }
+    });
+  });
+
+  return true;
+}
+
+void CommandHandler::respondAsync(uint64_t requestId, const SetCommand& output)
+{
+  const uint64_t current = _requestId;
+  _requestId = requestId;
+  respond(output);
+  _requestId = current;
+
+  // sent by the next dispatch, which removes the handler if the send fails
+  _reactor.dispatchAgain(this);
+}
+
+void CommandHandler::respond(const SetCommand& output, std::shared_ptr<const char> owner)
+{
+  // results in a ResultBuffer do not outlive the command, must be copied
+  static_assert(
+    sizeof(command::ResultBuffer) <= copyThreshold,
+    "Results are not copied to the output queue"
+  );
+
+  iovec serialized[SetCommand::serializedVectorSize];
+  std::size_t fullSize;
+  output.serialize(serialized, fullSize);
+
+  // the header (sizes, tag, key) is copied, the value is the last vector
+  queueResponse(serialized, SetCommand::serializedVectorSize, [&owner](std::size_t index) {
+    return (index + 1 == SetCommand::serializedVectorSize) ? owner : nullptr;
+  });
+}
+
+void CommandHandler::respond(const MultiSetCommand& output, const std::vector<ValueBuffer>& owners)
+{
+  _responseVector.resize(output.serializedVectorSize());
+  std::size_t fullSize;
+  output.serialize(_responseVector.data(), fullSize);
+
+  // the header (size, tag, count) and the keys and value sizes are copied,
+  // large values are referenced, like single responses
+  queueResponse(_responseVector.data(), _responseVector.size(), [&owners](std::size_t index) {
+    const bool isValue = index >= 3 && (index - 3) % 3 == 2;
+    return isValue ? std::shared_ptr<const char>(owners[(index - 3) / 3]) : nullptr;
+  });
+}
+
+void CommandHandler::respond(const HelloCommand& output)
+{
+  iovec serialized[HelloCommand::serializedVectorSize];
+  std::size_t fullSize;
+  output.serialize(serialized, fullSize);
+
+  queueResponse(serialized, HelloCommand::serializedVectorSize, [](std::size_t) {
+    return std::shared_ptr<const char>();
+  });
+}
+
+template <typename OwnerOf>
+void CommandHandler::queueResponse(const iovec* vectors, std::size_t count, OwnerOf&& ownerOf)
+{
+  auto queue = [this, count, &ownerOf](const iovec& vec, std::size_t index) {
+    std::shared_ptr<const char> owner = (index < count) ? ownerOf(index) : nullptr;
+    if (owner && vec.iov_len > copyThreshold)
     {
-      KVS_LOG_WARNING << "CommandHandler resp write: " << strerror(errno);
-      _socket.close();
-      return;
+      _output.reference(static_cast<const char*>(vec.iov_base), vec.iov_len, std::move(owner));
     }
+    else
+    {
+      _output.copy(vec.iov_base, vec.iov_len);
+    }
+  };
 
-    _buffer.doneRead(wsize);
-  }
-
-  if (_buffer.readAvailable())
+  if (_version == protocol::Version::v1)
   {
-    // add everything to backlog
-    writeBuffer(output, vecSize);
+    for (std::size_t i = 0; i < count; ++i) { queue(vectors[i], i); }
   }
   else
   {
-    // write latest
-    wsize = writev(*_socket, output, vecSize);
-    if (wsize < 0)
+    protocol::encode(_requestId, vectors, count, _responseScratch, queue);
+  }
+}
+
+bool CommandHandler::flush()
+{
+  if (completionBased())
+  {
+    send();
+
+    const bool paused = outputFull();
+    if (paused != _paused)
     {
-      KVS_LOG_WARNING << "CommandHandler resp write: " << strerror(errno);
-      _socket.close();
-      return;
+      _paused = paused;
+      watch(paused ? 0 : int(EPOLLIN));
+
+      if (! paused && _buffer.readAvailable()) { _reactor.dispatchAgain(this); }
     }
+    return true;
+  }
 
-    std::size_t uwsize = wsize;
-    if (uwsize == fullSize) { return; }
+  const std::size_t outputSize = _output.size();
+  if (! writeOutput(_output))
+  {
+    KVS_LOG_WARNING << "CommandHandler resp write: " << strerror(errno);
+    close();
+    return false;
+  }
 
-    KVS_LOG_DEBUG << "CommandHandler output socket was full: " << uwsize << "/" << fullSize;
+  if (_output.size() < outputSize) { _lastActivity = _reactor.now(); }
 
-    // save the rest
-    std::size_t i = 0;
-    for (; i < vecSize; ++i)
+  const bool waitingOutput = ! _output.empty();
+  const bool paused = outputFull();
+  if (waitingOutput != _waitingOutput || paused != _paused)
+  {
+    if (waitingOutput)
     {
-      if (uwsize >= output[i].iov_len)
-      {
-        uwsize -= output[i].iov_len;
-      }
-      else if (uwsize)
-      {
-        const char* chunk = reinterpret_cast<const char*>(output[i].iov_base) + uwsize;
-        _buffer.write(chunk, output[i].iov_len - uwsize);
-        break;
-      }
+      KVS_LOG_DEBUG << "CommandHandler output socket was full: " << _output.size() << " bytes left";
     }
-    writeBuffer(output + i, vecSize - i);
-  }
 
-  if (_buffer.readAvailable())
-  {
-    addToReactor();
+    _waitingOutput = waitingOutput;
+    _paused = paused;
+    watch((paused ? 0 : int(EPOLLIN)) | _reactor.edgeFlag() | (waitingOutput ? int(EPOLLOUT) : 0));
   }
+
+  return true;
 }
 
-void CommandHandler::ResponseWriter::writeBuffer(iovec* output, std::size_t vecSize)
+bool CommandHandler::outputFull() const
 {
-  for (std::size_t i = 0; i < vecSize; ++i)
-  {
-    _buffer.write(output[i].iov_base, output[i].iov_len);
-  }
+  // reading stops above the high-water mark, until the output drains below the low-water mark
+  return _output.size() >= outputHighWater || (_paused && _output.size() > outputLowWater);
 }
 
-void CommandHandler::ResponseWriter::addToReactor()
+void CommandHandler::send()
 {
-  if (_addedToReactor)
-  {
-    _reactor.readdHandler(this, *_socket, EPOLLOUT | EPOLLONESHOT);
-  }
-  else
+  if (_sending || _output.empty()) { return; }
+
+  _sendVector.resize(std::min<std::size_t>(_output.segmentCount(), IOV_MAX));
+  const std::size_t vecSize = _output.gather(_sendVector.data(), _sendVector.size());
+
+  memset(&_message, 0, sizeof(_message));
+  _message.msg_iov = _sendVector.data();
+  _message.msg_iovlen = vecSize;
+
+  _reactor.send(this, *_socket, &_message);
+  _sending = true;
+}
+
+void CommandHandler::close()
+{
+  _buffer.release();
+  _self.reset();
+
+  if (completionBased())
   {
-    _addedToReactor = _reactor.addHandler(this, *_socket, EPOLLOUT | EPOLLONESHOT);
+    if (_socket)
+    {
+      // ends the pending receive, the socket is closed after the prepared requests
+      shutdown(*_socket, SHUT_RDWR);
+      _reactor.close(_socket.release());
+    }
+
+    // a send in progress refers to the segments, cleared when completed
+    if (! _sending) { _output.clear(); }
+    return;
   }
+
+  _socket.close();
+  _output.clear();
 }
 
 } // namespace
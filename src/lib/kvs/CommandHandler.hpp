@@ -1,48 +1,215 @@
 #ifndef KVS_COMMANDHANDLER_HPP_
 #define KVS_COMMANDHANDLER_HPP_
 
-#include <sys/uio.h>
+#include <chrono>
+#include <memory>
+#include <utility> // declval
+#include <vector>
+
+#include <sys/socket.h>
 
 #include <kvs/IOHandler.hpp>
 #include <kvs/Fd.hpp>
-#include <kvs/Buffer.hpp>
+#include <kvs/BufferPool.hpp>
+#include <kvs/OutputQueue.hpp>
+#include <kvs/Protocol.hpp>
+#include <kvs/CommandTable.hpp>
 
 namespace kvs {
 
 class Store;
 class Reactor;
+class WorkerPool;
 
 class CommandHandler : public IOHandler
 {
 public:
-  CommandHandler(int socket, Store& store, Reactor& reactor);
+  /** Closes stalled connections, a zero timeout is disabled */
+  struct Timeouts
+  {
+    Timeouts() :idle(0), receive(0) {}
+
+    std::chrono::milliseconds idle;    // without input or output progress
+    std::chrono::milliseconds receive; // of a partially received command
+  };
+
+  /**
+   * Aggregates of large values, requested by v2 clients, run on `pWorkers`, if set:
+   * their responses are sent when ready, after the responses of later requests
+   */
+  CommandHandler(
+    int socket, Store& store, Reactor& reactor,
+    const Timeouts& timeouts = Timeouts(), WorkerPool* pWorkers = nullptr
+  );
+
+  /** Sets the deadline of the earliest timeout, if any. Called once added to the reactor */
+  void updateTimeout();
 
   bool dispatch() override;
 
+  bool received(const char* data, std::size_t size) override;
+  void sent(ssize_t result) override;
+  bool timedOut() override;
+
 private:
-  class ResponseWriter : public IOHandler
-  {
-  public:
-    ResponseWriter(Fd& socket, Reactor& reactor);
+  // The transport of the connection, the socket by default.
+  // Overridden by transports of other fds, e.g: ShmHandler, watching a doorbell
 
-    bool dispatch() override;
+  /** Reads at most `size` bytes of input, as read(2) */
+  virtual ssize_t readInput(char* data, std::size_t size);
 
-    void write(iovec* output, std::size_t vecSize, std::size_t fullSize);
+  /** Writes `output` until done, or the transport is full. @returns false on error, sets errno */
+  virtual bool writeOutput(OutputQueue& output);
 
-  private:
-    void writeBuffer(iovec* output, std::size_t vecSize);
-    void addToReactor();
+  /** Changes the events of the watched fd */
+  virtual void watch(int events);
 
-    Fd& _socket;
-    Reactor& _reactor;
-    WriteBuffer _buffer;
-    bool _addedToReactor;
-  };
+  /** @returns true, if the input must be read until drained: new input only is reported */
+  virtual bool edgeTriggered() const;
+
+  /** @returns true, if the reactor does the I/O of the transport */
+  virtual bool completionBased() const;
+
+  /** Executes the commands of the input buffer. @returns false if closed */
+  bool executeBuffered();
+
+  /** Makes `size` bytes available in the input buffer. @returns false if closed, out of memory */
+  bool reserveInput(std::size_t size);
+
+  /**
+   * Executes the complete commands of `data`, from `consumed`,
+   * advances `consumed` past them. Stops when throttled:
+   * after `commandBudget` commands, or if the output is full.
+   * @returns false if closed
+   */
+  bool processCommands(const char* data, std::size_t size, std::size_t& consumed);
+
+  /** A v1 command, deserialized by its command */
+  struct V1Frame;
+
+  /**
+   * Executes the command `tag` of `frame`, constructed by `frame.command<Command>()`.
+   * @returns false if closed
+   */
+  template <typename Frame>
+  bool executeCommand(command::Tag tag, const Frame& frame);
+
+  /** Constructs `Command` of `frame`, runs it. Called by the dispatch table of `executeCommand` */
+  template <typename Command, typename Frame>
+  bool visit(const Frame& frame);
+
+  template <typename Signature, typename Visitor, typename CommandList>
+  friend class command::Table;
+
+  /** Commands modifying the store, without a response */
+  template <typename Command>
+  auto run(Command& input) -> decltype(input.execute(std::declval<Store&>()), bool());
+
+  /** Aggregates, responding their result */
+  template <typename Command>
+  auto run(Command& input)
+    -> decltype(input.execute(std::declval<const Store&>(), std::declval<command::ResultBuffer&>()), bool());
+
+  bool run(GetCommand& input);
+  bool run(MultiGetCommand& input);
+  bool run(SourceCommand& input);
+  bool run(HelloCommand& input);
+
+  /** Runs a command of the CommandRegistry, v1 only */
+  bool executeUnknown(command::Tag tag, const V1Frame& frame);
+  bool executeUnknown(command::Tag tag, const protocol::Frame& frame);
+
+  /**
+   * Runs the decoded v2 `_frame` on a worker, if it aggregates more than `offloadThreshold` bytes,
+   * on a snapshot of the values. `body` is the frame, after its size.
+   * @returns true if offloaded
+   */
+  bool offload(const char* body, std::size_t size);
+
+  /** Responds to the offloaded request `requestId`, on the dispatching thread */
+  void respondAsync(uint64_t requestId, const SetCommand& output);
+
+  /**
+   * Adds the response to the output queue, values shared by `owner`
+   * (e.g: Store values) are referenced, instead of copied
+   */
+  void respond(const SetCommand& output, std::shared_ptr<const char> owner = nullptr);
+
+  /** Appends a batch response, `owners[i]` keeps the value of the `i`th item alive */
+  void respond(const MultiSetCommand& output, const std::vector<std::shared_ptr<char>>& owners);
+
+  /** Responds to a HELLO in the current framing */
+  void respond(const HelloCommand& output);
+
+  /**
+   * Appends the serialized response `vectors`, in the framing of the connection.
+   * Values longer than `copyThreshold` are referenced, if `ownerOf(index)` of their vector is set.
+   */
+  template <typename OwnerOf>
+  void queueResponse(const iovec* vectors, std::size_t count, OwnerOf&& ownerOf);
+
+  /**
+   * Writes the output queue, watches EPOLLOUT until it is empty.
+   * Completion based: sends the queue, one send at a time.
+   * Pauses reading while the output is above the high-water mark.
+   */
+  bool flush();
+
+  /** @returns true, if reading should be paused until the output drains */
+  bool outputFull() const;
+
+  /** Starts sending the output queue, unless already sending */
+  void send();
+
+  /** Closes the connection, releases the buffers */
+  void close();
+
+  /** Responses up to this size are copied to the output queue */
+  static constexpr std::size_t copyThreshold = 256;
+
+  /** Reads per dispatch in edge triggered mode, before yielding to other handlers */
+  static constexpr std::size_t readBudget = 16;
+
+  /** Commands per dispatch, before yielding to other handlers */
+  static constexpr std::size_t commandBudget = 128;
+
+  /** Reading pauses above this much output, resumes below the low-water mark */
+  static constexpr std::size_t outputHighWater = 1 << 20;
+  static constexpr std::size_t outputLowWater = 1 << 18;
+
+  /** Aggregates of values larger than this run on a worker */
+  static constexpr std::size_t offloadThreshold = 1 << 20;
 
   Fd _socket;
   Store& _store;
-  FixBuffer _buffer;
-  ResponseWriter _writer;
+  Reactor& _reactor;
+  const Timeouts _timeouts;
+  std::chrono::steady_clock::time_point _lastActivity; // input read, or output written
+  std::chrono::steady_clock::time_point _partialSince; // the partial command started
+  bool _partial; // a partial command is buffered
+  PooledBuffer _buffer;
+  std::size_t _pendingSize; // of the partially received command
+  std::size_t _executed; // commands of this dispatch
+  bool _throttled; // commands left in the input buffer
+  OutputQueue _output;
+  bool _waitingOutput;
+  bool _paused; // not reading, the output is full
+
+  protocol::Version _version; // negotiated by HELLO
+  uint64_t _requestId; // of the executed v2 request, returned by its response
+  protocol::Frame _frame; // decoded v2 request
+  std::vector<char> _responseScratch; // varints of the v2 response
+  std::vector<char> _libraryResponse; // value of a CommandRegistry command
+
+  WorkerPool* _pWorkers;
+  std::shared_ptr<CommandHandler*> _self; // reset when closed, the offloaded responses are dropped
+
+  // completion based send in progress, refers to the output queue
+  bool _sending;
+  msghdr _message;
+  std::vector<iovec> _sendVector;
+
+  std::vector<iovec> _responseVector; // of batch responses
 };
 
 } // namespace kvs
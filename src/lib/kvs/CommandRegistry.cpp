@@ -0,0 +1,33 @@
+#include <kvs/CommandRegistry.hpp>
+
+namespace kvs {
+
+constexpr uint16_t CommandRegistry::firstTag;
+
+CommandRegistry& CommandRegistry::instance()
+{
+  static CommandRegistry registry;
+  return registry;
+}
+
+bool CommandRegistry::add(command::Tag tag, Execute execute, Replay replay)
+{
+  if (uint16_t(tag) < firstTag || ! execute) { return false; }
+
+  std::lock_guard<std::mutex> lock(_mutex);
+  _entries[uint16_t(tag)] = Entry{execute, replay};
+  return true;
+}
+
+bool CommandRegistry::find(command::Tag tag, Entry& entry) const
+{
+  std::lock_guard<std::mutex> lock(_mutex);
+
+  auto finder = _entries.find(uint16_t(tag));
+  if (finder == _entries.end()) { return false; }
+
+  entry = finder->second;
+  return true;
+}
+
+} // namespace kvs
@@ -0,0 +1,64 @@
+#ifndef KVS_COMMANDREGISTRY_HPP_
+#define KVS_COMMANDREGISTRY_HPP_
+
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include <kvs/Command.hpp>
+
+namespace kvs {
+
+class Store;
+
+/**
+ * Commands of shared libraries, registered by their `kvs_commands(CommandRegistry&)`,
+ * called by SOURCE. The server also loads libraries before the persistent store,
+ * so their logged commands are replayed.
+ *
+ * Registered commands are v1 frames: [command::Size][command::Tag][payload],
+ * the builtin commands are dispatched first.
+ */
+class CommandRegistry
+{
+public:
+  /** Tags of the libraries start here, the ones below are reserved for the builtin commands */
+  static constexpr uint16_t firstTag = 0x100;
+
+  /**
+   * Runs a command of the frame at `buffer`, after its size (see the deserialize constructors).
+   * A serialized value set to `response` is responded as a SET of an empty key.
+   * Logged commands write their frame to the persistent store by Store::writePersStore.
+   * Throwing std::runtime_error closes the connection.
+   */
+  typedef void (*Execute)(Store& store, const char* buffer, command::Size size, std::vector<char>& response);
+
+  /** Applies a command of the persistent store, the frame at `buffer` is after its size */
+  typedef void (*Replay)(Store& store, const char* buffer, command::Size size);
+
+  struct Entry
+  {
+    Execute execute;
+    Replay replay; // nullptr, if not logged
+  };
+
+  static CommandRegistry& instance();
+
+  /**
+   * Registers the command `tag`, replacing the earlier registration of `tag`.
+   * @returns false, if `tag` is reserved
+   */
+  bool add(command::Tag tag, Execute execute, Replay replay = nullptr);
+
+  /** Sets `entry` to the command `tag`, @returns false if not registered */
+  bool find(command::Tag tag, Entry& entry) const;
+
+private:
+  mutable std::mutex _mutex; // SOURCE registers while other servers of the process dispatch
+  std::unordered_map<uint16_t, Entry> _entries;
+};
+
+} // namespace kvs
+
+#endif // KVS_COMMANDREGISTRY_HPP_
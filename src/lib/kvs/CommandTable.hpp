@@ -0,0 +1,127 @@
+#ifndef KVS_COMMANDTABLE_HPP_
+#define KVS_COMMANDTABLE_HPP_
+
+#include <cstddef>
+
+#include <kvs/Command.hpp>
+
+namespace kvs {
+namespace command {
+
+/** A list of command types */
+template <typename... Commands>
+struct List {};
+
+typedef List<
+  GetCommand, SetCommand, PushCommand, PopCommand, SumCommand, MaxCommand, MinCommand,
+  SourceCommand, ExecuteCommand, ArithmeticCommand, ScaleCommand, DotCommand, NormCommand,
+  QueryCommand, MultiGetCommand, MultiSetCommand, MultiPushCommand, HelloCommand
+> Builtins;
+
+/** Commands written to the persistent store, replayed when it is loaded */
+typedef List<
+  SetCommand, PushCommand, PopCommand, ArithmeticCommand, ScaleCommand, MultiSetCommand, MultiPushCommand
+> Logged;
+
+/** Commands reading the store only, responding a single computed value */
+typedef List<SumCommand, MaxCommand, MinCommand, DotCommand, NormCommand, QueryCommand> Aggregates;
+
+namespace detail {
+
+template <std::size_t... I>
+struct Indices {};
+
+template <std::size_t N, std::size_t... I>
+struct MakeIndices : MakeIndices<N - 1, N - 1, I...> {};
+
+template <std::size_t... I>
+struct MakeIndices<0, I...> { typedef Indices<I...> type; };
+
+template <typename... Commands>
+struct MaxTag { static constexpr std::size_t value = 0; };
+
+template <typename Command, typename... Rest>
+struct MaxTag<Command, Rest...>
+{
+  static constexpr std::size_t value = (std::size_t(Command::tag) > MaxTag<Rest...>::value)
+    ? std::size_t(Command::tag) : MaxTag<Rest...>::value;
+};
+
+template <Tag tag, typename... Commands>
+struct Contains { static constexpr bool value = false; };
+
+template <Tag tag, typename Command, typename... Rest>
+struct Contains<tag, Command, Rest...>
+{
+  static constexpr bool value = Command::tag == tag || Contains<tag, Rest...>::value;
+};
+
+template <typename... Commands>
+struct Distinct { static constexpr bool value = true; };
+
+template <typename Command, typename... Rest>
+struct Distinct<Command, Rest...>
+{
+  static constexpr bool value = ! Contains<Command::tag, Rest...>::value && Distinct<Rest...>::value;
+};
+
+} // namespace detail
+
+/**
+ * Dispatch table of the commands of a List, indexed by their tags,
+ * generated at compile time, instead of a switch over the tags.
+ *
+ * `find(tag)(visitor, args...)` calls `visitor.template visit<Command>(args...)`
+ * of the command of `tag`, `Signature` is the signature of `visit`.
+ */
+template <typename Signature, typename Visitor, typename CommandList>
+class Table;
+
+template <typename Result, typename... Args, typename Visitor, typename... Commands>
+class Table<Result(Args...), Visitor, List<Commands...>>
+{
+  static_assert(detail::Distinct<Commands...>::value, "Commands of a Table must have distinct tags");
+
+public:
+  typedef Result (*Entry)(Visitor& visitor, Args... args);
+
+  /** @returns the entry of `tag`, nullptr if the list has no such command */
+  static Entry find(Tag tag)
+  {
+    return find(tag, typename detail::MakeIndices<size>::type());
+  }
+
+private:
+  static constexpr std::size_t size = detail::MaxTag<Commands...>::value + 1;
+
+  template <typename Command>
+  static Result call(Visitor& visitor, Args... args)
+  {
+    return visitor.template visit<Command>(args...);
+  }
+
+  /** The entry of the tag `Index` */
+  template <std::size_t Index, typename... Rest>
+  struct Lookup { static constexpr Entry value = nullptr; };
+
+  template <std::size_t Index, typename Command, typename... Rest>
+  struct Lookup<Index, Command, Rest...>
+  {
+    static constexpr Entry value = (std::size_t(Command::tag) == Index)
+      ? &Table::template call<Command> : Lookup<Index, Rest...>::value;
+  };
+
+  template <std::size_t... I>
+  static Entry find(Tag tag, detail::Indices<I...>)
+  {
+    static constexpr Entry entries[] = { Lookup<I, Commands...>::value... };
+
+    const std::size_t index = std::size_t(tag);
+    return (index < size) ? entries[index] : nullptr;
+  }
+};
+
+} // namespace command
+} // namespace kvs
+
+#endif // KVS_COMMANDTABLE_HPP_
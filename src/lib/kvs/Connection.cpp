@@ -1,24 +1,26 @@
+#include <algorithm>
 #include <stdio.h>
+#include <errno.h>
+#include <limits.h> // IOV_MAX
 #include <sys/socket.h>
 #include <arpa/inet.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h> // TCP_NODELAY
 
 #include <kvs/Connection.hpp>
+#include <kvs/Shm.hpp>
+#include <kvs/UnixSocket.hpp>
 
 namespace kvs {
 
-Connection::Connection(const char* serverIp, int serverPort)
+Connection::Connection(const char* serverIp, int serverPort, protocol::Version version)
+  :_input(inputPool())
 {
   sockaddr_in serverAddr;
 
-  if (! (_serverConn = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP)))
-  {
-    failure("Connection socket");
-  }
-
   // Setup address
   memset(&serverAddr, 0, sizeof(serverAddr));
   serverAddr.sin_family = AF_INET; // IP
@@ -29,10 +31,67 @@ Connection::Connection(const char* serverIp, int serverPort)
     failure("Connection inet_aton");
   }
 
-  if (connect(*_serverConn, reinterpret_cast<sockaddr*>(&serverAddr), sizeof(serverAddr)) < 0)
+  connectTo(PF_INET, reinterpret_cast<sockaddr*>(&serverAddr), sizeof(serverAddr), version);
+}
+
+Connection::Connection(const std::string& path, protocol::Version version)
+  :_input(inputPool())
+{
+  sockaddr_un serverAddr;
+  const socklen_t serverAddrSize = unixAddress(path, serverAddr);
+
+  connectTo(PF_UNIX, reinterpret_cast<sockaddr*>(&serverAddr), serverAddrSize, version);
+}
+
+Connection::Connection(const Shm& shm, protocol::Version version)
+  :_shm(new ShmChannel(shm.path, shm.spin)),
+   _input(inputPool())
+{
+  negotiate(version);
+}
+
+constexpr std::size_t Connection::sendQueueLimit;
+constexpr std::size_t Connection::maxPending;
+constexpr std::size_t Connection::inputSize;
+
+Connection::~Connection() = default;
+
+BufferPool& Connection::inputPool()
+{
+  static BufferPool pool;
+  return pool;
+}
+
+void Connection::connectTo(int domain, const sockaddr* address, socklen_t addressSize, protocol::Version version)
+{
+  if (! (_serverConn = socket(domain, SOCK_STREAM, 0)))
+  {
+    failure("Connection socket");
+  }
+
+  if (connect(*_serverConn, address, addressSize) < 0)
   {
     failure("Connection connect");
   }
+
+  // requests are sent when flushed, waiting for more is pointless
+  if (domain == PF_INET)
+  {
+    int nodelay = 1;
+    setsockopt(*_serverConn, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+  }
+
+  negotiate(version);
+}
+
+void Connection::negotiate(protocol::Version version)
+{
+  if (version != protocol::Version::v1)
+  {
+    // the response is in v1 framing, the connection switches after it
+    sendCommand(HelloCommand(uint8_t(version)));
+    _version = protocol::Version(recvCommand<HelloCommand>().version());
+  }
 }
 
 void Connection::pop(const Key& key)
@@ -41,6 +100,204 @@ void Connection::pop(const Key& key)
   sendCommand(req);
 }
 
+void Connection::add(const Key& destination, const Key& lhs, const Key& rhs)
+{
+  ArithmeticCommand req(command::Arithmetic::ADD, destination, lhs, rhs);
+  sendCommand(req);
+}
+
+void Connection::subtract(const Key& destination, const Key& lhs, const Key& rhs)
+{
+  ArithmeticCommand req(command::Arithmetic::SUBTRACT, destination, lhs, rhs);
+  sendCommand(req);
+}
+
+void Connection::multiply(const Key& destination, const Key& lhs, const Key& rhs)
+{
+  ArithmeticCommand req(command::Arithmetic::MULTIPLY, destination, lhs, rhs);
+  sendCommand(req);
+}
+
+void Connection::writeVector(iovec* vec, std::size_t count)
+{
+  if (_shm)
+  {
+    _shm->write(vec, count);
+    return;
+  }
+
+  while (count)
+  {
+    ssize_t wsize = writev(*_serverConn, vec, int(std::min<std::size_t>(count, IOV_MAX)));
+    if (wsize < 0)
+    {
+      if (errno == EINTR) { continue; }
+      failure("Connection writev");
+    }
+
+    // skip the written vectors, continue the partially written one
+    while (count && std::size_t(wsize) >= vec->iov_len)
+    {
+      wsize -= vec->iov_len;
+      ++vec;
+      --count;
+    }
+
+    if (wsize)
+    {
+      vec->iov_base = static_cast<char*>(vec->iov_base) + wsize;
+      vec->iov_len -= wsize;
+    }
+  }
+}
+
+std::size_t Connection::recvSome(char* data, std::size_t size)
+{
+  if (_shm) { return _shm->readSome(data, size); }
+
+  ssize_t rsize;
+  do { rsize = read(*_serverConn, data, size); } while (rsize < 0 && errno == EINTR);
+
+  if (rsize <= 0) { failure("Connection recv"); }
+  return std::size_t(rsize);
+}
+
+uint64_t Connection::nextRequestId(std::function<void(const SetCommand&)> handler)
+{
+  auto lock = lockPending();
+
+  // between asynchronous requests, keeps the ids of `_pending` contiguous
+  if (handler || ! _pending.empty())
+  {
+    if (_pending.empty()) { _firstPending = _requestId + 1; }
+    _pending.emplace_back();
+  }
+
+  if (handler)
+  {
+    _pending.back().handler = std::move(handler);
+    ++_pendingCount;
+  }
+
+  return ++_requestId;
+}
+
+void Connection::sendFrame(const iovec* vectors, std::size_t count)
+{
+  // after the queued requests, by a single write
+  if (! _sendQueue.empty())
+  {
+    queueFrame(vectors, count);
+    flush();
+    return;
+  }
+
+  _frameVector.clear();
+  protocol::encode(nextRequestId(nullptr), vectors, count, _frameScratch, [this](const iovec& vec, std::size_t) {
+    _frameVector.push_back(vec);
+  });
+
+  writeVector(_frameVector.data(), _frameVector.size());
+}
+
+void Connection::queueFrame(const iovec* vectors, std::size_t count, std::function<void(const SetCommand&)> handler)
+{
+  protocol::encode(nextRequestId(std::move(handler)), vectors, count, _frameScratch, [this](const iovec& vec, std::size_t) {
+    const char* data = static_cast<const char*>(vec.iov_base);
+    _sendQueue.insert(_sendQueue.end(), data, data + vec.iov_len);
+  });
+}
+
+void Connection::flush()
+{
+  if (_sendQueue.empty()) { return; }
+
+  iovec vec{_sendQueue.data(), _sendQueue.size()};
+  writeVector(&vec, 1);
+
+  _sendQueue.clear();
+}
+
+void Connection::fill(std::size_t size)
+{
+  if (! _input.capacity()) { _input.reserve(inputSize); }
+
+  while (_input.readAvailable() < size)
+  {
+    _input.reserve(size - _input.readAvailable());
+    _input.doneWrite(recvSome(_input.write(), _input.writeAvailable()));
+  }
+}
+
+void Connection::recvFrame()
+{
+  uint64_t bodySize = 0;
+  std::size_t headerSize = 0;
+
+  // the frame might be shorter than the longest varint
+  while ((headerSize = protocol::readVarint(_input.read(), _input.readAvailable(), bodySize)) == 0)
+  {
+    if (_input.readAvailable() >= protocol::maxVarintSize) { failure("Connection: invalid frame size received"); }
+    fill(_input.readAvailable() + 1);
+  }
+
+  if (bodySize > command::maxSize - headerSize) { failure("Connection: invalid frame size received"); }
+  fill(headerSize + bodySize);
+
+  // refers to the input buffer, until the next receive
+  if (! protocol::decode(_input.read() + headerSize, bodySize, _frame)) { failure("Connection: invalid frame received"); }
+  _input.doneRead(headerSize + bodySize);
+}
+
+void Connection::dispatchResponse()
+{
+  std::function<void(const SetCommand&)> handler;
+  {
+    auto lock = lockPending();
+
+    const uint64_t index = _frame.requestId - _firstPending;
+    if (_frame.requestId < _firstPending || index >= _pending.size() || ! _pending[index].handler)
+    {
+      failure("Connection: response of an unexpected request");
+    }
+
+    // the handler might send further requests
+    handler = std::move(_pending[index].handler);
+    _pending[index].handler = nullptr;
+    --_pendingCount;
+
+    // answered and synchronous requests of the front
+    while (! _pending.empty() && ! _pending.front().handler)
+    {
+      _pending.pop_front();
+      ++_firstPending;
+    }
+  }
+
+  handler(_frame.command<SetCommand>());
+}
+
+void Connection::receiveResponse()
+{
+  flush();
+  recvFrame();
+  dispatchResponse();
+}
+
+void Connection::sync()
+{
+  while (_pendingCount) { receiveResponse(); }
+}
+
+bool Connection::alive() const
+{
+  if (_shm) { return ! _shm->closed(); }
+
+  char byte;
+  const ssize_t rsize = recv(*_serverConn, &byte, sizeof(byte), MSG_PEEK | MSG_DONTWAIT);
+  return rsize > 0 || (rsize < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR));
+}
+
 void Connection::source(const Key& key)
 {
   SourceCommand req(key);
@@ -1,38 +1,93 @@
 #ifndef KVS_CONNECTION_HPP_
 #define KVS_CONNECTION_HPP_
 
+#include <cstring> // memcpy
+#include <deque>
+#include <functional>
 #include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <utility>
 
 #include <sys/uio.h> // writev
 #include <sys/socket.h> // recv
 
 #include <boost/utility/string_ref.hpp>
+#include <boost/optional.hpp>
 
+#include <kvs/BufferPool.hpp>
 #include <kvs/Fd.hpp>
 #include <kvs/Error.hpp>
 #include <kvs/Command.hpp>
+#include <kvs/Protocol.hpp>
 #include <kvs/Value.hpp>
+#include <kvs/Query.hpp>
 
 namespace kvs {
 
+class ShmChannel;
+
 class Connection
 {
 public:
   typedef boost::string_ref Key;
 
-  Connection(const char* serverIp, int serverPort);
+  /** A ShmListener, at a unix socket */
+  struct Shm
+  {
+    explicit Shm(std::string path, std::size_t spin = 0) :path(std::move(path)), spin(spin) {}
+
+    std::string path;
+    std::size_t spin; // polls of the response ring, before sleeping
+  };
+
+  /**
+   * Requests `version` of the protocol by a HELLO, unless v1,
+   * the server might accept an earlier version: see `version()`
+   */
+  Connection(const char* serverIp, int serverPort, protocol::Version version = protocol::Version::v1);
+
+  /** Connects to the unix socket `path`, in the abstract namespace if it starts with '@' */
+  explicit Connection(const std::string& path, protocol::Version version = protocol::Version::v1);
+
+  /** Connects by shared memory, requests and responses bypass the kernel */
+  explicit Connection(const Shm& shm, protocol::Version version = protocol::Version::v1);
+
+  ~Connection();
+
+  protocol::Version version() const { return _version; }
 
   template <typename Field>
   bool get(const Key& key, Field& result);
 
+  /**
+   * @param layout list layout of the value, compressed layouts
+   * (ValueTag::delta, ValueTag::packed) are kept by later PUSH and POP commands
+   */
   template <typename Field>
-  void set(const Key& key, const Field& value);
+  void set(const Key& key, const Field& value, ValueTag layout = ValueTag::aligned);
 
   template <typename Field>
-  void push(const Key& key, const Field& value);
+  void push(const Key& key, const Field& value, ValueTag layout = ValueTag::aligned);
 
   void pop(const Key& key);
 
+  /**
+   * Gets many keys by a single request: `results[i]` is the value of `keys[i]`,
+   * if found and a `Field`. @returns the number of such results
+   */
+  template <typename Field>
+  std::size_t mget(const std::vector<Key>& keys, std::vector<boost::optional<Field>>& results);
+
+  /** Sets many keys by a single request, logged by a single append */
+  template <typename Field>
+  void mset(const std::vector<std::pair<Key, Field>>& items, ValueTag layout = ValueTag::aligned);
+
+  /** Pushes to many keys by a single request, logged by a single append */
+  template <typename Field>
+  void mpush(const std::vector<std::pair<Key, Field>>& items, ValueTag layout = ValueTag::aligned);
+
   template <typename Field>
   bool sum(const Key& key, Field& result);
 
@@ -42,26 +97,276 @@ public:
   template <typename Field>
   bool min(const Key& key, Field& result);
 
+  /** destination = lhs + rhs, element-wise */
+  void add(const Key& destination, const Key& lhs, const Key& rhs);
+
+  /** destination = lhs - rhs, element-wise */
+  void subtract(const Key& destination, const Key& lhs, const Key& rhs);
+
+  /** destination = lhs * rhs, element-wise */
+  void multiply(const Key& destination, const Key& lhs, const Key& rhs);
+
+  /** destination = source * factor, `Scalar` must match the element type */
+  template <typename Scalar>
+  void scale(const Key& destination, const Key& source, const Scalar& factor);
+
+  template <typename Field>
+  bool dot(const Key& lhs, const Key& rhs, Field& result);
+
+  template <typename Field>
+  bool norm(const Key& key, Field& result);
+
+  /**
+   * Runs a filter-and-aggregate `query` over the list at `key`,
+   * COUNT results are uint64_t, others are of the element type
+   */
+  template <typename Field>
+  bool query(const Key& key, const Query& query, Field& result);
+
   void source(const Key& library);
 
   void execute(const Key& procedure);
 
+  /** Gets the result of an asynchronous request, if found and a `Field` */
+  template <typename Field>
+  using Callback = std::function<void(boost::optional<Field>)>;
+
+  /** Result of an asynchronous request, set when a later call receives the response */
+  template <typename Field>
+  class Future;
+
+  /**
+   * Asynchronous requests, of v2 connections only, pipelined: queued until `flush()`,
+   * the next synchronous request, or until the queue fills up.
+   * The callback is called, or the future is set, when a later call receives the response, e.g: `sync()`.
+   * Slow requests are answered when ready, after the responses of later requests.
+   * Requests still queued when the connection is destroyed are dropped.
+   */
+  template <typename Field>
+  void getAsync(const Key& key, Callback<Field> callback);
+
+  template <typename Field>
+  Future<Field> getAsync(const Key& key);
+
+  template <typename Field>
+  void sumAsync(const Key& key, Callback<Field> callback);
+
+  template <typename Field>
+  Future<Field> sumAsync(const Key& key);
+
+  template <typename Field>
+  void maxAsync(const Key& key, Callback<Field> callback);
+
+  template <typename Field>
+  Future<Field> maxAsync(const Key& key);
+
+  template <typename Field>
+  void minAsync(const Key& key, Callback<Field> callback);
+
+  template <typename Field>
+  Future<Field> minAsync(const Key& key);
+
+  template <typename Field>
+  void dotAsync(const Key& lhs, const Key& rhs, Callback<Field> callback);
+
+  template <typename Field>
+  Future<Field> dotAsync(const Key& lhs, const Key& rhs);
+
+  template <typename Field>
+  void normAsync(const Key& key, Callback<Field> callback);
+
+  template <typename Field>
+  Future<Field> normAsync(const Key& key);
+
+  template <typename Field>
+  void queryAsync(const Key& key, const Query& query, Callback<Field> callback);
+
+  template <typename Field>
+  Future<Field> queryAsync(const Key& key, const Query& query);
+
+  /** Sends the queued requests, by a single write */
+  void flush();
+
+  /** Flushes, receives the responses of the asynchronous requests, calls their callbacks */
+  void sync();
+
+  /** Same as `sync()` */
+  void wait() { sync(); }
+
+  /** @returns the number of asynchronous requests not answered yet */
+  std::size_t pending() const
+  {
+    auto lock = lockPending();
+    return _pendingCount;
+  }
+
+  /**
+   * @returns false, if the server closed the connection, does not block.
+   * Meaningful while no response is pending: unread responses count as alive
+   */
+  bool alive() const;
+
+  /** Queued requests are flushed above this size */
+  static constexpr std::size_t sendQueueLimit = 1 << 16;
+
+  /**
+   * Asynchronous requests receive responses above this number of pending ones:
+   * the unanswered requests fit in the transport, the client is not blocked writing
+   * while the server is blocked by the unread responses
+   */
+  static constexpr std::size_t maxPending = 4096;
+
 private:
+  friend class ConnectionPool; // pipelines the requests of many threads
+
+  /** Connects `_serverConn` of `domain` to `address`, negotiates `version` */
+  void connectTo(int domain, const sockaddr* address, socklen_t addressSize, protocol::Version version);
+
+  /** Requests `version` by a HELLO, unless v1 */
+  void negotiate(protocol::Version version);
+
   template <typename Command>
   void sendCommand(const Command& command);
 
   template <typename Command>
   Command recvCommand();
 
+  /** Queues `command`, its response is passed to `callback` */
+  template <typename Field, typename Command>
+  void sendAsync(const Command& command, Callback<Field> callback);
+
+  /** Queues `command`, its response sets the returned future */
+  template <typename Field, typename Command>
+  Future<Field> sendAsync(const Command& command);
+
+  /** Queues `command` as a v2 frame, its response is passed to `handler` */
+  template <typename Command>
+  void queueAsync(const Command& command, std::function<void(const SetCommand&)> handler);
+
+  /** Same as `queueAsync`, without receiving above `maxPending` and without flushing */
+  template <typename Command>
+  void queueRequest(const Command& command, std::function<void(const SetCommand&)> handler);
+
+  /** @returns the value of `response`, if a `Field` */
+  template <typename Field>
+  static boost::optional<Field> field(const SetCommand& response);
+
+  /** Serializes the values of `items` to the send buffer, adds them to `batch` */
+  template <typename Batch, typename Field>
+  void addItems(const std::vector<std::pair<Key, Field>>& items, ValueTag layout, Batch& batch);
+
+  /** Sends a command of any number of vectors */
+  template <typename Command>
+  void sendBatch(const Command& command);
+
+  /** Writes all of `vec`, modifies it */
+  void writeVector(iovec* vec, std::size_t count);
+
+  /** Receives at least one, at most `size` bytes to `data`, fails on error. @returns the received size */
+  std::size_t recvSome(char* data, std::size_t size);
+
+  /** Receives to `_input` until `size` bytes are readable, as many as available by each recv */
+  void fill(std::size_t size);
+
+  /** Input buffers of the connections */
+  static BufferPool& inputPool();
+
+  /** @returns the next v2 request id, its response is passed to `handler`, if set */
+  uint64_t nextRequestId(std::function<void(const SetCommand&)> handler);
+
+  /** Sends the v1 serialized `vectors` as a v2 frame of the next request id, after the queued ones */
+  void sendFrame(const iovec* vectors, std::size_t count);
+
+  /**
+   * Copies the v1 serialized `vectors` as a v2 frame of the next request id to the send queue,
+   * its response is passed to `handler`, if set
+   */
+  void queueFrame(const iovec* vectors, std::size_t count, std::function<void(const SetCommand&)> handler = nullptr);
+
+  /** Receives a v2 response to `_frame`, refers to `_input` */
+  void recvFrame();
+
+  /** Passes the received `_frame` to the callback of its request */
+  void dispatchResponse();
+
+  /** Flushes, receives and dispatches a response of an asynchronous request */
+  void receiveResponse();
+
+  /** Locks `_pendingMutex`, if set */
+  std::unique_lock<std::mutex> lockPending() const
+  {
+    return _pendingMutex ? std::unique_lock<std::mutex>(*_pendingMutex) : std::unique_lock<std::mutex>();
+  }
+
+  /** An asynchronous request, or a synchronous one between them: without handler */
+  struct Pending
+  {
+    std::function<void(const SetCommand&)> handler; // reset when answered
+  };
+
+  /** Initial size of the input buffer, grows for larger frames */
+  static constexpr std::size_t inputSize = 1 << 16;
+
   Fd _serverConn;
+  std::unique_ptr<ShmChannel> _shm; // replaces the socket, if set
+
+  protocol::Version _version = protocol::Version::v1;
+  uint64_t _requestId = 0; // of the last v2 request
+  protocol::Frame _frame; // received v2 response
+  std::vector<char> _frameScratch;
+  std::vector<iovec> _frameVector;
+
+  std::vector<char> _sendQueue; // encoded v2 frames, not sent yet
 
-  std::size_t _recvBufferSize = 0;
-  std::unique_ptr<char[]> _recvBuffer;
+  // responses are parsed where received, many of them by a single recv.
+  // Mirrored: frames wrapping around are contiguous, never moved
+  PooledBuffer _input;
+
+  // by request id: requests are answered mostly in order, the front is dropped when answered
+  std::deque<Pending> _pending;
+  uint64_t _firstPending = 0; // request id of `_pending.front()`
+  std::size_t _pendingCount = 0; // with handler
+
+  // set if the requests are sent and received by different threads: see ConnectionPool.
+  // Guards the pending requests and `_requestId` only, never held while blocked
+  std::unique_ptr<std::mutex> _pendingMutex;
 
   std::size_t _sendBufferSize = 0;
   std::unique_ptr<char[]> _sendBuffer;
 };
 
+template <typename Field>
+class Connection::Future
+{
+public:
+  /** @returns true, if the response is received */
+  bool ready() const { return _state->ready; }
+
+  /** Flushes, receives responses until this one. @returns the result, if found and a `Field` */
+  boost::optional<Field> get()
+  {
+    while (! _state->ready) { _pConnection->receiveResponse(); }
+    return _state->result;
+  }
+
+private:
+  friend class Connection;
+
+  struct State
+  {
+    bool ready = false;
+    boost::optional<Field> result;
+  };
+
+  explicit Future(Connection& connection)
+    :_pConnection(&connection),
+     _state(std::make_shared<State>())
+  {}
+
+  Connection* _pConnection;
+  std::shared_ptr<State> _state;
+};
+
 template <typename Field>
 bool Connection::get(const Key& key, Field& result)
 {
@@ -81,16 +386,16 @@ bool Connection::get(const Key& key, Field& result)
 }
 
 template <typename Field>
-void Connection::set(const Key& key, const Field& value)
+void Connection::set(const Key& key, const Field& value, ValueTag layout)
 {
-  auto serSize = value::serializedSize(value);
+  auto serSize = value::serializedSize(value, layout);
   if (_sendBufferSize < serSize)
   {
     _sendBufferSize = serSize;
     _sendBuffer.reset(new char[_sendBufferSize]);
   }
 
-  value::serialize(value, _sendBuffer.get());
+  value::serialize(value, _sendBuffer.get(), layout);
 
   SetCommand req(key, serSize, _sendBuffer.get());
   sendCommand(req);
@@ -98,21 +403,66 @@ void Connection::set(const Key& key, const Field& value)
 
 
 template <typename Field>
-void Connection::push(const Key& key, const Field& value)
+void Connection::push(const Key& key, const Field& value, ValueTag layout)
 {
-  auto serSize = value::serializedSize(value);
+  auto serSize = value::serializedSize(value, layout);
   if (_sendBufferSize < serSize)
   {
     _sendBufferSize = serSize;
     _sendBuffer.reset(new char[_sendBufferSize]);
   }
 
-  value::serialize(value, _sendBuffer.get());
+  value::serialize(value, _sendBuffer.get(), layout);
 
   PushCommand req(key, serSize, _sendBuffer.get());
   sendCommand(req);
 }
 
+template <typename Field>
+std::size_t Connection::mget(const std::vector<Key>& keys, std::vector<boost::optional<Field>>& results)
+{
+  MultiGetCommand req;
+  for (const Key& key : keys) { req.add(key); }
+  sendBatch(req);
+
+  MultiSetCommand resp = recvCommand<MultiSetCommand>();
+  if (resp.items().size() != keys.size()) { failure("Connection: invalid MGET response"); }
+
+  std::size_t found = 0;
+  results.assign(keys.size(), boost::none);
+
+  for (std::size_t i = 0; i < keys.size(); ++i)
+  {
+    auto value = resp.items()[i].value();
+    TypedValue tvalue = value::deserialize(value.first, value.second);
+
+    Field* pResult = boost::get<Field>(&tvalue);
+    if (pResult)
+    {
+      results[i] = std::move(*pResult);
+      ++found;
+    }
+  }
+
+  return found;
+}
+
+template <typename Field>
+void Connection::mset(const std::vector<std::pair<Key, Field>>& items, ValueTag layout)
+{
+  MultiSetCommand req;
+  addItems(items, layout, req);
+  sendBatch(req);
+}
+
+template <typename Field>
+void Connection::mpush(const std::vector<std::pair<Key, Field>>& items, ValueTag layout)
+{
+  MultiPushCommand req;
+  addItems(items, layout, req);
+  sendBatch(req);
+}
+
 template <typename Field>
 bool Connection::sum(const Key& key, Field& result)
 {
@@ -167,6 +517,209 @@ bool Connection::min(const Key& key, Field& result)
   return true;
 }
 
+template <typename Scalar>
+void Connection::scale(const Key& destination, const Key& source, const Scalar& factor)
+{
+  char serialized[sizeof(ValueTag) + sizeof(Scalar)];
+  value::serialize(factor, serialized);
+
+  ScaleCommand req(destination, source, value::serializedSize(factor), serialized);
+  sendCommand(req);
+}
+
+template <typename Field>
+bool Connection::dot(const Key& lhs, const Key& rhs, Field& result)
+{
+  DotCommand req(lhs, rhs);
+  sendCommand(req);
+
+  SetCommand resp = recvCommand<SetCommand>();
+
+  auto value = resp.value();
+  TypedValue tvalue = value::deserialize(value.first, value.second);
+
+  Field* pResult = boost::get<Field>(&tvalue);
+  if (!pResult) { return false; }
+
+  result = *pResult;
+  return true;
+}
+
+template <typename Field>
+bool Connection::norm(const Key& key, Field& result)
+{
+  NormCommand req(key);
+  sendCommand(req);
+
+  SetCommand resp = recvCommand<SetCommand>();
+
+  auto value = resp.value();
+  TypedValue tvalue = value::deserialize(value.first, value.second);
+
+  Field* pResult = boost::get<Field>(&tvalue);
+  if (!pResult) { return false; }
+
+  result = *pResult;
+  return true;
+}
+
+template <typename Field>
+bool Connection::query(const Key& key, const Query& query, Field& result)
+{
+  QueryCommand req(key, query.size(), query.data());
+  sendCommand(req);
+
+  SetCommand resp = recvCommand<SetCommand>();
+
+  auto value = resp.value();
+  TypedValue tvalue = value::deserialize(value.first, value.second);
+
+  Field* pResult = boost::get<Field>(&tvalue);
+  if (!pResult) { return false; }
+
+  result = *pResult;
+  return true;
+}
+
+template <typename Field>
+void Connection::getAsync(const Key& key, Callback<Field> callback)
+{
+  sendAsync(GetCommand(key), std::move(callback));
+}
+
+template <typename Field>
+Connection::Future<Field> Connection::getAsync(const Key& key)
+{
+  return sendAsync<Field>(GetCommand(key));
+}
+
+template <typename Field>
+void Connection::sumAsync(const Key& key, Callback<Field> callback)
+{
+  sendAsync(SumCommand(key), std::move(callback));
+}
+
+template <typename Field>
+Connection::Future<Field> Connection::sumAsync(const Key& key)
+{
+  return sendAsync<Field>(SumCommand(key));
+}
+
+template <typename Field>
+void Connection::maxAsync(const Key& key, Callback<Field> callback)
+{
+  sendAsync(MaxCommand(key), std::move(callback));
+}
+
+template <typename Field>
+Connection::Future<Field> Connection::maxAsync(const Key& key)
+{
+  return sendAsync<Field>(MaxCommand(key));
+}
+
+template <typename Field>
+void Connection::minAsync(const Key& key, Callback<Field> callback)
+{
+  sendAsync(MinCommand(key), std::move(callback));
+}
+
+template <typename Field>
+Connection::Future<Field> Connection::minAsync(const Key& key)
+{
+  return sendAsync<Field>(MinCommand(key));
+}
+
+template <typename Field>
+void Connection::dotAsync(const Key& lhs, const Key& rhs, Callback<Field> callback)
+{
+  sendAsync(DotCommand(lhs, rhs), std::move(callback));
+}
+
+template <typename Field>
+Connection::Future<Field> Connection::dotAsync(const Key& lhs, const Key& rhs)
+{
+  return sendAsync<Field>(DotCommand(lhs, rhs));
+}
+
+template <typename Field>
+void Connection::normAsync(const Key& key, Callback<Field> callback)
+{
+  sendAsync(NormCommand(key), std::move(callback));
+}
+
+template <typename Field>
+Connection::Future<Field> Connection::normAsync(const Key& key)
+{
+  return sendAsync<Field>(NormCommand(key));
+}
+
+template <typename Field>
+void Connection::queryAsync(const Key& key, const Query& query, Callback<Field> callback)
+{
+  sendAsync(QueryCommand(key, query.size(), query.data()), std::move(callback));
+}
+
+template <typename Field>
+Connection::Future<Field> Connection::queryAsync(const Key& key, const Query& query)
+{
+  return sendAsync<Field>(QueryCommand(key, query.size(), query.data()));
+}
+
+template <typename Field, typename Command>
+void Connection::sendAsync(const Command& command, Callback<Field> callback)
+{
+  queueAsync(command, [callback](const SetCommand& response) {
+    callback(field<Field>(response));
+  });
+}
+
+template <typename Field, typename Command>
+Connection::Future<Field> Connection::sendAsync(const Command& command)
+{
+  Future<Field> future(*this);
+  auto state = future._state;
+
+  queueAsync(command, [state](const SetCommand& response) {
+    state->result = field<Field>(response);
+    state->ready = true;
+  });
+
+  return future;
+}
+
+template <typename Command>
+void Connection::queueAsync(const Command& command, std::function<void(const SetCommand&)> handler)
+{
+  while (_pendingCount >= maxPending) { receiveResponse(); }
+
+  queueRequest(command, std::move(handler));
+
+  if (_sendQueue.size() >= sendQueueLimit) { flush(); }
+}
+
+template <typename Command>
+void Connection::queueRequest(const Command& command, std::function<void(const SetCommand&)> handler)
+{
+  // v1 responses have no request id
+  check(_version != protocol::Version::v1);
+
+  enum { vecSize = Command::serializedVectorSize };
+  iovec input[vecSize];
+  command::Size csize = 0;
+  command.serialize(input, csize);
+  queueFrame(input, vecSize, std::move(handler));
+}
+
+template <typename Field>
+boost::optional<Field> Connection::field(const SetCommand& response)
+{
+  auto value = response.value();
+  TypedValue tvalue = value::deserialize(value.first, value.second);
+
+  Field* pResult = boost::get<Field>(&tvalue);
+  return pResult ? boost::optional<Field>(std::move(*pResult)) : boost::none;
+}
+
 template <typename Command>
 void Connection::sendCommand(const Command& command)
 {
@@ -175,33 +728,83 @@ void Connection::sendCommand(const Command& command)
   command::Size csize = 0;
   command.serialize(input, csize);
 
-  ssize_t wsize = writev(*_serverConn, input, vecSize);
+  if (_version != protocol::Version::v1)
+  {
+    sendFrame(input, vecSize);
+    return;
+  }
+
+  writeVector(input, vecSize);
+}
+
+template <typename Batch, typename Field>
+void Connection::addItems(
+  const std::vector<std::pair<Key, Field>>& items, ValueTag layout, Batch& batch
+)
+{
+  std::size_t fullSize = 0;
+  for (auto&& item : items) { fullSize += value::serializedSize(item.second, layout); }
 
-  if (wsize < csize) { failure("Connection writev"); }
+  if (_sendBufferSize < fullSize)
+  {
+    _sendBufferSize = fullSize;
+    _sendBuffer.reset(new char[_sendBufferSize]);
+  }
+
+  char* serialized = _sendBuffer.get();
+  for (auto&& item : items)
+  {
+    const std::size_t serSize = value::serializedSize(item.second, layout);
+    value::serialize(item.second, serialized, layout);
+    batch.add(typename Batch::Item(item.first, serSize, serialized));
+    serialized += serSize;
+  }
 }
 
 template <typename Command>
-Command Connection::recvCommand()
+void Connection::sendBatch(const Command& command)
 {
+  std::vector<iovec> input(command.serializedVectorSize());
   command::Size csize = 0;
-  ssize_t rsize = recv(*_serverConn, &csize, sizeof(csize), MSG_WAITALL);
+  command.serialize(input.data(), csize);
 
-  if (rsize != sizeof(csize)) { failure("Connection header recv"); }
+  if (_version != protocol::Version::v1)
+  {
+    sendFrame(input.data(), input.size());
+    return;
+  }
+
+  writeVector(input.data(), input.size());
+}
 
-  if (csize > _recvBufferSize)
+template <typename Command>
+Command Connection::recvCommand()
+{
+  if (_version != protocol::Version::v1)
   {
-    _recvBufferSize = csize;
-    _recvBuffer.reset(new char[_recvBufferSize]);
+    // responses of asynchronous requests might arrive first
+    recvFrame();
+    while (_frame.requestId != _requestId)
+    {
+      dispatchResponse();
+      recvFrame();
+    }
+
+    return _frame.command<Command>();
   }
 
-  if (csize < sizeof(csize)) { failure("Connection: invalid cszie received //"); }
+  command::Size csize = 0;
+  fill(sizeof(csize));
+  memcpy(&csize, _input.read(), sizeof(csize));
 
-  const auto payloadSize = csize - sizeof(csize);
-  rsize = recv(*_serverConn, _recvBuffer.get(), payloadSize, MSG_WAITALL);
+  if (csize < sizeof(csize) || csize > command::maxSize) { failure("Connection: invalid cszie received //"); }
 
-  if (rsize != payloadSize) { failure("Connection body recv"); }
+  // refers to the input buffer, until the next receive
+  fill(csize);
+  const char* payload = _input.read() + sizeof(csize);
+  _input.doneRead(csize);
 
-  return Command{command::deserialize{}, _recvBuffer.get(), payloadSize};
+  return Command{command::deserialize{}, payload, csize - sizeof(csize)};
 }
 
 } // namespace kvs
@@ -0,0 +1,97 @@
+#include <unordered_map>
+
+#include <kvs/ConnectionPool.hpp>
+#include <kvs/Log.hpp>
+
+namespace kvs {
+
+namespace {
+
+std::atomic<uint64_t> g_nextPoolId(0);
+
+} // namespace
+
+ConnectionPool::ConnectionPool(Connect connect, std::size_t size, std::chrono::milliseconds healthInterval)
+  :_connect(std::move(connect)),
+   _size(size),
+   _healthInterval(healthInterval),
+   _id(g_nextPoolId++),
+   _slots(new Slot[size]),
+   _nextSlot(0),
+   _connects(0)
+{
+  check(_size > 0 && _connect);
+}
+
+ConnectionPool::~ConnectionPool() = default;
+
+void ConnectionPool::pop(const Key& key)
+{
+  send([&](Connection& connection) { connection.pop(key); });
+}
+
+ConnectionPool::Lease ConnectionPool::lease()
+{
+  Slot& s = slot();
+
+  std::unique_lock<std::mutex> recvLock(s.recvMutex);
+  std::unique_lock<std::mutex> sendLock(s.sendMutex);
+  Connection& c = connection(s, true);
+
+  return Lease(std::move(recvLock), std::move(sendLock), c);
+}
+
+ConnectionPool::Slot& ConnectionPool::slot()
+{
+  // by the id of the pool: addresses are reused by later pools
+  thread_local std::unordered_map<uint64_t, std::size_t> assigned;
+
+  auto inserted = assigned.emplace(_id, 0);
+  if (inserted.second) { inserted.first->second = _nextSlot++ % _size; }
+
+  return _slots[inserted.first->second];
+}
+
+Connection& ConnectionPool::connection(Slot& slot, bool receiving)
+{
+  const auto now = std::chrono::steady_clock::now();
+
+  // only if idle: no thread is receiving, or waits for a response of it
+  if (slot.connection && now - slot.lastCheck >= _healthInterval && slot.connection->pending() == 0)
+  {
+    std::unique_lock<std::mutex> recvLock(slot.recvMutex, std::defer_lock);
+    if (receiving || recvLock.try_lock())
+    {
+      slot.lastCheck = now;
+      if (! slot.connection->alive())
+      {
+        KVS_LOG_INFO << "ConnectionPool: closed by the server, reconnecting";
+        slot.connection.reset();
+      }
+    }
+  }
+
+  if (! slot.connection)
+  {
+    std::unique_ptr<Connection> connection = _connect();
+
+    // the requests of many threads are told apart by the request ids
+    check(connection && connection->version() != protocol::Version::v1);
+
+    // requested by the sending threads, answered by the receiving one
+    connection->_pendingMutex.reset(new std::mutex);
+
+    slot.connection = std::move(connection);
+    slot.lastCheck = now;
+    ++_connects;
+  }
+
+  return *slot.connection;
+}
+
+ConnectionPool::Lease::~Lease()
+{
+  if (_recvLock.owns_lock()) { _pConnection->sync(); }
+}
+
+} // namespace kvs
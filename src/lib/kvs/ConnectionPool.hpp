@@ -0,0 +1,250 @@
+#ifndef KVS_CONNECTIONPOOL_HPP_
+#define KVS_CONNECTIONPOOL_HPP_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+
+#include <kvs/Connection.hpp>
+
+namespace kvs {
+
+/**
+ * Connections shared by threads.
+ *
+ * Each thread is assigned to a connection at its first request, round robin,
+ * and keeps using it. The threads of a connection pipeline their requests over it:
+ * a request is queued and flushed, then the first waiting thread receives the
+ * responses of every thread, until its own arrives. The receiving thread does not
+ * wait for the sending ones: a large request is not blocked by the unread responses.
+ *
+ * Connections are made at their first use. An idle connection is checked
+ * at most every `healthInterval`, and replaced if the server closed it.
+ */
+class ConnectionPool
+{
+public:
+  typedef Connection::Key Key;
+
+  /** Makes a v2 connection to the server */
+  typedef std::function<std::unique_ptr<Connection>()> Connect;
+
+  /** Exclusive use of the connection of a thread, for any request, while held */
+  class Lease;
+
+  /**
+   * @param size number of connections, shared by the threads.
+   * Throws std::runtime_error if 0
+   */
+  ConnectionPool(Connect connect, std::size_t size, std::chrono::milliseconds healthInterval = std::chrono::seconds(1));
+
+  ~ConnectionPool();
+
+  ConnectionPool(const ConnectionPool&) = delete;
+  ConnectionPool& operator=(const ConnectionPool&) = delete;
+
+  std::size_t size() const { return _size; }
+
+  /** @returns the number of connections made so far, replacements included */
+  std::size_t connects() const { return _connects.load(); }
+
+  template <typename Field>
+  bool get(const Key& key, Field& result);
+
+  template <typename Field>
+  void set(const Key& key, const Field& value, ValueTag layout = ValueTag::aligned);
+
+  template <typename Field>
+  void push(const Key& key, const Field& value, ValueTag layout = ValueTag::aligned);
+
+  void pop(const Key& key);
+
+  template <typename Field>
+  bool sum(const Key& key, Field& result);
+
+  template <typename Field>
+  bool max(const Key& key, Field& result);
+
+  template <typename Field>
+  bool min(const Key& key, Field& result);
+
+  template <typename Field>
+  bool dot(const Key& lhs, const Key& rhs, Field& result);
+
+  template <typename Field>
+  bool norm(const Key& key, Field& result);
+
+  template <typename Field>
+  bool query(const Key& key, const Query& query, Field& result);
+
+  /**
+   * @returns the connection of the calling thread, the other threads of it wait meanwhile.
+   * Asynchronous requests are synced when released
+   */
+  Lease lease();
+
+private:
+  struct Slot
+  {
+    std::mutex recvMutex; // held by the receiving thread, locked first
+    std::mutex sendMutex; // held while queueing and sending, not needed to receive
+    std::unique_ptr<Connection> connection;
+    std::chrono::steady_clock::time_point lastCheck;
+  };
+
+  /** @returns the slot of the calling thread */
+  Slot& slot();
+
+  /**
+   * Connects `slot`, or replaces its connection if closed by the server.
+   * Called with `sendMutex` held, and `recvMutex` too, if `receiving`
+   */
+  Connection& connection(Slot& slot, bool receiving);
+
+  /** Pipelines `command`, waits for its response */
+  template <typename Field, typename Command>
+  bool request(const Command& command, Field& result);
+
+  /** Sends a request without response by `f(Connection&)` */
+  template <typename F>
+  void send(F&& f);
+
+  const Connect _connect;
+  const std::size_t _size;
+  const std::chrono::milliseconds _healthInterval;
+  const uint64_t _id; // of this pool, in the assignments of the threads
+  std::unique_ptr<Slot[]> _slots;
+  std::atomic<std::size_t> _nextSlot;
+  std::atomic<std::size_t> _connects;
+};
+
+class ConnectionPool::Lease
+{
+public:
+  /** Syncs the asynchronous requests */
+  ~Lease();
+
+  Lease(Lease&&) = default;
+
+  Connection& operator*() const { return *_pConnection; }
+  Connection* operator->() const { return _pConnection; }
+
+private:
+  friend class ConnectionPool;
+
+  Lease(std::unique_lock<std::mutex> recvLock, std::unique_lock<std::mutex> sendLock, Connection& connection)
+    :_recvLock(std::move(recvLock)),
+     _sendLock(std::move(sendLock)),
+     _pConnection(&connection)
+  {}
+
+  std::unique_lock<std::mutex> _recvLock;
+  std::unique_lock<std::mutex> _sendLock;
+  Connection* _pConnection;
+};
+
+template <typename Field>
+bool ConnectionPool::get(const Key& key, Field& result)
+{
+  return request(GetCommand(key), result);
+}
+
+template <typename Field>
+void ConnectionPool::set(const Key& key, const Field& value, ValueTag layout)
+{
+  send([&](Connection& connection) { connection.set(key, value, layout); });
+}
+
+template <typename Field>
+void ConnectionPool::push(const Key& key, const Field& value, ValueTag layout)
+{
+  send([&](Connection& connection) { connection.push(key, value, layout); });
+}
+
+template <typename Field>
+bool ConnectionPool::sum(const Key& key, Field& result)
+{
+  return request(SumCommand(key), result);
+}
+
+template <typename Field>
+bool ConnectionPool::max(const Key& key, Field& result)
+{
+  return request(MaxCommand(key), result);
+}
+
+template <typename Field>
+bool ConnectionPool::min(const Key& key, Field& result)
+{
+  return request(MinCommand(key), result);
+}
+
+template <typename Field>
+bool ConnectionPool::dot(const Key& lhs, const Key& rhs, Field& result)
+{
+  return request(DotCommand(lhs, rhs), result);
+}
+
+template <typename Field>
+bool ConnectionPool::norm(const Key& key, Field& result)
+{
+  return request(NormCommand(key), result);
+}
+
+template <typename Field>
+bool ConnectionPool::query(const Key& key, const Query& query, Field& result)
+{
+  return request(QueryCommand(key, query.size(), query.data()), result);
+}
+
+template <typename Field, typename Command>
+bool ConnectionPool::request(const Command& command, Field& result)
+{
+  Slot& s = slot();
+
+  // set by the receiving thread, while this one waits for `recvMutex`
+  boost::optional<Field> response;
+  bool ready = false;
+
+  Connection* pConnection;
+  {
+    std::lock_guard<std::mutex> lock(s.sendMutex);
+    pConnection = &connection(s, false);
+
+    // pending requests are bounded by the threads, each waits for its own
+    pConnection->queueRequest(command, [&response, &ready](const SetCommand& frame) {
+      response = Connection::field<Field>(frame);
+      ready = true;
+    });
+    pConnection->flush();
+  }
+
+  // not replaced while a response is pending
+  std::lock_guard<std::mutex> lock(s.recvMutex);
+  while (! ready)
+  {
+    pConnection->recvFrame();
+    pConnection->dispatchResponse();
+  }
+
+  if (! response) { return false; }
+
+  result = std::move(*response);
+  return true;
+}
+
+template <typename F>
+void ConnectionPool::send(F&& f)
+{
+  Slot& s = slot();
+
+  std::lock_guard<std::mutex> lock(s.sendMutex);
+  f(connection(s, false));
+}
+
+} // namespace kvs
+
+#endif // KVS_CONNECTIONPOOL_HPP_
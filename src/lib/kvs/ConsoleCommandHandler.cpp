@@ -247,8 +247,9 @@ const char* ConsoleCommandHandler::processCommand(const char* buffer, const char
       std::string key;
       if (! readKey(buffer, end, key)) { return nullptr; }
 
+      command::ResultBuffer buffer;
       SumCommand command(key);
-      SetCommand result = command.execute(_store);
+      SetCommand result = command.execute(_store, buffer);
 
       writeCommand(result, _out);
 
@@ -259,8 +260,9 @@ const char* ConsoleCommandHandler::processCommand(const char* buffer, const char
       std::string key;
       if (! readKey(buffer, end, key)) { return nullptr; }
 
+      command::ResultBuffer buffer;
       MaxCommand command(key);
-      SetCommand result = command.execute(_store);
+      SetCommand result = command.execute(_store, buffer);
 
       writeCommand(result, _out);
 
@@ -271,8 +273,9 @@ const char* ConsoleCommandHandler::processCommand(const char* buffer, const char
       std::string key;
       if (! readKey(buffer, end, key)) { return nullptr; }
 
+      command::ResultBuffer buffer;
       MinCommand command(key);
-      SetCommand result = command.execute(_store);
+      SetCommand result = command.execute(_store, buffer);
 
       writeCommand(result, _out);
 
@@ -0,0 +1,472 @@
+#ifndef KVS_ENCODING_HPP_
+#define KVS_ENCODING_HPP_
+
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <type_traits>
+
+#include <kvs/Kernel.hpp> // Wrapping
+
+namespace kvs {
+
+/**
+ * Compressed payloads of integer lists.
+ *
+ * Elements are processed as their 64 bit two's complement representation,
+ * which makes deltas and offsets well defined for every integer type.
+ * Decoders produce blocks of `blockSize` elements into caller provided
+ * (usually stack) buffers, so aggregates never materialize the whole list.
+ */
+namespace encoding {
+
+constexpr std::size_t blockSize = 128;
+
+template <typename T>
+uint64_t widen(T t)
+{
+  static_assert(std::is_integral<T>::value, "Only integer lists can be compressed");
+  return static_cast<uint64_t>(t);
+}
+
+inline uint64_t zigzag(uint64_t d)
+{
+  return (d << 1) ^ static_cast<uint64_t>(static_cast<int64_t>(d) >> 63);
+}
+
+inline uint64_t unzigzag(uint64_t z)
+{
+  return (z >> 1) ^ (~(z & 1) + 1);
+}
+
+inline std::size_t varintSize(uint64_t v)
+{
+  std::size_t size = 1;
+  while (v >= 0x80) { v >>= 7; ++size; }
+  return size;
+}
+
+inline char* putVarint(uint64_t v, char* out)
+{
+  while (v >= 0x80)
+  {
+    *out++ = static_cast<char>(v | 0x80);
+    v >>= 7;
+  }
+  *out++ = static_cast<char>(v);
+  return out;
+}
+
+/** @returns the position after the varint, or nullptr if truncated */
+inline const char* getVarint(const char* begin, const char* end, uint64_t& v)
+{
+  v = 0;
+  for (unsigned shift = 0; begin != end && shift < 64; shift += 7)
+  {
+    const uint8_t byte = static_cast<uint8_t>(*begin++);
+    v |= uint64_t(byte & 0x7F) << shift;
+    if ((byte & 0x80) == 0) { return begin; }
+  }
+  return nullptr;
+}
+
+//
+// Delta: zigzag varint of the difference to the previous element
+//
+
+template <typename T>
+std::size_t deltaSize(const T* data, uint64_t size)
+{
+  std::size_t result = 0;
+  uint64_t prev = 0;
+  for (uint64_t i = 0; i < size; ++i)
+  {
+    const uint64_t cur = widen(data[i]);
+    result += varintSize(zigzag(cur - prev));
+    prev = cur;
+  }
+  return result;
+}
+
+template <typename T>
+void deltaEncode(const T* data, uint64_t size, char* out)
+{
+  uint64_t prev = 0;
+  for (uint64_t i = 0; i < size; ++i)
+  {
+    const uint64_t cur = widen(data[i]);
+    out = putVarint(zigzag(cur - prev), out);
+    prev = cur;
+  }
+}
+
+template <typename T>
+class DeltaDecoder
+{
+public:
+  DeltaDecoder(const char* begin, const char* end, uint64_t size)
+    :_current(begin), _end(end), _left(size)
+  {}
+
+  /**
+   * Decodes the next at most `blockSize` elements to `block`.
+   * @returns the number of decoded elements, 0 at the end or on error
+   */
+  std::size_t next(T* block)
+  {
+    const std::size_t count = std::min<uint64_t>(_left, blockSize);
+    for (std::size_t i = 0; i < count; ++i)
+    {
+      uint64_t z;
+      _current = getVarint(_current, _end, z);
+      if (! _current) { _left = 0; _current = _end; return 0; }
+      _prev += unzigzag(z);
+      block[i] = static_cast<T>(_prev);
+    }
+    _left -= count;
+    return count;
+  }
+
+  bool done() const { return _left == 0; }
+
+  /** @returns the number of payload bytes not decoded yet */
+  std::size_t unread() const { return std::size_t(_end - _current); }
+
+private:
+  const char* _current;
+  const char* _end;
+  uint64_t _left;
+  uint64_t _prev = 0;
+};
+
+//
+// Packed: blocks of `blockSize` elements, each a BlockHeader
+// followed by the bit-packed offsets from the block minimum
+//
+
+struct BlockHeader
+{
+  uint64_t min;   // widened T
+  uint64_t max;   // widened T
+  uint8_t width;  // bits per offset
+  uint8_t padding[7];
+};
+
+static_assert(sizeof(BlockHeader) == 24, "BlockHeader must be 8 byte aligned");
+
+inline std::size_t packedWords(std::size_t count, unsigned width)
+{
+  return (count * width + 63) / 64;
+}
+
+template <typename T>
+void blockBounds(const T* data, std::size_t count, T& min, T& max)
+{
+  min = max = data[0];
+  for (std::size_t i = 1; i < count; ++i)
+  {
+    min = std::min(min, data[i]);
+    max = std::max(max, data[i]);
+  }
+}
+
+inline unsigned bitWidth(uint64_t v)
+{
+  return v ? 64 - __builtin_clzll(v) : 0;
+}
+
+template <typename T>
+std::size_t packedSize(const T* data, uint64_t size)
+{
+  std::size_t result = 0;
+  for (uint64_t i = 0; i < size; i += blockSize)
+  {
+    const std::size_t count = std::min<uint64_t>(size - i, blockSize);
+    T min, max;
+    blockBounds(data + i, count, min, max);
+    const unsigned width = bitWidth(widen(max) - widen(min));
+    result += sizeof(BlockHeader) + packedWords(count, width) * sizeof(uint64_t);
+  }
+  return result;
+}
+
+template <typename T>
+void packedEncode(const T* data, uint64_t size, char* out)
+{
+  uint64_t words[blockSize];
+
+  for (uint64_t i = 0; i < size; i += blockSize)
+  {
+    const std::size_t count = std::min<uint64_t>(size - i, blockSize);
+    const T* block = data + i;
+
+    BlockHeader header{};
+    T min, max;
+    blockBounds(block, count, min, max);
+    header.min = widen(min);
+    header.max = widen(max);
+    header.width = bitWidth(header.max - header.min);
+
+    const unsigned width = header.width;
+    const std::size_t wordCount = packedWords(count, width);
+    std::fill(words, words + wordCount, 0);
+
+    for (std::size_t j = 0; j < count && width; ++j)
+    {
+      const uint64_t offset = widen(block[j]) - header.min;
+      const std::size_t bit = j * width;
+      const unsigned shift = bit % 64;
+      words[bit / 64] |= offset << shift;
+      if (shift + width > 64) { words[bit / 64 + 1] |= offset >> (64 - shift); }
+    }
+
+    std::memcpy(out, &header, sizeof(header));
+    out += sizeof(header);
+    std::memcpy(out, words, wordCount * sizeof(uint64_t));
+    out += wordCount * sizeof(uint64_t);
+  }
+}
+
+template <typename T>
+class PackedDecoder
+{
+public:
+  PackedDecoder(const char* begin, const char* end, uint64_t size)
+    :_current(begin), _end(end), _left(size)
+  {}
+
+  /**
+   * Reads the header of the next block and skips its offsets.
+   * @returns the number of elements in the block, 0 at the end or on error
+   */
+  std::size_t nextHeader(BlockHeader& header)
+  {
+    const std::size_t count = std::min<uint64_t>(_left, blockSize);
+    if (count == 0 || std::size_t(_end - _current) < sizeof(header)) { return fail(); }
+
+    std::memcpy(&header, _current, sizeof(header));
+    const std::size_t wordsSize = packedWords(count, header.width) * sizeof(uint64_t);
+    if (header.width > 64 || std::size_t(_end - _current) - sizeof(header) < wordsSize)
+    {
+      return fail();
+    }
+
+    _words = _current + sizeof(header);
+    _current = _words + wordsSize;
+    _left -= count;
+    return count;
+  }
+
+  /**
+   * Decodes the offsets of the next block from the block minimum.
+   * @returns the number of elements in the block, 0 at the end or on error
+   */
+  std::size_t nextOffsets(BlockHeader& header, uint64_t* offsets)
+  {
+    const std::size_t count = nextHeader(header);
+    if (count == 0) { return 0; }
+
+    const unsigned width = header.width;
+
+    if (width == 0)
+    {
+      std::fill(offsets, offsets + count, 0);
+      return count;
+    }
+
+    uint64_t words[blockSize + 1];
+    const std::size_t wordCount = packedWords(count, width);
+    std::memcpy(words, _words, wordCount * sizeof(uint64_t));
+    words[wordCount] = 0;
+
+    const uint64_t mask = (width == 64) ? ~uint64_t(0) : (uint64_t(1) << width) - 1;
+
+    for (std::size_t j = 0; j < count; ++j)
+    {
+      const std::size_t bit = j * width;
+      const unsigned shift = bit % 64;
+      // bits from the next word are masked out, unless the offset spans two words
+      const uint64_t high = shift ? words[bit / 64 + 1] << (64 - shift) : 0;
+      offsets[j] = ((words[bit / 64] >> shift) | high) & mask;
+    }
+
+    return count;
+  }
+
+  /** Decodes the next block to `block`, @returns the number of elements */
+  std::size_t next(T* block)
+  {
+    BlockHeader header;
+    uint64_t offsets[blockSize];
+    const std::size_t count = nextOffsets(header, offsets);
+
+    for (std::size_t j = 0; j < count; ++j)
+    {
+      block[j] = static_cast<T>(header.min + offsets[j]);
+    }
+
+    return count;
+  }
+
+  bool done() const { return _left == 0; }
+
+  /** @returns the number of payload bytes not decoded yet */
+  std::size_t unread() const { return std::size_t(_end - _current); }
+
+private:
+  std::size_t fail()
+  {
+    _left = 0;
+    _current = _end;
+    return 0;
+  }
+
+  const char* _current;
+  const char* _end;
+  const char* _words = nullptr;
+  uint64_t _left;
+};
+
+//
+// Aggregates
+//
+
+template <typename T, typename Decoder>
+T sum(Decoder& decoder)
+{
+  typedef kernel::Wrapping<T> W;
+
+  T block[blockSize];
+  W result = 0;
+  while (std::size_t count = decoder.next(block))
+  {
+    for (std::size_t i = 0; i < count; ++i) { result = static_cast<W>(result + W(block[i])); }
+  }
+  return static_cast<T>(result);
+}
+
+template <typename T>
+T sum(PackedDecoder<T>& decoder)
+{
+  // sum = count * min + sum of the offsets, modulo 2^64 as T arithmetic wraps
+  BlockHeader header;
+  uint64_t offsets[blockSize];
+  uint64_t result = 0;
+  while (std::size_t count = decoder.nextOffsets(header, offsets))
+  {
+    result += count * header.min;
+    for (std::size_t i = 0; i < count; ++i) { result += offsets[i]; }
+  }
+  return static_cast<T>(result);
+}
+
+/** @returns false, if the list is empty */
+template <typename T, typename Decoder>
+bool min(Decoder& decoder, T& result)
+{
+  T block[blockSize];
+  bool found = false;
+  while (std::size_t count = decoder.next(block))
+  {
+    const T blockMin = *std::min_element(block, block + count);
+    result = found ? std::min(result, blockMin) : blockMin;
+    found = true;
+  }
+  return found;
+}
+
+template <typename T, typename Decoder>
+bool max(Decoder& decoder, T& result)
+{
+  T block[blockSize];
+  bool found = false;
+  while (std::size_t count = decoder.next(block))
+  {
+    const T blockMax = *std::max_element(block, block + count);
+    result = found ? std::max(result, blockMax) : blockMax;
+    found = true;
+  }
+  return found;
+}
+
+// packed block headers already hold the bounds, offsets are not decoded
+
+template <typename T>
+bool min(PackedDecoder<T>& decoder, T& result)
+{
+  BlockHeader header;
+  bool found = false;
+  while (decoder.nextHeader(header))
+  {
+    const T blockMin = static_cast<T>(header.min);
+    result = found ? std::min(result, blockMin) : blockMin;
+    found = true;
+  }
+  return found;
+}
+
+template <typename T>
+bool max(PackedDecoder<T>& decoder, T& result)
+{
+  BlockHeader header;
+  bool found = false;
+  while (decoder.nextHeader(header))
+  {
+    const T blockMax = static_cast<T>(header.max);
+    result = found ? std::max(result, blockMax) : blockMax;
+    found = true;
+  }
+  return found;
+}
+
+//
+// Validation: the aggregates above trust the payload, e.g: packed MIN/MAX
+// answer from the block headers, payloads from clients are checked once
+//
+
+/** @returns true, if the payload holds exactly `size` elements */
+template <typename T>
+bool valid(DeltaDecoder<T>& decoder, uint64_t size)
+{
+  T block[blockSize];
+  uint64_t decoded = 0;
+  while (std::size_t count = decoder.next(block)) { decoded += count; }
+  return decoded == size && decoder.unread() == 0;
+}
+
+/**
+ * @returns true, if the payload holds exactly `size` elements,
+ * and every block header matches the elements of its block
+ */
+template <typename T>
+bool valid(PackedDecoder<T>& decoder, uint64_t size)
+{
+  BlockHeader header;
+  uint64_t offsets[blockSize];
+  T block[blockSize];
+  uint64_t decoded = 0;
+  while (std::size_t count = decoder.nextOffsets(header, offsets))
+  {
+    for (std::size_t j = 0; j < count; ++j) { block[j] = static_cast<T>(header.min + offsets[j]); }
+
+    T min, max;
+    blockBounds(block, count, min, max);
+    if (
+       widen(min) != header.min
+    || widen(max) != header.max
+    || header.width != bitWidth(header.max - header.min)
+    )
+    {
+      return false;
+    }
+
+    decoded += count;
+  }
+  return decoded == size && decoder.unread() == 0;
+}
+
+} // namespace encoding
+
+} // namespace kvs
+
+#endif // KVS_ENCODING_HPP_
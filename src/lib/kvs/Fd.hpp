@@ -56,6 +56,14 @@ public:
     }
   }
 
+  /** @returns the fd, without closing it */
+  int release()
+  {
+    const int fd = _fd;
+    _fd = -1;
+    return fd;
+  }
+
   explicit operator bool() const
   {
     return _fd >= 0;
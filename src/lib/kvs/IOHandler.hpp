@@ -1,6 +1,12 @@
 #ifndef KVS_IOHANDLER_HPP_
 #define KVS_IOHANDLER_HPP_
 
+#include <cstddef>
+#include <cstdint>
+
+#include <sys/types.h>
+#include <unistd.h>
+
 namespace kvs {
 
 class IOHandler
@@ -10,6 +16,32 @@ public:
 
   /** @returns true, if should reuse */
   virtual bool dispatch() = 0;
+
+  /** The deadline of `Reactor::setTimeout` passed. @returns true, if should reuse */
+  virtual bool timedOut() { return false; }
+
+  // Completion based reactors (io_uring) do the I/O of listeners and streams,
+  // and report the results instead of calling `dispatch`
+
+  /** Connection `fd` accepted on the listening socket of `Reactor::addAcceptor` */
+  virtual void accepted(int fd) { ::close(fd); }
+
+  /**
+   * `size` bytes received on the socket of `Reactor::addStream`,
+   * `data` is valid during the call. `size` is 0 at the end of the stream, or on error.
+   *
+   * @returns true, if should reuse
+   */
+  virtual bool received(const char* data, std::size_t size) { return false; }
+
+  /** Completion of `Reactor::send`: the number of bytes sent, or -errno */
+  virtual void sent(ssize_t result) {}
+
+private:
+  friend class Reactor;
+
+  /** Index in the handler table of the reactor */
+  uint32_t _slot = UINT32_MAX;
 };
 
 } // namespace kvs
@@ -0,0 +1,242 @@
+#ifndef KVS_KERNEL_HPP_
+#define KVS_KERNEL_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <type_traits>
+
+namespace kvs {
+
+/**
+ * Element-wise kernels over list elements, accessed in place.
+ *
+ * Loops are kept simple and the pointers restrict qualified,
+ * to let the compiler vectorize them. Reductions use independent
+ * accumulators, floating point sums are not reassociated otherwise.
+ * Integers wrap around: the elements are client data, signed overflow
+ * must not be undefined.
+ */
+namespace kernel {
+
+namespace detail {
+
+template <typename T, bool = std::is_integral<T>::value>
+struct Wrapping { typedef T type; };
+
+// at least unsigned int: smaller types are promoted to int
+template <typename T>
+struct Wrapping<T, true>
+{
+  typedef typename std::conditional<
+    (sizeof(T) < sizeof(unsigned)), unsigned, typename std::make_unsigned<T>::type
+  >::type type;
+};
+
+} // namespace detail
+
+/** Type of the arithmetic on T: unsigned for integers, T otherwise */
+template <typename T>
+using Wrapping = typename detail::Wrapping<T>::type;
+
+template <typename T>
+void add(const T* __restrict lhs, const T* __restrict rhs, T* __restrict out, std::size_t size)
+{
+  typedef Wrapping<T> W;
+  for (std::size_t i = 0; i < size; ++i) { out[i] = static_cast<T>(W(lhs[i]) + W(rhs[i])); }
+}
+
+template <typename T>
+void subtract(const T* __restrict lhs, const T* __restrict rhs, T* __restrict out, std::size_t size)
+{
+  typedef Wrapping<T> W;
+  for (std::size_t i = 0; i < size; ++i) { out[i] = static_cast<T>(W(lhs[i]) - W(rhs[i])); }
+}
+
+template <typename T>
+void multiply(const T* __restrict lhs, const T* __restrict rhs, T* __restrict out, std::size_t size)
+{
+  typedef Wrapping<T> W;
+  for (std::size_t i = 0; i < size; ++i) { out[i] = static_cast<T>(W(lhs[i]) * W(rhs[i])); }
+}
+
+template <typename T>
+void scale(const T* __restrict in, T factor, T* __restrict out, std::size_t size)
+{
+  typedef Wrapping<T> W;
+  for (std::size_t i = 0; i < size; ++i) { out[i] = static_cast<T>(W(in[i]) * W(factor)); }
+}
+
+template <typename T>
+T dot(const T* __restrict lhs, const T* __restrict rhs, std::size_t size)
+{
+  constexpr std::size_t lanes = 8;
+  typedef Wrapping<T> W;
+
+  W acc[lanes] = {};
+
+  std::size_t i = 0;
+  for (; i + lanes <= size; i += lanes)
+  {
+    for (std::size_t j = 0; j < lanes; ++j)
+    {
+      acc[j] = static_cast<W>(acc[j] + W(lhs[i + j]) * W(rhs[i + j]));
+    }
+  }
+
+  W result = 0;
+  for (; i < size; ++i) { result = static_cast<W>(result + W(lhs[i]) * W(rhs[i])); }
+  for (std::size_t j = 0; j < lanes; ++j) { result = static_cast<W>(result + acc[j]); }
+
+  return static_cast<T>(result);
+}
+
+/** Sum of the squares of the elements, accumulated as R */
+template <typename R, typename T>
+R squaredNorm(const T* __restrict in, std::size_t size)
+{
+  constexpr std::size_t lanes = 8;
+
+  R acc[lanes] = {};
+
+  std::size_t i = 0;
+  for (; i + lanes <= size; i += lanes)
+  {
+    for (std::size_t j = 0; j < lanes; ++j)
+    {
+      const R x = in[i + j];
+      acc[j] += x * x;
+    }
+  }
+
+  R result = 0;
+  for (; i < size; ++i) { const R x = in[i]; result += x * x; }
+  for (std::size_t j = 0; j < lanes; ++j) { result += acc[j]; }
+
+  return result;
+}
+
+template <typename T>
+T sum(const T* __restrict in, std::size_t size)
+{
+  constexpr std::size_t lanes = 8;
+  typedef Wrapping<T> W;
+
+  W acc[lanes] = {};
+
+  std::size_t i = 0;
+  for (; i + lanes <= size; i += lanes)
+  {
+    for (std::size_t j = 0; j < lanes; ++j) { acc[j] = static_cast<W>(acc[j] + W(in[i + j])); }
+  }
+
+  W result = 0;
+  for (; i < size; ++i) { result = static_cast<W>(result + W(in[i])); }
+  for (std::size_t j = 0; j < lanes; ++j) { result = static_cast<W>(result + acc[j]); }
+
+  return static_cast<T>(result);
+}
+
+/** @returns the smallest element, or the largest T if `size` is 0 */
+template <typename T>
+T min(const T* __restrict in, std::size_t size)
+{
+  constexpr std::size_t lanes = 8;
+
+  T acc[lanes];
+  for (std::size_t j = 0; j < lanes; ++j) { acc[j] = std::numeric_limits<T>::max(); }
+
+  std::size_t i = 0;
+  for (; i + lanes <= size; i += lanes)
+  {
+    for (std::size_t j = 0; j < lanes; ++j) { acc[j] = (in[i + j] < acc[j]) ? in[i + j] : acc[j]; }
+  }
+
+  T result = std::numeric_limits<T>::max();
+  for (; i < size; ++i) { result = (in[i] < result) ? in[i] : result; }
+  for (std::size_t j = 0; j < lanes; ++j) { result = (acc[j] < result) ? acc[j] : result; }
+
+  return result;
+}
+
+/** @returns the largest element, or the lowest T if `size` is 0 */
+template <typename T>
+T max(const T* __restrict in, std::size_t size)
+{
+  constexpr std::size_t lanes = 8;
+
+  T acc[lanes];
+  for (std::size_t j = 0; j < lanes; ++j) { acc[j] = std::numeric_limits<T>::lowest(); }
+
+  std::size_t i = 0;
+  for (; i + lanes <= size; i += lanes)
+  {
+    for (std::size_t j = 0; j < lanes; ++j) { acc[j] = (in[i + j] > acc[j]) ? in[i + j] : acc[j]; }
+  }
+
+  T result = std::numeric_limits<T>::lowest();
+  for (; i < size; ++i) { result = (in[i] > result) ? in[i] : result; }
+  for (std::size_t j = 0; j < lanes; ++j) { result = (acc[j] > result) ? acc[j] : result; }
+
+  return result;
+}
+
+//
+// Masked kernels: `mask` holds 1 for selected and 0 for filtered elements
+//
+
+/** Clears the mask of the elements which fail `predicate` */
+template <typename T, typename Predicate>
+void filter(const T* __restrict in, std::size_t size, Predicate predicate, uint8_t* __restrict mask)
+{
+  for (std::size_t i = 0; i < size; ++i) { mask[i] &= uint8_t(predicate(in[i])); }
+}
+
+template <typename T>
+T maskedSum(const T* __restrict in, const uint8_t* __restrict mask, std::size_t size)
+{
+  typedef Wrapping<T> W;
+
+  W result = 0;
+  for (std::size_t i = 0; i < size; ++i) { result = static_cast<W>(result + (mask[i] ? W(in[i]) : W(0))); }
+  return static_cast<T>(result);
+}
+
+inline uint64_t maskedCount(const uint8_t* __restrict mask, std::size_t size)
+{
+  uint64_t result = 0;
+  for (std::size_t i = 0; i < size; ++i) { result += mask[i]; }
+  return result;
+}
+
+/** @returns the smallest selected element, or the largest T if none */
+template <typename T>
+T maskedMin(const T* __restrict in, const uint8_t* __restrict mask, std::size_t size)
+{
+  T result = std::numeric_limits<T>::max();
+  for (std::size_t i = 0; i < size; ++i)
+  {
+    const T item = mask[i] ? in[i] : std::numeric_limits<T>::max();
+    result = (item < result) ? item : result;
+  }
+  return result;
+}
+
+/** @returns the largest selected element, or the lowest T if none */
+template <typename T>
+T maskedMax(const T* __restrict in, const uint8_t* __restrict mask, std::size_t size)
+{
+  T result = std::numeric_limits<T>::lowest();
+  for (std::size_t i = 0; i < size; ++i)
+  {
+    const T item = mask[i] ? in[i] : std::numeric_limits<T>::lowest();
+    result = (item > result) ? item : result;
+  }
+  return result;
+}
+
+} // namespace kernel
+
+} // namespace kvs
+
+#endif // KVS_KERNEL_HPP_
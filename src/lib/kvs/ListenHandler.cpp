@@ -1,20 +1,29 @@
-#include <cstring> // memset
+#include <cstring> // memset, strerror
 #include <cerrno>
 
 #include <sys/socket.h>
 #include <arpa/inet.h>
+#include <netinet/tcp.h> // TCP_NODELAY
 #include <sys/epoll.h>
+#include <unistd.h>
 
 #include <kvs/ListenHandler.hpp>
 #include <kvs/Error.hpp>
 #include <kvs/CommandHandler.hpp>
 #include <kvs/Log.hpp>
+#include <kvs/UnixSocket.hpp>
 
 namespace kvs {
 
-ListenHandler::ListenHandler(Reactor& reactor, uint16_t port, Store& store)
+ListenHandler::ListenHandler(
+  Reactor& reactor, uint16_t port, Store& store,
+  const CommandHandler::Timeouts& timeouts,
+  WorkerPool* pWorkers
+)
   :_reactor(reactor),
-   _store(store)
+   _store(store),
+   _timeouts(timeouts),
+   _pWorkers(pWorkers)
 {
   // open listening socket
 
@@ -32,7 +41,42 @@ ListenHandler::ListenHandler(Reactor& reactor, uint16_t port, Store& store)
   server.sin_addr.s_addr = htonl(INADDR_ANY);
   server.sin_port = htons(port);
 
-  if (bind(*_listenSocket, (sockaddr*)&server, sizeof(server)) < 0)
+  listenAt((sockaddr*)&server, sizeof(server));
+
+  KVS_LOG_INFO << "Listening at port: " << port;
+}
+
+ListenHandler::ListenHandler(
+  Reactor& reactor, const std::string& path, Store& store,
+  const CommandHandler::Timeouts& timeouts,
+  WorkerPool* pWorkers
+)
+  :_reactor(reactor),
+   _store(store),
+   _timeouts(timeouts),
+   _pWorkers(pWorkers)
+{
+  sockaddr_un server;
+  const socklen_t serverSize = unixAddress(path, server);
+
+  _listenSocket = socket(PF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0);
+  if (! _listenSocket) { failure("socket"); }
+
+  if (! isAbstract(path))
+  {
+    // left behind by an earlier server
+    unlink(path.c_str());
+    _socketFile = path;
+  }
+
+  listenAt((sockaddr*)&server, serverSize);
+
+  KVS_LOG_INFO << "Listening at unix socket: " << path;
+}
+
+void ListenHandler::listenAt(const sockaddr* address, socklen_t addressSize)
+{
+  if (bind(*_listenSocket, address, addressSize) < 0)
   {
     failure("bind");
   }
@@ -42,13 +86,21 @@ ListenHandler::ListenHandler(Reactor& reactor, uint16_t port, Store& store)
     failure("listen");
   }
 
-  // Add to reactor
-  if (! _reactor.addHandler(this, *_listenSocket, EPOLLIN))
+  // Add to reactor, accepts until EAGAIN, can be edge triggered
+  if (! _reactor.addAcceptor(this, *_listenSocket))
   {
     failure("addHandler");
   }
+}
 
-  KVS_LOG_INFO << "Listening at port: " << port;
+ListenHandler::~ListenHandler()
+{
+  // stop listening now: a pending accept of a completion based reactor
+  // holds the socket open until the ring is released
+  shutdown(*_listenSocket, SHUT_RDWR);
+  _reactor.removeHandler(this);
+
+  if (! _socketFile.empty()) { unlink(_socketFile.c_str()); }
 }
 
 bool ListenHandler::dispatch()
@@ -60,13 +112,7 @@ bool ListenHandler::dispatch()
     client = accept4(*_listenSocket, nullptr, nullptr, SOCK_NONBLOCK);
     if (client >= 0)
     {
-      if (_reactor.addHandler<CommandHandler>(
-        client, EPOLLIN,
-        client, _store, _reactor
-      ))
-      {
-        KVS_LOG_INFO << "Client accepted";
-      }
+      accepted(client);
     }
     else
     {
@@ -74,10 +120,16 @@ bool ListenHandler::dispatch()
       {
         break;
       }
-      else
+      else if (errno == EBADF || errno == EINVAL || errno == ENOTSOCK)
       {
         perror("accept4");
-        return false;
+        return false; // not listening, removed from the reactor
+      }
+      else
+      {
+        // e.g: aborted connection, out of fds: keep listening
+        KVS_LOG_WARNING << "ListenHandler: accept4: " << strerror(errno);
+        break;
       }
     }
   } while (client >= 0);
@@ -85,4 +137,42 @@ bool ListenHandler::dispatch()
   return true;
 }
 
+void ListenHandler::accepted(int client)
+{
+  // the responses of a dispatch are written at once, waiting for more delays the pipelining clients.
+  // Fails on unix sockets, harmless
+  int nodelay = 1;
+  setsockopt(client, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+
+  if (_reactor.busyPoll().count()) { busyPoll(client); }
+
+  CommandHandler* pHandler = _reactor.addStream<CommandHandler>(
+    client,
+    client, _store, _reactor, _timeouts, _pWorkers
+  );
+
+  if (pHandler)
+  {
+    // a connection which never sends is idle too
+    pHandler->updateTimeout();
+    KVS_LOG_INFO << "Client accepted";
+  }
+}
+
+void ListenHandler::busyPoll(int client)
+{
+  // polls the device queue in the reads, instead of waiting for its interrupt.
+  // Above net.core.busy_read, only permitted with CAP_NET_ADMIN
+  int usecs = int(_reactor.busyPoll().count());
+  if (setsockopt(client, SOL_SOCKET, SO_BUSY_POLL, &usecs, sizeof(usecs)) < 0)
+  {
+    KVS_LOG_DEBUG << "ListenHandler: SO_BUSY_POLL: " << strerror(errno);
+  }
+
+#ifdef SO_PREFER_BUSY_POLL
+  int prefer = 1;
+  setsockopt(client, SOL_SOCKET, SO_PREFER_BUSY_POLL, &prefer, sizeof(prefer));
+#endif
+}
+
 } // namespace
@@ -2,26 +2,60 @@
 #define KVS_LISTENHANDLER_HPP_
 
 #include <cstdint>
+#include <string>
+
+#include <sys/socket.h>
 
 #include <kvs/IOHandler.hpp>
 #include <kvs/Fd.hpp>
 #include <kvs/Reactor.hpp>
+#include <kvs/CommandHandler.hpp>
 
 namespace kvs {
 
 class Store;
+class WorkerPool;
 
 class ListenHandler : public IOHandler
 {
 public:
-  ListenHandler(Reactor& reactor, uint16_t port, Store& store);
+  /** Accepted connections are closed after `timeouts`, run slow commands on `pWorkers`, if set */
+  ListenHandler(
+    Reactor& reactor, uint16_t port, Store& store,
+    const CommandHandler::Timeouts& timeouts = CommandHandler::Timeouts(),
+    WorkerPool* pWorkers = nullptr
+  );
+
+  /**
+   * Listens at the unix socket `path`, in the abstract namespace if it starts with '@',
+   * replaces the socket file otherwise, removed when destroyed
+   */
+  ListenHandler(
+    Reactor& reactor, const std::string& path, Store& store,
+    const CommandHandler::Timeouts& timeouts = CommandHandler::Timeouts(),
+    WorkerPool* pWorkers = nullptr
+  );
+
+  ~ListenHandler();
 
   bool dispatch() override;
+  void accepted(int client) override;
 
-private:
+protected:
   Reactor& _reactor;
-  Fd _listenSocket;
   Store& _store;
+  const CommandHandler::Timeouts _timeouts;
+  WorkerPool* _pWorkers;
+
+private:
+  /** Binds `_listenSocket` to `address`, listens, adds it to the reactor */
+  void listenAt(const sockaddr* address, socklen_t addressSize);
+
+  /** Sets the busy polling budget of the reactor on the `client` socket */
+  void busyPoll(int client);
+
+  Fd _listenSocket;
+  std::string _socketFile; // of a unix socket, not abstract
 };
 
 } // namespace kvs
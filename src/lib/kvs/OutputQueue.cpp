@@ -0,0 +1,148 @@
+#include <cerrno>
+#include <climits> // IOV_MAX
+#include <cstring> // memcpy
+
+#include <sys/uio.h>
+
+#include <kvs/OutputQueue.hpp>
+
+namespace kvs {
+
+void OutputQueue::copy(const void* data, std::size_t size)
+{
+  if (size == 0) { return; }
+
+  if (size > chunkSize - _chunkUsed)
+  {
+    // large copies get a buffer of their own
+    if (size > chunkSize / 2)
+    {
+      char* buffer = new char[size];
+      std::shared_ptr<const char> owner(buffer, std::default_delete<char[]>());
+      memcpy(buffer, data, size);
+      reference(buffer, size, std::move(owner));
+      return;
+    }
+
+    _chunk.reset(new char[chunkSize], std::default_delete<char[]>());
+    _chunkUsed = 0;
+  }
+
+  char* target = _chunk.get() + _chunkUsed;
+  memcpy(target, data, size);
+  _chunkUsed += size;
+  _size += size;
+
+  // adjacent copies are written as a single segment
+  if (
+     ! empty()
+  && _segments.back().owner == _chunk
+  && _segments.back().data + _segments.back().size == target
+  )
+  {
+    _segments.back().size += size;
+  }
+  else
+  {
+    _segments.push_back(Segment{target, size, _chunk});
+  }
+}
+
+void OutputQueue::reference(const char* data, std::size_t size, std::shared_ptr<const char> owner)
+{
+  if (size == 0) { return; }
+
+  _segments.push_back(Segment{data, size, std::move(owner)});
+  _size += size;
+}
+
+bool OutputQueue::writeTo(int fd)
+{
+  iovec output[IOV_MAX];
+
+  while (! empty())
+  {
+    const std::size_t vecSize = gather(output, IOV_MAX);
+
+    std::size_t fullSize = 0;
+    for (std::size_t i = 0; i < vecSize; ++i) { fullSize += output[i].iov_len; }
+
+    const ssize_t wsize = writev(fd, output, vecSize);
+    if (wsize < 0)
+    {
+      if (errno == EINTR) { continue; }
+      if (errno == EAGAIN || errno == EWOULDBLOCK) { break; }
+      return false;
+    }
+
+    consume(wsize);
+
+    if (std::size_t(wsize) < fullSize) { break; } // socket is full
+  }
+
+  return true;
+}
+
+std::size_t OutputQueue::gather(iovec* output, std::size_t size) const
+{
+  std::size_t vecSize = 0;
+
+  for (std::size_t i = _head; i < _segments.size() && vecSize < size; ++i)
+  {
+    output[vecSize].iov_base = const_cast<char*>(_segments[i].data);
+    output[vecSize].iov_len = _segments[i].size;
+    ++vecSize;
+  }
+
+  return vecSize;
+}
+
+void OutputQueue::consume(std::size_t size)
+{
+  // release the written segments
+  _size -= size;
+
+  while (size && size >= _segments[_head].size)
+  {
+    size -= _segments[_head].size;
+    _segments[_head].owner.reset();
+    ++_head;
+  }
+
+  if (size)
+  {
+    _segments[_head].data += size;
+    _segments[_head].size -= size;
+  }
+
+  if (empty())
+  {
+    clear();
+  }
+  else if (_head > keptSegments && _head * 2 >= _segments.size())
+  {
+    // amortized: each segment is moved at most once per erased one
+    _segments.erase(_segments.begin(), _segments.begin() + _head);
+    _head = 0;
+  }
+}
+
+void OutputQueue::clear()
+{
+  if (_segments.capacity() > keptSegments)
+  {
+    std::vector<Segment>().swap(_segments);
+  }
+  else
+  {
+    _segments.clear();
+  }
+
+  _head = 0;
+  _size = 0;
+
+  _chunk.reset();
+  _chunkUsed = chunkSize;
+}
+
+} // namespace kvs
@@ -0,0 +1,82 @@
+#ifndef KVS_OUTPUTQUEUE_HPP_
+#define KVS_OUTPUTQUEUE_HPP_
+
+#include <memory>
+#include <vector>
+
+#include <sys/uio.h>
+
+namespace kvs {
+
+/**
+ * Chain of output segments, written by vectored writes.
+ *
+ * Segments either reference shared buffers (e.g: Store values),
+ * which are kept alive until written, or hold copies of small,
+ * short lived data in chunks owned by the queue.
+ * A drained queue holds no chunk, to keep idle connections small.
+ */
+class OutputQueue
+{
+public:
+  /** Appends a copy of `data` */
+  void copy(const void* data, std::size_t size);
+
+  /** Appends `data` without copying, `owner` keeps it alive until written */
+  void reference(const char* data, std::size_t size, std::shared_ptr<const char> owner);
+
+  /**
+   * Writes the segments to `fd`, until done or the socket is full,
+   * with a single writev per IOV_MAX segments.
+   *
+   * @returns false, on write error
+   */
+  bool writeTo(int fd);
+
+  /**
+   * Describes the first, at most `size` segments in `output`,
+   * for writes submitted elsewhere. @returns the number of segments described
+   */
+  std::size_t gather(iovec* output, std::size_t size) const;
+
+  /** Releases the first `size` bytes, after they are written */
+  void consume(std::size_t size);
+
+  /** Drops the segments not yet written */
+  void clear();
+
+  bool empty() const { return _head == _segments.size(); }
+
+  /** @returns the number of bytes not yet written */
+  std::size_t size() const { return _size; }
+
+  /** @returns the number of segments not yet written */
+  std::size_t segmentCount() const { return _segments.size() - _head; }
+
+private:
+  static constexpr std::size_t chunkSize = 4096;
+
+  /** Segment storage kept when the queue drains, larger is released */
+  static constexpr std::size_t keptSegments = 16;
+
+  struct Segment
+  {
+    const char* data;
+    std::size_t size;
+    std::shared_ptr<const char> owner;
+  };
+
+  // written segments before _head are released when the queue drains,
+  // to keep reusing the storage, or when they are the most of it:
+  // a queue which never drains does not grow without bound
+  std::vector<Segment> _segments;
+  std::size_t _head = 0;
+  std::size_t _size = 0;
+
+  std::shared_ptr<char> _chunk;
+  std::size_t _chunkUsed = chunkSize;
+};
+
+} // namespace kvs
+
+#endif // KVS_OUTPUTQUEUE_HPP_
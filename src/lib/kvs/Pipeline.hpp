@@ -0,0 +1,59 @@
+#ifndef KVS_PIPELINE_HPP_
+#define KVS_PIPELINE_HPP_
+
+#include <cstddef>
+#include <cstdint>
+
+namespace kvs {
+
+namespace query {
+
+enum class Predicate : uint8_t
+{
+  LESS,
+  LESS_EQUAL,
+  GREATER,
+  GREATER_EQUAL,
+  EQUAL,
+  NOT_EQUAL,
+  RANGE,  // lo <= x <= hi
+};
+
+enum class Reducer : uint8_t
+{
+  SUM,
+  COUNT,
+  MIN,
+  MAX,
+};
+
+constexpr std::size_t maxStages = 8;
+
+/** Predicate stage, operands are raw values of the element type */
+struct Stage
+{
+  Predicate predicate;
+  uint16_t operandTag;
+  uint64_t lo;
+  uint64_t hi;
+};
+
+/**
+ * Parsed query: elements passing every stage are reduced.
+ * Serialized as: reducer | stage count | (predicate | operand tag | lo | hi)*
+ */
+struct Pipeline
+{
+  Reducer reducer;
+  std::size_t stageCount;
+  Stage stages[maxStages];
+};
+
+/** @returns false, if `buffer` does not hold a valid serialized pipeline */
+bool parse(const char* buffer, std::size_t size, Pipeline& result);
+
+} // namespace query
+
+} // namespace kvs
+
+#endif // KVS_PIPELINE_HPP_
@@ -0,0 +1,297 @@
+#include <kvs/Protocol.hpp>
+
+namespace kvs {
+namespace protocol {
+
+const char* schema(command::Tag tag)
+{
+  switch (tag)
+  {
+  case command::Tag::GET:
+  case command::Tag::POP:
+  case command::Tag::SUM:
+  case command::Tag::MAX:
+  case command::Tag::MIN:
+  case command::Tag::SOURCE:
+  case command::Tag::EXECUTE:
+  case command::Tag::NORM:
+    return "k";
+  case command::Tag::SET:
+  case command::Tag::PUSH:
+  case command::Tag::QUERY:
+    return "klv";
+  case command::Tag::ARITHMETIC:
+    return "bkkk";
+  case command::Tag::SCALE:
+    return "kklv";
+  case command::Tag::DOT:
+    return "kk";
+  case command::Tag::MGET:
+    return "c*k";
+  case command::Tag::MSET:
+  case command::Tag::MPUSH:
+    return "c*klv";
+  case command::Tag::HELLO:
+    return "b";
+  }
+
+  return nullptr;
+}
+
+namespace {
+
+/** Reads a varint of at most `limit`, advances `data` past it */
+bool readSize(const char*& data, const char* end, uint64_t limit, std::size_t& output)
+{
+  uint64_t value;
+  const std::size_t size = readVarint(data, std::size_t(end - data), value);
+  if (size == 0 || value > limit) { return false; }
+
+  data += size;
+  output = std::size_t(value);
+  return true;
+}
+
+} // namespace
+
+bool decode(const char* data, std::size_t size, Frame& frame)
+{
+  const char* end = data + size;
+  frame.fields.clear();
+
+  std::size_t tag;
+  if (! readSize(data, end, UINT64_MAX, frame.requestId)) { return false; }
+  if (! readSize(data, end, UINT16_MAX, tag)) { return false; }
+  frame.tag = command::Tag(tag);
+
+  const char* fields = schema(frame.tag);
+  if (! fields) { return false; }
+
+  const char* repeated = nullptr;
+  std::size_t repeats = 0;
+
+  for (const char* field = fields; ; ++field)
+  {
+    // the repeated part, by the item count read before
+    if (*field == '*')
+    {
+      if (repeats == 0) { break; }
+      --repeats;
+      repeated = field + 1;
+      continue;
+    }
+
+    if (*field == '\0')
+    {
+      if (! repeated || repeats == 0) { break; }
+      --repeats;
+      field = repeated - 1;
+      continue;
+    }
+
+    Field result{data, 0};
+    switch (*field)
+    {
+    case 'k':
+      // the size, the key and its terminator
+      if (! readSize(data, end, UINT64_MAX, result.size)) { return false; }
+      if (std::size_t(end - data) <= result.size || data[result.size] != '\0') { return false; }
+      result.data = data;
+      data += result.size + 1;
+      break;
+    case 'l':
+      // the size of the value of the next field
+      if (! readSize(data, end, std::size_t(end - data), result.size)) { return false; }
+      if (std::size_t(end - data) < result.size) { return false; }
+      ++field;
+      result.data = data;
+      data += result.size;
+      break;
+    case 'b':
+      if (data == end) { return false; }
+      result.size = 1;
+      data += 1;
+      break;
+    case 'c':
+      // each item takes a byte at least, not to reserve for a corrupt count
+      if (! readSize(data, end, std::size_t(end - data), repeats)) { return false; }
+      result.data = nullptr;
+      result.size = repeats;
+      break;
+    default:
+      return false;
+    }
+
+    frame.fields.push_back(result);
+  }
+
+  return data == end;
+}
+
+//
+// Commands of the decoded fields, in the order of their serialized vectors
+//
+
+namespace {
+
+template <typename Command>
+void checkFields(const Frame& frame, std::size_t count)
+{
+  check(frame.tag == Command::tag && frame.fields.size() == count);
+}
+
+/** Constructs a command of a key */
+template <typename Command>
+Command keyCommand(const Frame& frame)
+{
+  checkFields<Command>(frame, 1);
+  return Command(frame.key(0));
+}
+
+/** Constructs a command of a key and a value */
+template <typename Command>
+Command valueCommand(const Frame& frame)
+{
+  checkFields<Command>(frame, 2);
+  return Command(frame.key(0), frame.fields[1].size, frame.fields[1].data);
+}
+
+template <typename Batch>
+Batch multiCommand(const Frame& frame)
+{
+  check(frame.tag == Batch::tag && ! frame.fields.empty());
+
+  typedef typename Batch::Item Item;
+
+  Batch result;
+  for (std::size_t i = 1; i + 1 < frame.fields.size(); i += 2)
+  {
+    result.add(Item(frame.key(i), frame.fields[i + 1].size, frame.fields[i + 1].data));
+  }
+  return result;
+}
+
+} // namespace
+
+template <>
+GetCommand Frame::command<GetCommand>() const
+{
+  return keyCommand<GetCommand>(*this);
+}
+
+template <>
+SetCommand Frame::command<SetCommand>() const
+{
+  return valueCommand<SetCommand>(*this);
+}
+
+template <>
+PushCommand Frame::command<PushCommand>() const
+{
+  return valueCommand<PushCommand>(*this);
+}
+
+template <>
+PopCommand Frame::command<PopCommand>() const
+{
+  return keyCommand<PopCommand>(*this);
+}
+
+template <>
+SumCommand Frame::command<SumCommand>() const
+{
+  return keyCommand<SumCommand>(*this);
+}
+
+template <>
+MaxCommand Frame::command<MaxCommand>() const
+{
+  return keyCommand<MaxCommand>(*this);
+}
+
+template <>
+MinCommand Frame::command<MinCommand>() const
+{
+  return keyCommand<MinCommand>(*this);
+}
+
+template <>
+SourceCommand Frame::command<SourceCommand>() const
+{
+  return keyCommand<SourceCommand>(*this);
+}
+
+template <>
+ExecuteCommand Frame::command<ExecuteCommand>() const
+{
+  return keyCommand<ExecuteCommand>(*this);
+}
+
+template <>
+ArithmeticCommand Frame::command<ArithmeticCommand>() const
+{
+  checkFields<ArithmeticCommand>(*this, 4);
+
+  const auto op = command::Arithmetic(*fields[0].data);
+  check(op <= command::Arithmetic::MULTIPLY);
+
+  return ArithmeticCommand(op, key(1), key(2), key(3));
+}
+
+template <>
+ScaleCommand Frame::command<ScaleCommand>() const
+{
+  checkFields<ScaleCommand>(*this, 3);
+  return ScaleCommand(key(0), key(1), fields[2].size, fields[2].data);
+}
+
+template <>
+DotCommand Frame::command<DotCommand>() const
+{
+  checkFields<DotCommand>(*this, 2);
+  return DotCommand(key(0), key(1));
+}
+
+template <>
+NormCommand Frame::command<NormCommand>() const
+{
+  return keyCommand<NormCommand>(*this);
+}
+
+template <>
+QueryCommand Frame::command<QueryCommand>() const
+{
+  return valueCommand<QueryCommand>(*this);
+}
+
+template <>
+MultiGetCommand Frame::command<MultiGetCommand>() const
+{
+  check(tag == MultiGetCommand::tag && ! fields.empty());
+
+  MultiGetCommand result;
+  for (std::size_t i = 1; i < fields.size(); ++i) { result.add(key(i)); }
+  return result;
+}
+
+template <>
+MultiSetCommand Frame::command<MultiSetCommand>() const
+{
+  return multiCommand<MultiSetCommand>(*this);
+}
+
+template <>
+MultiPushCommand Frame::command<MultiPushCommand>() const
+{
+  return multiCommand<MultiPushCommand>(*this);
+}
+
+template <>
+HelloCommand Frame::command<HelloCommand>() const
+{
+  checkFields<HelloCommand>(*this, 1);
+  return HelloCommand(uint8_t(*fields[0].data));
+}
+
+} // namespace protocol
+} // namespace kvs
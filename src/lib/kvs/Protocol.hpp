@@ -0,0 +1,232 @@
+#ifndef KVS_PROTOCOL_HPP_
+#define KVS_PROTOCOL_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring> // memcpy
+#include <vector>
+
+#include <sys/uio.h>
+
+#include <kvs/Command.hpp>
+#include <kvs/Error.hpp>
+
+namespace kvs {
+namespace protocol {
+
+/**
+ * v1: frames start with a command::Size and a command::Tag,
+ * keys are NUL terminated, values are prefixed by their std::size_t size.
+ *
+ * v2: negotiated by a v1 HELLO, the connection switches after its response.
+ * Frames are [varint size of the rest][varint request id][varint tag][fields],
+ * keys are prefixed by their varint size, and stay NUL terminated:
+ * they are referred in place, as v1 keys. Values are prefixed by their varint size.
+ * Responses carry the request id of their request.
+ */
+enum class Version : uint8_t
+{
+  v1 = 1,
+  v2 = 2,
+};
+
+constexpr Version latest = Version::v2;
+
+/** Size limit of a 64 bit varint */
+constexpr std::size_t maxVarintSize = 10;
+
+/** Writes `value` as a varint (LEB128) to `output`, @returns its size */
+inline std::size_t writeVarint(uint64_t value, char* output)
+{
+  std::size_t size = 0;
+  while (value >= 0x80)
+  {
+    output[size++] = char(value | 0x80);
+    value >>= 7;
+  }
+  output[size++] = char(value);
+  return size;
+}
+
+/** @returns the size of the varint of `value` */
+inline std::size_t varintSize(uint64_t value)
+{
+  std::size_t size = 1;
+  while (value >= 0x80) { value >>= 7; ++size; }
+  return size;
+}
+
+/**
+ * Reads a varint of `input`, @returns its size, or 0 if incomplete.
+ * Longer than `maxVarintSize` is invalid, also reported as 0.
+ */
+inline std::size_t readVarint(const char* input, std::size_t size, uint64_t& value)
+{
+  value = 0;
+  for (std::size_t i = 0; i < size && i < maxVarintSize; ++i)
+  {
+    const uint8_t byte = uint8_t(input[i]);
+    value |= uint64_t(byte & 0x7f) << (7 * i);
+    if (! (byte & 0x80)) { return i + 1; }
+  }
+  return 0;
+}
+
+/**
+ * Fields of the commands, in the order of the v1 serialized vectors:
+ * 'k' key, 'l' value size, 'v' value, 'b' byte, 'c' item count,
+ * the part after '*' is repeated by the item count. nullptr if unknown.
+ */
+const char* schema(command::Tag tag);
+
+/** A key, a value, a byte, or an item count (in `size`) of a decoded v2 frame */
+struct Field
+{
+  const char* data;
+  std::size_t size;
+};
+
+/** A decoded v2 frame, refers to the received bytes */
+struct Frame
+{
+  uint64_t requestId;
+  command::Tag tag;
+  std::vector<Field> fields;
+
+  /** @returns the command of the fields, throws std::runtime_error if not `Command` */
+  template <typename Command>
+  Command command() const;
+
+  Key key(std::size_t index) const { return Key(fields[index].data, fields[index].size); }
+};
+
+template <> GetCommand Frame::command<GetCommand>() const;
+template <> SetCommand Frame::command<SetCommand>() const;
+template <> PushCommand Frame::command<PushCommand>() const;
+template <> PopCommand Frame::command<PopCommand>() const;
+template <> SumCommand Frame::command<SumCommand>() const;
+template <> MaxCommand Frame::command<MaxCommand>() const;
+template <> MinCommand Frame::command<MinCommand>() const;
+template <> SourceCommand Frame::command<SourceCommand>() const;
+template <> ExecuteCommand Frame::command<ExecuteCommand>() const;
+template <> ArithmeticCommand Frame::command<ArithmeticCommand>() const;
+template <> ScaleCommand Frame::command<ScaleCommand>() const;
+template <> DotCommand Frame::command<DotCommand>() const;
+template <> NormCommand Frame::command<NormCommand>() const;
+template <> QueryCommand Frame::command<QueryCommand>() const;
+template <> MultiGetCommand Frame::command<MultiGetCommand>() const;
+template <> MultiSetCommand Frame::command<MultiSetCommand>() const;
+template <> MultiPushCommand Frame::command<MultiPushCommand>() const;
+template <> HelloCommand Frame::command<HelloCommand>() const;
+
+/**
+ * Decodes the v2 frame of `size` bytes at `data`, after its size.
+ * @returns false if malformed
+ */
+bool decode(const char* data, std::size_t size, Frame& frame);
+
+/**
+ * Encodes the v1 serialized `vectors` of a command as a v2 frame of `requestId`,
+ * calls `f(const iovec&, std::size_t source)` for each vector of the frame:
+ * `source` is the index of the referred v1 vector, `count` if the vector is generated.
+ * Generated vectors refer to `scratch`, valid until the next call.
+ */
+template <typename F>
+void encode(uint64_t requestId, const iovec* vectors, std::size_t count, std::vector<char>& scratch, F&& f)
+{
+  command::Tag tag;
+  memcpy(&tag, vectors[1].iov_base, sizeof(tag));
+
+  const char* fields = schema(tag);
+  check(fields != nullptr);
+
+  // the field of each vector, the repeated part restarts after '*'
+  const char* repeated = nullptr;
+  auto nextField = [&repeated](const char*& field) {
+    if (*field == '*') { repeated = ++field; }
+    if (*field == '\0') { field = repeated; }
+    return *field++;
+  };
+
+  // varints of the sizes and counts, not reallocated while referred
+  scratch.resize((count + 2) * maxVarintSize);
+  char* next = scratch.data() + 2 * maxVarintSize;
+
+  std::size_t bodySize = varintSize(requestId) + varintSize(uint16_t(tag));
+  {
+    const char* field = fields;
+    for (std::size_t i = 2; i < count; ++i)
+    {
+      const std::size_t size = vectors[i].iov_len;
+      switch (nextField(field))
+      {
+      case 'k': bodySize += varintSize(size - 1) + size; break;
+      case 'l':
+      {
+        std::size_t valueSize;
+        memcpy(&valueSize, vectors[i].iov_base, sizeof(valueSize));
+        bodySize += varintSize(valueSize);
+        break;
+      }
+      case 'c':
+      {
+        command::BatchSize itemCount;
+        memcpy(&itemCount, vectors[i].iov_base, sizeof(itemCount));
+        bodySize += varintSize(itemCount);
+        break;
+      }
+      default: bodySize += size; break; // 'v', 'b'
+      }
+    }
+  }
+
+  {
+    char* header = scratch.data();
+    std::size_t headerSize = writeVarint(bodySize, header);
+    headerSize += writeVarint(requestId, header + headerSize);
+    headerSize += writeVarint(uint16_t(tag), header + headerSize);
+    f(iovec{header, headerSize}, count);
+  }
+
+  const char* field = fields;
+  repeated = nullptr;
+  for (std::size_t i = 2; i < count; ++i)
+  {
+    const iovec& vec = vectors[i];
+    switch (nextField(field))
+    {
+    case 'k':
+    {
+      const std::size_t size = writeVarint(vec.iov_len - 1, next);
+      f(iovec{next, size}, count);
+      next += size;
+      f(vec, i);
+      break;
+    }
+    case 'l':
+    {
+      std::size_t valueSize;
+      memcpy(&valueSize, vec.iov_base, sizeof(valueSize));
+      const std::size_t size = writeVarint(valueSize, next);
+      f(iovec{next, size}, count);
+      next += size;
+      break;
+    }
+    case 'c':
+    {
+      command::BatchSize itemCount;
+      memcpy(&itemCount, vec.iov_base, sizeof(itemCount));
+      const std::size_t size = writeVarint(itemCount, next);
+      f(iovec{next, size}, count);
+      next += size;
+      break;
+    }
+    default: f(vec, i); break; // 'v', 'b'
+    }
+  }
+}
+
+} // namespace protocol
+} // namespace kvs
+
+#endif // KVS_PROTOCOL_HPP_
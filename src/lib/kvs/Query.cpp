@@ -0,0 +1,155 @@
+#include <algorithm>
+
+#include <kvs/Query.hpp>
+#include <kvs/Kernel.hpp>
+#include <kvs/Log.hpp>
+
+namespace kvs {
+
+namespace query {
+
+bool parse(const char* buffer, std::size_t size, Pipeline& result)
+{
+  ReadBuffer reader(buffer, size);
+
+  uint8_t stageCount;
+
+  if (! reader.read(result.reducer) || result.reducer > Reducer::MAX) { return false; }
+  if (! reader.read(stageCount) || stageCount > maxStages) { return false; }
+
+  result.stageCount = stageCount;
+
+  for (std::size_t i = 0; i < result.stageCount; ++i)
+  {
+    Stage& stage = result.stages[i];
+
+    if (
+       ! reader.read(stage.predicate)
+    || stage.predicate > Predicate::RANGE
+    || ! reader.read(stage.operandTag)
+    || ! reader.read(stage.lo)
+    || ! reader.read(stage.hi)
+    )
+    {
+      return false;
+    }
+  }
+
+  return ! reader;
+}
+
+namespace {
+
+/** Elements are filtered and reduced in blocks of this size, the mask lives on the stack */
+constexpr std::size_t blockSize = 256;
+
+struct Evaluate : public boost::static_visitor<std::size_t>
+{
+  Evaluate(const Pipeline& pipeline, char* result)
+    :_pipeline(pipeline), _result(result)
+  {}
+
+  template <typename T>
+  std::size_t operator()(const value::ListView<T>& items) const
+  {
+    T lo[maxStages];
+    T hi[maxStages];
+
+    for (std::size_t s = 0; s < _pipeline.stageCount; ++s)
+    {
+      const Stage& stage = _pipeline.stages[s];
+      if (stage.operandTag != ValueDescriptor<T>::tag)
+      {
+        KVS_LOG_WARNING << "Query command: type mismatch"
+          " (exp: " << int(ValueDescriptor<T>::tag) << ", act: " << stage.operandTag << ")";
+        return 0;
+      }
+
+      std::memcpy(&lo[s], &stage.lo, sizeof(T));
+      std::memcpy(&hi[s], &stage.hi, sizeof(T));
+    }
+
+    kernel::Wrapping<T> sum = 0;
+    uint64_t count = 0;
+    T min = std::numeric_limits<T>::max();
+    T max = std::numeric_limits<T>::lowest();
+
+    uint8_t mask[blockSize];
+
+    for (ListSize offset = 0; offset < items.size; offset += blockSize)
+    {
+      const T* block = items.data + offset;
+      const std::size_t size = std::min<ListSize>(items.size - offset, blockSize);
+
+      std::fill(mask, mask + size, 1);
+
+      // the predicate is selected once per block, elements are not branched on
+      for (std::size_t s = 0; s < _pipeline.stageCount; ++s)
+      {
+        const T l = lo[s];
+        const T h = hi[s];
+
+        switch (_pipeline.stages[s].predicate)
+        {
+        case Predicate::LESS:          kernel::filter(block, size, [l](T x) { return x < l; }, mask); break;
+        case Predicate::LESS_EQUAL:    kernel::filter(block, size, [l](T x) { return x <= l; }, mask); break;
+        case Predicate::GREATER:       kernel::filter(block, size, [l](T x) { return x > l; }, mask); break;
+        case Predicate::GREATER_EQUAL: kernel::filter(block, size, [l](T x) { return x >= l; }, mask); break;
+        case Predicate::EQUAL:         kernel::filter(block, size, [l](T x) { return x == l; }, mask); break;
+        case Predicate::NOT_EQUAL:     kernel::filter(block, size, [l](T x) { return x != l; }, mask); break;
+        case Predicate::RANGE:         kernel::filter(block, size, [l, h](T x) { return (x >= l) & (x <= h); }, mask); break;
+        }
+      }
+
+      // selected elements are counted by MIN/MAX as well, to tell apart "none" from a limit value
+      count += kernel::maskedCount(mask, size);
+
+      switch (_pipeline.reducer)
+      {
+      case Reducer::SUM:   sum += kernel::Wrapping<T>(kernel::maskedSum(block, mask, size)); break;
+      case Reducer::COUNT: break;
+      case Reducer::MIN:   min = std::min(min, kernel::maskedMin(block, mask, size)); break;
+      case Reducer::MAX:   max = std::max(max, kernel::maskedMax(block, mask, size)); break;
+      }
+    }
+
+    switch (_pipeline.reducer)
+    {
+    case Reducer::SUM:   return write(static_cast<T>(sum));
+    case Reducer::COUNT: return write(count);
+    case Reducer::MIN:   return count ? write(min) : 0;
+    case Reducer::MAX:   return count ? write(max) : 0;
+    }
+
+    return 0;
+  }
+
+  std::size_t operator()(const NullValue&) const { return 0; }
+
+  template <typename R>
+  std::size_t write(const R& r) const
+  {
+    value::serialize(r, _result);
+    return value::serializedSize(r);
+  }
+
+  const Pipeline& _pipeline;
+  char* _result;
+};
+
+} // namespace
+
+std::size_t execute(
+  const Pipeline& pipeline,
+  const char* buffer,
+  std::size_t size,
+  command::ResultBuffer& result
+)
+{
+  Evaluate visitor(pipeline, result);
+  return value::applyViewVisitor(visitor, buffer, size);
+}
+
+} // namespace query
+
+} // namespace kvs
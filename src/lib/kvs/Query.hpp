@@ -0,0 +1,103 @@
+#ifndef KVS_QUERY_HPP_
+#define KVS_QUERY_HPP_
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include <kvs/Command.hpp>
+#include <kvs/Error.hpp>
+#include <kvs/Pipeline.hpp>
+#include <kvs/Value.hpp>
+
+namespace kvs {
+
+namespace query {
+
+/**
+ * Runs the pipeline over the serialized list in `buffer`.
+ * The serialized result (COUNT: uint64_t, otherwise the element type)
+ * is written to `result`.
+ *
+ * @returns the size of the result, 0 if `buffer` is not a list,
+ * the operand types do not match the element type or MIN/MAX selected nothing
+ */
+std::size_t execute(
+  const Pipeline& pipeline,
+  const char* buffer,
+  std::size_t size,
+  command::ResultBuffer& result
+);
+
+} // namespace query
+
+/**
+ * Builder of serialized query pipelines, e.g:
+ *
+ *     Query().greater(10).less(20).sum()
+ *
+ * Operands must be of the element type of the queried list.
+ * At most query::maxStages stages are added, a stage more throws std::runtime_error.
+ */
+class Query
+{
+public:
+  Query() : _serialized{static_cast<char>(query::Reducer::COUNT), 0} {}
+
+  template <typename T> Query& less(T t)         { return stage(query::Predicate::LESS, t, t); }
+  template <typename T> Query& lessEqual(T t)    { return stage(query::Predicate::LESS_EQUAL, t, t); }
+  template <typename T> Query& greater(T t)      { return stage(query::Predicate::GREATER, t, t); }
+  template <typename T> Query& greaterEqual(T t) { return stage(query::Predicate::GREATER_EQUAL, t, t); }
+  template <typename T> Query& equal(T t)        { return stage(query::Predicate::EQUAL, t, t); }
+  template <typename T> Query& notEqual(T t)     { return stage(query::Predicate::NOT_EQUAL, t, t); }
+  template <typename T> Query& range(T lo, T hi) { return stage(query::Predicate::RANGE, lo, hi); }
+
+  Query& sum()   { return reduce(query::Reducer::SUM); }
+  Query& count() { return reduce(query::Reducer::COUNT); }
+  Query& min()   { return reduce(query::Reducer::MIN); }
+  Query& max()   { return reduce(query::Reducer::MAX); }
+
+  const char* data() const { return _serialized.data(); }
+  std::size_t size() const { return _serialized.size(); }
+
+private:
+  template <typename T>
+  Query& stage(query::Predicate predicate, T lo, T hi);
+
+  Query& reduce(query::Reducer reducer)
+  {
+    _serialized[0] = static_cast<char>(reducer);
+    return *this;
+  }
+
+  std::vector<char> _serialized;
+};
+
+template <typename T>
+Query& Query::stage(query::Predicate predicate, T lo, T hi)
+{
+  static_assert(std::is_arithmetic<T>::value, "Query operands must be scalars");
+  check(std::size_t(_serialized[1]) < query::maxStages);
+
+  const uint16_t tag = ValueDescriptor<T>::tag;
+  uint64_t rawLo = 0;
+  uint64_t rawHi = 0;
+  std::memcpy(&rawLo, &lo, sizeof(T));
+  std::memcpy(&rawHi, &hi, sizeof(T));
+
+  const std::size_t offset = _serialized.size();
+  _serialized.resize(offset + sizeof(predicate) + sizeof(tag) + sizeof(rawLo) + sizeof(rawHi));
+
+  FixWriteBuffer writer(_serialized.data() + offset);
+  writer.write(predicate);
+  writer.write(tag);
+  writer.write(rawLo);
+  writer.write(rawHi);
+
+  ++_serialized[1];
+  return *this;
+}
+
+} // namespace kvs
+
+#endif // KVS_QUERY_HPP_
@@ -1,26 +1,144 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring> // strerror
+
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+
 #include <kvs/Reactor.hpp>
+#include <kvs/Uring.hpp>
 #include <kvs/Error.hpp>
 #include <kvs/Log.hpp>
 
 namespace kvs {
 
-Reactor::Reactor()
-  :_stopped(false),
-   _epollfd(epoll_create1(0))
+namespace {
+
+/** Submission and completion ring sizes */
+constexpr unsigned uringEntries = 1024;
+constexpr unsigned uringCompletions = 16384;
+
+/** Provided receive buffers, shared by the streams */
+constexpr uint16_t receiveGroup = 0;
+constexpr uint16_t receiveBufferCount = 8192;
+constexpr uint32_t receiveBufferSize = 4096;
+
+/** Slot index of handlers not in the table, and the end of the free list */
+constexpr uint32_t noSlot = UINT32_MAX;
+
+} // namespace
+
+constexpr std::size_t Reactor::minEvents;
+constexpr std::size_t Reactor::maxEvents;
+constexpr uint64_t Reactor::requestBits;
+constexpr uint64_t Reactor::requestMask;
+constexpr uint32_t Reactor::maxSlots;
+constexpr std::size_t Reactor::taskBudget;
+
+class Reactor::TaskHandler : public IOHandler
 {
-  if (! _epollfd) { failure("epoll_create1"); }
+public:
+  explicit TaskHandler(Reactor& reactor) :_reactor(reactor) {}
+
+  bool dispatch() override
+  {
+    _reactor.runTasks();
+    return true;
+  }
+
+private:
+  Reactor& _reactor;
+};
+
+Reactor::Reactor(Trigger trigger, Backend backend)
+  :_trigger(trigger),
+   _stopped(false),
+   _freeSlot(noSlot),
+   _staleTimers(0),
+   _now(Clock::now()),
+   _busyPoll(0),
+   _lastEvent(_now),
+   _wakeupPending(false)
+{
+  if (backend == Backend::uring)
+  {
+    _uring.reset(new Uring(uringEntries, uringCompletions));
+    _uring->provideBuffers(receiveGroup, receiveBufferCount, receiveBufferSize);
+  }
+  else
+  {
+    _epollfd = epoll_create1(0);
+    if (! _epollfd) { failure("epoll_create1"); }
+    _events.resize(minEvents);
+  }
+
+  _wakeupfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (! _wakeupfd) { failure("eventfd"); }
+
+  _taskHandler.reset(new TaskHandler(*this));
+  if (! addHandler(_taskHandler.get(), *_wakeupfd, EPOLLIN)) { failure("addHandler"); }
+}
+
+Reactor::~Reactor()
+{
+  // the requests of the ring are released with it
+  for (Slot& slot : _slots)
+  {
+    if (slot.pHandler && slot.owned) { delete slot.pHandler; }
+  }
 }
 
 bool Reactor::addHandler(IOHandler* pHandler, int fd, int events)
 {
-  return addToEpoll(pHandler, fd, events);
+  return addWatch(addSlot(pHandler, false), fd, events, Request::poll);
+}
+
+bool Reactor::addAcceptor(IOHandler* pHandler, int fd)
+{
+  return addWatch(addSlot(pHandler, false), fd, EPOLLIN | edgeFlag(), Request::accept);
 }
 
 bool Reactor::readdHandler(IOHandler* pHandler, int fd, int events)
 {
+  const uint32_t index = pHandler->_slot;
+  if (index == noSlot) { return false; }
+  _slots[index].watch.events = events;
+
+  if (_uring)
+  {
+    Slot& slot = _slots[index];
+    if (slot.watch.request == Request::receive)
+    {
+      // pause or resume receiving: a running receive completes, but it is not prepared again
+      if (! (events & EPOLLIN) && slot.armed)
+      {
+        io_uring_sqe& sqe = _uring->prepare();
+        sqe.opcode = IORING_OP_ASYNC_CANCEL;
+        sqe.fd = -1;
+        sqe.addr = token(index, Request::receive);
+        sqe.user_data = uint64_t(Request::ignore);
+      }
+      else if ((events & EPOLLIN) && ! slot.armed)
+      {
+        prepare(index);
+      }
+      return true;
+    }
+
+    // update the events of the pending poll
+    io_uring_sqe& sqe = _uring->prepare();
+    sqe.opcode = IORING_OP_POLL_REMOVE;
+    sqe.fd = -1;
+    sqe.addr = token(index, Request::poll);
+    sqe.len = IORING_POLL_UPDATE_EVENTS;
+    sqe.poll32_events = events & ~EPOLLET;
+    sqe.user_data = uint64_t(Request::ignore);
+    return true;
+  }
+
   epoll_event ev;
   ev.events = events;
-  ev.data.ptr = pHandler;
+  ev.data.u64 = token(index, Request::poll);
   if (epoll_ctl(*_epollfd, EPOLL_CTL_MOD, fd, &ev) < 0)
   {
     KVS_LOG_ERROR << "Reactor: Failed to readd handler: " << strerror(errno);
@@ -30,99 +148,520 @@ bool Reactor::readdHandler(IOHandler* pHandler, int fd, int events)
   return true;
 }
 
+void Reactor::removeHandler(IOHandler* pHandler)
+{
+  if (pHandler->_slot != noSlot)
+  {
+    remove(pHandler->_slot);
+  }
+}
+
 bool Reactor::dispatch()
 {
-  constexpr int eventsSize = 16;
-  epoll_event events[eventsSize];
+  // handlers which yielded in the previous round,
+  // their fd remains ready without a new event
+  std::vector<uint64_t> pending;
+  pending.swap(_pending);
+
+  for (uint64_t handlerToken : pending)
+  {
+    const uint32_t index = tokenIndex(handlerToken);
+    if (current(handlerToken) && ! _slots[index].pHandler->dispatch() && current(handlerToken))
+    {
+      remove(index);
+    }
+  }
+
+  // do not block if a handler yielded again, or while busy polling
+  int timeout = _pending.empty() ? timerTimeout(1000 /* 1s */) : 0;
+  if (timeout && _now - _lastEvent < _busyPoll) { timeout = 0; }
+
+  const std::size_t eventCount = _uring ? waitUring(timeout) : waitEpoll(timeout);
+
+  const bool active = eventCount > 0 || ! pending.empty();
+  if (active) { _lastEvent = _now; }
+
+  expireTimers();
+
+  return active;
+}
+
+std::size_t Reactor::waitEpoll(int timeout)
+{
+  int eventCount = epoll_wait(*_epollfd, _events.data(), int(_events.size()), timeout);
+  if (eventCount < 0)
+  {
+    // interrupted by a signal, e.g: of a debugger
+    if (errno != EINTR) { failure("epoll_wait"); }
+    eventCount = 0;
+  }
 
-  const int eventCount = epoll_wait(*_epollfd, events, eventsSize, 1000 /* 1s */);
-  if (eventCount < 0) { failure("epoll_wait"); }
+  _now = Clock::now();
 
 //  KVS_LOG_DEBUG << "Reactor received #" << eventCount << " event(s)";
 
   for (int eventIndex = 0; eventIndex < eventCount; ++eventIndex)
   {
-    IOHandler* pHandler = reinterpret_cast<IOHandler*>(events[eventIndex].data.ptr);
+    const uint64_t handlerToken = _events[eventIndex].data.u64;
+    const uint32_t index = tokenIndex(handlerToken);
+
+    // removed by an earlier event of this wait
+    if (! current(handlerToken)) { continue; }
 
     if (
-       (events[eventIndex].events & EPOLLERR)
-    || (events[eventIndex].events & EPOLLHUP)
+       (_events[eventIndex].events & EPOLLERR)
+    || (_events[eventIndex].events & EPOLLHUP)
     )
     {
-      KVS_LOG_WARNING << "ERR/HUP on handler: " << pHandler
-        << " ev: events[eventIndex].events";
-      removeFromEpoll(pHandler);
-      removeHandler(pHandler);
+      KVS_LOG_WARNING << "ERR/HUP on handler: " << _slots[index].pHandler
+        << " ev: " << _events[eventIndex].events;
+      remove(index);
+    }
+    else if (! _slots[index].pHandler->dispatch() && current(handlerToken))
+    {
+      remove(index);
+    }
+  }
+
+  // a full array might have left ready handlers waiting: fewer waits under load
+  if (eventCount == int(_events.size()) && _events.size() < maxEvents)
+  {
+    _events.resize(_events.size() * 2);
+  }
+
+  return std::size_t(eventCount);
+}
+
+std::size_t Reactor::waitUring(int timeout)
+{
+  // submits the requests prepared since the last wait, e.g: sends
+  _uring->enter(timeout);
+
+  _now = Clock::now();
+
+  return _uring->complete([this](const io_uring_cqe& cqe) { complete(cqe); });
+}
+
+void Reactor::complete(const io_uring_cqe& cqe)
+{
+  const Request request = Request(cqe.user_data & requestMask);
+  if (request == Request::ignore) { return; }
+
+  const uint32_t index = tokenIndex(cqe.user_data);
+  Slot& slot = _slots[index];
+
+  // slots are released only after their requests complete
+  const bool more = cqe.flags & IORING_CQE_F_MORE;
+  if (request == Request::send) { --slot.sends; }
+  else if (! more) { slot.armed = false; }
+
+  const bool hasBuffer = cqe.flags & IORING_CQE_F_BUFFER;
+  const uint16_t bufferId = uint16_t(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+
+  if (slot.removed)
+  {
+    if (hasBuffer) { _uring->recycle(bufferId); }
+    if (! slot.armed && slot.sends == 0) { release(index); }
+    return;
+  }
+
+  // the handler might add handlers (and move the slots) or remove itself
+  IOHandler* pHandler = slot.pHandler;
+  const uint64_t handlerToken = cqe.user_data;
+  bool reuse = true;
+
+  switch (request)
+  {
+  case Request::poll:
+  {
+    if (cqe.res < 0 || (cqe.res & (EPOLLERR | EPOLLHUP)))
+    {
+      KVS_LOG_WARNING << "ERR/HUP on handler: " << pHandler << " res: " << cqe.res;
+      reuse = false;
+      break;
+    }
+
+    reuse = pHandler->dispatch();
+    break;
+  }
+  case Request::accept:
+  {
+    if (cqe.res >= 0)
+    {
+      pHandler->accepted(cqe.res);
     }
     else
     {
-      pHandler->dispatch();
+      KVS_LOG_WARNING << "Reactor: accept failed: " << strerror(-cqe.res);
+    }
+    break;
+  }
+  case Request::receive:
+  {
+    if (cqe.res == -ENOBUFS)
+    {
+      KVS_LOG_DEBUG << "Reactor: out of receive buffers";
+      break; // receive again, after the buffers are recycled
     }
+
+    if (cqe.res == -ECANCELED) { break; } // paused
+
+    // the handler closes the socket if not reused, the pending receive ends with the shutdown
+    reuse = (cqe.res > 0)
+      ? pHandler->received(_uring->buffer(bufferId), std::size_t(cqe.res))
+      : pHandler->received(nullptr, 0);
+
+    if (hasBuffer) { _uring->recycle(bufferId); }
+    break;
   }
+  case Request::send:
+  {
+    pHandler->sent(cqe.res);
+    break;
+  }
+  case Request::ignore:
+    break;
+  }
+
+  if (! current(handlerToken)) { return; }
 
-  return eventCount > 0;
+  if (! reuse)
+  {
+    remove(index);
+  }
+  else if (
+     ! more
+  && request != Request::send
+  && _slots[index].watch.request == request
+  && (request != Request::receive || (_slots[index].watch.events & EPOLLIN))
+  )
+  {
+    // the multishot request ended, or the receive completed: prepare a new one, unless paused
+    prepare(index);
+  }
 }
 
-bool Reactor::addToEpoll(IOHandler* pHandler, int fd, int events)
+void Reactor::prepare(uint32_t index)
 {
-  epoll_event ev;
-  ev.events = events;
-  ev.data.ptr = pHandler;
-  if (epoll_ctl(*_epollfd, EPOLL_CTL_ADD, fd, &ev) < 0)
+  Slot& slot = _slots[index];
+  const Watch& watch = slot.watch;
+  slot.armed = true;
+
+  io_uring_sqe& sqe = _uring->prepare();
+  sqe.fd = watch.fd;
+  sqe.user_data = token(index, watch.request);
+
+  switch (watch.request)
   {
-    KVS_LOG_ERROR << "Reactor: Failed to add handler: " << strerror(errno);
-    return false;
+  case Request::poll:
+    sqe.opcode = IORING_OP_POLL_ADD;
+    // multishot polls are edge triggered: level triggered ones are
+    // single shot, prepared again after dispatch, while the fd is ready
+    sqe.poll32_events = watch.events & ~(EPOLLET | EPOLLONESHOT);
+    sqe.len = (watch.events & EPOLLET) ? IORING_POLL_ADD_MULTI : 0;
+    break;
+  case Request::accept:
+    // accepted sockets are blocking, io_uring waits for them
+    sqe.opcode = IORING_OP_ACCEPT;
+    sqe.ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe.accept_flags = SOCK_CLOEXEC;
+    break;
+  case Request::receive:
+    // single shot: a multishot receive is rarely idle to be cancelled under load,
+    // paused streams must stop receiving
+    sqe.opcode = IORING_OP_RECV;
+    sqe.flags = IOSQE_BUFFER_SELECT;
+    sqe.buf_group = receiveGroup;
+    break;
+  case Request::send:
+  case Request::ignore:
+    break;
   }
+}
+
+void Reactor::send(IOHandler* pHandler, int fd, const msghdr* message)
+{
+  const uint32_t index = pHandler->_slot;
+  ++_slots[index].sends;
+
+  io_uring_sqe& sqe = _uring->prepare();
+  sqe.opcode = IORING_OP_SENDMSG;
+  sqe.fd = fd;
+  sqe.addr = reinterpret_cast<uintptr_t>(message);
+  sqe.len = 1;
+  sqe.msg_flags = MSG_NOSIGNAL;
+  sqe.user_data = token(index, Request::send);
+}
 
-  if ((events & EPOLLONESHOT) == false)
+void Reactor::close(int fd)
+{
+  if (_uring)
   {
-    std::lock_guard<std::mutex> lock(_fdsMutex);
-    _fdHandlers.insert({pHandler, fd});
+    // requests prepared for the fd are submitted before it is closed,
+    // they cannot end up on a new socket of the same number
+    io_uring_sqe& sqe = _uring->prepare();
+    sqe.opcode = IORING_OP_CLOSE;
+    sqe.fd = fd;
+    sqe.user_data = uint64_t(Request::ignore);
   }
+  else
+  {
+    ::close(fd);
+  }
+}
 
-  return true;
+void Reactor::stop()
+{
+  _stopped.store(true);
+  wakeup();
 }
 
-bool Reactor::removeFromEpoll(IOHandler* pHandler)
+void Reactor::post(Task task)
 {
-  std::lock_guard<std::mutex> lock(_fdsMutex);
-  auto finder = _fdHandlers.find(pHandler);
-  if (finder == _fdHandlers.end())
+  _tasks.push(std::move(task));
+  wakeup();
+}
+
+void Reactor::wakeup()
+{
+  // one write until the tasks run, the pushed task is visible to them
+  if (! _wakeupPending.exchange(true))
   {
-    return false;
+    const uint64_t one = 1;
+    ssize_t wsize = write(*_wakeupfd, &one, sizeof(one));
+    (void)wsize;
   }
+}
 
-  epoll_ctl(*_epollfd, EPOLL_CTL_DEL, finder->second, nullptr);
-  _fdHandlers.erase(finder);
-  return true;
+void Reactor::runTasks()
+{
+  uint64_t count;
+  ssize_t rsize = read(*_wakeupfd, &count, sizeof(count));
+  (void)rsize;
+
+  // tasks pushed after this wake up again
+  _wakeupPending.exchange(false);
+
+  Task task;
+  for (std::size_t i = 0; i < taskBudget; ++i)
+  {
+    if (! _tasks.pop(task)) { return; }
+    task();
+  }
+
+  dispatchAgain(_taskHandler.get());
+}
+
+void Reactor::setTimeout(IOHandler* pHandler, Clock::time_point deadline)
+{
+  const uint32_t index = pHandler->_slot;
+  if (index == noSlot) { return; }
+
+  _slots[index].deadline = deadline;
+  queueTimer(index);
+}
+
+void Reactor::queueTimer(uint32_t index)
+{
+  Slot& slot = _slots[index];
+
+  // a later deadline is queued when the queued timer expires
+  if (slot.deadline < slot.queued)
+  {
+    if (slot.queued != Clock::time_point::max()) { ++_staleTimers; }
+
+    slot.queued = slot.deadline;
+    _timers.push_back(Timer{slot.deadline, token(index, Request::poll)});
+    std::push_heap(_timers.begin(), _timers.end());
+
+    if (2 * _staleTimers > _timers.size()) { compactTimers(); }
+  }
 }
 
-void Reactor::addHandler(IOHandler* pHandler)
+bool Reactor::stale(const Timer& timer) const
 {
-  std::lock_guard<std::mutex> lock(_handlersMutex);
-  for (auto&& handlerPtr : _handlers)
+  return ! current(timer.token) || timer.deadline != _slots[tokenIndex(timer.token)].queued;
+}
+
+void Reactor::compactTimers()
+{
+  _timers.erase(
+    std::remove_if(_timers.begin(), _timers.end(), [this](const Timer& timer) { return stale(timer); }),
+    _timers.end()
+  );
+  std::make_heap(_timers.begin(), _timers.end());
+  _staleTimers = 0;
+}
+
+void Reactor::expireTimers()
+{
+  while (! _timers.empty() && _timers.front().deadline <= _now)
   {
-    if (handlerPtr == nullptr)
+    const Timer timer = _timers.front();
+    std::pop_heap(_timers.begin(), _timers.end());
+    _timers.pop_back();
+
+    // removed handler, or replaced by an earlier deadline
+    if (stale(timer))
     {
-      handlerPtr.reset(pHandler);
-      return;
+      --_staleTimers;
+      continue;
     }
+    const uint32_t index = tokenIndex(timer.token);
+    Slot& slot = _slots[index];
+
+    slot.queued = Clock::time_point::max();
+
+    // the deadline moved later, or was cancelled
+    if (slot.deadline > _now)
+    {
+      queueTimer(index);
+      continue;
+    }
+
+    slot.deadline = Clock::time_point::max();
+    if (! slot.pHandler->timedOut() && current(timer.token))
+    {
+      remove(index);
+    }
+  }
+}
+
+int Reactor::timerTimeout(int timeout) const
+{
+  if (_timers.empty()) { return timeout; }
+
+  const Clock::duration until = _timers.front().deadline - Clock::now();
+  if (until <= Clock::duration::zero()) { return 0; }
+
+  // rounded up, not to wake up just before the deadline
+  const auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(until).count() + 1;
+  return int(std::min<decltype(ms)>(ms, timeout));
+}
+
+void Reactor::dispatchAgain(IOHandler* pHandler)
+{
+  _pending.push_back(token(pHandler->_slot, Request::poll));
+}
+
+bool Reactor::addWatch(uint32_t index, int fd, int events, Request request)
+{
+  _slots[index].watch = Watch{fd, events, request};
+
+  if (_uring)
+  {
+    prepare(index);
+    return true;
+  }
+
+  epoll_event ev;
+  ev.events = events;
+  ev.data.u64 = token(index, request);
+  if (epoll_ctl(*_epollfd, EPOLL_CTL_ADD, fd, &ev) < 0)
+  {
+    KVS_LOG_ERROR << "Reactor: Failed to add handler: " << strerror(errno);
+    _slots[index].watch.fd = -1;
+    remove(index);
+    return false;
+  }
+
+  return true;
+}
+
+uint32_t Reactor::addSlot(IOHandler* pHandler, bool owned)
+{
+  uint32_t index = _freeSlot;
+  if (index != noSlot)
+  {
+    _freeSlot = _slots[index].nextFree;
   }
+  else
+  {
+    check(_slots.size() < maxSlots);
+    index = uint32_t(_slots.size());
+    _slots.push_back(Slot{
+      nullptr, false, false, false, 0, 0, noSlot, Watch{-1, 0, Request::poll},
+      Clock::time_point::max(), Clock::time_point::max()
+    });
+  }
+
+  Slot& slot = _slots[index];
+  slot.pHandler = pHandler;
+  slot.owned = owned;
+  slot.removed = false;
+  slot.armed = false;
+  slot.sends = 0;
+  slot.watch = Watch{-1, 0, Request::poll};
+  slot.deadline = Clock::time_point::max();
+  slot.queued = Clock::time_point::max(); // timers of the earlier handler are stale
 
-  _handlers.emplace_back(pHandler);
+  pHandler->_slot = index;
+  return index;
 }
 
-void Reactor::removeHandler(IOHandler* toDelete)
+void Reactor::remove(uint32_t index)
 {
-  std::lock_guard<std::mutex> lock(_handlersMutex);
-  for (auto&& handlerPtr: _handlers)
+  Slot& slot = _slots[index];
+  if (slot.removed) { return; }
+
+  slot.removed = true;
+  slot.pHandler->_slot = noSlot;
+
+  // its queued timer is stale
+  if (slot.queued != Clock::time_point::max())
+  {
+    slot.queued = Clock::time_point::max();
+    ++_staleTimers;
+  }
+
+  if (_uring)
   {
-    if (handlerPtr.get() == toDelete)
+    if (slot.armed)
     {
-      handlerPtr.release();
-      return;
+      io_uring_sqe& sqe = _uring->prepare();
+      sqe.opcode = IORING_OP_ASYNC_CANCEL;
+      sqe.fd = -1;
+      sqe.addr = token(index, slot.watch.request);
+      sqe.user_data = uint64_t(Request::ignore);
     }
   }
+  else if (slot.watch.fd >= 0)
+  {
+    // fails, if the handler closed its fd already
+    epoll_ctl(*_epollfd, EPOLL_CTL_DEL, slot.watch.fd, nullptr);
+  }
+
+  if (! slot.armed && slot.sends == 0) { release(index); }
+}
+
+void Reactor::release(uint32_t index)
+{
+  Slot& slot = _slots[index];
+  IOHandler* pHandler = slot.pHandler;
+  const bool owned = slot.owned;
+
+  slot.pHandler = nullptr;
+  ++slot.generation;
+  slot.nextFree = _freeSlot;
+  _freeSlot = index;
+
+  if (owned) { delete pHandler; }
+}
+
+uint64_t Reactor::token(uint32_t index, Request request) const
+{
+  return (uint64_t(_slots[index].generation) << 32)
+    | (uint64_t(index) << requestBits)
+    | uint64_t(request);
+}
+
+bool Reactor::current(uint64_t token) const
+{
+  const uint32_t index = tokenIndex(token);
+  return index < _slots.size()
+    && _slots[index].pHandler
+    && ! _slots[index].removed
+    && _slots[index].generation == uint32_t(token >> 32);
 }
 
 } // namespace
@@ -3,54 +3,282 @@
 
 #include <vector>
 #include <memory>
-#include <mutex>
-#include <map>
 #include <atomic>
+#include <chrono>
+#include <cstdint>
 
 #include <sys/epoll.h>
 
 #include <kvs/Fd.hpp>
 #include <kvs/IOHandler.hpp>
+#include <kvs/BufferPool.hpp>
+#include <kvs/TaskQueue.hpp>
+
+struct io_uring_cqe;
+struct msghdr;
 
 namespace kvs {
 
+class Uring;
+
 class Reactor
 {
 public:
-  Reactor();
+  /**
+   * Level triggered handlers are dispatched while their fd is ready,
+   * edge triggered handlers (registered with `edgeFlag()`) only when
+   * it becomes ready: they must drain it, or ask to be dispatched again.
+   */
+  enum class Trigger { level, edge };
+
+  /**
+   * epoll: handlers are dispatched when their fd is ready, and do their own I/O.
+   *
+   * uring: io_uring. Listeners and streams are completion based: connections
+   * are accepted by multishot requests, input is received into a ring of
+   * provided buffers, sends are submitted with the next wait.
+   * Other handlers are dispatched by polls. The trigger of the reactor is ignored.
+   */
+  enum class Backend { epoll, uring };
 
+  /**
+   * Handlers must be added and removed, and sends started by the dispatching thread,
+   * or before it starts dispatching.
+   */
+  explicit Reactor(Trigger trigger = Trigger::level, Backend backend = Backend::epoll);
+  ~Reactor();
+
+  /**
+   * Adds a handler owned by the reactor: deleted when its `dispatch` or `received`
+   * returns false, or on error, after its pending requests complete.
+   * @returns the handler, or nullptr if it could not be added
+   */
   template <typename Handler, typename... HandlerArgs>
-  bool addHandler(int fd, int events, HandlerArgs&&... handlerArgs);
+  Handler* addHandler(int fd, int events, HandlerArgs&&... handlerArgs);
 
+  /** Adds a handler owned by the caller, it must be removed before destroyed */
   bool addHandler(IOHandler* pHandler, int fd, int events);
+
+  /**
+   * Changes the watched events of the handler.
+   * Completion based streams stop receiving without EPOLLIN.
+   */
   bool readdHandler(IOHandler* pHandler, int fd, int events);
 
+  /** Stops watching a handler owned by the caller, if not removed already */
+  void removeHandler(IOHandler* pHandler);
+
+  /**
+   * Adds the handler of a listening socket: dispatched when EPOLLIN,
+   * or gets every `accepted` connection, if completion based.
+   */
+  bool addAcceptor(IOHandler* pHandler, int fd);
+
+  /**
+   * Adds the handler of a connected socket: dispatched when EPOLLIN
+   * (and edge triggered, if set), or gets the `received` input, if completion based.
+   * @returns the handler, or nullptr if it could not be added
+   */
+  template <typename Handler, typename... HandlerArgs>
+  Handler* addStream(int fd, HandlerArgs&&... handlerArgs);
+
+  /**
+   * Completion based only: sends `message` on `fd`, calls `pHandler->sent`
+   * when done. `message` and the data it refers to must be valid until then.
+   */
+  void send(IOHandler* pHandler, int fd, const msghdr* message);
+
+  /** Closes `fd`, after the requests prepared for it are submitted */
+  void close(int fd);
+
+  /** @returns true, if listeners and streams are completion based */
+  bool completionBased() const { return _uring != nullptr; }
+
   bool dispatch();
 
+  /**
+   * Dispatches `pHandler` in the next round, without waiting for an event.
+   * For edge triggered handlers which stopped reading before EAGAIN,
+   * to let the other handlers run.
+   */
+  void dispatchAgain(IOHandler* pHandler);
+
+  bool edgeTriggered() const { return _trigger == Trigger::edge; }
+
+  /**
+   * Busy polling: after an event, waits with a zero timeout until `budget` passes
+   * without events, before blocking. Trades a core for wakeup latency, best with
+   * the dispatching thread pinned (see `pinThread`). Zero disables it (default).
+   * Accepted sockets busy poll their device queue too, if permitted (SO_BUSY_POLL).
+   */
+  void setBusyPoll(std::chrono::microseconds budget) { _busyPoll = budget; }
+
+  std::chrono::microseconds busyPoll() const { return _busyPoll; }
+
+  /** @returns EPOLLET in edge triggered mode, for handlers which drain their fd */
+  int edgeFlag() const { return edgeTriggered() ? int(EPOLLET) : 0; }
+
+  typedef std::chrono::steady_clock Clock;
+
+  /** @returns the time of the current round, cheaper than reading the clock */
+  Clock::time_point now() const { return _now; }
+
+  /**
+   * Calls `pHandler->timedOut()` after `deadline`, replaces the earlier deadline
+   * of the handler, if any. `Clock::time_point::max()` cancels it.
+   * Moving the deadline later is O(1), earlier is O(log n) and leaves the
+   * earlier timer stale in the heap, until it expires or the stale timers
+   * outnumber the live ones.
+   */
+  void setTimeout(IOHandler* pHandler, Clock::time_point deadline);
+
   bool isStopped() const { return _stopped.load(); }
-  void stop() { _stopped.store(true); }
+
+  /** Thread safe, wakes up the dispatching thread */
+  void stop();
+
+  typedef TaskQueue::Task Task;
+
+  /**
+   * Runs `task` on the dispatching thread, in a following dispatch.
+   * Thread safe and lock-free, e.g: for completions of other threads.
+   * Tasks not run when the reactor is destroyed are dropped.
+   */
+  void post(Task task);
+
+  /** Buffers shared by the handlers of this reactor */
+  BufferPool& bufferPool() { return _bufferPool; }
 
 private:
-  void addHandler(IOHandler* pHandler);
-  bool addToEpoll(IOHandler* pHandler, int fd, int events);
-  bool removeFromEpoll(IOHandler* pHandler);
-  void removeHandler(IOHandler* toDelete);
+  /** Runs the posted tasks, when woken up */
+  class TaskHandler;
+
+  /** Makes the wakeup eventfd readable, unless already */
+  void wakeup();
+
+  /** Runs the posted tasks, at most `taskBudget` in a dispatch */
+  void runTasks();
+
+  /** Tasks run in a dispatch, the rest run after the other handlers */
+  static constexpr std::size_t taskBudget = 1024;
+
+  /**
+   * Kind of the io_uring request.
+   *
+   * Events and completions refer to handlers by tokens: the generation of the slot
+   * in the high 32 bits, the slot index and the request in the low bits.
+   * The generation changes when the slot is released, events of a removed handler
+   * are ignored, even if its slot is reused.
+   */
+  enum class Request : uint64_t { poll, accept, receive, send, ignore };
+  static constexpr uint64_t requestBits = 3;
+  static constexpr uint64_t requestMask = (uint64_t(1) << requestBits) - 1;
+  static constexpr uint32_t maxSlots = uint32_t(1) << (32 - requestBits);
+
+  /** The fd of a handler, and the events it is polled for */
+  struct Watch
+  {
+    int fd;
+    int events;
+    Request request;
+  };
+
+  /** Entry of the handler table, free slots form a list */
+  struct Slot
+  {
+    IOHandler* pHandler; // nullptr, if free
+    bool owned;
+    bool removed; // released when its requests complete
+    bool armed;   // the io_uring request of the watch is pending
+    uint32_t sends; // io_uring sends in progress
+    uint32_t generation;
+    uint32_t nextFree;
+    Watch watch;
+    Clock::time_point deadline; // of the timeout, max if none
+    Clock::time_point queued;   // of the timer queued for the slot, max if none
+  };
+
+  /** Entry of the timer heap, stale if its deadline is not the queued one of the slot */
+  struct Timer
+  {
+    Clock::time_point deadline;
+    uint64_t token;
+
+    /** Orders the heap by the earliest deadline */
+    bool operator<(const Timer& rhs) const { return deadline > rhs.deadline; }
+  };
+
+  /** @returns the index of a new slot of `pHandler` */
+  uint32_t addSlot(IOHandler* pHandler, bool owned);
+  /** Stops watching the handler of `index`, releases the slot if it has no pending requests */
+  void remove(uint32_t index);
+  /** Deletes the handler, if owned, makes the slot free */
+  void release(uint32_t index);
 
+  uint64_t token(uint32_t index, Request request) const;
+  static uint32_t tokenIndex(uint64_t token) { return uint32_t(token) >> requestBits; }
+  /** @returns true, if the handler of the token is not removed */
+  bool current(uint64_t token) const;
+
+  bool addWatch(uint32_t index, int fd, int events, Request request);
+
+  /** Queues the timer of a slot, if its deadline is earlier than the queued one */
+  void queueTimer(uint32_t index);
+  /** @returns true, if the handler of the timer is removed, or its deadline is replaced */
+  bool stale(const Timer& timer) const;
+  /** Drops the stale timers of the heap */
+  void compactTimers();
+  /** Calls the handlers whose deadline passed */
+  void expireTimers();
+  /** @returns the wait timeout, at most `timeout`, until the first queued deadline */
+  int timerTimeout(int timeout) const;
+
+  std::size_t waitEpoll(int timeout);
+  std::size_t waitUring(int timeout);
+  void prepare(uint32_t index);
+  void complete(const io_uring_cqe& cqe);
+
+  /** Size limits of the event array, which grows when filled by a single wait */
+  static constexpr std::size_t minEvents = 16;
+  static constexpr std::size_t maxEvents = 1024;
+
+  const Trigger _trigger;
   std::atomic<bool> _stopped;
   Fd _epollfd;
-  std::mutex _handlersMutex;
-  std::vector<std::unique_ptr<IOHandler>> _handlers;
-  std::mutex _fdsMutex;
-  std::map<IOHandler*, int> _fdHandlers;
+  std::vector<epoll_event> _events;
+  std::unique_ptr<Uring> _uring;
+  std::vector<uint64_t> _pending; // tokens of handlers dispatched again in the next round
+  BufferPool _bufferPool; // outlives the handlers
+  std::vector<Slot> _slots;
+  uint32_t _freeSlot; // head of the free list
+
+  // a single live timer per slot: later deadlines are queued when it expires,
+  // earlier ones are queued at once, making the timer queued before stale
+  std::vector<Timer> _timers; // heap
+  std::size_t _staleTimers;   // in the heap
+  Clock::time_point _now;
+
+  std::chrono::microseconds _busyPoll;
+  Clock::time_point _lastEvent; // or a handler dispatched again, ends the busy polling budget later
+
+  TaskQueue _tasks;
+  Fd _wakeupfd; // eventfd, watched by the task handler
+  std::atomic<bool> _wakeupPending; // written to the eventfd, tasks not run yet
+  std::unique_ptr<TaskHandler> _taskHandler;
 };
 
 template <typename Handler, typename... HandlerArgs>
-bool Reactor::addHandler(int fd, int events, HandlerArgs&&... handlerArgs)
+Handler* Reactor::addHandler(int fd, int events, HandlerArgs&&... handlerArgs)
 {
-  IOHandler* pHandler = new Handler(std::forward<HandlerArgs>(handlerArgs)...);
-  addHandler(pHandler);
+  Handler* pHandler = new Handler(std::forward<HandlerArgs>(handlerArgs)...);
+  return addWatch(addSlot(pHandler, true), fd, events, Request::poll) ? pHandler : nullptr;
+}
 
-  return addToEpoll(pHandler, fd, events);
+template <typename Handler, typename... HandlerArgs>
+Handler* Reactor::addStream(int fd, HandlerArgs&&... handlerArgs)
+{
+  Handler* pHandler = new Handler(std::forward<HandlerArgs>(handlerArgs)...);
+  return addWatch(addSlot(pHandler, true), fd, EPOLLIN | edgeFlag(), Request::receive) ? pHandler : nullptr;
 }
 
 } // namespace kvs
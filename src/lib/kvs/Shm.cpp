@@ -0,0 +1,380 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring> // memcpy, memset
+#include <new>
+#include <type_traits>
+
+#include <linux/futex.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <kvs/Shm.hpp>
+#include <kvs/Error.hpp>
+#include <kvs/UnixSocket.hpp>
+
+namespace kvs {
+namespace shm {
+
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "futex words are atomics");
+static_assert(std::is_standard_layout<Header>::value, "the header is shared by processes");
+
+constexpr uint32_t Header::magic;
+
+namespace {
+
+/** Checks of the other side while waiting */
+constexpr std::chrono::milliseconds checkInterval(100);
+
+/** Maximum number of fds passed by `sendFds` and `recvFds` */
+constexpr std::size_t maxFds = 4;
+
+/** Hint of a busy wait loop */
+inline void relax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#endif
+}
+
+long futex(std::atomic<uint32_t>& word, int op, uint32_t value, const timespec* timeout)
+{
+  // not FUTEX_PRIVATE_FLAG: the word is shared by processes
+  return syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), op, value, timeout, nullptr, 0);
+}
+
+} // namespace
+
+void wake(std::atomic<uint32_t>& word)
+{
+  futex(word, FUTEX_WAKE, INT32_MAX, nullptr);
+}
+
+void wait(std::atomic<uint32_t>& word, uint32_t expected, std::chrono::milliseconds timeout)
+{
+  timespec ts;
+  ts.tv_sec = timeout.count() / 1000;
+  ts.tv_nsec = (timeout.count() % 1000) * 1000000;
+
+  // EAGAIN: changed already, EINTR, ETIMEDOUT: checked by the caller
+  futex(word, FUTEX_WAIT, expected, &ts);
+}
+
+void ring(int doorbell)
+{
+  const uint64_t one = 1;
+  // EAGAIN: the counter is full, the doorbell is readable anyway
+  if (::write(doorbell, &one, sizeof(one)) < 0 && errno != EAGAIN) { failure("shm doorbell"); }
+}
+
+bool sendFds(int socket, const int* fds, std::size_t count)
+{
+  check(count <= maxFds);
+
+  char byte = 0;
+  iovec vec{&byte, sizeof(byte)};
+
+  char control[CMSG_SPACE(maxFds * sizeof(int))];
+  memset(control, 0, sizeof(control));
+
+  msghdr message;
+  memset(&message, 0, sizeof(message));
+  message.msg_iov = &vec;
+  message.msg_iovlen = 1;
+  message.msg_control = control;
+  message.msg_controllen = CMSG_SPACE(count * sizeof(int));
+
+  cmsghdr* cmsg = CMSG_FIRSTHDR(&message);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(count * sizeof(int));
+  memcpy(CMSG_DATA(cmsg), fds, count * sizeof(int));
+
+  return sendmsg(socket, &message, MSG_NOSIGNAL) == sizeof(byte);
+}
+
+bool recvFds(int socket, int* fds, std::size_t count)
+{
+  check(count <= maxFds);
+
+  char byte;
+  iovec vec{&byte, sizeof(byte)};
+
+  char control[CMSG_SPACE(maxFds * sizeof(int))];
+
+  msghdr message;
+  memset(&message, 0, sizeof(message));
+  message.msg_iov = &vec;
+  message.msg_iovlen = 1;
+  message.msg_control = control;
+  message.msg_controllen = sizeof(control);
+
+  ssize_t rsize;
+  do { rsize = recvmsg(socket, &message, MSG_CMSG_CLOEXEC); } while (rsize < 0 && errno == EINTR);
+  if (rsize != sizeof(byte)) { return false; }
+
+  cmsghdr* cmsg = CMSG_FIRSTHDR(&message);
+  if (! cmsg || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) { return false; }
+
+  const std::size_t received = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+  memcpy(fds, CMSG_DATA(cmsg), std::min(received, count) * sizeof(int));
+
+  // unexpected extra fds are not leaked
+  for (std::size_t i = count; i < received; ++i)
+  {
+    int fd;
+    memcpy(&fd, CMSG_DATA(cmsg) + i * sizeof(int), sizeof(fd));
+    ::close(fd);
+  }
+
+  if (received == count) { return true; }
+
+  for (std::size_t i = 0; i < std::min(received, count); ++i) { ::close(fds[i]); }
+  return false;
+}
+
+std::size_t RingView::write(const iovec* vec, std::size_t count)
+{
+  const uint32_t capacity = _mask + 1;
+  const uint32_t head = _control->head.load(std::memory_order_acquire);
+  uint32_t tail = _control->tail.load(std::memory_order_relaxed);
+
+  // the positions are written by the other process too: never out of the ring
+  uint32_t used = std::min(tail - head, capacity);
+
+  std::size_t written = 0;
+  for (std::size_t i = 0; i < count; ++i)
+  {
+    const char* data = static_cast<const char*>(vec[i].iov_base);
+    const std::size_t size = std::min<std::size_t>(vec[i].iov_len, capacity - used);
+    if (size == 0) { break; }
+
+    // up to the end of the ring, the rest at the start
+    const uint32_t offset = tail & _mask;
+    const std::size_t first = std::min<std::size_t>(size, capacity - offset);
+    memcpy(_data + offset, data, first);
+    memcpy(_data, data + first, size - first);
+
+    tail += uint32_t(size);
+    used += uint32_t(size);
+    written += size;
+  }
+
+  if (written) { _control->tail.store(tail); }
+  return written;
+}
+
+std::size_t RingView::read(char* data, std::size_t size)
+{
+  const uint32_t capacity = _mask + 1;
+  const uint32_t tail = _control->tail.load(std::memory_order_acquire);
+  const uint32_t head = _control->head.load(std::memory_order_relaxed);
+
+  size = std::min<std::size_t>(size, std::min(tail - head, capacity));
+  if (size == 0) { return 0; }
+
+  const uint32_t offset = head & _mask;
+  const std::size_t first = std::min<std::size_t>(size, capacity - offset);
+  memcpy(data, _data + offset, first);
+  memcpy(data + first, _data, size - first);
+
+  _control->head.store(head + uint32_t(size));
+  return size;
+}
+
+Segment::Segment(uint32_t capacity)
+  :_fd(memfd_create("kvs-shm", MFD_CLOEXEC)),
+   _size(sizeof(Header) + 2 * std::size_t(capacity))
+{
+  check(capacity >= 64 && capacity <= (uint32_t(1) << 30) && (capacity & (capacity - 1)) == 0);
+  check(_fd && ftruncate(*_fd, off_t(_size)) == 0);
+
+  map();
+
+  Header& h = *new (_base) Header;
+  h.tag = Header::magic;
+  h.capacity = capacity;
+  h.clientClosed = 0;
+  h.serverClosed = 0;
+
+  for (Ring* pRing : {&h.requests, &h.responses})
+  {
+    pRing->head = 0;
+    pRing->tail = 0;
+    pRing->producerWaiting = 0;
+    pRing->consumerWaiting = 0;
+  }
+
+  // the server waits for the first request
+  h.requests.consumerWaiting = 1;
+}
+
+Segment::Segment(Fd fd)
+  :_fd(std::move(fd))
+{
+  struct stat info;
+  check(_fd && fstat(*_fd, &info) == 0 && std::size_t(info.st_size) >= sizeof(Header));
+  _size = std::size_t(info.st_size);
+
+  map();
+
+  // the size is fixed by the creator: the rings must fit
+  const Header& h = header();
+  if (h.tag != Header::magic || ! h.capacity || (h.capacity & (h.capacity - 1))
+    || sizeof(Header) + 2 * std::size_t(h.capacity) > _size)
+  {
+    munmap(_base, _size);
+    _base = nullptr;
+    check(false);
+  }
+}
+
+Segment::~Segment()
+{
+  if (_base) { munmap(_base, _size); }
+}
+
+void Segment::map()
+{
+  void* base = mmap(nullptr, _size, PROT_READ | PROT_WRITE, MAP_SHARED, *_fd, 0);
+  check(base != MAP_FAILED);
+  _base = base;
+}
+
+RingView Segment::requests()
+{
+  Header& h = header();
+  return RingView(h.requests, static_cast<char*>(_base) + sizeof(Header), h.capacity);
+}
+
+RingView Segment::responses()
+{
+  Header& h = header();
+  return RingView(h.responses, static_cast<char*>(_base) + sizeof(Header) + h.capacity, h.capacity);
+}
+
+} // namespace shm
+
+ShmChannel::ShmChannel(const std::string& path, std::size_t spin)
+  :_spin(spin)
+{
+  sockaddr_un address;
+  const socklen_t addressSize = unixAddress(path, address);
+
+  if (! (_socket = socket(PF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)))
+  {
+    failure("ShmChannel socket");
+  }
+
+  if (connect(*_socket, reinterpret_cast<sockaddr*>(&address), addressSize) < 0)
+  {
+    failure("ShmChannel connect");
+  }
+
+  // the segment and the doorbell
+  int fds[2];
+  if (! shm::recvFds(*_socket, fds, 2)) { failure("ShmChannel: handshake"); }
+
+  _doorbell = fds[1];
+  _segment.reset(new shm::Segment(Fd(fds[0])));
+  _header = &_segment->header();
+  _requests = _segment->requests();
+  _responses = _segment->responses();
+}
+
+ShmChannel::~ShmChannel()
+{
+  _header->clientClosed.store(1);
+  shm::ring(*_doorbell);
+}
+
+void ShmChannel::write(iovec* vec, std::size_t count)
+{
+  shm::Ring& control = _requests.control();
+
+  while (count)
+  {
+    std::size_t written = _requests.write(vec, count);
+
+    // the server sleeps only if it found the ring empty
+    if (written && control.consumerWaiting.exchange(0)) { shm::ring(*_doorbell); }
+
+    // skip the written vectors, continue the partially written one
+    while (count && written >= vec->iov_len)
+    {
+      written -= vec->iov_len;
+      ++vec;
+      --count;
+    }
+
+    if (written)
+    {
+      vec->iov_base = static_cast<char*>(vec->iov_base) + written;
+      vec->iov_len -= written;
+    }
+
+    if (! count) { break; }
+
+    // full: wait for the server to read
+    const uint32_t head = control.head.load();
+    control.producerWaiting.store(1);
+    if (_requests.full()) { wait(control.head, head); }
+  }
+}
+
+void ShmChannel::read(char* data, std::size_t size)
+{
+  while (size)
+  {
+    const std::size_t rsize = readSome(data, size);
+    data += rsize;
+    size -= rsize;
+  }
+}
+
+std::size_t ShmChannel::readSome(char* data, std::size_t size)
+{
+  shm::Ring& control = _responses.control();
+
+  for (;;)
+  {
+    const std::size_t rsize = _responses.read(data, size);
+    if (rsize)
+    {
+      // the server waits for space
+      if (control.producerWaiting.exchange(0)) { shm::ring(*_doorbell); }
+      return rsize;
+    }
+
+    // busy poll, cheaper than a wakeup if the response is close
+    for (std::size_t i = 0; i < _spin && _responses.empty(); ++i) { shm::relax(); }
+    if (! _responses.empty()) { continue; }
+
+    const uint32_t tail = control.tail.load();
+    control.consumerWaiting.store(1);
+    if (_responses.empty()) { wait(control.tail, tail); }
+    control.consumerWaiting.store(0);
+  }
+}
+
+void ShmChannel::wait(std::atomic<uint32_t>& word, uint32_t expected)
+{
+  shm::wait(word, expected, shm::checkInterval);
+
+  if (word.load() != expected) { return; }
+
+  // woken up by the close, or by the timeout: the server might be gone
+  if (closed()) { failure("ShmChannel: server closed"); }
+}
+
+bool ShmChannel::closed() const
+{
+  char byte;
+  return _header->serverClosed.load() || recv(*_socket, &byte, 1, MSG_PEEK | MSG_DONTWAIT) == 0;
+}
+
+} // namespace kvs
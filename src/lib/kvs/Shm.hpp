@@ -0,0 +1,183 @@
+#ifndef KVS_SHM_HPP_
+#define KVS_SHM_HPP_
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include <sys/uio.h>
+
+#include <kvs/Fd.hpp>
+
+namespace kvs {
+
+/**
+ * Shared memory transport of same host clients.
+ *
+ * A client connects to the unix socket of a ShmListener, which responds
+ * a memfd segment and an eventfd doorbell (SCM_RIGHTS). The segment holds
+ * two single producer, single consumer byte rings: requests and responses,
+ * carrying the frames of the socket transport.
+ *
+ * The server waits for requests by the reactor, the client rings the doorbell
+ * only if the server found the request ring empty. The client waits for
+ * responses by a futex on the tail of the response ring, after polling it,
+ * if configured. A full ring is waited for the same way, by the other side.
+ *
+ * The connection ends when either side closes it, or its socket hangs up.
+ */
+namespace shm {
+
+/** Control block of a ring, the positions wrap around */
+struct Ring
+{
+  alignas(64) std::atomic<uint32_t> head; // read, advanced by the consumer
+  std::atomic<uint32_t> producerWaiting;  // for space, waits on `head` or the doorbell
+  alignas(64) std::atomic<uint32_t> tail; // written, advanced by the producer
+  std::atomic<uint32_t> consumerWaiting;  // for data, waits on `tail` or the doorbell
+};
+
+/** Start of the segment, followed by the data of the request and the response ring */
+struct Header
+{
+  static constexpr uint32_t magic = 0x6b767331; // "kvs1"
+
+  uint32_t tag;
+  uint32_t capacity; // of each ring, a power of two
+  std::atomic<uint32_t> clientClosed;
+  std::atomic<uint32_t> serverClosed;
+  Ring requests;
+  Ring responses;
+};
+
+/** Ring capacity of the listeners, by default */
+constexpr uint32_t defaultCapacity = 1 << 20;
+
+/** Wakes the waiters of `word`, in any process */
+void wake(std::atomic<uint32_t>& word);
+
+/**
+ * Sleeps while `word` is `expected`, at most `timeout`.
+ * Might return early, the caller checks the condition again.
+ */
+void wait(std::atomic<uint32_t>& word, uint32_t expected, std::chrono::milliseconds timeout);
+
+/** Makes the eventfd `doorbell` readable */
+void ring(int doorbell);
+
+/** Sends `count` fds on the unix socket `socket`. @returns false on error */
+bool sendFds(int socket, const int* fds, std::size_t count);
+
+/** Receives `count` fds of the unix socket `socket`, blocks. @returns false on error */
+bool recvFds(int socket, int* fds, std::size_t count);
+
+/**
+ * Producer or consumer side of a ring.
+ * Positions are published with sequentially consistent stores: the waiting flags
+ * are stored before the positions are checked again, waits are not lost.
+ */
+class RingView
+{
+public:
+  RingView() = default;
+
+  RingView(Ring& control, char* data, uint32_t capacity)
+    :_control(&control),
+     _data(data),
+     _mask(capacity - 1)
+  {}
+
+  Ring& control() { return *_control; }
+
+  bool empty() const { return _control->tail.load() == _control->head.load(); }
+
+  bool full() const { return _control->tail.load() - _control->head.load() == _mask + 1; }
+
+  /** Producer: copies the vectors, while they fit. @returns the number of bytes written */
+  std::size_t write(const iovec* vec, std::size_t count);
+
+  /** Consumer: copies at most `size` bytes. @returns the number of bytes read */
+  std::size_t read(char* data, std::size_t size);
+
+private:
+  Ring* _control = nullptr;
+  char* _data = nullptr;
+  uint32_t _mask = 0;
+};
+
+/** A mapped memfd segment */
+class Segment
+{
+public:
+  /** Creates a segment of rings of `capacity` bytes, a power of two. Throws std::runtime_error on error */
+  explicit Segment(uint32_t capacity);
+
+  /** Maps the segment of `fd`, created by the other side. Throws std::runtime_error if invalid */
+  explicit Segment(Fd fd);
+
+  ~Segment();
+
+  Segment(const Segment&) = delete;
+  void operator=(const Segment&) = delete;
+
+  int fd() const { return *_fd; }
+
+  Header& header() { return *static_cast<Header*>(_base); }
+
+  RingView requests();
+  RingView responses();
+
+private:
+  void map();
+
+  Fd _fd;
+  void* _base = nullptr;
+  std::size_t _size = 0;
+};
+
+} // namespace shm
+
+/** Client side of a shared memory connection, see `shm` */
+class ShmChannel
+{
+public:
+  /**
+   * Connects to the ShmListener of the unix socket `path`.
+   * Waiting for responses polls the ring `spin` times before sleeping.
+   */
+  ShmChannel(const std::string& path, std::size_t spin);
+
+  /** Tells the server to close the connection */
+  ~ShmChannel();
+
+  /** Writes all of `vec` to the request ring, waits while it is full. Modifies `vec` */
+  void write(iovec* vec, std::size_t count);
+
+  /** Reads `size` bytes of the response ring, waits until received */
+  void read(char* data, std::size_t size);
+
+  /** Reads at most `size` bytes of the response ring, waits for at least one. @returns the size read */
+  std::size_t readSome(char* data, std::size_t size);
+
+  /** @returns true, if the server closed the connection, or it is gone */
+  bool closed() const;
+
+private:
+  /** Waits for `word` to change from `expected`, fails if the server is gone */
+  void wait(std::atomic<uint32_t>& word, uint32_t expected);
+
+  Fd _socket; // hangs up when the server is gone
+  Fd _doorbell;
+  std::unique_ptr<shm::Segment> _segment;
+  shm::Header* _header;
+  shm::RingView _requests;
+  shm::RingView _responses;
+  const std::size_t _spin;
+};
+
+} // namespace kvs
+
+#endif // KVS_SHM_HPP_
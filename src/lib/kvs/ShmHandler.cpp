@@ -0,0 +1,140 @@
+#include <cerrno>
+#include <climits> // IOV_MAX
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <kvs/ShmHandler.hpp>
+#include <kvs/Log.hpp>
+#include <kvs/Reactor.hpp>
+
+namespace kvs {
+
+constexpr std::chrono::seconds ShmHandler::peerCheckInterval;
+
+ShmHandler::ShmHandler(
+  int doorbell, Fd socket, std::unique_ptr<shm::Segment> segment,
+  Store& store, Reactor& reactor, WorkerPool* pWorkers
+)
+  :CommandHandler(doorbell, store, reactor, Timeouts(), pWorkers),
+   _doorbell(doorbell),
+   _socket(std::move(socket)),
+   _segment(std::move(segment)),
+   _header(_segment->header()),
+   _requests(_segment->requests()),
+   _responses(_segment->responses()),
+   _reactor(reactor),
+   _armed(true),
+   _lastInput(reactor.now()),
+   _polling(false)
+{}
+
+ShmHandler::~ShmHandler()
+{
+  _header.serverClosed.store(1);
+  shm::wake(_header.responses.tail);
+  shm::wake(_header.requests.head);
+}
+
+void ShmHandler::checkPeerLater()
+{
+  _reactor.setTimeout(this, _reactor.now() + peerCheckInterval);
+}
+
+bool ShmHandler::dispatch()
+{
+  // rung only after a waiting flag is set: otherwise the rings are checked without a read
+  if (_armed)
+  {
+    uint64_t count;
+    while (read(_doorbell, &count, sizeof(count)) < 0 && errno == EINTR) {}
+    _armed = false;
+  }
+
+  _polling = false;
+  if (! CommandHandler::dispatch()) { return false; }
+
+  if (_polling) { _reactor.dispatchAgain(this); }
+  return true;
+}
+
+bool ShmHandler::timedOut()
+{
+  char byte;
+  const ssize_t rsize = recv(*_socket, &byte, 1, MSG_PEEK | MSG_DONTWAIT);
+  if (rsize == 0 || (rsize < 0 && errno != EAGAIN && errno != EWOULDBLOCK))
+  {
+    KVS_LOG_INFO << "ShmHandler: client gone";
+    return false;
+  }
+
+  checkPeerLater();
+  return true;
+}
+
+ssize_t ShmHandler::readInput(char* data, std::size_t size)
+{
+  shm::Ring& control = _requests.control();
+
+  std::size_t rsize = _requests.read(data, size);
+  if (rsize) { _lastInput = _reactor.now(); }
+
+  if (rsize < size)
+  {
+    if (_reactor.now() - _lastInput < _reactor.busyPoll())
+    {
+      // busy polling: read again in the next round, the client does not ring
+      _polling = true;
+    }
+    else
+    {
+      // drained: the client rings the doorbell with its next request
+      control.consumerWaiting.store(1);
+      _armed = true;
+
+      rsize += _requests.read(data + rsize, size - rsize);
+    }
+
+    if (rsize == 0)
+    {
+      if (_header.clientClosed.load()) { return 0; }
+
+      errno = EAGAIN;
+      return -1;
+    }
+  }
+
+  // the client waits for space
+  if (control.producerWaiting.exchange(0)) { shm::wake(control.head); }
+
+  return ssize_t(rsize);
+}
+
+bool ShmHandler::writeOutput(OutputQueue& output)
+{
+  shm::Ring& control = _responses.control();
+  iovec vec[IOV_MAX];
+  bool written = false;
+
+  while (! output.empty())
+  {
+    const std::size_t vecSize = output.gather(vec, IOV_MAX);
+    const std::size_t wsize = _responses.write(vec, vecSize);
+    output.consume(wsize);
+    written = written || wsize;
+
+    if (wsize == 0)
+    {
+      // full: the client rings the doorbell when it reads
+      control.producerWaiting.store(1);
+      _armed = true;
+      if (_responses.full()) { break; }
+    }
+  }
+
+  if (written && control.consumerWaiting.exchange(0)) { shm::wake(control.tail); }
+
+  return true;
+}
+
+} // namespace kvs
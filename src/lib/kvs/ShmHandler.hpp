@@ -0,0 +1,61 @@
+#ifndef KVS_SHMHANDLER_HPP_
+#define KVS_SHMHANDLER_HPP_
+
+#include <chrono>
+#include <memory>
+
+#include <kvs/CommandHandler.hpp>
+#include <kvs/Fd.hpp>
+#include <kvs/Reactor.hpp>
+#include <kvs/Shm.hpp>
+
+namespace kvs {
+
+/**
+ * Server side of a shared memory connection (see `shm`):
+ * executes the frames of the request ring, as the CommandHandler of a socket,
+ * responds to the response ring. Watches the doorbell of the client.
+ */
+class ShmHandler : public CommandHandler
+{
+public:
+  /** `socket` is the unix socket of the client, watched for hang up */
+  ShmHandler(
+    int doorbell, Fd socket, std::unique_ptr<shm::Segment> segment,
+    Store& store, Reactor& reactor, WorkerPool* pWorkers = nullptr
+  );
+
+  /** Tells the client the connection is closed */
+  ~ShmHandler();
+
+  /** Checks the client after `peerCheckInterval`. Called once added to the reactor */
+  void checkPeerLater();
+
+  bool dispatch() override;
+  bool timedOut() override;
+
+private:
+  ssize_t readInput(char* data, std::size_t size) override;
+  bool writeOutput(OutputQueue& output) override;
+  void watch(int events) override {}
+  bool edgeTriggered() const override { return true; }
+  bool completionBased() const override { return false; }
+
+  /** A client gone without closing the connection is noticed by this period */
+  static constexpr std::chrono::seconds peerCheckInterval{1};
+
+  const int _doorbell; // owned by CommandHandler
+  Fd _socket;
+  std::unique_ptr<shm::Segment> _segment;
+  shm::Header& _header;
+  shm::RingView _requests;
+  shm::RingView _responses;
+  Reactor& _reactor;
+  bool _armed; // a waiting flag is set, the client might ring the doorbell
+  Reactor::Clock::time_point _lastInput;
+  bool _polling; // the request ring is polled, while the reactor busy polls
+};
+
+} // namespace kvs
+
+#endif // KVS_SHMHANDLER_HPP_
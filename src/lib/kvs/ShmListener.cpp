@@ -0,0 +1,69 @@
+#include <cstring> // strerror
+#include <cerrno>
+#include <memory>
+#include <stdexcept>
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#include <kvs/ShmListener.hpp>
+#include <kvs/Error.hpp>
+#include <kvs/Log.hpp>
+#include <kvs/ShmHandler.hpp>
+
+namespace kvs {
+
+ShmListener::ShmListener(
+  Reactor& reactor, const std::string& path, Store& store,
+  uint32_t capacity, WorkerPool* pWorkers
+)
+  :ListenHandler(reactor, path, store, CommandHandler::Timeouts(), pWorkers),
+   _capacity(capacity)
+{
+  // not to fail at the first client
+  check(capacity >= 64 && capacity <= (uint32_t(1) << 30) && (capacity & (capacity - 1)) == 0);
+}
+
+void ShmListener::accepted(int client)
+{
+  Fd socket(client);
+
+  std::unique_ptr<shm::Segment> segment;
+  try
+  {
+    segment.reset(new shm::Segment(_capacity));
+  }
+  catch (const std::runtime_error&)
+  {
+    KVS_LOG_WARNING << "ShmListener: segment: " << strerror(errno);
+    return;
+  }
+
+  Fd doorbell(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC));
+  if (! doorbell)
+  {
+    KVS_LOG_WARNING << "ShmListener: eventfd: " << strerror(errno);
+    return;
+  }
+
+  const int fds[] = {segment->fd(), *doorbell};
+  if (! shm::sendFds(*socket, fds, 2))
+  {
+    KVS_LOG_WARNING << "ShmListener: handshake: " << strerror(errno);
+    return;
+  }
+
+  const int doorbellFd = doorbell.release();
+  ShmHandler* pHandler = _reactor.addHandler<ShmHandler>(
+    doorbellFd, EPOLLIN,
+    doorbellFd, std::move(socket), std::move(segment), _store, _reactor, _pWorkers
+  );
+
+  if (pHandler)
+  {
+    pHandler->checkPeerLater();
+    KVS_LOG_INFO << "Shared memory client accepted";
+  }
+}
+
+} // namespace kvs
@@ -0,0 +1,33 @@
+#ifndef KVS_SHMLISTENER_HPP_
+#define KVS_SHMLISTENER_HPP_
+
+#include <cstdint>
+#include <string>
+
+#include <kvs/ListenHandler.hpp>
+#include <kvs/Shm.hpp>
+
+namespace kvs {
+
+/**
+ * Accepts shared memory connections (see `shm`) at the unix socket `path`:
+ * responds the segment and the doorbell of each, serves them by a ShmHandler
+ */
+class ShmListener : public ListenHandler
+{
+public:
+  /** Rings of the connections have `capacity` bytes, a power of two */
+  ShmListener(
+    Reactor& reactor, const std::string& path, Store& store,
+    uint32_t capacity = shm::defaultCapacity, WorkerPool* pWorkers = nullptr
+  );
+
+  void accepted(int client) override;
+
+private:
+  const uint32_t _capacity;
+};
+
+} // namespace kvs
+
+#endif // KVS_SHMLISTENER_HPP_
@@ -1,13 +1,40 @@
+#include <algorithm>
+#include <atomic>
 #include <stdexcept>
 #include <cstring> // strerror
+#include <climits> // IOV_MAX
 #include <fcntl.h>
 
 #include <sys/mman.h>
 
 #include <kvs/Store.hpp>
+#include <kvs/CommandRegistry.hpp>
 
 namespace kvs {
 
+namespace {
+
+/** Deletes a value buffer, keeps its capacity */
+struct ValueDeleter
+{
+  void operator()(char* buffer) const { delete[] buffer; }
+
+  std::size_t capacity;
+};
+
+} // namespace
+
+ValueBuffer makeValueBuffer(std::size_t capacity)
+{
+  return ValueBuffer(new char[capacity], ValueDeleter{capacity});
+}
+
+std::size_t valueCapacity(const ValueBuffer& buffer)
+{
+  const ValueDeleter* deleter = std::get_deleter<ValueDeleter>(buffer);
+  return deleter ? deleter->capacity : 0;
+}
+
 Store::Store(const char* persStore)
 {
   if (persStore)
@@ -54,13 +81,22 @@ void Store::writePersStore(const iovec* pIovec, std::size_t vecSize, std::size_t
 {
   if (_persStore)
   {
-    ssize_t wsize = writev(*_persStore, pIovec, vecSize);
-    if (wsize < 0 || std::size_t(wsize) < fullSize)
+    // batches might have more vectors than a writev takes
+    for (std::size_t offset = 0; offset < vecSize; offset += IOV_MAX)
     {
-      throw std::runtime_error(std::string("Failed to write persistent store: ") + strerror(errno));
+      const std::size_t count = std::min<std::size_t>(vecSize - offset, IOV_MAX);
+
+      std::size_t size = 0;
+      for (std::size_t i = offset; i < offset + count; ++i) { size += pIovec[i].iov_len; }
+
+      ssize_t wsize = writev(*_persStore, pIovec + offset, count);
+      if (wsize < 0 || std::size_t(wsize) < size)
+      {
+        throw std::runtime_error(std::string("Failed to write persistent store: ") + strerror(errno));
+      }
     }
 
-    KVS_LOG_DEBUG << "Persistent storage write done, " << wsize << " bytes";
+    KVS_LOG_DEBUG << "Persistent storage write done, " << fullSize << " bytes";
   } // else: persistent storage was turned off
 
 //  else { KVS_LOG_DEBUG <<"Store turned off"; }
@@ -112,32 +148,22 @@ bool Store::executeCommand(ReadBuffer& reader)
 
   try
   {
+    typedef command::Table<void(const char*, command::Size), Store, command::Logged> Replay;
 
-    switch (comTag)
-    {
-    case command::Tag::SET:
+    CommandRegistry::Entry library;
+
+    if (Replay::Entry replay = Replay::find(comTag))
     {
-      SetCommand input(command::deserialize{}, comBegin, payloadSize);
-      input.execute(*this);
-      break;
+      replay(*this, comBegin, payloadSize);
     }
-    case command::Tag::PUSH:
+    else if (CommandRegistry::instance().find(comTag, library) && library.replay)
     {
-      PushCommand input(command::deserialize{}, comBegin, payloadSize);
-      input.execute(*this);
-      break;
+      library.replay(*this, comBegin, payloadSize);
     }
-    case command::Tag::POP:
+    else
     {
-      PopCommand input(command::deserialize{}, comBegin, payloadSize);
-      input.execute(*this);
-      break;
-    }
-    default:
       KVS_LOG_WARNING << "Unknown command in persistent store: " << int(comTag);
-      break;
     }
-
   }
   catch (const std::runtime_error& ex)
   {
@@ -150,6 +176,64 @@ bool Store::executeCommand(ReadBuffer& reader)
   return true;
 }
 
+template <typename Command>
+void Store::visit(const char* buffer, command::Size size)
+{
+  Command input(command::deserialize{}, buffer, size);
+  input.execute(*this);
+}
+
+namespace {
+
+/**
+ * @returns true if only the store refers to `buffer`. The other references might be
+ * dropped by other threads, the snapshots of the workers: the fence orders their reads
+ * of the buffer before the writes of the caller, use_count is a relaxed load
+ */
+bool exclusive(const ValueBuffer& buffer)
+{
+  if (buffer.use_count() != 1) { return false; }
+
+  std::atomic_thread_fence(std::memory_order_acquire);
+  return true;
+}
+
+} // namespace
+
+char* resetValue(Store::Entry& entry, std::size_t size)
+{
+  if (valueCapacity(entry.second) < size || ! exclusive(entry.second))
+  {
+    entry.second = makeValueBuffer(size);
+  }
+
+  return entry.second.get();
+}
+
+char* modifyValue(Store::Entry& entry)
+{
+  if (entry.second && ! exclusive(entry.second))
+  {
+    ValueBuffer copy = makeValueBuffer(entry.first);
+    memcpy(copy.get(), entry.second.get(), entry.first);
+    entry.second = std::move(copy);
+  }
+
+  return entry.second.get();
+}
+
+char* growValue(Store::Entry& entry, std::size_t size)
+{
+  if (valueCapacity(entry.second) < size || ! exclusive(entry.second))
+  {
+    ValueBuffer grown = makeValueBuffer(std::max(size, 2 * entry.first));
+    if (entry.first) { memcpy(grown.get(), entry.second.get(), entry.first); }
+    entry.second = std::move(grown);
+  }
+
+  return entry.second.get();
+}
+
 void Store::foreach(std::function<void(const std::string&, Container::mapped_type&)> func)
 {
   for (auto&& pair : _store)
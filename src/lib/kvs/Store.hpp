@@ -10,20 +10,35 @@
 
 #include <kvs/Fd.hpp>
 #include <kvs/Command.hpp>  // Key
+#include <kvs/CommandTable.hpp>
 #include <kvs/Buffer.hpp>
 
 namespace kvs {
 
+/**
+ * Serialized value. Buffers are shared with the responses in flight,
+ * a shared buffer must not be modified: see resetValue and modifyValue.
+ */
+typedef std::shared_ptr<char> ValueBuffer;
+
+/** @returns a buffer of `capacity` bytes, values up to it fit in place */
+ValueBuffer makeValueBuffer(std::size_t capacity);
+
+/** @returns the capacity of `buffer`, 0 if not made by makeValueBuffer */
+std::size_t valueCapacity(const ValueBuffer& buffer);
+
 /**
  * TODO Store use boost::concurrent_unordered when ready or
  * TODO Store use boost::unordered_map and templated find/op[]
  */
 class Store
 {
-  typedef std::unordered_map<
-    std::string,
-    std::pair<std::size_t, std::unique_ptr<char[]>>
-  > Container;
+public:
+  /** size and buffer of a serialized value */
+  typedef std::pair<std::size_t, ValueBuffer> Entry;
+
+private:
+  typedef std::unordered_map<std::string, Entry> Container;
 
 public:
   Store(const char* persStore);
@@ -44,10 +59,33 @@ public:
 private:
   bool executeCommand(ReadBuffer& buffer);
 
+  /** Replays a logged command, called by the dispatch table of `executeCommand` */
+  template <typename Command>
+  void visit(const char* buffer, command::Size size);
+
+  template <typename Signature, typename Visitor, typename CommandList>
+  friend class command::Table;
+
   Fd _persStore;
   Container _store;
 };
 
+/**
+ * @returns a buffer of at least `size` bytes for the new value of `entry`:
+ * the current buffer if large enough and not shared, a new one otherwise
+ */
+char* resetValue(Store::Entry& entry, std::size_t size);
+
+/** @returns the buffer of `entry` to be modified in place, copied first if shared */
+char* modifyValue(Store::Entry& entry);
+
+/**
+ * @returns the buffer of `entry` to be extended in place to `size` bytes,
+ * copied first to a larger one, if shared or not large enough. Grows geometrically:
+ * appending to a value repeatedly is amortized linear
+ */
+char* growValue(Store::Entry& entry, std::size_t size);
+
 } // namespace kvs
 
 #endif // KVS_STORE_HPP_
@@ -0,0 +1,48 @@
+#include <utility>
+
+#include <kvs/TaskQueue.hpp>
+
+namespace kvs {
+
+TaskQueue::TaskQueue()
+  :_head(new Node)
+{
+  _head->next.store(nullptr, std::memory_order_relaxed);
+  _tail.store(_head, std::memory_order_relaxed);
+}
+
+TaskQueue::~TaskQueue()
+{
+  // tasks not popped are dropped
+  while (_head)
+  {
+    Node* next = _head->next.load(std::memory_order_acquire);
+    delete _head;
+    _head = next;
+  }
+}
+
+void TaskQueue::push(Task task)
+{
+  Node* node = new Node;
+  node->next.store(nullptr, std::memory_order_relaxed);
+  node->task = std::move(task);
+
+  Node* previous = _tail.exchange(node, std::memory_order_acq_rel);
+  previous->next.store(node, std::memory_order_release);
+}
+
+bool TaskQueue::pop(Task& task)
+{
+  Node* next = _head->next.load(std::memory_order_acquire);
+  if (! next) { return false; }
+
+  // the popped node becomes the stub
+  task = std::move(next->task);
+  next->task = nullptr;
+  delete _head;
+  _head = next;
+  return true;
+}
+
+} // namespace kvs
@@ -0,0 +1,46 @@
+#ifndef KVS_TASKQUEUE_HPP_
+#define KVS_TASKQUEUE_HPP_
+
+#include <atomic>
+#include <functional>
+
+namespace kvs {
+
+/**
+ * Lock-free queue of tasks: any thread pushes, a single thread pops.
+ *
+ * An intrusive linked list with a stub node: a push is an exchange of the tail,
+ * then a link from the previous tail. A pop might miss a push
+ * until its link is visible, the pusher notifies the consumer after it.
+ */
+class TaskQueue
+{
+public:
+  typedef std::function<void()> Task;
+
+  TaskQueue();
+  ~TaskQueue();
+
+  TaskQueue(const TaskQueue&) = delete;
+  TaskQueue& operator=(const TaskQueue&) = delete;
+
+  /** Thread safe */
+  void push(Task task);
+
+  /** Consumer only: moves the first task to `task`, @returns false if none */
+  bool pop(Task& task);
+
+private:
+  struct Node
+  {
+    std::atomic<Node*> next;
+    Task task;
+  };
+
+  std::atomic<Node*> _tail; // pushed to
+  Node* _head; // the stub, or the last popped node
+};
+
+} // namespace kvs
+
+#endif // KVS_TASKQUEUE_HPP_
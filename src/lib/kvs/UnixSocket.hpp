@@ -0,0 +1,41 @@
+#ifndef KVS_UNIXSOCKET_HPP_
+#define KVS_UNIXSOCKET_HPP_
+
+#include <cstddef> // offsetof
+#include <cstring> // memcpy, memset
+#include <string>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <kvs/Error.hpp>
+
+namespace kvs {
+
+/**
+ * Unix socket paths starting with '@' are in the abstract namespace (Linux):
+ * not files, released with the last socket referring to them.
+ */
+inline bool isAbstract(const std::string& path)
+{
+  return ! path.empty() && path[0] == '@';
+}
+
+/** Sets `address` to the unix socket `path`, @returns its size. Throws std::runtime_error if too long */
+inline socklen_t unixAddress(const std::string& path, sockaddr_un& address)
+{
+  check(! path.empty() && path.size() < sizeof(address.sun_path));
+
+  std::memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  std::memcpy(address.sun_path, path.data(), path.size());
+
+  // abstract names are not terminated, every byte of the size is part of the name
+  if (isAbstract(path)) { address.sun_path[0] = '\0'; }
+
+  return socklen_t(offsetof(sockaddr_un, sun_path) + path.size() + (isAbstract(path) ? 0 : 1));
+}
+
+} // namespace kvs
+
+#endif // KVS_UNIXSOCKET_HPP_
@@ -0,0 +1,190 @@
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstring> // memset
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <kvs/Uring.hpp>
+#include <kvs/Error.hpp>
+
+namespace kvs {
+
+namespace {
+
+template <typename T>
+T* offset(void* base, unsigned offset)
+{
+  return reinterpret_cast<T*>(static_cast<char*>(base) + offset);
+}
+
+void* mapRing(int fd, std::size_t size, off_t offset)
+{
+  void* result = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, offset);
+  if (result == MAP_FAILED) { failure("mmap io_uring"); }
+  return result;
+}
+
+} // namespace
+
+Uring::Uring(unsigned entries, unsigned completionEntries)
+  :_bufferRing(nullptr),
+   _bufferRingSize(0),
+   _bufferMask(0),
+   _bufferTail(0),
+   _bufferSize(0),
+   _buffers(nullptr)
+{
+  io_uring_params params;
+  std::memset(&params, 0, sizeof(params));
+  params.flags = IORING_SETUP_CQSIZE;
+  params.cq_entries = completionEntries;
+
+  _fd = int(syscall(__NR_io_uring_setup, entries, &params));
+  if (! _fd) { failure("io_uring_setup"); }
+
+  if (! (params.features & IORING_FEAT_SINGLE_MMAP) || ! (params.features & IORING_FEAT_NODROP))
+  {
+    errno = ENOSYS;
+    failure("io_uring features");
+  }
+
+  // the completion ring shares the mapping of the submission ring
+  _ringSize = std::max(
+    params.sq_off.array + params.sq_entries * sizeof(unsigned),
+    params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe)
+  );
+  _ring = mapRing(*_fd, _ringSize, IORING_OFF_SQ_RING);
+
+  _sqHead = offset<unsigned>(_ring, params.sq_off.head);
+  _sqTail = offset<unsigned>(_ring, params.sq_off.tail);
+  _sqMask = *offset<unsigned>(_ring, params.sq_off.ring_mask);
+  _sqArray = offset<unsigned>(_ring, params.sq_off.array);
+  _sqLocalTail = *_sqTail;
+
+  _sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+  _sqes = static_cast<io_uring_sqe*>(mapRing(*_fd, _sqesSize, IORING_OFF_SQES));
+
+  // entries are submitted in order
+  for (unsigned i = 0; i < params.sq_entries; ++i) { _sqArray[i] = i; }
+
+  _cqHead = offset<unsigned>(_ring, params.cq_off.head);
+  _cqTail = offset<unsigned>(_ring, params.cq_off.tail);
+  _cqMask = *offset<unsigned>(_ring, params.cq_off.ring_mask);
+  _cqes = offset<io_uring_cqe>(_ring, params.cq_off.cqes);
+}
+
+Uring::~Uring()
+{
+  // the kernel releases the rings and the buffer registrations with the fd
+  _fd.close();
+
+  if (_buffers) { munmap(_buffers, std::size_t(_bufferMask + 1) * _bufferSize); }
+  if (_bufferRing) { munmap(_bufferRing, _bufferRingSize); }
+  munmap(_sqes, _sqesSize);
+  munmap(_ring, _ringSize);
+}
+
+io_uring_sqe& Uring::prepare()
+{
+  while (_sqLocalTail - __atomic_load_n(_sqHead, __ATOMIC_ACQUIRE) > _sqMask)
+  {
+    enter(0);
+  }
+
+  io_uring_sqe& sqe = _sqes[_sqLocalTail & _sqMask];
+  ++_sqLocalTail;
+
+  std::memset(&sqe, 0, sizeof(sqe));
+  return sqe;
+}
+
+void Uring::publish()
+{
+  __atomic_store_n(_sqTail, _sqLocalTail, __ATOMIC_RELEASE);
+}
+
+void Uring::enter(int timeoutMs)
+{
+  publish();
+
+  const unsigned toSubmit = _sqLocalTail - __atomic_load_n(_sqHead, __ATOMIC_ACQUIRE);
+  const bool wait = timeoutMs > 0;
+  if (toSubmit == 0 && ! wait) { return; }
+
+  __kernel_timespec timeout;
+  timeout.tv_sec = timeoutMs / 1000;
+  timeout.tv_nsec = (timeoutMs % 1000) * 1000000L;
+
+  io_uring_getevents_arg arg;
+  std::memset(&arg, 0, sizeof(arg));
+  arg.sigmask_sz = _NSIG / 8;
+  arg.ts = reinterpret_cast<uint64_t>(&timeout);
+
+  const long result = syscall(
+    __NR_io_uring_enter, *_fd, toSubmit, wait ? 1 : 0,
+    wait ? IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG : 0,
+    wait ? &arg : nullptr, wait ? sizeof(arg) : 0
+  );
+
+  // ETIME: timeout, EBUSY: completions to reap first
+  if (result < 0 && errno != ETIME && errno != EINTR && errno != EBUSY && errno != EAGAIN)
+  {
+    failure("io_uring_enter");
+  }
+}
+
+void Uring::provideBuffers(uint16_t group, uint16_t count, uint32_t size)
+{
+  check(_bufferRing == nullptr && count && (count & (count - 1)) == 0);
+
+  _bufferRingSize = count * sizeof(io_uring_buf);
+  void* ring = mmap(nullptr, _bufferRingSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (ring == MAP_FAILED) { failure("mmap"); }
+  _bufferRing = static_cast<io_uring_buf_ring*>(ring);
+
+  // pages are touched when first received into
+  void* buffers = mmap(nullptr, std::size_t(count) * size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (buffers == MAP_FAILED) { failure("mmap"); }
+  _buffers = static_cast<char*>(buffers);
+
+  io_uring_buf_reg reg;
+  std::memset(&reg, 0, sizeof(reg));
+  reg.ring_addr = reinterpret_cast<uint64_t>(_bufferRing);
+  reg.ring_entries = count;
+  reg.bgid = group;
+
+  if (syscall(__NR_io_uring_register, *_fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0)
+  {
+    failure("io_uring_register");
+  }
+
+  _bufferMask = uint16_t(count - 1);
+  _bufferSize = size;
+  _bufferTail = 0;
+
+  for (uint16_t id = 0; id < count; ++id) { recycle(id); }
+  publishBuffers();
+}
+
+void Uring::recycle(uint16_t id)
+{
+  // not `_bufferRing->bufs`: the flexible array of the uapi header is misplaced in C++
+  io_uring_buf& entry = reinterpret_cast<io_uring_buf*>(_bufferRing)[_bufferTail & _bufferMask];
+  entry.addr = reinterpret_cast<uint64_t>(buffer(id));
+  entry.len = _bufferSize;
+  entry.bid = id;
+  ++_bufferTail;
+}
+
+void Uring::publishBuffers()
+{
+  if (_bufferRing)
+  {
+    __atomic_store_n(&_bufferRing->tail, _bufferTail, __ATOMIC_RELEASE);
+  }
+}
+
+} // namespace kvs
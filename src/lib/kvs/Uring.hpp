@@ -0,0 +1,117 @@
+#ifndef KVS_URING_HPP_
+#define KVS_URING_HPP_
+
+#include <cstddef>
+#include <cstdint>
+
+#include <linux/io_uring.h>
+
+#include <kvs/Fd.hpp>
+
+namespace kvs {
+
+/**
+ * Minimal io_uring, over the raw syscalls:
+ * submission and completion rings, and a ring of provided receive buffers.
+ *
+ * Not thread safe, submissions must be serialized by the owner.
+ */
+class Uring
+{
+public:
+  /** Terminates, if io_uring is not available */
+  Uring(unsigned entries, unsigned completionEntries);
+  ~Uring();
+
+  Uring(const Uring&) = delete;
+  Uring& operator=(const Uring&) = delete;
+
+  /**
+   * @returns a cleared submission entry, visible to the kernel after `publish()`.
+   * If the ring is full, the published entries are submitted first.
+   */
+  io_uring_sqe& prepare();
+
+  /** Makes the prepared entries visible to the kernel */
+  void publish();
+
+  /**
+   * Submits the published entries, then waits for a completion,
+   * at most `timeoutMs` milliseconds. Does not wait if `timeoutMs` is 0.
+   */
+  void enter(int timeoutMs);
+
+  /** Calls `f(const io_uring_cqe&)` for every available completion, @returns their count */
+  template <typename F>
+  std::size_t complete(F&& f);
+
+  /**
+   * Registers `count` buffers of `size` bytes as buffer group `group`,
+   * selected by IOSQE_BUFFER_SELECT receives.
+   */
+  void provideBuffers(uint16_t group, uint16_t count, uint32_t size);
+
+  /** @returns the provided buffer `id`, reported by a completion */
+  char* buffer(uint16_t id) { return _buffers + std::size_t(id) * _bufferSize; }
+
+  /** Gives back the provided buffer `id`, after its data is consumed */
+  void recycle(uint16_t id);
+
+private:
+  void publishBuffers();
+
+  Fd _fd;
+
+  // submission ring
+  void* _ring;
+  std::size_t _ringSize;
+  unsigned* _sqHead;
+  unsigned* _sqTail;
+  unsigned _sqMask;
+  unsigned* _sqArray;
+  io_uring_sqe* _sqes;
+  std::size_t _sqesSize;
+  unsigned _sqLocalTail; // prepared, not necessarily published
+
+  // completion ring, mapped with the submission ring
+  unsigned* _cqHead;
+  unsigned* _cqTail;
+  unsigned _cqMask;
+  io_uring_cqe* _cqes;
+
+  // provided buffers
+  io_uring_buf_ring* _bufferRing;
+  std::size_t _bufferRingSize;
+  uint16_t _bufferMask;
+  uint16_t _bufferTail;
+  uint32_t _bufferSize;
+  char* _buffers;
+};
+
+template <typename F>
+std::size_t Uring::complete(F&& f)
+{
+  const unsigned head = *_cqHead;
+  const unsigned tail = __atomic_load_n(_cqTail, __ATOMIC_ACQUIRE);
+
+  for (unsigned next = head; next != tail; )
+  {
+    // consumed before `f` runs: submissions of `f` need room for their completions,
+    // the kernel refuses them while the completion ring is full
+    const io_uring_cqe cqe = _cqes[next & _cqMask];
+    __atomic_store_n(_cqHead, ++next, __ATOMIC_RELEASE);
+
+    f(cqe);
+  }
+
+  const std::size_t count = tail - head;
+
+  // buffers recycled by `f` are available for the next receives
+  publishBuffers();
+
+  return count;
+}
+
+} // namespace kvs
+
+#endif // KVS_URING_HPP_
@@ -63,32 +63,86 @@ namespace value {
 
 struct SerializedSizeVisitor : public boost::static_visitor<std::size_t>
 {
+  SerializedSizeVisitor(ValueTag layout) :_layout(layout) {}
+  ValueTag _layout;
+
   template <typename T>
-  std::size_t operator()(const T& t) const { return serializedSize(t); }
+  std::size_t operator()(const T& t) const { return serializedSize(t, _layout); }
 };
 
-std::size_t serializedSize(const TypedValue& value)
+std::size_t serializedSize(const TypedValue& value, ValueTag layout)
 {
-  SerializedSizeVisitor visitor;
+  SerializedSizeVisitor visitor(layout);
   return boost::apply_visitor(visitor, value);
 }
 
 struct SerializeVisitor : public boost::static_visitor<>
 {
-  SerializeVisitor(char* buffer) :_buffer(buffer) {}
+  SerializeVisitor(char* buffer, ValueTag layout) :_buffer(buffer), _layout(layout) {}
   char* _buffer;
+  ValueTag _layout;
 
   template <typename T>
-  void operator()(const T& t) const { serialize(t, _buffer); }
+  void operator()(const T& t) const { serialize(t, _buffer, _layout); }
 };
 
-void serialize(const TypedValue& value, char* buffer)
+void serialize(const TypedValue& value, char* buffer, ValueTag layout)
 {
-  SerializeVisitor visitor(buffer);
+  SerializeVisitor visitor(buffer, layout);
 
   boost::apply_visitor(visitor, value);
 }
 
+namespace {
+
+template <typename T, typename Decoder>
+bool decodeList(Decoder&& decoder, ListSize listSize, std::vector<T>& result)
+{
+  result.resize(listSize);
+
+  for (ListSize i = 0; i < listSize; )
+  {
+    const std::size_t count = decoder.next(result.data() + i);
+    if (count == 0) { return false; }
+    i += count;
+  }
+
+  return true;
+}
+
+template <typename T>
+bool decodeList(ReadBuffer& reader, uint16_t layout, ListSize listSize, std::vector<T>& result, std::false_type)
+{
+  if (layout != 0 && layout != ValueTag::aligned) { return false; }
+  if (listSize > reader.size() / sizeof(T)) { return false; }
+
+  result.resize(listSize);
+  return reader.read(reinterpret_cast<char*>(result.data()), listSize * sizeof(T));
+}
+
+template <typename T>
+bool decodeList(ReadBuffer& reader, uint16_t layout, ListSize listSize, std::vector<T>& result, std::true_type)
+{
+  const char* begin = reader.get();
+  const char* end = begin + reader.size();
+
+  // bound the list size by the payload, every element takes at least a byte,
+  // or a share of a block header
+  switch (layout)
+  {
+  case ValueTag::delta:
+    if (listSize > reader.size()) { return false; }
+    return decodeList(encoding::DeltaDecoder<T>(begin, end, listSize), listSize, result);
+  case ValueTag::packed:
+    if (listSize / encoding::blockSize > reader.size() / sizeof(encoding::BlockHeader)) { return false; }
+    return decodeList(encoding::PackedDecoder<T>(begin, end, listSize), listSize, result);
+  default:
+    return decodeList(reader, layout, listSize, result, std::false_type{});
+  }
+}
+
+} // namespace
+
 TypedValue deserialize(const char* buffer, std::size_t bufferSize)
 {
   TypedValue result;
@@ -111,24 +165,29 @@ TypedValue deserialize(const char* buffer, std::size_t bufferSize)
   case tag: \
   { \
     std::vector<type> vt; \
-    vt.reserve(listSize);\
-    for (ListSize i = 0; i < listSize; ++i) \
+    if (decodeList(reader, layout, listSize, vt, std::is_integral<type>{})) \
     { \
-      type t; \
-      if (! reader.read(t)) { break; } \
-      vt.push_back(t); \
+      result = std::move(vt); \
     } \
-    result = vt; \
     break; \
   } \
   /**/
 
   if (tag & ValueTag::list)
   {
+    const uint16_t layout = tag & layoutMask;
+
+    if (layout)
+    {
+      const std::size_t padding = listHeaderSize - sizeof(ListSize) - sizeof(tag);
+      if (reader.size() < padding) { return result; }
+      reader.discard(padding);
+    }
+
     ListSize listSize;
     if (! reader.read(listSize)) { return result; }
 
-    decltype(tag) scalarTag = tag & ~ValueTag::list;
+    decltype(tag) scalarTag = tag & ~ValueTag::list & ~layoutMask;
     switch (scalarTag)
     {
       KVS_LIST_CASE(tag_int8, char)
@@ -168,12 +227,123 @@ TypedValue deserialize(const char* buffer, std::size_t bufferSize)
 
 ValueTag deserializeTag(const char* buffer, std::size_t bufferSize)
 {
-  ValueTag result = ValueTag::null;
+  uint16_t result = ValueTag::null;
 
   ReadBuffer reader(buffer, bufferSize);
   reader.read(result);
 
-  return result;
+  return static_cast<ValueTag>(result & ~layoutMask);
+}
+
+ValueTag deserializeLayout(const char* buffer, std::size_t bufferSize)
+{
+  uint16_t result = ValueTag::null;
+
+  ReadBuffer reader(buffer, bufferSize);
+  reader.read(result);
+
+  return static_cast<ValueTag>(result & layoutMask);
+}
+
+namespace {
+
+bool isLegacyList(const char* buffer, std::size_t bufferSize)
+{
+  uint16_t tag = ValueTag::null;
+
+  ReadBuffer reader(buffer, bufferSize);
+  reader.read(tag);
+
+  return (tag & ValueTag::list) && (tag & layoutMask) == 0
+      && bufferSize >= sizeof(tag) + sizeof(ListSize);
+}
+
+} // namespace
+
+std::size_t normalizedSize(const char* buffer, std::size_t bufferSize)
+{
+  if (isLegacyList(buffer, bufferSize))
+  {
+    return bufferSize - sizeof(ValueTag) - sizeof(ListSize) + listHeaderSize;
+  }
+
+  return bufferSize;
+}
+
+void normalize(const char* buffer, std::size_t bufferSize, char* output)
+{
+  if (isLegacyList(buffer, bufferSize))
+  {
+    // legacy layout: tag | ListSize | elements, ListSize and elements are moved
+    uint16_t tag;
+    std::memcpy(&tag, buffer, sizeof(tag));
+    tag |= ValueTag::aligned;
+
+    std::memset(output, 0, listHeaderSize);
+    std::memcpy(output, &tag, sizeof(tag));
+    std::memcpy(
+      output + listHeaderSize - sizeof(ListSize),
+      buffer + sizeof(tag),
+      bufferSize - sizeof(tag)
+    );
+  }
+  else
+  {
+    std::memcpy(output, buffer, bufferSize);
+  }
+}
+
+namespace {
+
+struct ValidateVisitor
+{
+  typedef bool result_type;
+
+  template <typename T>
+  bool operator()(const T&) const { return true; }
+
+  template <typename T>
+  bool operator()(const ListRef<T>& list) const
+  {
+    return valid(list, std::is_integral<T>{});
+  }
+
+  template <typename T>
+  static bool valid(const ListRef<T>& list, std::false_type)
+  {
+    return list.layout == ValueTag::null || list.layout == ValueTag::aligned;
+  }
+
+  template <typename T>
+  static bool valid(const ListRef<T>& list, std::true_type)
+  {
+    switch (list.layout)
+    {
+    case ValueTag::delta:
+    {
+      encoding::DeltaDecoder<T> decoder(list.data, list.end, list.size);
+      return encoding::valid(decoder, list.size);
+    }
+    case ValueTag::packed:
+    {
+      encoding::PackedDecoder<T> decoder(list.data, list.end, list.size);
+      return encoding::valid(decoder, list.size);
+    }
+    default:
+      return valid(list, std::false_type{});
+    }
+  }
+};
+
+} // namespace
+
+bool validate(const char* buffer, std::size_t bufferSize)
+{
+  ValueRef valueRef;
+  if (! ref(buffer, bufferSize, valueRef)) { return true; }
+
+  ValidateVisitor visitor;
+  return applyRefVisitor(visitor, valueRef);
 }
 
 } // namespace value
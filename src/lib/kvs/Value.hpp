@@ -1,6 +1,7 @@
 #ifndef KVS_VALUE_HPP_
 #define KVS_VALUE_HPP_
 
+#include <cstddef>
 #include <cstdint>
 #include <cstring>
 #include <vector>
@@ -12,6 +13,7 @@
 #include <boost/variant/get.hpp>
 
 #include <kvs/Buffer.hpp>
+#include <kvs/Encoding.hpp>
 
 namespace kvs {
 
@@ -32,8 +34,33 @@ enum ValueTag : uint16_t
 
   tag_float  = 18,
   tag_double = 20,
+
+  // list layouts, kept in the high byte of the serialized tag
+  aligned = 0x100,
+  delta   = 0x200, // integer lists only: zigzag varint deltas
+  packed  = 0x300, // integer lists only: frame of reference bit-packed blocks
 };
 
+namespace value {
+
+/** Mask of the serialized tag bits which select the list layout */
+constexpr uint16_t layoutMask = 0xFF00;
+
+/**
+ * Elements of aligned lists start at this offset of the serialized value.
+ * Serialized values are kept in buffers at least this aligned,
+ * so elements can be accessed in place, by SIMD loads as well.
+ */
+constexpr std::size_t alignment = 16;
+constexpr std::size_t listHeaderSize = alignment;
+
+static_assert(
+  alignof(std::max_align_t) >= alignment,
+  "operator new[] does not provide aligned value buffers"
+);
+
+} // namespace value
+
 struct NullValue
 {
   static constexpr std::size_t serializedSize = sizeof(ValueTag::null);
@@ -110,20 +137,75 @@ struct ValueDescriptor<std::vector<T>>
   static constexpr ValueTag tag =
     static_cast<ValueTag>(ValueDescriptor<T>::tag | ValueTag::list);
 
-  static std::size_t size(const std::vector<T>& vec)
+  /**
+   * @param layout aligned, or a compressed layout;
+   * compressed layouts fall back to aligned for non-integer lists.
+   */
+  static std::size_t size(const std::vector<T>& vec, ValueTag layout = ValueTag::aligned)
   {
-    return sizeof(tag) + sizeof(ListSize) + vec.size() * sizeof(T);
+    return value::listHeaderSize + payloadSize(vec, effectiveLayout(layout), Compressible{});
   }
 
-  static void serialize(const std::vector<T>& vec, char* buffer)
+  // layout: tag | padding | ListSize | payload, at value::listHeaderSize
+  static void serialize(
+    const std::vector<T>& vec,
+    char* buffer,
+    ValueTag layout = ValueTag::aligned
+  )
   {
-    const ValueTag tag_ = tag;
-    ListSize size = vec.size();
+    layout = effectiveLayout(layout);
+    serializeHeader(vec.size(), buffer, layout);
+    serializePayload(vec, buffer + value::listHeaderSize, layout, Compressible{});
+  }
 
-    FixWriteBuffer writer(buffer);
-    writer.write(tag_);
-    writer.write(size);
-    writer.write(vec.data(), sizeof(T) * size);
+  /** Writes the list header, elements follow at value::listHeaderSize */
+  static void serializeHeader(ListSize size, char* buffer, ValueTag layout = ValueTag::aligned)
+  {
+    const uint16_t tag_ = tag | layout;
+
+    std::memset(buffer, 0, value::listHeaderSize);
+    std::memcpy(buffer, &tag_, sizeof(tag_));
+    std::memcpy(buffer + value::listHeaderSize - sizeof(size), &size, sizeof(size));
+  }
+
+private:
+  typedef std::integral_constant<bool, std::is_integral<T>::value> Compressible;
+
+  static ValueTag effectiveLayout(ValueTag layout)
+  {
+    return (Compressible::value && (layout == ValueTag::delta || layout == ValueTag::packed))
+      ? layout
+      : ValueTag::aligned;
+  }
+
+  static std::size_t payloadSize(const std::vector<T>& vec, ValueTag layout, std::true_type)
+  {
+    switch (layout)
+    {
+    case ValueTag::delta:  return encoding::deltaSize(vec.data(), vec.size());
+    case ValueTag::packed: return encoding::packedSize(vec.data(), vec.size());
+    default:               return payloadSize(vec, layout, std::false_type{});
+    }
+  }
+
+  static std::size_t payloadSize(const std::vector<T>& vec, ValueTag, std::false_type)
+  {
+    return vec.size() * sizeof(T);
+  }
+
+  static void serializePayload(const std::vector<T>& vec, char* buffer, ValueTag layout, std::true_type)
+  {
+    switch (layout)
+    {
+    case ValueTag::delta:  encoding::deltaEncode(vec.data(), vec.size(), buffer); break;
+    case ValueTag::packed: encoding::packedEncode(vec.data(), vec.size(), buffer); break;
+    default:               serializePayload(vec, buffer, layout, std::false_type{}); break;
+    }
+  }
+
+  static void serializePayload(const std::vector<T>& vec, char* buffer, ValueTag, std::false_type)
+  {
+    std::memcpy(buffer, vec.data(), vec.size() * sizeof(T));
   }
 };
 
@@ -181,14 +263,345 @@ void serialize(const T& t, char* buffer)
   ValueDescriptor<T>::serialize(t, buffer);
 }
 
-std::size_t serializedSize(const TypedValue& value);
+/** Serialized size of `t`, in the given list layout (ignored by scalars) */
+template <typename T>
+std::size_t serializedSize(const T& t, ValueTag)
+{
+  return ValueDescriptor<T>::size(t);
+}
+
+template <typename T>
+std::size_t serializedSize(const std::vector<T>& t, ValueTag layout)
+{
+  return ValueDescriptor<std::vector<T>>::size(t, layout);
+}
 
-void serialize(const TypedValue& value, char* buffer);
+template <typename T>
+void serialize(const T& t, char* buffer, ValueTag)
+{
+  ValueDescriptor<T>::serialize(t, buffer);
+}
+
+template <typename T>
+void serialize(const std::vector<T>& t, char* buffer, ValueTag layout)
+{
+  ValueDescriptor<std::vector<T>>::serialize(t, buffer, layout);
+}
+
+std::size_t serializedSize(const TypedValue& value, ValueTag layout = ValueTag::aligned);
+
+void serialize(const TypedValue& value, char* buffer, ValueTag layout = ValueTag::aligned);
 
 TypedValue deserialize(const char* buffer, std::size_t bufferSize);
 
+/** @returns the type tag of the serialized value, without the layout bits */
 ValueTag deserializeTag(const char* buffer, std::size_t bufferSize);
 
+/** @returns the layout bits of the serialized value */
+ValueTag deserializeLayout(const char* buffer, std::size_t bufferSize);
+
+/**
+ * Non-owning view of the elements of a serialized list
+ */
+template <typename T>
+struct ListView
+{
+  const T* data = nullptr;
+  ListSize size = 0;
+
+  const T* begin() const { return data; }
+  const T* end() const { return data + size; }
+};
+
+/**
+ * Points `result` to the elements of the aligned T list in `buffer`.
+ *
+ * @returns false, if `buffer` does not hold an aligned list of T
+ * or the elements are not suitably aligned in memory
+ */
+template <typename T>
+bool view(const char* buffer, std::size_t bufferSize, ListView<T>& result)
+{
+  const uint16_t expectedTag = ValueDescriptor<std::vector<T>>::tag | ValueTag::aligned;
+
+  uint16_t tag;
+  ListSize size;
+
+  if (bufferSize < listHeaderSize) { return false; }
+  std::memcpy(&tag, buffer, sizeof(tag));
+  std::memcpy(&size, buffer + listHeaderSize - sizeof(size), sizeof(size));
+
+  const char* data = buffer + listHeaderSize;
+
+  if (
+     tag != expectedTag
+  || reinterpret_cast<std::uintptr_t>(data) % alignof(T) != 0
+  || size > (bufferSize - listHeaderSize) / sizeof(T)
+  )
+  {
+    return false;
+  }
+
+  result.data = reinterpret_cast<const T*>(data);
+  result.size = size;
+  return true;
+}
+
+/**
+ * Points `result` to the elements of the T list in `buffer`.
+ * Lists which can not be viewed in place are decoded to `scratch`.
+ *
+ * @returns false, if `buffer` does not hold a list of T
+ */
+template <typename T>
+bool view(const char* buffer, std::size_t bufferSize, ListView<T>& result, std::vector<T>& scratch)
+{
+  if (view(buffer, bufferSize, result)) { return true; }
+
+  TypedValue decoded = deserialize(buffer, bufferSize);
+  std::vector<T>* list = boost::get<std::vector<T>>(&decoded);
+  if (! list) { return false; }
+
+  scratch = std::move(*list);
+  result.data = scratch.data();
+  result.size = scratch.size();
+  return true;
+}
+
+/**
+ * Calls `visitor` with the ListView of the list in `buffer`,
+ * or with NullValue, if `buffer` does not hold a list.
+ *
+ * `Visitor` is a boost::static_visitor, which accepts a ListView of any
+ * element type and NullValue.
+ */
+template <typename Visitor>
+typename Visitor::result_type
+applyViewVisitor(Visitor& visitor, const char* buffer, std::size_t bufferSize)
+{
+#define KVS_VIEW_CASE(type) \
+  case ValueDescriptor<std::vector<type>>::tag: \
+  { \
+    ListView<type> view; \
+    std::vector<type> scratch; \
+    if (value::view(buffer, bufferSize, view, scratch)) { return visitor(view); } \
+    break; \
+  } \
+  /**/
+
+  switch (static_cast<uint16_t>(deserializeTag(buffer, bufferSize)))
+  {
+    KVS_VIEW_CASE(char)
+    KVS_VIEW_CASE(short)
+    KVS_VIEW_CASE(int)
+    KVS_VIEW_CASE(int64_t)
+    KVS_VIEW_CASE(unsigned char)
+    KVS_VIEW_CASE(unsigned short)
+    KVS_VIEW_CASE(unsigned int)
+    KVS_VIEW_CASE(uint64_t)
+    KVS_VIEW_CASE(float)
+    KVS_VIEW_CASE(double)
+    default: break;
+  }
+
+#undef KVS_VIEW_CASE
+
+  return visitor(NullValue{});
+}
+
+//
+// Flat values: the hot paths dispatch on the serialized tag,
+// without materializing a TypedValue
+//
+
+/**
+ * Non-owning typed view of a serialized value.
+ * `data` points to the scalar, or to the payload of lists,
+ * which is not necessarily aligned (e.g: values in the read buffer).
+ */
+struct ValueRef
+{
+  ValueTag tag = ValueTag::null;    // without the layout bits
+  ValueTag layout = ValueTag::null; // of lists, null for legacy lists
+  const char* data = nullptr;
+  const char* end = nullptr;
+  ListSize size = 0;                // of lists
+};
+
+/** @returns false, if `buffer` is too short to hold the header of its tag */
+inline bool ref(const char* buffer, std::size_t bufferSize, ValueRef& result)
+{
+  uint16_t tag;
+  if (bufferSize < sizeof(tag)) { return false; }
+  std::memcpy(&tag, buffer, sizeof(tag));
+
+  result.tag = static_cast<ValueTag>(tag & ~layoutMask);
+  result.layout = static_cast<ValueTag>(tag & layoutMask);
+  result.end = buffer + bufferSize;
+  result.size = 0;
+
+  if (tag & ValueTag::list)
+  {
+    // legacy layout: tag | ListSize | elements
+    const std::size_t headerSize = result.layout ? listHeaderSize : sizeof(tag) + sizeof(ListSize);
+    if (bufferSize < headerSize) { return false; }
+
+    std::memcpy(&result.size, buffer + headerSize - sizeof(ListSize), sizeof(ListSize));
+    result.data = buffer + headerSize;
+  }
+  else
+  {
+    result.data = buffer + sizeof(tag);
+  }
+
+  return true;
+}
+
+/**
+ * Typed view of a serialized list payload
+ */
+template <typename T>
+struct ListRef
+{
+  ValueTag layout;
+  const char* data;
+  const char* end;
+  ListSize size;
+
+  /** @returns true, if the elements are stored uncompressed (maybe unaligned) */
+  bool isPlain() const
+  {
+    return (layout == ValueTag::null || layout == ValueTag::aligned)
+        && size <= std::size_t(end - data) / sizeof(T);
+  }
+
+  std::size_t plainSize() const { return size * sizeof(T); }
+
+  /** @returns false, if the elements can not be accessed in place */
+  bool view(ListView<T>& result) const
+  {
+    if (
+       layout != ValueTag::aligned
+    || reinterpret_cast<std::uintptr_t>(data) % alignof(T) != 0
+    || ! isPlain()
+    )
+    {
+      return false;
+    }
+
+    result.data = reinterpret_cast<const T*>(data);
+    result.size = size;
+    return true;
+  }
+};
+
+/** Scalar type of a tag, list tags map to their element type */
+template <uint16_t Tag>
+struct TagType { typedef NullValue type; };
+
+#define KVS_TAG_TYPE(tag, T) \
+  template <> struct TagType<tag> { typedef T type; }; \
+  template <> struct TagType<tag | ValueTag::list> { typedef T type; }; \
+  /**/
+
+KVS_TAG_TYPE(tag_int8, char)
+KVS_TAG_TYPE(tag_int16, short)
+KVS_TAG_TYPE(tag_int32, int)
+KVS_TAG_TYPE(tag_int64, int64_t)
+KVS_TAG_TYPE(tag_uint8, unsigned char)
+KVS_TAG_TYPE(tag_uint16, unsigned short)
+KVS_TAG_TYPE(tag_uint32, unsigned int)
+KVS_TAG_TYPE(tag_uint64, uint64_t)
+KVS_TAG_TYPE(tag_float, float)
+KVS_TAG_TYPE(tag_double, double)
+
+#undef KVS_TAG_TYPE
+
+/** Number of tags without layout bits: the size of the dispatch tables */
+constexpr uint16_t tagCount = ValueTag::tag_double + ValueTag::list + 1;
+
+namespace detail {
+
+template <typename Visitor, uint16_t Tag, typename T = typename TagType<Tag>::type>
+struct RefCase
+{
+  static typename Visitor::result_type apply(Visitor& visitor, const ValueRef& ref)
+  {
+    if (Tag & ValueTag::list)
+    {
+      return visitor(ListRef<T>{ref.layout, ref.data, ref.end, ref.size});
+    }
+
+    T t;
+    if (std::size_t(ref.end - ref.data) < sizeof(t)) { return visitor(NullValue{}); }
+    std::memcpy(&t, ref.data, sizeof(t));
+    return visitor(t);
+  }
+};
+
+template <typename Visitor, uint16_t Tag>
+struct RefCase<Visitor, Tag, NullValue>
+{
+  static typename Visitor::result_type apply(Visitor& visitor, const ValueRef&)
+  {
+    return visitor(NullValue{});
+  }
+};
+
+template <uint16_t...> struct TagSequence {};
+
+template <uint16_t N, uint16_t... Tags>
+struct MakeTagSequence : MakeTagSequence<N - 1, N - 1, Tags...> {};
+
+template <uint16_t... Tags>
+struct MakeTagSequence<0, Tags...> { typedef TagSequence<Tags...> type; };
+
+template <typename Visitor, typename Sequence>
+struct RefTable;
+
+template <typename Visitor, uint16_t... Tags>
+struct RefTable<Visitor, TagSequence<Tags...>>
+{
+  typedef typename Visitor::result_type (*Entry)(Visitor&, const ValueRef&);
+  static constexpr Entry entries[sizeof...(Tags)] = { &RefCase<Visitor, Tags>::apply... };
+};
+
+template <typename Visitor, uint16_t... Tags>
+constexpr typename RefTable<Visitor, TagSequence<Tags...>>::Entry
+RefTable<Visitor, TagSequence<Tags...>>::entries[sizeof...(Tags)];
+
+} // namespace detail
+
+/**
+ * Calls `visitor` with the scalar (T), the ListRef<T> or the NullValue
+ * held by `ref`, through a jump table indexed by the tag.
+ */
+template <typename Visitor>
+typename Visitor::result_type applyRefVisitor(Visitor& visitor, const ValueRef& ref)
+{
+  typedef detail::RefTable<Visitor, detail::MakeTagSequence<tagCount>::type> Table;
+
+  return (ref.tag < tagCount)
+    ? Table::entries[ref.tag](visitor, ref)
+    : visitor(NullValue{});
+}
+
+/**
+ * Size of `buffer` after normalize():
+ * lists in the legacy (unaligned) layout grow by the header padding.
+ */
+std::size_t normalizedSize(const char* buffer, std::size_t bufferSize);
+
+/** Copies the serialized value to `output`, converting legacy lists to the aligned layout */
+void normalize(const char* buffer, std::size_t bufferSize, char* output);
+
+/**
+ * @returns false, if `buffer` holds a compressed list, whose payload
+ * does not decode to exactly its size, or whose block headers do not
+ * match their elements. Other values are not checked.
+ */
+bool validate(const char* buffer, std::size_t bufferSize);
+
 } // namespace value
 
 } // namespace kvs
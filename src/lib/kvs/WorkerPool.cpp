@@ -0,0 +1,54 @@
+#include <utility>
+
+#include <kvs/WorkerPool.hpp>
+
+namespace kvs {
+
+WorkerPool::WorkerPool(std::size_t threadCount)
+  :_stopped(false)
+{
+  for (std::size_t i = 0; i < threadCount; ++i)
+  {
+    _threads.emplace_back(&WorkerPool::run, this);
+  }
+}
+
+WorkerPool::~WorkerPool()
+{
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _stopped = true;
+  }
+  _ready.notify_all();
+
+  for (std::thread& thread : _threads) { thread.join(); }
+}
+
+void WorkerPool::post(Task task)
+{
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _tasks.push_back(std::move(task));
+  }
+  _ready.notify_one();
+}
+
+void WorkerPool::run()
+{
+  std::unique_lock<std::mutex> lock(_mutex);
+
+  while (true)
+  {
+    _ready.wait(lock, [this] { return _stopped || ! _tasks.empty(); });
+    if (_stopped) { return; }
+
+    Task task = std::move(_tasks.front());
+    _tasks.pop_front();
+
+    lock.unlock();
+    task();
+    lock.lock();
+  }
+}
+
+} // namespace kvs
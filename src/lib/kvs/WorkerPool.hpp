@@ -0,0 +1,45 @@
+#ifndef KVS_WORKERPOOL_HPP_
+#define KVS_WORKERPOOL_HPP_
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace kvs {
+
+/**
+ * Threads running posted tasks, e.g: slow commands, off the reactor.
+ * Tasks report back by `Reactor::post`: the pool must be destroyed before the reactor.
+ */
+class WorkerPool
+{
+public:
+  typedef std::function<void()> Task;
+
+  explicit WorkerPool(std::size_t threadCount);
+
+  /** Waits for the running tasks, the queued ones are dropped */
+  ~WorkerPool();
+
+  WorkerPool(const WorkerPool&) = delete;
+  WorkerPool& operator=(const WorkerPool&) = delete;
+
+  /** Thread safe */
+  void post(Task task);
+
+private:
+  void run();
+
+  std::mutex _mutex;
+  std::condition_variable _ready;
+  std::deque<Task> _tasks;
+  bool _stopped;
+  std::vector<std::thread> _threads;
+};
+
+} // namespace kvs
+
+#endif // KVS_WORKERPOOL_HPP_
@@ -4,17 +4,17 @@
 
 struct Backup
 {
-  Backup(const std::string& k, std::size_t s, std::unique_ptr<char[]>& v)
+  Backup(const std::string& k, std::size_t s, kvs::ValueBuffer& v)
     :key("backup_" + k),
      size(s),
-     value(new char[size])
+     value(kvs::makeValueBuffer(size))
   {
     std::memcpy(value.get(), v.get(), size);
   }
 
   std::string key;
   std::size_t size;
-  std::unique_ptr<char[]> value;
+  kvs::ValueBuffer value;
 };
 
 extern "C" {
@@ -25,7 +25,7 @@ void kvs_procedure(kvs::Store& store)
 
   auto backup = [&](
     const std::string& key,
-    std::pair<std::size_t, std::unique_ptr<char[]>>& value
+    kvs::Store::Entry& value
   )
   {
     if (key.compare(0, 7, "backup_") != 0)
@@ -0,0 +1,165 @@
+#include <cstring>
+#include <limits>
+#include <new>
+#include <numeric>
+#include <vector>
+
+#include <kvs/BufferPool.hpp>
+#include <kvs/OutputQueue.hpp>
+
+#define BOOST_TEST_MODULE Buffer
+#include <boost/test/unit_test.hpp>
+
+using namespace kvs;
+
+BOOST_AUTO_TEST_CASE(MirroredBuffer)
+{
+  BufferPool pool;
+
+  const std::size_t capacity = BufferPool::capacity(1);
+  char* buffer = pool.acquire(1);
+
+  buffer[capacity - 1] = 'a';
+  BOOST_CHECK_EQUAL('a', buffer[2 * capacity - 1]);
+
+  buffer[capacity] = 'b';
+  BOOST_CHECK_EQUAL('b', buffer[0]);
+
+  pool.release(buffer, capacity);
+  BOOST_CHECK_EQUAL(capacity, pool.freeBytes());
+
+  // reused
+  BOOST_CHECK(buffer == pool.acquire(1));
+  BOOST_CHECK_EQUAL(0, pool.freeBytes());
+  pool.release(buffer, capacity);
+
+  // not pooled
+  const std::size_t largeCapacity = BufferPool::capacity(BufferPool::maxSize + 1);
+  BOOST_CHECK(largeCapacity > BufferPool::maxSize);
+  pool.release(pool.acquire(BufferPool::maxSize + 1), largeCapacity);
+  BOOST_CHECK_EQUAL(capacity, pool.freeBytes());
+}
+
+BOOST_AUTO_TEST_CASE(PooledBufferWrapAround)
+{
+  BufferPool pool;
+  PooledBuffer buffer(pool);
+
+  BOOST_CHECK_EQUAL(0, buffer.capacity());
+
+  std::vector<char> input(100000);
+  std::iota(input.begin(), input.end(), 0);
+
+  // write and read records of a size coprime to the capacity,
+  // keeping a partial record unread, like the CommandHandler
+  const std::size_t recordSize = 333;
+  std::size_t written = 0;
+  std::size_t read = 0;
+
+  buffer.reserve(256);
+  const std::size_t capacity = buffer.capacity();
+  const char* base = buffer.read();
+
+  while (read + recordSize <= input.size())
+  {
+    const std::size_t chunk = std::min(buffer.writeAvailable(), std::min<std::size_t>(1000, input.size() - written));
+    std::memcpy(buffer.write(), input.data() + written, chunk);
+    buffer.doneWrite(chunk);
+    written += chunk;
+
+    while (buffer.readAvailable() >= recordSize)
+    {
+      BOOST_REQUIRE(std::memcmp(buffer.read(), input.data() + read, recordSize) == 0);
+      buffer.doneRead(recordSize);
+      read += recordSize;
+    }
+
+    BOOST_REQUIRE(buffer.read() >= base && buffer.read() < base + capacity);
+  }
+
+  // never grown, nor moved
+  BOOST_CHECK_EQUAL(capacity, buffer.capacity());
+  BOOST_CHECK(base == buffer.read() - (read % capacity));
+
+  buffer.releaseIfEmpty();
+  BOOST_CHECK_EQUAL(capacity, buffer.capacity());
+}
+
+BOOST_AUTO_TEST_CASE(PooledBufferGrow)
+{
+  BufferPool pool;
+  PooledBuffer buffer(pool);
+
+  buffer.reserve(10);
+  const std::size_t capacity = buffer.capacity();
+
+  std::vector<char> input(3 * capacity);
+  std::iota(input.begin(), input.end(), 0);
+
+  // unread bytes are kept across the end of the buffer
+  std::memcpy(buffer.write(), input.data(), capacity);
+  buffer.doneWrite(capacity);
+  buffer.doneRead(capacity - 10);
+
+  buffer.reserve(input.size());
+  BOOST_CHECK(buffer.capacity() > capacity);
+  BOOST_CHECK_EQUAL(10, buffer.readAvailable());
+  BOOST_CHECK(std::memcmp(buffer.read(), input.data() + capacity - 10, 10) == 0);
+
+  // the smaller buffer is back in the pool
+  BOOST_CHECK_EQUAL(capacity, pool.freeBytes());
+
+  buffer.doneRead(10);
+  buffer.releaseIfEmpty();
+  BOOST_CHECK_EQUAL(0, buffer.capacity());
+  BOOST_CHECK_EQUAL(capacity + BufferPool::capacity(input.size() + 10), pool.freeBytes());
+}
+
+BOOST_AUTO_TEST_CASE(PooledBufferTooLarge)
+{
+  BufferPool pool;
+  PooledBuffer buffer(pool);
+
+  buffer.reserve(10);
+  std::memcpy(buffer.write(), "0123456789", 10);
+  buffer.doneWrite(10);
+  const std::size_t capacity = buffer.capacity();
+
+  // the size overflows, or is not mapped: the buffer is kept
+  BOOST_CHECK_THROW(buffer.reserve(std::numeric_limits<std::size_t>::max() - 5), std::bad_alloc);
+  BOOST_CHECK_THROW(buffer.reserve(std::size_t(1) << 60), std::bad_alloc);
+
+  BOOST_CHECK_EQUAL(capacity, buffer.capacity());
+  BOOST_CHECK_EQUAL(10, buffer.readAvailable());
+  BOOST_CHECK(std::memcmp(buffer.read(), "0123456789", 10) == 0);
+}
+
+BOOST_AUTO_TEST_CASE(OutputQueueNeverDrained)
+{
+  OutputQueue queue;
+  std::vector<std::weak_ptr<const char>> owners;
+
+  auto append = [&queue, &owners](char value) {
+    std::shared_ptr<const char> owner(new char(value));
+    owners.push_back(owner);
+    queue.reference(owner.get(), 1, owner);
+  };
+
+  // more appended than consumed: the written segments are dropped on the way
+  append(0);
+  for (int i = 1; i < 10000; ++i)
+  {
+    append(char(2 * i - 1));
+    append(char(2 * i));
+
+    iovec first;
+    BOOST_REQUIRE_EQUAL(1u, queue.gather(&first, 1));
+    BOOST_CHECK_EQUAL(char(i - 1), *static_cast<const char*>(first.iov_base));
+
+    queue.consume(1);
+    BOOST_CHECK(owners[i - 1].expired());
+  }
+
+  BOOST_CHECK_EQUAL(10000u, queue.size());
+  BOOST_CHECK_EQUAL(10000u, queue.segmentCount());
+}
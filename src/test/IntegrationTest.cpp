@@ -1,4 +1,15 @@
 #include <thread>
+#include <future>
+#include <numeric>
+#include <cmath>
+#include <limits>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
 
 #define BOOST_TEST_MODULE IntegrationTest
 #include <boost/test/unit_test.hpp>
@@ -7,8 +18,13 @@
 
 #include <kvs/Reactor.hpp>
 #include <kvs/ListenHandler.hpp>
+#include <kvs/ShmListener.hpp>
+#include <kvs/UnixSocket.hpp>
 #include <kvs/Store.hpp>
 #include <kvs/Connection.hpp>
+#include <kvs/ConnectionPool.hpp>
+#include <kvs/WorkerPool.hpp>
+#include <kvs/CommandRegistry.hpp>
 
 using namespace kvs;
 
@@ -135,6 +151,25 @@ BOOST_AUTO_TEST_CASE(PushCommandTest)
   BOOST_CHECK(connection.get("iarr", iarr));
   BOOST_CHECK((iarr == std::vector<int>{1,2,3,4,5,6,7}));
 
+  // appended in place, or copied while shared by a response
+  std::vector<int> expected;
+  for (int i = 0; i < 5000; ++i)
+  {
+    connection.push("many", i);
+    expected.push_back(i);
+
+    if (i % 1000 == 0)
+    {
+      std::vector<int> many;
+      BOOST_CHECK(connection.get("many", many));
+      BOOST_CHECK(many == expected);
+    }
+  }
+
+  std::vector<int> many;
+  BOOST_CHECK(connection.get("many", many));
+  BOOST_CHECK(many == expected);
+
   reactor.stop();
 
   serverThread.join();
@@ -232,3 +267,1864 @@ BOOST_AUTO_TEST_CASE(MinMaxCommandTest)
 
   BOOST_CHECK(true);
 }
+BOOST_AUTO_TEST_CASE(CompressedListTest)
+{
+  Reactor reactor;
+  const int port = 1338;
+  boost::latch serverStarted(1);
+
+  std::thread serverThread(
+    server, std::ref(reactor), port, std::ref(serverStarted), nullptr
+  );
+
+  serverStarted.wait();
+
+  Connection connection("127.0.0.1", port);
+
+  std::vector<int64_t> expected;
+  for (int64_t i = 0; i < 300; ++i) { expected.push_back(1000 + i * 10 - i % 3); }
+
+  for (ValueTag layout : {ValueTag::delta, ValueTag::packed})
+  {
+    connection.set("ts", std::vector<int64_t>(expected.begin(), expected.end() - 1), layout);
+    connection.push("ts", expected.back());
+
+    std::vector<int64_t> ts;
+    BOOST_CHECK(connection.get("ts", ts));
+    BOOST_CHECK((ts == expected));
+
+    int64_t sum = 0;
+    int64_t max = 0;
+    int64_t min = 0;
+    BOOST_CHECK(connection.sum("ts", sum));
+    BOOST_CHECK(connection.max("ts", max));
+    BOOST_CHECK(connection.min("ts", min));
+
+    BOOST_CHECK_EQUAL(std::accumulate(expected.begin(), expected.end(), int64_t(0)), sum);
+    BOOST_CHECK_EQUAL(*std::max_element(expected.begin(), expected.end()), max);
+    BOOST_CHECK_EQUAL(*std::min_element(expected.begin(), expected.end()), min);
+
+    connection.pop("ts");
+    BOOST_CHECK(connection.get("ts", ts));
+    BOOST_CHECK((ts == std::vector<int64_t>(expected.begin(), expected.end() - 1)));
+  }
+
+  reactor.stop();
+
+  serverThread.join();
+}
+
+BOOST_AUTO_TEST_CASE(VectorArithmeticTest)
+{
+  unlink("/tmp/kvs-inttest.db");
+
+  const std::vector<double> a{1, 2, 3, 4, 5, 6, 7, 8, 9, 10};
+  const std::vector<double> b{10, 9, 8, 7, 6, 5, 4, 3, 2, 1};
+
+  {
+    Reactor reactor;
+    const int port = 1341;
+    boost::latch serverStarted(1);
+
+    std::thread serverThread(
+      server, std::ref(reactor), port, std::ref(serverStarted), "/tmp/kvs-inttest.db"
+    );
+
+    serverStarted.wait();
+
+    Connection connection("127.0.0.1", port);
+
+    connection.set("a", a);
+    connection.set("b", b);
+    connection.set("i", std::vector<int>{1, 2});
+
+    connection.add("sum", "a", "b");
+    connection.subtract("diff", "a", "b");
+    connection.multiply("prod", "a", "b");
+    connection.scale("scaled", "a", 2.0);
+    connection.multiply("a", "a", "a"); // in place
+
+    // type rules: mismatching operands leave the destination untouched
+    connection.add("mismatch", "a", "i");
+    connection.scale("mismatch", "a", 2);
+
+    double dot = 0;
+    BOOST_CHECK(connection.dot("b", "b", dot));
+    BOOST_CHECK_EQUAL(385, dot);
+    BOOST_CHECK(! connection.dot("a", "i", dot));
+
+    double norm = 0;
+    BOOST_CHECK(connection.norm("i", norm));
+    BOOST_CHECK_CLOSE(std::sqrt(5.0), norm, 1e-9);
+
+    std::vector<double> mismatch;
+    BOOST_CHECK(! connection.get("mismatch", mismatch));
+
+    // integers wrap around, near the limits of the type
+    const int64_t top = std::numeric_limits<int64_t>::max();
+    connection.set("big", std::vector<int64_t>{top, top - 1, -top});
+    connection.add("bigsum", "big", "big");
+    connection.multiply("bigprod", "big", "big");
+    connection.scale("bigscaled", "big", int64_t(3));
+
+    std::vector<int64_t> wrapped;
+    BOOST_CHECK(connection.get("bigsum", wrapped));
+    BOOST_CHECK((wrapped == std::vector<int64_t>{-2, -4, 2}));
+    BOOST_CHECK(connection.get("bigprod", wrapped));
+    BOOST_CHECK((wrapped == std::vector<int64_t>{1, 4, 1}));
+    BOOST_CHECK(connection.get("bigscaled", wrapped));
+    BOOST_CHECK((wrapped == std::vector<int64_t>{top - 2, top - 5, -top + 2}));
+
+    int64_t bigDot = 0;
+    BOOST_CHECK(connection.dot("big", "big", bigDot));
+    BOOST_CHECK_EQUAL(6, bigDot);
+
+    // in every lane of the sum, and decoded
+    for (ValueTag layout : {ValueTag::aligned, ValueTag::delta})
+    {
+      connection.set("bigs", std::vector<int64_t>(9, top), layout);
+      int64_t bigSum = 0;
+      BOOST_CHECK(connection.sum("bigs", bigSum));
+      BOOST_CHECK_EQUAL(top - 8, bigSum);
+    }
+
+    reactor.stop();
+
+    serverThread.join();
+  }
+
+  {
+    // replay from the persistent store
+    Reactor reactor;
+    const int port = 1342;
+    boost::latch serverStarted(1);
+
+    std::thread serverThread(
+      server, std::ref(reactor), port, std::ref(serverStarted), "/tmp/kvs-inttest.db"
+    );
+
+    serverStarted.wait();
+
+    Connection connection("127.0.0.1", port);
+
+    std::vector<double> sum, diff, prod, scaled, squared;
+    BOOST_CHECK(connection.get("sum", sum));
+    BOOST_CHECK(connection.get("diff", diff));
+    BOOST_CHECK(connection.get("prod", prod));
+    BOOST_CHECK(connection.get("scaled", scaled));
+    BOOST_CHECK(connection.get("a", squared));
+
+    for (std::size_t i = 0; i < a.size(); ++i)
+    {
+      BOOST_CHECK_EQUAL(a[i] + b[i], sum[i]);
+      BOOST_CHECK_EQUAL(a[i] - b[i], diff[i]);
+      BOOST_CHECK_EQUAL(a[i] * b[i], prod[i]);
+      BOOST_CHECK_EQUAL(a[i] * 2, scaled[i]);
+      BOOST_CHECK_EQUAL(a[i] * a[i], squared[i]);
+    }
+
+    reactor.stop();
+
+    serverThread.join();
+  }
+}
+
+BOOST_AUTO_TEST_CASE(QueryCommandTest)
+{
+  Reactor reactor;
+  const int port = 1338;
+  boost::latch serverStarted(1);
+
+  std::thread serverThread(
+    server, std::ref(reactor), port, std::ref(serverStarted), nullptr
+  );
+
+  serverStarted.wait();
+
+  Connection connection("127.0.0.1", port);
+
+  std::vector<int> items;
+  for (int i = -500; i < 500; ++i) { items.push_back(i); }
+  connection.set("iarr", items);
+  connection.set("farr", std::vector<float>{-1.5f, 0.5f, 2.5f, 4.0f});
+
+  int sum = 0;
+  BOOST_CHECK(connection.query("iarr", Query().greater(400).sum(), sum));
+  BOOST_CHECK_EQUAL(44550, sum);
+
+  uint64_t count = 0;
+  BOOST_CHECK(connection.query("iarr", Query().range(-10, 10).count(), count));
+  BOOST_CHECK_EQUAL(21u, count);
+
+  BOOST_CHECK(connection.query("iarr", Query().greaterEqual(0).less(100).notEqual(50).count(), count));
+  BOOST_CHECK_EQUAL(99u, count);
+
+  int min = 0;
+  int max = 0;
+  BOOST_CHECK(connection.query("iarr", Query().greater(-300).min(), min));
+  BOOST_CHECK(connection.query("iarr", Query().lessEqual(7).max(), max));
+  BOOST_CHECK_EQUAL(-299, min);
+  BOOST_CHECK_EQUAL(7, max);
+
+  // nothing selected
+  BOOST_CHECK(! connection.query("iarr", Query().greater(1000).max(), max));
+
+  float fsum = 0;
+  BOOST_CHECK(connection.query("farr", Query().greater(0.0f).sum(), fsum));
+  BOOST_CHECK_EQUAL(7.0f, fsum);
+
+  // operand type mismatch
+  BOOST_CHECK(! connection.query("farr", Query().greater(0).sum(), fsum));
+
+  // at most maxStages stages
+  Query full;
+  for (std::size_t i = 0; i < query::maxStages; ++i) { full.greater(-1000); }
+  BOOST_CHECK(connection.query("iarr", full.count(), count));
+  BOOST_CHECK_EQUAL(items.size(), count);
+  BOOST_CHECK_THROW(full.greater(-1000), std::runtime_error);
+
+  // compressed lists are decoded block-wise
+  connection.set("parr", items, ValueTag::packed);
+  BOOST_CHECK(connection.query("parr", Query().greater(400).sum(), sum));
+  BOOST_CHECK_EQUAL(44550, sum);
+
+  reactor.stop();
+
+  serverThread.join();
+}
+
+
+template <typename Command>
+void appendCommand(const Command& command, std::vector<char>& output)
+{
+  iovec serialized[Command::serializedVectorSize];
+  command::Size size;
+  command.serialize(serialized, size);
+
+  for (auto&& vec : serialized)
+  {
+    const char* begin = static_cast<const char*>(vec.iov_base);
+    output.insert(output.end(), begin, begin + vec.iov_len);
+  }
+}
+
+template <typename T>
+std::vector<char> serializeValue(const T& t)
+{
+  std::vector<char> result(value::serializedSize(t));
+  value::serialize(t, result.data());
+  return result;
+}
+
+/** Connects without Connection, to send pipelined requests */
+Fd connectRaw(int port)
+{
+  Fd socket(::socket(PF_INET, SOCK_STREAM, IPPROTO_TCP));
+  sockaddr_in address{};
+  address.sin_family = AF_INET;
+  address.sin_port = htons(port);
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  BOOST_REQUIRE(connect(*socket, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0);
+  return socket;
+}
+
+TypedValue recvValue(int socket)
+{
+  command::Size size = 0;
+  BOOST_REQUIRE_EQUAL(ssize_t(sizeof(size)), recv(socket, &size, sizeof(size), MSG_WAITALL));
+
+  std::vector<char> payload(size - sizeof(size));
+  BOOST_REQUIRE_EQUAL(ssize_t(payload.size()), recv(socket, payload.data(), payload.size(), MSG_WAITALL));
+
+  SetCommand response(command::deserialize{}, payload.data(), payload.size());
+  return value::deserialize(response.value().first, response.value().second);
+}
+
+BOOST_AUTO_TEST_CASE(PipelinedResponsesTest)
+{
+  Reactor reactor;
+  const int port = 1338;
+  boost::latch serverStarted(1);
+
+  std::thread serverThread(
+    server, std::ref(reactor), port, std::ref(serverStarted), nullptr
+  );
+
+  serverStarted.wait();
+
+  Connection connection("127.0.0.1", port);
+
+  // larger than the copied segments of the responses
+  const std::vector<int> before(100, 1);
+  const std::vector<int> after(100, 2);
+  const std::vector<char> afterValue = serializeValue(after);
+
+  connection.set("small", 7);
+  connection.set("large", before);
+
+  // sent at once, responses of a single read are coalesced
+  std::vector<char> requests;
+  const int getCount = 100;
+  for (int i = 0; i < getCount; ++i) { appendCommand(GetCommand("small"), requests); }
+  appendCommand(GetCommand("large"), requests);
+  appendCommand(SetCommand("large", afterValue.size(), afterValue.data()), requests);
+  appendCommand(GetCommand("large"), requests);
+  appendCommand(SumCommand("large"), requests);
+
+  Fd socket = connectRaw(port);
+  BOOST_REQUIRE_EQUAL(ssize_t(requests.size()), ::write(*socket, requests.data(), requests.size()));
+
+  for (int i = 0; i < getCount; ++i)
+  {
+    BOOST_CHECK(TypedValue(7) == recvValue(*socket));
+  }
+
+  // the value sent before the SET is not overwritten by it
+  BOOST_CHECK(TypedValue(before) == recvValue(*socket));
+  BOOST_CHECK(TypedValue(after) == recvValue(*socket));
+  BOOST_CHECK(TypedValue(200) == recvValue(*socket));
+
+  reactor.stop();
+
+  serverThread.join();
+}
+
+BOOST_AUTO_TEST_CASE(InvalidCompressedListTest)
+{
+  Reactor reactor;
+  const int port = 1338;
+  boost::latch serverStarted(1);
+
+  std::thread serverThread(
+    server, std::ref(reactor), port, std::ref(serverStarted), nullptr
+  );
+
+  serverStarted.wait();
+
+  Connection connection("127.0.0.1", port);
+
+  std::vector<int64_t> expected;
+  for (int64_t i = 0; i < 300; ++i) { expected.push_back(1000 + i * 10 - i % 3); }
+  const TypedValue typed(expected);
+
+  std::vector<char> packed(value::serializedSize(typed, ValueTag::packed));
+  value::serialize(typed, packed.data(), ValueTag::packed);
+
+  connection.set("packed", expected, ValueTag::packed);
+
+  // the block header claims a larger max than its elements
+  std::vector<char> inconsistent = packed;
+  const std::size_t maxOffset = value::listHeaderSize + offsetof(encoding::BlockHeader, max);
+  uint64_t blockMax;
+  std::memcpy(&blockMax, inconsistent.data() + maxOffset, sizeof(blockMax));
+  blockMax += 1000000;
+  std::memcpy(inconsistent.data() + maxOffset, &blockMax, sizeof(blockMax));
+
+  // the last block is cut short
+  std::vector<char> truncated(packed.begin(), packed.end() - sizeof(uint64_t));
+
+  // a block more is declared than encoded
+  std::vector<char> overcounted = packed;
+  ListSize size;
+  std::memcpy(&size, overcounted.data() + value::listHeaderSize - sizeof(size), sizeof(size));
+  size += encoding::blockSize;
+  std::memcpy(overcounted.data() + value::listHeaderSize - sizeof(size), &size, sizeof(size));
+
+  // rejected, the value stored before is kept
+  std::vector<char> requests;
+  for (const std::vector<char>* invalid : {&inconsistent, &truncated, &overcounted})
+  {
+    appendCommand(SetCommand("packed", invalid->size(), invalid->data()), requests);
+  }
+  appendCommand(GetCommand("packed"), requests);
+  appendCommand(MaxCommand("packed"), requests);
+
+  Fd socket = connectRaw(port);
+  BOOST_REQUIRE_EQUAL(ssize_t(requests.size()), ::write(*socket, requests.data(), requests.size()));
+
+  BOOST_CHECK(typed == recvValue(*socket));
+  BOOST_CHECK(TypedValue(*std::max_element(expected.begin(), expected.end())) == recvValue(*socket));
+
+  reactor.stop();
+
+  serverThread.join();
+}
+
+BOOST_AUTO_TEST_CASE(BackloggedResponsesTest)
+{
+  Reactor reactor;
+  const int port = 1338;
+  boost::latch serverStarted(1);
+
+  std::thread serverThread(
+    server, std::ref(reactor), port, std::ref(serverStarted), nullptr
+  );
+
+  serverStarted.wait();
+
+  Connection connection("127.0.0.1", port);
+
+  const std::vector<int> before(1 << 16, 1);
+  const std::vector<int> after(1 << 16, 2);
+  const std::vector<char> afterValue = serializeValue(after);
+
+  connection.set("large", before);
+
+  // SET is not acknowledged, wait until it is executed
+  std::vector<int> stored;
+  BOOST_REQUIRE(connection.get("large", stored));
+  BOOST_REQUIRE(stored == before);
+
+  // responses do not fit into the socket buffers, are queued by the server,
+  // while the value they refer to is overwritten
+  std::vector<char> requests;
+  const int getCount = 64;
+  for (int i = 0; i < getCount; ++i) { appendCommand(GetCommand("large"), requests); }
+  appendCommand(SetCommand("large", afterValue.size(), afterValue.data()), requests);
+  appendCommand(GetCommand("large"), requests);
+
+  Fd socket = connectRaw(port);
+  BOOST_REQUIRE_EQUAL(ssize_t(requests.size()), ::write(*socket, requests.data(), requests.size()));
+
+  for (int i = 0; i < getCount; ++i)
+  {
+    BOOST_CHECK(TypedValue(before) == recvValue(*socket));
+  }
+
+  BOOST_CHECK(TypedValue(after) == recvValue(*socket));
+
+  reactor.stop();
+
+  serverThread.join();
+}
+
+BOOST_AUTO_TEST_CASE(FragmentedCommandTest)
+{
+  Reactor reactor;
+  const int port = 1338;
+  boost::latch serverStarted(1);
+
+  std::thread serverThread(
+    server, std::ref(reactor), port, std::ref(serverStarted), nullptr
+  );
+
+  serverStarted.wait();
+
+  // larger than the largest pooled input buffer
+  std::vector<int> large(1 << 20);
+  std::iota(large.begin(), large.end(), 0);
+  const std::vector<char> largeValue = serializeValue(large);
+
+  std::vector<char> requests;
+  appendCommand(SetCommand("large", largeValue.size(), largeValue.data()), requests);
+  appendCommand(GetCommand("large"), requests);
+
+  // the input buffer grows to the size of the partially received command
+  Fd socket = connectRaw(port);
+  const std::size_t fragments[] = {3, 4096, 1 << 20, requests.size()};
+  std::size_t sent = 0;
+  for (std::size_t end : fragments)
+  {
+    BOOST_REQUIRE_EQUAL(ssize_t(end - sent), ::write(*socket, requests.data() + sent, end - sent));
+    sent = end;
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+
+  BOOST_CHECK(TypedValue(large) == recvValue(*socket));
+
+  // the idle connection returned its input buffer
+  Connection connection("127.0.0.1", port);
+  connection.set("small", 5);
+  int small = 0;
+  BOOST_CHECK(connection.get("small", small));
+  BOOST_CHECK_EQUAL(5, small);
+  BOOST_CHECK(reactor.bufferPool().freeBytes() >= BufferPool::minSize);
+
+  reactor.stop();
+
+  serverThread.join();
+}
+
+BOOST_AUTO_TEST_CASE(OversizedCommandTest)
+{
+  Reactor reactor;
+  const int port = 1338;
+  boost::latch serverStarted(1);
+
+  std::thread serverThread(
+    server, std::ref(reactor), port, std::ref(serverStarted), nullptr
+  );
+
+  serverStarted.wait();
+
+  // the declared size is not allocated: the connection is closed, the server keeps serving
+  const command::Size sizes[] = {command::maxSize + 1, command::Size(1) << 46, ~command::Size(0)};
+  for (command::Size size : sizes)
+  {
+    Fd socket = connectRaw(port);
+    char header[sizeof(command::Size) + sizeof(command::Tag) + 1] = {};
+    memcpy(header, &size, sizeof(size));
+    BOOST_REQUIRE_EQUAL(ssize_t(sizeof(header)), ::write(*socket, header, sizeof(header)));
+
+    char byte;
+    BOOST_CHECK_EQUAL(0, recv(*socket, &byte, sizeof(byte), 0));
+  }
+
+  Connection connection("127.0.0.1", port);
+  connection.set("small", 5);
+  int small = 0;
+  BOOST_CHECK(connection.get("small", small));
+  BOOST_CHECK_EQUAL(5, small);
+
+  reactor.stop();
+
+  serverThread.join();
+}
+
+BOOST_AUTO_TEST_CASE(EdgeTriggeredTest)
+{
+  Reactor reactor(Reactor::Trigger::edge);
+  const int port = 1338;
+  boost::latch serverStarted(1);
+
+  std::thread serverThread(
+    server, std::ref(reactor), port, std::ref(serverStarted), nullptr
+  );
+
+  serverStarted.wait();
+
+  Connection connection("127.0.0.1", port);
+  connection.set("small", 7);
+
+  // more input than the read budget of a dispatch, more output than the socket buffers
+  std::vector<char> requests;
+  const int getCount = 1 << 15;
+  for (int i = 0; i < getCount; ++i) { appendCommand(GetCommand("small"), requests); }
+
+  Fd socket = connectRaw(port);
+  std::thread flood([&socket, &requests]()
+  {
+    const char* data = requests.data();
+    std::size_t size = requests.size();
+    while (size)
+    {
+      const ssize_t wsize = ::write(*socket, data, size);
+      if (wsize <= 0) { break; }
+      data += wsize;
+      size -= wsize;
+    }
+  });
+
+  // served while the other connection yields
+  connection.set("other", 5);
+  int other = 0;
+  BOOST_CHECK(connection.get("other", other));
+  BOOST_CHECK_EQUAL(5, other);
+
+  for (int i = 0; i < getCount; ++i)
+  {
+    BOOST_REQUIRE(TypedValue(7) == recvValue(*socket));
+  }
+
+  flood.join();
+
+  reactor.stop();
+
+  serverThread.join();
+}
+
+BOOST_AUTO_TEST_CASE(UringBackendTest)
+{
+  Reactor reactor(Reactor::Trigger::level, Reactor::Backend::uring);
+  const int port = 1338;
+  boost::latch serverStarted(1);
+
+  std::thread serverThread(
+    server, std::ref(reactor), port, std::ref(serverStarted), nullptr
+  );
+
+  serverStarted.wait();
+
+  Connection connection("127.0.0.1", port);
+
+  int val = 0;
+  BOOST_CHECK(! connection.get("foo", val));
+  connection.set<int>("foo", 123);
+  BOOST_CHECK(connection.get("foo", val));
+  BOOST_CHECK_EQUAL(123, val);
+
+  // larger than a receive buffer, received in parts
+  std::vector<int> large(1 << 16);
+  std::iota(large.begin(), large.end(), 0);
+  const std::vector<char> largeValue = serializeValue(large);
+
+  std::vector<char> requests;
+  appendCommand(SetCommand("large", largeValue.size(), largeValue.data()), requests);
+
+  // pipelined, the responses do not fit into the socket buffers
+  const int getCount = 64;
+  for (int i = 0; i < getCount; ++i) { appendCommand(GetCommand("large"), requests); }
+  appendCommand(GetCommand("foo"), requests);
+
+  Fd socket = connectRaw(port);
+  const std::size_t fragments[] = {3, 100, 20000, requests.size()};
+  std::size_t sent = 0;
+  for (std::size_t end : fragments)
+  {
+    BOOST_REQUIRE_EQUAL(ssize_t(end - sent), ::write(*socket, requests.data() + sent, end - sent));
+    sent = end;
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+
+  for (int i = 0; i < getCount; ++i)
+  {
+    BOOST_REQUIRE(TypedValue(large) == recvValue(*socket));
+  }
+  BOOST_CHECK(TypedValue(123) == recvValue(*socket));
+
+  // a closed connection does not affect the others
+  socket.close();
+  BOOST_CHECK(connection.get("foo", val));
+  BOOST_CHECK_EQUAL(123, val);
+
+  reactor.stop();
+
+  serverThread.join();
+}
+
+/** @returns the number of open file descriptors of the process */
+std::size_t openFds()
+{
+  DIR* fds = opendir("/proc/self/fd");
+  BOOST_REQUIRE(fds);
+  std::size_t result = 0;
+  while (readdir(fds)) { ++result; }
+  closedir(fds);
+  return result;
+}
+
+BOOST_AUTO_TEST_CASE(ReconnectTest)
+{
+  for (Reactor::Backend backend : {Reactor::Backend::epoll, Reactor::Backend::uring})
+  {
+    Reactor reactor(Reactor::Trigger::level, backend);
+    const int port = 1338;
+    boost::latch serverStarted(1);
+
+    std::thread serverThread(
+      server, std::ref(reactor), port, std::ref(serverStarted), nullptr
+    );
+
+    serverStarted.wait();
+
+    // a response: the connection is accepted
+    Connection connection("127.0.0.1", port);
+    connection.set("foo", 11);
+    int val = 0;
+    BOOST_CHECK(connection.get("foo", val));
+    const std::size_t fdsBefore = openFds();
+
+    std::vector<char> requests;
+    appendCommand(GetCommand("foo"), requests);
+
+    std::vector<char> pipelined;
+    for (int i = 0; i < 4096; ++i) { appendCommand(GetCommand("foo"), pipelined); }
+
+    // closed, reset, and reset with responses pending: the slots of the handlers are reused
+    const linger reset{1, 0};
+    for (int i = 0; i < 768; ++i)
+    {
+      Fd socket = connectRaw(port);
+      if (i % 3 == 2)
+      {
+        BOOST_REQUIRE_EQUAL(ssize_t(pipelined.size()), ::write(*socket, pipelined.data(), pipelined.size()));
+      }
+      else
+      {
+        BOOST_REQUIRE_EQUAL(ssize_t(requests.size()), ::write(*socket, requests.data(), requests.size()));
+        BOOST_REQUIRE(TypedValue(11) == recvValue(*socket));
+      }
+      if (i % 3) { setsockopt(*socket, SOL_SOCKET, SO_LINGER, &reset, sizeof(reset)); }
+    }
+
+    // the handlers of the closed connections are deleted, their sockets closed
+    for (int i = 0; i < 100 && openFds() > fdsBefore; ++i)
+    {
+      BOOST_CHECK(connection.get("foo", val));
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    BOOST_CHECK_EQUAL(fdsBefore, openFds());
+
+    BOOST_CHECK(connection.get("foo", val));
+    BOOST_CHECK_EQUAL(11, val);
+
+    reactor.stop();
+
+    serverThread.join();
+  }
+}
+
+BOOST_AUTO_TEST_CASE(PostTest)
+{
+  for (Reactor::Backend backend : {Reactor::Backend::epoll, Reactor::Backend::uring})
+  {
+    Reactor reactor(Reactor::Trigger::level, backend);
+    std::thread reactorThread([&reactor]()
+    {
+      while (! reactor.isStopped()) { reactor.dispatch(); }
+    });
+
+    // tasks run on the reactor thread, in the order of each poster
+    const int posterCount = 4;
+    const int taskCount = 20000;
+    std::vector<int> lastTask(posterCount, -1);
+    bool ordered = true;
+    int executed = 0;
+
+    std::vector<std::thread> posters;
+    for (int poster = 0; poster < posterCount; ++poster)
+    {
+      posters.emplace_back([&, poster]()
+      {
+        for (int task = 0; task < taskCount; ++task)
+        {
+          reactor.post([&, poster, task]()
+          {
+            ordered = ordered && lastTask[poster] + 1 == task;
+            lastTask[poster] = task;
+            ++executed;
+          });
+        }
+      });
+    }
+    for (std::thread& poster : posters) { poster.join(); }
+
+    std::promise<int> done;
+    reactor.post([&]() { done.set_value(executed); });
+    BOOST_CHECK_EQUAL(posterCount * taskCount, done.get_future().get());
+    BOOST_CHECK(ordered);
+
+    // wakes up the waiting reactor
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    const auto stopped = std::chrono::steady_clock::now();
+    reactor.stop();
+    reactorThread.join();
+    BOOST_CHECK(std::chrono::steady_clock::now() - stopped < std::chrono::milliseconds(500));
+  }
+}
+
+BOOST_AUTO_TEST_CASE(BackpressureTest)
+{
+  const std::pair<Reactor::Trigger, Reactor::Backend> configs[] = {
+    {Reactor::Trigger::level, Reactor::Backend::epoll},
+    {Reactor::Trigger::edge, Reactor::Backend::epoll},
+    {Reactor::Trigger::level, Reactor::Backend::uring},
+  };
+
+  for (auto&& config : configs)
+  {
+    Reactor reactor(config.first, config.second);
+    const int port = 1338;
+    boost::latch serverStarted(1);
+
+    std::thread serverThread(
+      server, std::ref(reactor), port, std::ref(serverStarted), nullptr
+    );
+
+    serverStarted.wait();
+
+    // the responses are as large as the requests, with the key
+    Connection connection("127.0.0.1", port);
+    const std::string key(4096, 'k');
+    connection.set(key, 3);
+    int val = 0;
+    BOOST_REQUIRE(connection.get(key, val));
+
+    std::vector<char> requests;
+    const int getCount = 1 << 15;
+    for (int i = 0; i < getCount; ++i) { appendCommand(GetCommand(key), requests); }
+
+    // the client does not read the responses: the server stops reading its requests
+    Fd socket = connectRaw(port);
+    const int flags = fcntl(*socket, F_GETFL);
+    fcntl(*socket, F_SETFL, flags | O_NONBLOCK);
+
+    std::size_t sent = 0;
+    while (sent < requests.size())
+    {
+      const ssize_t wsize = ::write(*socket, requests.data() + sent, requests.size() - sent);
+      if (wsize > 0) { sent += wsize; continue; }
+
+      pollfd writable{*socket, POLLOUT, 0};
+      if (poll(&writable, 1, 200) == 0) { break; }
+    }
+    BOOST_CHECK_LT(sent, requests.size() / 4);
+
+    // served meanwhile
+    connection.set("other", 5);
+    BOOST_CHECK(connection.get("other", val));
+    BOOST_CHECK_EQUAL(5, val);
+
+    // reading resumes as the responses are received
+    fcntl(*socket, F_SETFL, flags);
+    std::thread writer([&socket, &requests, sent]()
+    {
+      const char* data = requests.data() + sent;
+      std::size_t size = requests.size() - sent;
+      while (size)
+      {
+        const ssize_t wsize = ::write(*socket, data, size);
+        if (wsize <= 0) { break; }
+        data += wsize;
+        size -= wsize;
+      }
+    });
+
+    for (int i = 0; i < getCount; ++i)
+    {
+      BOOST_REQUIRE(TypedValue(3) == recvValue(*socket));
+    }
+
+    writer.join();
+
+    reactor.stop();
+
+    serverThread.join();
+  }
+}
+
+/** Counts its timeouts */
+class TimeoutCounter : public IOHandler
+{
+public:
+  bool dispatch() override { return true; }
+  bool timedOut() override { ++count; return true; }
+
+  int count = 0;
+};
+
+BOOST_AUTO_TEST_CASE(TimerTest)
+{
+  for (auto backend : {Reactor::Backend::epoll, Reactor::Backend::uring})
+  {
+    Reactor reactor(Reactor::Trigger::level, backend);
+
+    // never readable
+    Fd fds[3];
+    TimeoutCounter moved, cancelled, earlier;
+    TimeoutCounter* handlers[] = {&moved, &cancelled, &earlier};
+    for (int i = 0; i < 3; ++i)
+    {
+      fds[i] = eventfd(0, EFD_NONBLOCK);
+      BOOST_REQUIRE(reactor.addHandler(handlers[i], *fds[i], EPOLLIN));
+    }
+
+    const Reactor::Clock::time_point start = Reactor::Clock::now();
+    const std::chrono::milliseconds step(50);
+
+    reactor.setTimeout(&moved, start + step);
+    reactor.setTimeout(&moved, start + 3 * step);
+    reactor.setTimeout(&cancelled, start + step);
+    reactor.setTimeout(&cancelled, Reactor::Clock::time_point::max());
+    reactor.setTimeout(&earlier, start + 4 * step);
+    // every earlier deadline leaves a stale timer, dropped by compactions
+    for (int i = 1000; i > 0; --i)
+    {
+      reactor.setTimeout(&earlier, start + 2 * step + std::chrono::microseconds(i));
+    }
+    reactor.setTimeout(&earlier, start + 2 * step);
+
+    while (moved.count == 0) { reactor.dispatch(); }
+    BOOST_CHECK(Reactor::Clock::now() - start >= 3 * step);
+    BOOST_CHECK_EQUAL(1, earlier.count);
+
+    // dispatch wakes up for the deadlines
+    while (Reactor::Clock::now() - start < 6 * step) { reactor.dispatch(); }
+
+    BOOST_CHECK_EQUAL(1, moved.count);
+    BOOST_CHECK_EQUAL(0, cancelled.count);
+    BOOST_CHECK_EQUAL(1, earlier.count);
+
+    for (TimeoutCounter* pHandler : handlers)
+    {
+      reactor.removeHandler(pHandler);
+    }
+  }
+}
+
+/** @returns true, if the server closed `socket` within `timeout` */
+bool closedWithin(int socket, std::chrono::milliseconds timeout)
+{
+  pollfd readable{socket, POLLIN, 0};
+  if (poll(&readable, 1, int(timeout.count())) != 1) { return false; }
+
+  char data;
+  return recv(socket, &data, 1, 0) <= 0;
+}
+
+BOOST_AUTO_TEST_CASE(ConnectionTimeoutTest)
+{
+  const std::pair<Reactor::Trigger, Reactor::Backend> configs[] = {
+    {Reactor::Trigger::level, Reactor::Backend::epoll},
+    {Reactor::Trigger::edge, Reactor::Backend::epoll},
+    {Reactor::Trigger::level, Reactor::Backend::uring},
+  };
+
+  const std::chrono::milliseconds idle(1000);
+  CommandHandler::Timeouts timeouts;
+  timeouts.idle = idle;
+  timeouts.receive = std::chrono::milliseconds(200);
+
+  for (auto&& config : configs)
+  {
+    Reactor reactor(config.first, config.second);
+    const int port = 1338;
+    boost::latch serverStarted(1);
+
+    std::thread serverThread([&]()
+    {
+      Store store(nullptr);
+      ListenHandler server(reactor, port, store, timeouts);
+      serverStarted.count_down();
+
+      while (! reactor.isStopped())
+      {
+        reactor.dispatch();
+      }
+    });
+
+    serverStarted.wait();
+
+    // active connections are kept
+    Connection connection("127.0.0.1", port);
+    connection.set("key", 1);
+    int val = 0;
+    for (int i = 0; i < 3; ++i)
+    {
+      std::this_thread::sleep_for(idle / 2);
+      BOOST_CHECK(connection.get("key", val));
+    }
+
+    // a connection which sends nothing
+    const Reactor::Clock::time_point start = Reactor::Clock::now();
+    Fd silent = connectRaw(port);
+    BOOST_CHECK(closedWithin(*silent, 3 * idle));
+    BOOST_CHECK(Reactor::Clock::now() - start >= idle / 2);
+
+    // a partial command, sent slower than the receive timeout, but not idle
+    const std::vector<char> value = serializeValue(2);
+    std::vector<char> command;
+    appendCommand(SetCommand("key", value.size(), value.data()), command);
+
+    Fd slow = connectRaw(port);
+    bool closed = false;
+    for (std::size_t sent = 0; sent + 1 < command.size() && ! closed; ++sent)
+    {
+      if (send(*slow, &command[sent], 1, MSG_NOSIGNAL) != 1) { break; }
+      closed = closedWithin(*slow, std::chrono::milliseconds(50));
+    }
+    BOOST_CHECK(closed || closedWithin(*slow, idle / 2));
+
+    reactor.stop();
+    serverThread.join();
+  }
+}
+
+BOOST_AUTO_TEST_CASE(MultiKeyTest)
+{
+  unlink("/tmp/kvs-inttest.db");
+
+  // more items than a writev takes
+  const int count = 10000;
+  std::vector<std::string> names;
+  for (int i = 0; i < count; ++i) { names.push_back("counter" + std::to_string(i)); }
+
+  {
+    Reactor reactor;
+    const int port = 1339;
+    boost::latch serverStarted(1);
+
+    std::thread serverThread(
+      server, std::ref(reactor), port, std::ref(serverStarted), "/tmp/kvs-inttest.db"
+    );
+
+    serverStarted.wait();
+
+    Connection connection("127.0.0.1", port);
+
+    std::vector<std::pair<Connection::Key, int>> counters;
+    for (int i = 0; i < count; ++i) { counters.emplace_back(names[i], i); }
+    connection.mset(counters);
+
+    // large values are referenced by the response
+    const std::vector<int> large(1000, 7);
+    connection.mset(std::vector<std::pair<Connection::Key, std::vector<int>>>{
+      {"list1", {1}}, {"list2", large}
+    });
+    connection.mpush(std::vector<std::pair<Connection::Key, int>>{
+      {"list1", 2}, {"list2", 8}, {"list1", 3}
+    });
+
+    std::vector<Connection::Key> keys(names.begin(), names.end());
+    keys.push_back("missing");
+    std::vector<boost::optional<int>> results;
+    BOOST_CHECK_EQUAL(std::size_t(count), connection.mget(keys, results));
+    BOOST_REQUIRE_EQUAL(keys.size(), results.size());
+    for (int i = 0; i < count; ++i) { BOOST_CHECK(results[i] && *results[i] == i); }
+    BOOST_CHECK(! results[count]);
+
+    // the value of another type is not a result
+    std::vector<boost::optional<std::vector<int>>> lists;
+    BOOST_CHECK_EQUAL(2u, connection.mget({"list1", "counter1", "list2"}, lists));
+    BOOST_REQUIRE(lists[0] && lists[2]);
+    BOOST_CHECK((*lists[0] == std::vector<int>{1, 2, 3}));
+    BOOST_CHECK(! lists[1]);
+    BOOST_CHECK_EQUAL(large.size() + 1, lists[2]->size());
+    BOOST_CHECK_EQUAL(8, lists[2]->back());
+
+    reactor.stop();
+
+    serverThread.join();
+  }
+
+  // batches are replayed from the persistent store
+  {
+    Reactor reactor;
+    const int port = 1340;
+    boost::latch serverStarted(1);
+
+    std::thread serverThread(
+      server, std::ref(reactor), port, std::ref(serverStarted), "/tmp/kvs-inttest.db"
+    );
+
+    serverStarted.wait();
+
+    Connection connection("127.0.0.1", port);
+
+    int val = 0;
+    BOOST_CHECK(connection.get(names[count - 1], val));
+    BOOST_CHECK_EQUAL(count - 1, val);
+
+    std::vector<int> list;
+    BOOST_CHECK(connection.get("list1", list));
+    BOOST_CHECK((list == std::vector<int>{1, 2, 3}));
+
+    reactor.stop();
+
+    serverThread.join();
+  }
+}
+
+template <typename Command>
+void appendFrame(uint64_t requestId, const Command& command, std::vector<char>& output)
+{
+  iovec serialized[Command::serializedVectorSize];
+  command::Size size;
+  command.serialize(serialized, size);
+
+  std::vector<char> scratch;
+  protocol::encode(requestId, serialized, Command::serializedVectorSize, scratch,
+    [&output](const iovec& vec, std::size_t) {
+      const char* begin = static_cast<const char*>(vec.iov_base);
+      output.insert(output.end(), begin, begin + vec.iov_len);
+    }
+  );
+}
+
+/** Receives a v2 frame to `payload`, decodes it to `frame` */
+void recvFrame(int socket, std::vector<char>& payload, protocol::Frame& frame)
+{
+  char header[protocol::maxVarintSize];
+  uint64_t bodySize = 0;
+  std::size_t headerSize = 0;
+  for (std::size_t i = 0; headerSize == 0 && i < sizeof(header); ++i)
+  {
+    BOOST_REQUIRE_EQUAL(1, recv(socket, header + i, 1, MSG_WAITALL));
+    headerSize = protocol::readVarint(header, i + 1, bodySize);
+  }
+
+  payload.resize(bodySize);
+  BOOST_REQUIRE_EQUAL(ssize_t(bodySize), recv(socket, payload.data(), bodySize, MSG_WAITALL));
+  BOOST_REQUIRE(protocol::decode(payload.data(), payload.size(), frame));
+}
+
+BOOST_AUTO_TEST_CASE(ProtocolV2Test)
+{
+  unlink("/tmp/kvs-inttest.db");
+
+  {
+    Reactor reactor;
+    const int port = 1339;
+    boost::latch serverStarted(1);
+
+    std::thread serverThread(
+      server, std::ref(reactor), port, std::ref(serverStarted), "/tmp/kvs-inttest.db"
+    );
+
+    serverStarted.wait();
+
+    // v1 and v2 clients side by side
+    Connection v1("127.0.0.1", port);
+    Connection v2("127.0.0.1", port, protocol::Version::v2);
+    BOOST_CHECK(protocol::Version::v1 == v1.version());
+    BOOST_CHECK(protocol::Version::v2 == v2.version());
+
+    // larger than the copied responses
+    const std::vector<int> large(1000, 3);
+
+    v2.set("int", 42);
+    v2.set("large", large);
+    v2.push("large", 4);
+    v1.set("v1list", std::vector<double>{3, 4});
+    std::vector<double> v1list;
+    BOOST_CHECK(v1.get("v1list", v1list)); // SET is not acknowledged, used by the other connection
+    v2.mset(std::vector<std::pair<Connection::Key, int>>{{"a", 1}, {"b", 2}});
+    v2.add("sum", "v1list", "v1list");
+    v2.scale("scaled", "v1list", 2.0);
+
+    int val = 0;
+    BOOST_CHECK(v1.get("int", val));
+    BOOST_CHECK_EQUAL(42, val);
+    BOOST_CHECK(v2.get("a", val));
+    BOOST_CHECK_EQUAL(1, val);
+    BOOST_CHECK(! v2.get("missing", val));
+
+    std::vector<int> list;
+    BOOST_CHECK(v2.get("large", list));
+    BOOST_CHECK_EQUAL(large.size() + 1, list.size());
+    BOOST_CHECK_EQUAL(4, list.back());
+
+    int sum = 0;
+    BOOST_CHECK(v2.sum("large", sum));
+    BOOST_CHECK_EQUAL(3004, sum);
+
+    double result = 0;
+    BOOST_CHECK(v2.dot("sum", "scaled", result));
+    BOOST_CHECK_EQUAL(100.0, result);
+    BOOST_CHECK(v2.norm("v1list", result));
+    BOOST_CHECK_EQUAL(5.0, result);
+
+    std::vector<boost::optional<int>> results;
+    BOOST_CHECK_EQUAL(2u, v2.mget({"a", "missing", "b"}, results));
+    BOOST_CHECK(results[0] && *results[0] == 1 && ! results[1] && results[2] && *results[2] == 2);
+
+    // responses carry the request id of their request
+    Fd socket = connectRaw(port);
+    std::vector<char> requests;
+    appendCommand(HelloCommand(uint8_t(protocol::Version::v2)), requests);
+    BOOST_REQUIRE_EQUAL(ssize_t(requests.size()), ::write(*socket, requests.data(), requests.size()));
+
+    std::vector<char> hello(sizeof(command::Size) + sizeof(command::Tag) + 1);
+    BOOST_REQUIRE_EQUAL(ssize_t(hello.size()), recv(*socket, hello.data(), hello.size(), MSG_WAITALL));
+    BOOST_CHECK_EQUAL(uint8_t(protocol::Version::v2), HelloCommand(
+      command::deserialize{}, hello.data() + sizeof(command::Size), hello.size() - sizeof(command::Size)
+    ).version());
+
+    requests.clear();
+    appendFrame(7, GetCommand("int"), requests);
+    appendFrame(300, SumCommand("large"), requests);
+    appendFrame(3, GetCommand("large"), requests);
+
+    // fragmented in the middle of a frame
+    const std::size_t half = requests.size() / 2;
+    BOOST_REQUIRE_EQUAL(ssize_t(half), ::write(*socket, requests.data(), half));
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    BOOST_REQUIRE_EQUAL(ssize_t(requests.size() - half), ::write(*socket, requests.data() + half, requests.size() - half));
+
+    std::vector<char> payload;
+    protocol::Frame frame;
+    const uint64_t requestIds[] = {7, 300, 3};
+    const TypedValue values[] = {TypedValue(42), TypedValue(3004), TypedValue(list)};
+
+    for (int i = 0; i < 3; ++i)
+    {
+      recvFrame(*socket, payload, frame);
+      BOOST_CHECK_EQUAL(requestIds[i], frame.requestId);
+
+      const SetCommand response = frame.command<SetCommand>();
+      BOOST_CHECK(values[i] == value::deserialize(response.value().first, response.value().second));
+    }
+
+    // a size overflowing with its header is not trusted: closed, the others are served
+    char header[protocol::maxVarintSize];
+    const std::size_t headerSize = protocol::writeVarint(~uint64_t(0), header);
+    BOOST_REQUIRE_EQUAL(ssize_t(headerSize), ::write(*socket, header, headerSize));
+
+    char byte;
+    BOOST_CHECK_EQUAL(0, recv(*socket, &byte, sizeof(byte), 0));
+
+    int intValue = 0;
+    BOOST_CHECK(v2.get("int", intValue));
+    BOOST_CHECK_EQUAL(42, intValue);
+
+    reactor.stop();
+
+    serverThread.join();
+  }
+
+  // v2 commands are logged in v1 format
+  {
+    Reactor reactor;
+    const int port = 1340;
+    boost::latch serverStarted(1);
+
+    std::thread serverThread(
+      server, std::ref(reactor), port, std::ref(serverStarted), "/tmp/kvs-inttest.db"
+    );
+
+    serverStarted.wait();
+
+    Connection connection("127.0.0.1", port);
+
+    int val = 0;
+    BOOST_CHECK(connection.get("int", val));
+    BOOST_CHECK_EQUAL(42, val);
+    BOOST_CHECK(connection.get("b", val));
+    BOOST_CHECK_EQUAL(2, val);
+
+    std::vector<double> scaled;
+    BOOST_CHECK(connection.get("scaled", scaled));
+    BOOST_CHECK((scaled == std::vector<double>{6, 8}));
+
+    reactor.stop();
+
+    serverThread.join();
+  }
+}
+
+BOOST_AUTO_TEST_CASE(AsyncResponseTest)
+{
+  Reactor reactor;
+  const int port = 1338;
+  boost::latch serverStarted(1);
+
+  // the worker is busy until released, the latches outlive it
+  boost::latch released(1);
+  boost::latch releasedAgain(1);
+  WorkerPool workers(1);
+
+  std::thread serverThread([&]() {
+    Store store(nullptr);
+    ListenHandler server(reactor, port, store, CommandHandler::Timeouts(), &workers);
+
+    serverStarted.count_down();
+
+    while (! reactor.isStopped())
+    {
+      reactor.dispatch();
+    }
+  });
+
+  serverStarted.wait();
+
+  Connection connection("127.0.0.1", port, protocol::Version::v2);
+
+  // larger than the offload threshold
+  const std::vector<int> huge(300000, 1);
+  connection.set("huge", huge);
+  connection.set("small", 7);
+
+  workers.post([&released]() { released.wait(); });
+
+  std::vector<std::string> responses;
+  connection.sumAsync<int>("huge", [&responses](boost::optional<int> result) {
+    BOOST_CHECK(result && *result == 300000);
+    responses.push_back("sum");
+  });
+  connection.getAsync<int>("small", [&responses](boost::optional<int> result) {
+    BOOST_CHECK(result && *result == 7);
+    responses.push_back("get");
+  });
+
+  // overwritten after the snapshot of the sum
+  connection.set("huge", std::vector<int>{1});
+
+  // a synchronous request is answered before the slow one, the fast one is dispatched meanwhile
+  int val = 0;
+  BOOST_CHECK(connection.get("small", val));
+  BOOST_CHECK_EQUAL(7, val);
+  BOOST_CHECK_EQUAL(1u, connection.pending());
+  BOOST_CHECK((responses == std::vector<std::string>{"get"}));
+
+  released.count_down();
+  connection.wait();
+
+  BOOST_CHECK_EQUAL(0u, connection.pending());
+  BOOST_CHECK((responses == std::vector<std::string>{"get", "sum"}));
+
+  // responses of closed connections are dropped
+  connection.set("huge", huge);
+  BOOST_CHECK(connection.get("small", val)); // SET is not acknowledged, received by many reads
+  {
+    workers.post([&releasedAgain]() { releasedAgain.wait(); });
+
+    Connection closed("127.0.0.1", port, protocol::Version::v2);
+    closed.sumAsync<int>("huge", [](boost::optional<int>) { BOOST_ERROR("not received"); });
+    BOOST_CHECK(closed.get("small", val));
+    BOOST_CHECK_EQUAL(1u, closed.pending());
+  }
+  releasedAgain.count_down();
+
+  // v1 clients are answered in order
+  Connection v1("127.0.0.1", port);
+  BOOST_CHECK(v1.sum("huge", val));
+  BOOST_CHECK_EQUAL(300000, val);
+  BOOST_CHECK(connection.sum("huge", val));
+  BOOST_CHECK_EQUAL(300000, val);
+
+  reactor.stop();
+
+  serverThread.join();
+}
+
+/** A command of a library: increments the int of its key, logged, responds the new value */
+const command::Tag incrementTag = command::Tag(CommandRegistry::firstTag);
+
+int applyIncrement(Store& store, const char* buffer, command::Size size)
+{
+  ReadBuffer reader(buffer, size);
+  command::Tag tag;
+  Key key;
+  check(reader.read(tag) && tag == incrementTag);
+  check(reader.read(key));
+
+  auto&& entry = store[key];
+  int result = 1;
+  if (entry.first > 0)
+  {
+    TypedValue current = value::deserialize(entry.second.get(), entry.first);
+    if (const int* pCurrent = boost::get<int>(&current)) { result += *pCurrent; }
+  }
+
+  const std::size_t resultSize = value::serializedSize(result);
+  value::serialize(result, resetValue(entry, resultSize));
+  entry.first = resultSize;
+  return result;
+}
+
+void replayIncrement(Store& store, const char* buffer, command::Size size)
+{
+  applyIncrement(store, buffer, size);
+}
+
+void executeIncrement(Store& store, const char* buffer, command::Size size, std::vector<char>& response)
+{
+  command::Size fullSize = sizeof(fullSize) + size;
+  iovec serialized[2] = {{&fullSize, sizeof(fullSize)}, {const_cast<char*>(buffer), size}};
+  store.writePersStore(serialized, 2, fullSize);
+
+  response = serializeValue(applyIncrement(store, buffer, size));
+}
+
+void appendIncrement(const char* key, std::vector<char>& output)
+{
+  const command::Size size = sizeof(command::Size) + sizeof(command::Tag) + strlen(key) + 1;
+  const char* pSize = reinterpret_cast<const char*>(&size);
+  const char* pTag = reinterpret_cast<const char*>(&incrementTag);
+  output.insert(output.end(), pSize, pSize + sizeof(size));
+  output.insert(output.end(), pTag, pTag + sizeof(incrementTag));
+  output.insert(output.end(), key, key + strlen(key) + 1);
+}
+
+BOOST_AUTO_TEST_CASE(CommandRegistryTest)
+{
+  unlink("/tmp/kvs-inttest.db");
+
+  CommandRegistry& registry = CommandRegistry::instance();
+  BOOST_CHECK(! registry.add(command::Tag::GET, executeIncrement));
+  BOOST_REQUIRE(registry.add(incrementTag, executeIncrement, replayIncrement));
+
+  {
+    Reactor reactor;
+    const int port = 1339;
+    boost::latch serverStarted(1);
+
+    std::thread serverThread(
+      server, std::ref(reactor), port, std::ref(serverStarted), "/tmp/kvs-inttest.db"
+    );
+
+    serverStarted.wait();
+
+    Fd socket = connectRaw(port);
+
+    std::vector<char> requests;
+    appendIncrement("counter", requests);
+    appendIncrement("counter", requests);
+    appendCommand(GetCommand("counter"), requests);
+    BOOST_REQUIRE_EQUAL(ssize_t(requests.size()), send(*socket, requests.data(), requests.size(), 0));
+
+    BOOST_CHECK(recvValue(*socket) == TypedValue(1));
+    BOOST_CHECK(recvValue(*socket) == TypedValue(2));
+    BOOST_CHECK(recvValue(*socket) == TypedValue(2));
+
+    // neither builtin, nor registered
+    requests.clear();
+    appendIncrement("counter", requests);
+    const command::Tag unknown = command::Tag(CommandRegistry::firstTag + 1);
+    memcpy(requests.data() + sizeof(command::Size), &unknown, sizeof(unknown));
+    BOOST_REQUIRE_EQUAL(ssize_t(requests.size()), send(*socket, requests.data(), requests.size(), 0));
+    BOOST_CHECK(closedWithin(*socket, std::chrono::seconds(5)));
+
+    reactor.stop();
+
+    serverThread.join();
+  }
+
+  // the logged commands of the library are replayed
+  {
+    Reactor reactor;
+    const int port = 1340;
+    boost::latch serverStarted(1);
+
+    std::thread serverThread(
+      server, std::ref(reactor), port, std::ref(serverStarted), "/tmp/kvs-inttest.db"
+    );
+
+    serverStarted.wait();
+
+    Connection connection("127.0.0.1", port);
+
+    int val = 0;
+    BOOST_CHECK(connection.get("counter", val));
+    BOOST_CHECK_EQUAL(2, val);
+
+    reactor.stop();
+
+    serverThread.join();
+  }
+}
+
+BOOST_AUTO_TEST_CASE(UnixSocketTest)
+{
+  const char* socketFile = "/tmp/kvs-inttest.sock";
+
+  for (const std::string path : {socketFile, "@kvs-inttest"})
+  {
+    Reactor reactor;
+    boost::latch serverStarted(1);
+
+    std::thread serverThread([&]() {
+      Store store(nullptr);
+      ListenHandler server(reactor, path, store);
+      ListenHandler tcpServer(reactor, 1338, store);
+
+      serverStarted.count_down();
+
+      while (! reactor.isStopped())
+      {
+        reactor.dispatch();
+      }
+    });
+
+    serverStarted.wait();
+
+    BOOST_CHECK_EQUAL(path == socketFile, access(socketFile, F_OK) == 0);
+
+    // the same store, served by the same handlers
+    Connection tcp("127.0.0.1", 1338);
+    Connection v1(path);
+    Connection v2(path, protocol::Version::v2);
+    BOOST_CHECK(v2.version() == protocol::Version::v2);
+
+    // each write is awaited by a GET of its connection, before the next connection writes
+    int val = 0;
+    tcp.set("key", 42);
+    BOOST_CHECK(tcp.get("key", val));
+    BOOST_CHECK(v1.get("key", val));
+    BOOST_CHECK_EQUAL(42, val);
+
+    std::vector<int> list;
+    v1.push("list", 1);
+    BOOST_CHECK(v1.get("list", list));
+    v2.push("list", 2);
+    BOOST_CHECK(v2.get("list", list));
+    BOOST_CHECK((list == std::vector<int>{1, 2}));
+
+    reactor.stop();
+
+    serverThread.join();
+
+    BOOST_CHECK(access(socketFile, F_OK) != 0);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(SharedMemoryTest)
+{
+  const std::string path = "@kvs-inttest-shm";
+
+  Reactor reactor;
+  boost::latch serverStarted(1);
+
+  std::thread serverThread([&]() {
+    Store store(nullptr);
+    // small rings: frames wrap around, large ones wait for space
+    ShmListener server(reactor, path, store, 256);
+    ListenHandler tcpServer(reactor, 1338, store);
+
+    serverStarted.count_down();
+
+    while (! reactor.isStopped())
+    {
+      reactor.dispatch();
+    }
+  });
+
+  serverStarted.wait();
+
+  // accepted, before the fds are counted
+  Connection tcp("127.0.0.1", 1338);
+  int val = 0;
+  BOOST_CHECK(! tcp.get("key", val));
+  const std::size_t fdsBefore = openFds();
+
+  {
+    Connection v1{Connection::Shm(path)};
+    Connection v2(Connection::Shm(path, 1000), protocol::Version::v2);
+    BOOST_CHECK(v2.version() == protocol::Version::v2);
+
+    for (int i = 0; i < 100; ++i)
+    {
+      v1.set("key", i);
+      BOOST_CHECK(v1.get("key", val));
+      BOOST_CHECK_EQUAL(i, val);
+    }
+
+    // larger than the rings, in both directions
+    std::vector<int> list(1000);
+    std::iota(list.begin(), list.end(), 0);
+    v2.set("list", list);
+    std::vector<int> result;
+    BOOST_CHECK(v2.get("list", result));
+    BOOST_CHECK(list == result);
+
+    // the same store, as the socket clients
+    BOOST_CHECK(tcp.get("list", result));
+    BOOST_CHECK(list == result);
+
+    int sum = 0;
+    int asyncVal = 0;
+    v2.sumAsync<int>("list", [&sum](boost::optional<int> r) { sum = r.get_value_or(-1); });
+    v2.getAsync<int>("key", [&asyncVal](boost::optional<int> r) { asyncVal = r.get_value_or(-1); });
+    v2.wait();
+    BOOST_CHECK_EQUAL(999 * 1000 / 2, sum);
+    BOOST_CHECK_EQUAL(99, asyncVal);
+  }
+
+  // closed by the clients
+  for (int i = 0; i < 100 && openFds() > fdsBefore; ++i)
+  {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  BOOST_CHECK_EQUAL(fdsBefore, openFds());
+
+  {
+    // a client gone without closing is noticed by its socket
+    sockaddr_un address;
+    const socklen_t addressSize = unixAddress(path, address);
+    Fd socket(::socket(PF_UNIX, SOCK_STREAM, 0));
+    BOOST_REQUIRE(connect(*socket, reinterpret_cast<sockaddr*>(&address), addressSize) == 0);
+
+    int fds[2];
+    BOOST_REQUIRE(shm::recvFds(*socket, fds, 2));
+    ::close(fds[0]);
+    ::close(fds[1]);
+  }
+
+  for (int i = 0; i < 300 && openFds() > fdsBefore; ++i)
+  {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  BOOST_CHECK_EQUAL(fdsBefore, openFds());
+
+  reactor.stop();
+
+  serverThread.join();
+}
+
+BOOST_AUTO_TEST_CASE(BusyPollTest)
+{
+  const std::string path = "@kvs-inttest-shm";
+
+  Reactor reactor;
+  reactor.setBusyPoll(std::chrono::milliseconds(2));
+  boost::latch serverStarted(1);
+  std::atomic<std::size_t> rounds(0);
+
+  std::thread serverThread([&]() {
+    Store store(nullptr);
+    ShmListener server(reactor, path, store);
+    ListenHandler tcpServer(reactor, 1338, store);
+
+    serverStarted.count_down();
+
+    while (! reactor.isStopped())
+    {
+      reactor.dispatch();
+      ++rounds;
+    }
+  });
+
+  serverStarted.wait();
+
+  {
+    Connection tcp("127.0.0.1", 1338);
+    Connection shm{Connection::Shm(path)};
+
+    // the request ring is polled, instead of the doorbell rung
+    int val = 0;
+    for (int i = 0; i < 100; ++i)
+    {
+      shm.set("key", i);
+      BOOST_CHECK(shm.get("key", val));
+      BOOST_CHECK_EQUAL(i, val);
+      BOOST_CHECK(tcp.get("key", val));
+    }
+
+    // idle: blocks after the budget
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    const std::size_t idleRounds = rounds.load();
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    BOOST_CHECK_LE(rounds.load() - idleRounds, 2u);
+
+    // woken up by the doorbell
+    shm.set("key", 42);
+    BOOST_CHECK(shm.get("key", val));
+    BOOST_CHECK_EQUAL(42, val);
+  }
+
+  reactor.stop();
+
+  serverThread.join();
+}
+
+BOOST_AUTO_TEST_CASE(PipelineTest)
+{
+  const std::string path = "@kvs-inttest-shm";
+
+  Reactor reactor;
+  boost::latch serverStarted(1);
+
+  std::thread serverThread([&]() {
+    Store store(nullptr);
+    ListenHandler tcpServer(reactor, 1338, store);
+    // frames wrap around, the client waits for space
+    ShmListener shmServer(reactor, path, store, 256);
+
+    serverStarted.count_down();
+
+    while (! reactor.isStopped())
+    {
+      reactor.dispatch();
+    }
+  });
+
+  serverStarted.wait();
+
+  {
+    Connection tcp("127.0.0.1", 1338, protocol::Version::v2);
+    Connection shm{Connection::Shm(path), protocol::Version::v2};
+
+    for (Connection* pConnection : {&tcp, &shm})
+    {
+      Connection& connection = *pConnection;
+
+      const int count = 10000;
+      for (int i = 0; i < count; ++i) { connection.set(std::to_string(i), i); }
+
+      // more than the pending limit: responses are received while queueing
+      std::vector<Connection::Future<int>> futures;
+      for (int i = 0; i < count; ++i) { futures.push_back(connection.getAsync<int>(std::to_string(i))); }
+      BOOST_CHECK_LE(connection.pending(), Connection::maxPending);
+
+      for (int i = 0; i < count; ++i) { BOOST_CHECK_EQUAL(i, futures[i].get().get_value_or(-1)); }
+      BOOST_CHECK_EQUAL(0u, connection.pending());
+
+      // queued until flushed, then dispatched in order by a barrier
+      std::vector<int> results;
+      for (int i = 0; i < 100; ++i)
+      {
+        connection.getAsync<int>(std::to_string(i), [&results](boost::optional<int> r) {
+          results.push_back(r.get_value_or(-1));
+        });
+      }
+      auto missing = connection.getAsync<int>("missing");
+
+      connection.flush();
+      BOOST_CHECK_EQUAL(101u, connection.pending());
+      BOOST_CHECK(results.empty());
+
+      connection.sync();
+      BOOST_CHECK_EQUAL(100u, results.size());
+      for (int i = 0; i < int(results.size()); ++i) { BOOST_CHECK_EQUAL(i, results[i]); }
+      BOOST_CHECK(missing.ready());
+      BOOST_CHECK(! missing.get());
+
+      // a synchronous request is sent after the queued ones
+      auto before = connection.getAsync<int>("0");
+      connection.set("0", 42);
+      int val = 0;
+      BOOST_CHECK(connection.get("0", val));
+      BOOST_CHECK_EQUAL(42, val);
+      BOOST_CHECK(before.ready());
+      BOOST_CHECK_EQUAL(0, before.get().get_value_or(-1));
+
+      // responses larger than the receive buffer, between small ones
+      const std::vector<int> large(100000, 7);
+      connection.set("large", large);
+      auto small = connection.getAsync<int>("1");
+      auto list = connection.getAsync<std::vector<int>>("large");
+      auto sum = connection.sumAsync<int>("large");
+      BOOST_CHECK(list.get() == large);
+      BOOST_CHECK_EQUAL(700000, sum.get().get_value_or(-1));
+      BOOST_CHECK_EQUAL(1, small.get().get_value_or(-1));
+    }
+
+    // v1 responses have no request id
+    Connection v1("127.0.0.1", 1338);
+    BOOST_CHECK_THROW(v1.getAsync<int>("0"), std::runtime_error);
+
+    // responses wrap around the input buffer, which grows for the large ones
+    for (int i = 0; i < 1000; ++i)
+    {
+      int val = 0;
+      BOOST_CHECK(v1.get(std::to_string(i), val));
+      BOOST_CHECK_EQUAL(i == 0 ? 42 : i, val);
+
+      if (i % 100 == 0)
+      {
+        std::vector<int> list;
+        BOOST_CHECK(v1.get("large", list));
+        BOOST_CHECK_EQUAL(100000u, list.size());
+      }
+    }
+  }
+
+  reactor.stop();
+
+  serverThread.join();
+}
+
+BOOST_AUTO_TEST_CASE(ConnectionPoolTest)
+{
+  const std::string path = "@kvs-inttest-shm";
+
+  CommandHandler::Timeouts timeouts;
+  timeouts.idle = std::chrono::milliseconds(100);
+
+  Reactor reactor;
+  boost::latch serverStarted(1);
+
+  std::thread serverThread([&]() {
+    Store store(nullptr);
+    ListenHandler tcpServer(reactor, 1338, store, timeouts);
+    ShmListener shmServer(reactor, path, store);
+
+    serverStarted.count_down();
+
+    while (! reactor.isStopped())
+    {
+      reactor.dispatch();
+    }
+  });
+
+  serverStarted.wait();
+
+  {
+    ConnectionPool tcp([]() {
+      return std::unique_ptr<Connection>(new Connection("127.0.0.1", 1338, protocol::Version::v2));
+    }, 2, std::chrono::milliseconds(0));
+
+    ConnectionPool shm([&path]() {
+      return std::unique_ptr<Connection>(new Connection(Connection::Shm(path), protocol::Version::v2));
+    }, 3);
+
+    // connected at the first use
+    BOOST_CHECK_EQUAL(0u, tcp.connects());
+
+    // the requests of the threads of a connection are pipelined, each thread sees its own writes
+    for (ConnectionPool* pPool : {&shm, &tcp})
+    {
+      ConnectionPool& pool = *pPool;
+      const std::string prefix = pPool == &tcp ? "tcp" : "shm";
+      std::atomic<int> errors(0);
+
+      std::vector<std::thread> clients;
+      for (int t = 0; t < 8; ++t)
+      {
+        clients.emplace_back([&pool, &prefix, &errors, t]() {
+          const std::string key = prefix + std::to_string(t);
+          for (int i = 0; i < 500; ++i)
+          {
+            pool.set(key, i);
+            pool.push(key + "list", i);
+
+            int val = -1;
+            if (! pool.get(key, val) || val != i) { ++errors; }
+            if (! pool.sum(key + "list", val) || val != i * (i + 1) / 2) { ++errors; }
+          }
+        });
+      }
+      for (std::thread& client : clients) { client.join(); }
+
+      BOOST_CHECK_EQUAL(0, errors.load());
+      BOOST_CHECK_EQUAL(pool.size(), pool.connects());
+    }
+
+    // exclusive use, for any request
+    int sum = 0;
+    {
+      auto lease = tcp.lease();
+
+      std::vector<boost::optional<int>> results;
+      BOOST_CHECK_EQUAL(2u, lease->mget<int>({"tcp0", "tcp7", "missing"}, results));
+      BOOST_CHECK_EQUAL(499, results[1].get_value_or(-1));
+
+      lease->sumAsync<int>("tcp0list", [&sum](boost::optional<int> r) { sum = r.get_value_or(-1); });
+      BOOST_CHECK_EQUAL(1u, lease->pending());
+    }
+    // synced when released
+    BOOST_CHECK_EQUAL(499 * 500 / 2, sum);
+
+    // closed by the server when idle: replaced
+    const std::size_t connects = tcp.connects();
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    int val = 0;
+    BOOST_CHECK(tcp.get("tcp0", val));
+    BOOST_CHECK_EQUAL(499, val);
+    BOOST_CHECK_EQUAL(connects + 1, tcp.connects());
+  }
+
+  // larger than the socket buffers: the thread receiving the responses
+  // does not wait for the one blocked sending, until the server reads again
+  {
+    ConnectionPool pool([]() {
+      return std::unique_ptr<Connection>(new Connection("127.0.0.1", 1338, protocol::Version::v2));
+    }, 1);
+
+    const std::vector<int> large(1 << 21, 1);
+    pool.set("tcplarge", large);
+
+    std::atomic<int> errors(0);
+    std::vector<std::thread> clients;
+    clients.emplace_back([&pool, &large]() {
+      for (int i = 0; i < 10; ++i) { pool.set("tcplarge", large); }
+    });
+    for (int t = 0; t < 3; ++t)
+    {
+      clients.emplace_back([&pool, &large, &errors]() {
+        for (int i = 0; i < 10; ++i)
+        {
+          std::vector<int> result;
+          if (! pool.get("tcplarge", result) || result != large) { ++errors; }
+        }
+      });
+    }
+    for (std::thread& client : clients) { client.join(); }
+
+    BOOST_CHECK_EQUAL(0, errors.load());
+  }
+
+  reactor.stop();
+
+  serverThread.join();
+}
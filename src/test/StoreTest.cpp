@@ -1,4 +1,9 @@
+#include <cstdio> // remove
+#include <fstream>
+#include <cstring>
+#include <algorithm>
 
+#include <kvs/Value.hpp>
 #include <kvs/Store.hpp>
 
 #define BOOST_TEST_MODULE Store
@@ -19,3 +24,96 @@ BOOST_AUTO_TEST_CASE(StoreBasics)
   auto entryIt = store.find(Key("bar"));
   BOOST_REQUIRE(entryIt->second.first == 123);
 }
+
+BOOST_AUTO_TEST_CASE(LegacyPersistentStore)
+{
+  const char* path = "/tmp/kvs-storetest.db";
+
+  {
+    // SET foo [1, 2, 3], in the legacy list layout
+    const uint16_t valueTag = ValueTag::tag_int32 | ValueTag::list;
+    const ListSize listSize = 3;
+    const int elements[] = {1, 2, 3};
+    const std::size_t valueSize = sizeof(valueTag) + sizeof(listSize) + sizeof(elements);
+
+    const command::Tag comTag = command::Tag::SET;
+    const command::Size comSize =
+      sizeof(comSize) + sizeof(comTag) + sizeof("foo") + sizeof(valueSize) + valueSize;
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<const char*>(&comSize), sizeof(comSize));
+    file.write(reinterpret_cast<const char*>(&comTag), sizeof(comTag));
+    file.write("foo", sizeof("foo"));
+    file.write(reinterpret_cast<const char*>(&valueSize), sizeof(valueSize));
+    file.write(reinterpret_cast<const char*>(&valueTag), sizeof(valueTag));
+    file.write(reinterpret_cast<const char*>(&listSize), sizeof(listSize));
+    file.write(reinterpret_cast<const char*>(elements), sizeof(elements));
+  }
+
+  Store store(path);
+
+  auto entryIt = store.find(Key("foo"));
+  BOOST_REQUIRE(entryIt != store.end());
+
+  value::ListView<int> view;
+  BOOST_REQUIRE(value::view(entryIt->second.second.get(), entryIt->second.first, view));
+  BOOST_CHECK_EQUAL(3u, view.size);
+  BOOST_CHECK_EQUAL(3, view.data[2]);
+
+  std::remove(path);
+}
+
+BOOST_AUTO_TEST_CASE(SharedValueBuffers)
+{
+  Store store(nullptr);
+
+  auto&& entry = store[Key("foo")];
+  char* buffer = resetValue(entry, 16);
+  entry.first = 16;
+  std::memset(buffer, 'a', 16);
+
+  // not shared: reused
+  BOOST_CHECK(resetValue(entry, 8) == buffer);
+  BOOST_CHECK(modifyValue(entry) == buffer);
+
+  // shared, e.g: by a response in flight: the shared copy is not changed
+  ValueBuffer inFlight = entry.second;
+
+  char* modified = modifyValue(entry);
+  BOOST_CHECK(modified != buffer);
+  BOOST_CHECK(std::equal(buffer, buffer + 16, modified));
+  modified[0] = 'b';
+  BOOST_CHECK_EQUAL('a', inFlight.get()[0]);
+
+  ValueBuffer inFlight2 = entry.second;
+  BOOST_CHECK(resetValue(entry, 8) != modified);
+  BOOST_CHECK_EQUAL('b', inFlight2.get()[0]);
+}
+
+BOOST_AUTO_TEST_CASE(GrownValueBuffers)
+{
+  Store store(nullptr);
+
+  auto&& entry = store[Key("foo")];
+  char* buffer = growValue(entry, 8);
+  std::memset(buffer, 'a', 8);
+  entry.first = 8;
+
+  // geometrically: the next growth is in place
+  char* grown = growValue(entry, 12);
+  BOOST_CHECK(grown != buffer);
+  BOOST_CHECK(valueCapacity(entry.second) >= 16);
+  std::memset(grown + 8, 'b', 4);
+  entry.first = 12;
+
+  BOOST_CHECK(growValue(entry, 16) == grown);
+  BOOST_CHECK(std::string(grown, 12) == "aaaaaaaabbbb");
+
+  // shared: copied, the shared one is not changed
+  ValueBuffer inFlight = entry.second;
+  char* copied = growValue(entry, 16);
+  BOOST_CHECK(copied != grown);
+  BOOST_CHECK(std::string(copied, 12) == "aaaaaaaabbbb");
+  copied[0] = 'c';
+  BOOST_CHECK_EQUAL('a', inFlight.get()[0]);
+}
@@ -1,4 +1,8 @@
+#include <algorithm>
+#include <cstring>
+#include <limits>
 #include <ostream>
+#include <string>
 
 #include <kvs/Value.hpp>
 
@@ -49,3 +53,182 @@ BOOST_AUTO_TEST_CASE(ValueRead)
 
   checkMatch("\"foobar\"", std::vector<char>{'f', 'o', 'o', 'b', 'a', 'r'});
 }
+
+BOOST_AUTO_TEST_CASE(AlignedListLayout)
+{
+  const std::vector<double> input{1.5, 2.5, 3.5};
+
+  const std::size_t size = value::serializedSize(input);
+  BOOST_CHECK_EQUAL(value::listHeaderSize + 3 * sizeof(double), size);
+
+  std::unique_ptr<char[]> buffer(new char[size]);
+  value::serialize(input, buffer.get());
+
+  BOOST_CHECK_EQUAL(ValueTag::tag_double | ValueTag::list, value::deserializeTag(buffer.get(), size));
+  BOOST_CHECK_EQUAL(TypedValue{input}, value::deserialize(buffer.get(), size));
+
+  value::ListView<double> view;
+  BOOST_REQUIRE(value::view(buffer.get(), size, view));
+  BOOST_CHECK_EQUAL(3u, view.size);
+  BOOST_CHECK_EQUAL(0u, reinterpret_cast<std::uintptr_t>(view.data) % value::alignment);
+  BOOST_CHECK(std::equal(view.begin(), view.end(), input.begin()));
+
+  value::ListView<float> mismatch;
+  BOOST_CHECK(! value::view(buffer.get(), size, mismatch));
+}
+
+BOOST_AUTO_TEST_CASE(LegacyListLayout)
+{
+  // tag | ListSize | elements, as written by earlier versions
+  const uint16_t tag = ValueTag::tag_int32 | ValueTag::list;
+  const ListSize listSize = 3;
+  const int elements[] = {1, 2, 3};
+
+  char legacy[sizeof(tag) + sizeof(listSize) + sizeof(elements)];
+  FixWriteBuffer writer(legacy);
+  writer.write(tag);
+  writer.write(listSize);
+  writer.write(elements, sizeof(elements));
+
+  const std::vector<int> expected{1, 2, 3};
+  BOOST_CHECK_EQUAL(TypedValue{expected}, value::deserialize(legacy, sizeof(legacy)));
+
+  value::ListView<int> view;
+  BOOST_CHECK(! value::view(legacy, sizeof(legacy), view));
+
+  const std::size_t size = value::normalizedSize(legacy, sizeof(legacy));
+  BOOST_CHECK_EQUAL(value::serializedSize(expected), size);
+
+  std::unique_ptr<char[]> normalized(new char[size]);
+  value::normalize(legacy, sizeof(legacy), normalized.get());
+
+  BOOST_REQUIRE(value::view(normalized.get(), size, view));
+  BOOST_CHECK(std::equal(view.begin(), view.end(), expected.begin()));
+}
+
+template <typename T>
+void checkCompressed(const std::vector<T>& input, ValueTag layout)
+{
+  const std::size_t size = value::serializedSize(input, layout);
+  std::unique_ptr<char[]> buffer(new char[size]);
+  value::serialize(input, buffer.get(), layout);
+
+  BOOST_CHECK_EQUAL(layout, value::deserializeLayout(buffer.get(), size));
+  BOOST_CHECK_EQUAL(ValueTag(ValueDescriptor<std::vector<T>>::tag), value::deserializeTag(buffer.get(), size));
+  BOOST_CHECK_EQUAL(TypedValue{input}, value::deserialize(buffer.get(), size));
+
+  // truncated payloads are rejected
+  if (! input.empty())
+  {
+    BOOST_CHECK_EQUAL(TypedValue{}, value::deserialize(buffer.get(), size - 1));
+  }
+}
+
+BOOST_AUTO_TEST_CASE(CompressedListLayout)
+{
+  std::vector<int64_t> timestamps;
+  for (int64_t i = 0; i < 1000; ++i) { timestamps.push_back(1500000000000 + i * 1000 + i % 7); }
+
+  std::vector<int> mixed{-5, 7, std::numeric_limits<int>::min(), 0, std::numeric_limits<int>::max()};
+  std::vector<uint64_t> wide{0, std::numeric_limits<uint64_t>::max(), 3};
+  std::vector<unsigned char> same(300, 42);
+
+  for (ValueTag layout : {ValueTag::delta, ValueTag::packed})
+  {
+    checkCompressed(timestamps, layout);
+    checkCompressed(mixed, layout);
+    checkCompressed(wide, layout);
+    checkCompressed(same, layout);
+    checkCompressed(std::vector<short>{}, layout);
+  }
+
+  // small deltas compress well
+  BOOST_CHECK_LT(value::serializedSize(timestamps, ValueTag::delta) * 3, value::serializedSize(timestamps));
+  BOOST_CHECK_LT(value::serializedSize(timestamps, ValueTag::packed) * 3, value::serializedSize(timestamps));
+
+  // non-integer lists fall back to the aligned layout
+  const std::vector<double> doubles{1.0, 2.0};
+  std::unique_ptr<char[]> buffer(new char[value::serializedSize(doubles, ValueTag::delta)]);
+  value::serialize(doubles, buffer.get(), ValueTag::delta);
+  BOOST_CHECK_EQUAL(ValueTag::aligned, value::deserializeLayout(buffer.get(), value::serializedSize(doubles)));
+}
+
+/** Describes the value passed by applyRefVisitor */
+struct DescribeRef : public boost::static_visitor<std::string>
+{
+  std::string operator()(NullValue) const { return "null"; }
+
+  template <typename T>
+  std::string operator()(const T& t) const
+  {
+    return "scalar " + std::to_string(t);
+  }
+
+  template <typename T>
+  std::string operator()(const value::ListRef<T>& list) const
+  {
+    if (! list.isPlain()) { return "not plain"; }
+
+    std::string result = "list";
+    for (ListSize i = 0; i < list.size; ++i)
+    {
+      T t;
+      std::memcpy(&t, list.data + i * sizeof(T), sizeof(T));
+      result += " " + std::to_string(t);
+    }
+    return result;
+  }
+};
+
+std::string describe(const char* buffer, std::size_t size)
+{
+  value::ValueRef ref;
+  if (! value::ref(buffer, size, ref)) { return "invalid"; }
+
+  DescribeRef visitor;
+  return value::applyRefVisitor(visitor, ref);
+}
+
+template <typename T>
+std::string describe(const T& t, ValueTag layout = ValueTag::aligned)
+{
+  // at least a list header, which the list serializer writes first
+  const std::size_t size = value::serializedSize(t, layout);
+  std::vector<char> buffer(std::max<std::size_t>(size, value::listHeaderSize));
+  value::serialize(t, buffer.data(), layout);
+  return describe(buffer.data(), size);
+}
+
+BOOST_AUTO_TEST_CASE(ValueRefDispatch)
+{
+  BOOST_CHECK_EQUAL("null", describe(NullValue{}));
+  BOOST_CHECK_EQUAL("scalar 7", describe(int64_t(7)));
+  BOOST_CHECK_EQUAL("scalar 1.500000", describe(1.5f));
+  BOOST_CHECK_EQUAL("list 1 2 3", describe(std::vector<unsigned short>{1, 2, 3}));
+  BOOST_CHECK_EQUAL("list", describe(std::vector<double>{}));
+  BOOST_CHECK_EQUAL("not plain", describe(std::vector<int>{1, 2, 3}, ValueTag::delta));
+
+  // legacy layout: tag | ListSize | elements
+  const uint16_t tag = ValueTag::tag_int32 | ValueTag::list;
+  const ListSize listSize = 2;
+  const int elements[] = {4, 5};
+
+  char legacy[sizeof(tag) + sizeof(listSize) + sizeof(elements)];
+  FixWriteBuffer writer(legacy);
+  writer.write(tag);
+  writer.write(listSize);
+  writer.write(elements, sizeof(elements));
+
+  BOOST_CHECK_EQUAL("list 4 5", describe(legacy, sizeof(legacy)));
+
+  // truncated values and unknown tags
+  BOOST_CHECK_EQUAL("invalid", describe(legacy, 1));
+  BOOST_CHECK_EQUAL("invalid", describe(legacy, sizeof(tag) + sizeof(listSize) - 1));
+  BOOST_CHECK_EQUAL("not plain", describe(legacy, sizeof(tag) + sizeof(listSize) + 1));
+
+  const uint16_t unknown = 98;
+  BOOST_CHECK_EQUAL("null", describe(reinterpret_cast<const char*>(&unknown), sizeof(unknown)));
+
+  const uint16_t scalarTag = ValueTag::tag_double;
+  BOOST_CHECK_EQUAL("null", describe(reinterpret_cast<const char*>(&scalarTag), sizeof(scalarTag)));
+}